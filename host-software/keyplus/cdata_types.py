@@ -87,6 +87,10 @@ class scan_plan_t(CStructWithBytes):
         uint8_t parasitic_discharge_delay_debouncing;
         uint8_t max_col_pin_num;
         uint8_t max_key_num;
+        uint8_t debounce_mode;
+        uint8_t debounce_adapt_limit;
+        uint8_t scan_idle_time;
+        uint8_t anti_ghosting;
     """
 
 
@@ -98,7 +102,7 @@ class settings_header_t(CStructWithBytes):
     uint8_t timestamp[8];
     uint8_t default_report_mode;
     struct scan_plan_t scan_plan;
-    uint8_t _reserved0[8];
+    uint8_t _reserved0[4];
     uint8_t feature_ctrl;
     uint8_t _reserved1[14];
     uint16_t crc; /* total size == 96 */
@@ -229,7 +233,12 @@ class rf_settings_t(CStructWithBytes):
     uint8_t arc;
     uint8_t data_rate;
     uint8_t power;
-    uint8_t _reserved[14];
+    uint8_t hw_type;
+    uint8_t power_idle_time;
+    uint8_t power_sleep_time;
+    uint8_t power_idle_scan_interval;
+    uint8_t power_max_backoff;
+    uint8_t _reserved[9];
     uint8_t ekey[AES_KEY_LEN];
     uint8_t dkey[AES_KEY_LEN];
     """
@@ -18,6 +18,7 @@ ERROR_KEY_EVENT_QUEUE_UNLOADED_DEVICE = 5
 ERROR_VENDOR_IN_REPORT_CANT_KEEP_UP = 6
 ERROR_INVALID_KB_ID_USED = 7
 ERROR_MACRO_CMD_ERROR = 8
+ERROR_KEY_TRANSITION_QUEUE_FULL = 9
 
 # critical errors
 CRITICAL_ERROR_START = 64
@@ -40,6 +41,7 @@ ERROR_CODE_MAP = {
     6: "ERROR_VENDOR_IN_REPORT_CANT_KEEP_UP",
     7: "ERROR_INVALID_KB_ID_USED",
     8: "ERROR_MACRO_CMD_ERROR",
+    9: "ERROR_KEY_TRANSITION_QUEUE_FULL",
 
     64: "ERROR_EKC_STORAGE_TOO_LARGE",
     65: "ERROR_NUM_LAYOUTS_TOO_LARGE",
@@ -22,6 +22,18 @@ SCAN_MODE_STR_MAP = {
 
 INVALID_KEY_NUMBER = 0xff
 
+DEBOUNCE_MODE_TIMER = 0x00
+DEBOUNCE_MODE_INTEGRATOR = 0x01
+DEBOUNCE_MODE_EAGER = 0x02
+
+DEBOUNCE_MODE_NAME_MAP = {
+    "timer": DEBOUNCE_MODE_TIMER,
+    "integrator": DEBOUNCE_MODE_INTEGRATOR,
+    "eager": DEBOUNCE_MODE_EAGER,
+}
+
+DEBOUNCE_COUNTER_MAX_TIME = 15
+
 def is_valid_scan_mode(mode):
     return mode in SCAN_MODE_STR_MAP
 
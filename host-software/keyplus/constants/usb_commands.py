@@ -22,6 +22,7 @@ CMD_UPDATE_SETTINGS = 0x0A
 CMD_UPDATE_LAYOUT = 0x0B
 CMD_READ_LAYOUT = 0x0C
 CMD_WRITE_FLASH = 0x0D
+CMD_REPORT_RATE_TEST = 0x0E
 
 CMD_UNIFYING_PAIR = 0x10
 CMD_UNIFYING_SEND = 0x11
@@ -61,6 +62,10 @@ INFO_LAYOUT_DATA_2 = 8  # // 186
 INFO_LAYOUT_DATA_3 = 9  # // 248
 INFO_LAYOUT_DATA_4 = 10 # // 310
 INFO_LAYOUT_DATA_5 = 11 # // 372
+INFO_HID_STATS = 12
+INFO_DEBOUNCE_STATS = 13
+INFO_RF_STATS = 14
+INFO_TIMESLOT_STATS = 15
 INFO_UNSUPPORTED = 0xff
 
 INFO_NUM_LAYOUT_DATA_PAGES = INFO_LAYOUT_DATA_5 - INFO_LAYOUT_DATA_0 + 1
@@ -27,6 +27,31 @@ from keyplus.layout import *
 from keyplus.debug import DEBUG
 from keyplus.cdata_types import layout_settings_t
 
+HIDReportStats = namedtuple(
+    'HIDReportStats', ['poll_interval', 'missed_poll_slots', 'max_wait']
+)
+
+DebounceKeyStats = namedtuple(
+    'DebounceKeyStats',
+    ['key_number', 'bounce_count', 'max_bounce_time', 'extra_time']
+)
+
+RFDeviceStats = namedtuple(
+    'RFDeviceStats',
+    ['device_id', 'received', 'rejected', 'replayed', 'late', 'resyncs',
+     'sync_state', 'battery_level']
+)
+
+RFStats = namedtuple(
+    'RFStats', ['channel', 'pipe_drops', 'devices']
+)
+
+TimeslotStats = namedtuple(
+    'TimeslotStats',
+    ['len_us', 'gap_us', 'granted', 'end', 'blocked', 'canceled',
+     'extensions', 'extend_failed', 'rx', 'tx', 'slot_packets']
+)
+
 def _get_similar_serial_number(dev_list, serial_num):
     partial_match = None
     partial_match_pos = None
@@ -480,17 +505,21 @@ class KeyplusKeyboard(object):
             if total and (count >= total):
                 return count
 
-    def get_info_cmd(self, info_page_number):
+    def get_info_cmd(self, info_page_number, args=[]):
         retries = 2
         while retries != 0:
-            response = self.simple_command(CMD_GET_INFO, [info_page_number])
+            response = self.simple_command(
+                CMD_GET_INFO, [info_page_number] + list(args)
+            )
             if response[0] == INFO_UNSUPPORTED:
                 raise KeyplusUnsupportedError(
                     "Device doesn't have any data for info page number '{}'"
                     .format(info_page_number)
                 )
             elif response[0] != info_page_number:
-                response = self.simple_command(CMD_GET_INFO, [info_page_number])
+                response = self.simple_command(
+                    CMD_GET_INFO, [info_page_number] + list(args)
+                )
                 retries -= 1
             else:
                 break
@@ -554,6 +583,119 @@ class KeyplusKeyboard(object):
         self._rf_info_dirty = False
         return rf_info
 
+    def get_hid_stats(self):
+        """ Read the HID report timing statistics from the device. """
+        response = self.get_info_cmd(INFO_HID_STATS)
+        return HIDReportStats._make(
+            struct.unpack("<BHH", bytes(response[0:5]))
+        )
+
+    def get_debounce_stats(self):
+        """ Read the bounce statistics for every key in the matrix. """
+        DEBOUNCE_KEY_STATS_SIZE = 3
+        result = []
+        while True:
+            first_key = len(result)
+            response = self.get_info_cmd(INFO_DEBOUNCE_STATS, [first_key])
+            count = response[1]
+            if response[0] != first_key or count == 0:
+                break
+            for i in range(count):
+                offset = 2 + i*DEBOUNCE_KEY_STATS_SIZE
+                result.append(DebounceKeyStats._make(
+                    (first_key + i,) + tuple(response[offset:offset+3])
+                ))
+        return result
+
+    def get_rf_stats(self):
+        """
+        Read the link statistics a receiver keeps for each wireless device.
+
+        Returns:
+            An `RFStats` tuple with the receiver's current channel, the
+            packets its receive buffer dropped on each pipe, and an
+            `RFDeviceStats` for every device id.
+        """
+        RF_STATS_HEADER_SIZE = 15
+        RF_DEVICE_STATS_SIZE = 12
+        NUM_RF_PIPES = 6
+        channel = None
+        pipe_drops = None
+        devices = []
+        while True:
+            first_device = len(devices)
+            response = self.get_info_cmd(INFO_RF_STATS, [first_device])
+            count = response[1]
+            if response[0] != first_device:
+                break
+            channel = response[2]
+            pipe_drops = list(struct.unpack(
+                "<{}H".format(NUM_RF_PIPES), bytes(response[3:RF_STATS_HEADER_SIZE])
+            ))
+            if count == 0:
+                break
+            for i in range(count):
+                offset = RF_STATS_HEADER_SIZE + i*RF_DEVICE_STATS_SIZE
+                devices.append(RFDeviceStats._make(
+                    (first_device + i,) + struct.unpack(
+                        "<HHHHHBB",
+                        bytes(response[offset:offset+RF_DEVICE_STATS_SIZE])
+                    )
+                ))
+        return RFStats(channel, pipe_drops, devices)
+
+    def get_timeslot_stats(self):
+        """
+        Read the statistics of the radio timeslots an nRF52 receiver runs ESB
+        in while it shares the radio with bluetooth.
+
+        Returns:
+            A `TimeslotStats` tuple with the length of the next slot and the
+            gap before it in us, the slot counters, and a histogram of the
+            slots with 0, 1, 2-3, 4-7 and 8 or more ESB packets received.
+        """
+        NUM_SLOT_PACKET_BUCKETS = 5
+        response = self.get_info_cmd(INFO_TIMESLOT_STATS)
+        values = struct.unpack(
+            "<HH{}I".format(8 + NUM_SLOT_PACKET_BUCKETS),
+            bytes(response[0:4 + 4*(8 + NUM_SLOT_PACKET_BUCKETS)])
+        )
+        return TimeslotStats._make(
+            values[:10] + (list(values[10:]),)
+        )
+
+    def run_report_rate_test(self, count, timeout=1000):
+        """
+        Make the device send `count` timestamped packets as fast as it can.
+
+        Returns:
+            A list of `(host_time, seq_num, device_time)` tuples for the
+            packets received, in the order they arrived. `host_time` is in
+            seconds and `device_time` is in ms.
+        """
+        self.simple_command(
+            CMD_REPORT_RATE_TEST,
+            struct.pack("<H", count),
+            receive=False
+        )
+
+        packets = []
+        while len(packets) < count:
+            response = self.hid_read(timeout=timeout)
+            if response == None or len(response) == 0:
+                # Stop the test if the device stopped responding
+                self.simple_command(
+                    CMD_REPORT_RATE_TEST,
+                    struct.pack("<H", 0),
+                    receive=False
+                )
+                break
+            if response[0] != CMD_REPORT_RATE_TEST:
+                continue
+            seq_num, device_time = struct.unpack("<HH", bytes(response[1:5]))
+            packets.append((time.perf_counter(), seq_num, device_time))
+        return packets
+
     def read_settings_section(self):
         """ Reads the settings section from the device and returns it """
         # NOTE: In the future, might support mulitple formats of the settings
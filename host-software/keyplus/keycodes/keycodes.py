@@ -439,6 +439,9 @@ KC_MACRO                   = KC_SPECIAL_START | 0x1002
 # mouse gesture
 KC_MOUSE_GESTURE           = KC_SPECIAL_START | 0x1004
 
+# mouse movement key with an acceleration profile
+KC_MOUSE_KEY               = KC_SPECIAL_START | 0x1005
+
 
 # Special macro keycodes
 KC_MACRO_CMD_START_ADDR     = 0x6000
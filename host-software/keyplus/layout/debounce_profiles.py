@@ -12,6 +12,9 @@ DEBOUNCE_PROFILE_TABLE = {
         "trigger_time_release": 3,
         "parasitic_discharge_delay_idle": 2.0,
         "parasitic_discharge_delay_debouncing": 10.0,
+        "debounce_mode": "timer",
+        "debounce_adapt_limit": 0,
+        "scan_idle_time": 20,
     },
     "cherry_mx": {
         "debounce_time_press": 5,
@@ -20,6 +23,20 @@ DEBOUNCE_PROFILE_TABLE = {
         "trigger_time_release": 2,
         "parasitic_discharge_delay_idle": 2.0,
         "parasitic_discharge_delay_debouncing": 10.0,
+        "debounce_mode": "timer",
+        "debounce_adapt_limit": 0,
+        "scan_idle_time": 20,
+    },
+    "eager": {
+        "debounce_time_press": 5,
+        "debounce_time_release": 5,
+        "trigger_time_press": 0,
+        "trigger_time_release": 2,
+        "parasitic_discharge_delay_idle": 2.0,
+        "parasitic_discharge_delay_debouncing": 10.0,
+        "debounce_mode": "eager",
+        "debounce_adapt_limit": 0,
+        "scan_idle_time": 20,
     },
     "kailh_box": {
         "debounce_time_press": 8,
@@ -28,5 +45,8 @@ DEBOUNCE_PROFILE_TABLE = {
         "trigger_time_release": 3,
         "parasitic_discharge_delay_idle": 2.0,
         "parasitic_discharge_delay_debouncing": 10.0,
+        "debounce_mode": "timer",
+        "debounce_adapt_limit": 0,
+        "scan_idle_time": 20,
     },
 }
@@ -46,8 +46,18 @@ class EKCMouseGestureKey(EKCData):
     #    0x14: keycode down_left
     #    0x16: keycode down_right
     #    0x18: keycode tap
+    #    0x1A: timeout
+    #    0x1C: flick_time
+    #    0x1E: num_sequences
+    #    0x1F: reserved
+    #    0x20: sequences[num_sequences] {
+    #       0x00: first stroke
+    #       0x01: second stroke (0xff for flicks)
+    #       0x02: keycode
+    #    }
     # }
-    SIZE =  13*2
+    HEADER_SIZE = 0x20
+    SEQUENCE_SIZE = 4
 
     # Threshold for Horizontal and Vertical mouse gestures
     GESTURE_THRESHOLD = 110
@@ -59,10 +69,43 @@ class EKCMouseGestureKey(EKCData):
     # amount in both the X and Y axes to trigger a tap gesture.
     GESTURE_THRESHOLD_TAP = 20
 
+    # Time in ms to wait for the second stroke of a two-stroke gesture. A tap
+    # must also be released within this time. 0 waits until the key is
+    # released.
+    GESTURE_TIMEOUT = 500
+
+    # Strokes that reach their threshold within this many ms are flicks.
+    # 0 disables flicks.
+    GESTURE_FLICK_TIME = 0
+
+    STROKES = {
+        'left': 0,
+        'right': 1,
+        'up': 2,
+        'down': 3,
+        'up_left': 4,
+        'up_right': 5,
+        'down_left': 6,
+        'down_right': 7,
+    }
+
+    FLICKS = {
+        'flick_left': 9,
+        'flick_right': 10,
+        'flick_up': 11,
+        'flick_down': 12,
+    }
+
+    STROKE_NONE = 0xff
+
+    MAX_SEQUENCES = 0xff
+
     def __init__(self):
         self.threshold = EKCMouseGestureKey.GESTURE_THRESHOLD
         self.threshold_diag = EKCMouseGestureKey.GESTURE_THRESHOLD_DIAG
         self.threshold_tap = EKCMouseGestureKey.GESTURE_THRESHOLD_TAP
+        self.timeout = EKCMouseGestureKey.GESTURE_TIMEOUT
+        self.flick_time = EKCMouseGestureKey.GESTURE_FLICK_TIME
 
         self.kc_left = None
         self.kc_right = None
@@ -76,13 +119,16 @@ class EKCMouseGestureKey(EKCData):
 
         self.kc_tap = None
 
+        # list of (first, second, keycode)
+        self.sequences = []
+
     def size(self):
-        return self.SIZE
+        return self.HEADER_SIZE + self.SEQUENCE_SIZE * len(self.sequences)
 
     def to_bytes(self):
-        result = bytearray(self.SIZE)
+        result = bytearray(self.size())
 
-        struct.pack_into("< 13H", result, 0,
+        struct.pack_into("< 13H 2H 2B", result, 0,
             keycodes.KC_MOUSE_GESTURE,
             self.threshold,
             self.threshold_diag,
@@ -96,10 +142,47 @@ class EKCMouseGestureKey(EKCData):
             self.kc_map_function(self.kc_down_left),
             self.kc_map_function(self.kc_down_right),
             self.kc_map_function(self.kc_tap),
+            self.timeout,
+            self.flick_time,
+            len(self.sequences),
+            0,
         )
 
+        for (i, (first, second, kc)) in enumerate(self.sequences):
+            struct.pack_into("< 2B H", result,
+                self.HEADER_SIZE + i*self.SEQUENCE_SIZE,
+                first,
+                second,
+                self.kc_map_function(kc),
+            )
+
         return result
 
+    def _parse_two_stroke(self, parser_info):
+        two_stroke = parser_info.try_get(
+            'two_stroke',
+            field_type=dict,
+            optional=True
+        )
+        if two_stroke == None:
+            return
+
+        for (strokes, kc) in two_stroke.items():
+            names = [name.strip() for name in str(strokes).split(',')]
+            if (len(names) != 2 or
+                    names[0] not in self.STROKES or
+                    names[1] not in self.STROKES):
+                raise KeyplusParseError(
+                    "Expected two strokes separated by a comma in "
+                    "'two_stroke', e.g. 'left, up', but got '{}'. Valid "
+                    "strokes are: {}".format(
+                        strokes, ", ".join(self.STROKES)
+                    )
+                )
+            self.sequences.append(
+                (self.STROKES[names[0]], self.STROKES[names[1]], kc)
+            )
+
     def parse_json(self, kc_name, json_obj=None, parser_info=None):
 
         print_warnings = False
@@ -138,6 +221,20 @@ class EKCMouseGestureKey(EKCData):
             default=EKCMouseGestureKey.GESTURE_THRESHOLD_TAP
         )
 
+        # Get the timing for taps, flicks and two-stroke gestures
+        self.timeout = parser_info.try_get(
+            'timeout',
+            field_type=int,
+            default=EKCMouseGestureKey.GESTURE_TIMEOUT,
+            field_range=[0, 0xffff]
+        )
+        self.flick_time = parser_info.try_get(
+            'flick_time',
+            field_type=int,
+            default=EKCMouseGestureKey.GESTURE_FLICK_TIME,
+            field_range=[0, 0xffff]
+        )
+
         # Get the keycodes for different directions field
         self.kc_left  = parser_info.try_get('left' , default='none')
         self.kc_right = parser_info.try_get('right', default='none')
@@ -151,6 +248,22 @@ class EKCMouseGestureKey(EKCData):
 
         self.kc_tap = parser_info.try_get('tap', default='none')
 
+        # Flicks only get their own entry when a keycode is given, otherwise
+        # the firmware uses the keycode for the normal stroke.
+        self.sequences = []
+        for (name, stroke) in self.FLICKS.items():
+            kc = parser_info.try_get(name, optional=True)
+            if kc != None:
+                self.sequences.append((stroke, self.STROKE_NONE, kc))
+
+        self._parse_two_stroke(parser_info)
+
+        if len(self.sequences) > self.MAX_SEQUENCES:
+            raise KeyplusParseError(
+                "Too many flick and two-stroke gestures, the maximum is {}"
+                .format(self.MAX_SEQUENCES)
+            )
+
         # Finish parsing `device_name`
         parser_info.exit()
 
@@ -161,6 +274,167 @@ class EKCMouseGestureKey(EKCData):
 
 
 
+class EKCMouseKey(EKCData):
+    # Data: {
+    #    0x00: KC_MOUSE_KEY
+    #    0x02: keycode direction
+    #    0x04: profile
+    #    0x05: interval
+    #    0x06: start_speed
+    #    0x08: max_speed
+    #    0x0A: delay
+    #    0x0C: ramp_time
+    # }
+    SIZE = 14
+
+    PROFILE_MAP = {
+        'constant': 0,
+        'linear': 1,
+        'quadratic': 2,
+        'constant_then_ramp': 3,
+    }
+
+    # Speeds are stored as 8.8 fixed point values in counts per report
+    SPEED_SCALE = 256
+    SPEED_MAX = 0x7FFF / SPEED_SCALE
+
+    DEFAULT_PROFILE = 'linear'
+    DEFAULT_INTERVAL = 10
+    DEFAULT_SPEED = 1
+    DEFAULT_MAX_SPEED = 20
+    DEFAULT_DELAY = 0
+    DEFAULT_RAMP_DELAY = 300
+    DEFAULT_RAMP_TIME = 1000
+
+    # The firmware stops tracking the hold time after this many ms
+    TIME_MAX = 0x4000
+
+    DIRECTIONS = [
+        keycodes.KC_MOUSE_UP,
+        keycodes.KC_MOUSE_DOWN,
+        keycodes.KC_MOUSE_LEFT,
+        keycodes.KC_MOUSE_RIGHT,
+        keycodes.KC_MOUSE_WH_UP,
+        keycodes.KC_MOUSE_WH_DOWN,
+        keycodes.KC_MOUSE_WH_LEFT,
+        keycodes.KC_MOUSE_WH_RIGHT,
+    ]
+
+    def __init__(self):
+        self.direction = None
+        self.profile = EKCMouseKey.DEFAULT_PROFILE
+        self.interval = EKCMouseKey.DEFAULT_INTERVAL
+        self.speed = EKCMouseKey.DEFAULT_SPEED
+        self.max_speed = EKCMouseKey.DEFAULT_MAX_SPEED
+        self.delay = EKCMouseKey.DEFAULT_DELAY
+        self.ramp_time = EKCMouseKey.DEFAULT_RAMP_TIME
+
+    def size(self):
+        return self.SIZE
+
+    def to_bytes(self):
+        result = bytearray(self.SIZE)
+
+        direction = self.kc_map_function(self.direction)
+        if direction not in EKCMouseKey.DIRECTIONS:
+            raise KeyplusSettingsError(
+                "Mouse key 'direction' must be a mouse movement or wheel "
+                "keycode, got '{}'".format(self.direction)
+            )
+
+        if self.profile == 'constant':
+            start_speed = self.max_speed
+        else:
+            start_speed = self.speed
+
+        struct.pack_into("< 2H 2B 4H", result, 0,
+            keycodes.KC_MOUSE_KEY,
+            direction,
+            EKCMouseKey.PROFILE_MAP[self.profile],
+            self.interval,
+            int(round(start_speed * EKCMouseKey.SPEED_SCALE)),
+            int(round(self.max_speed * EKCMouseKey.SPEED_SCALE)),
+            self.delay,
+            self.ramp_time,
+        )
+
+        return result
+
+    def parse_json(self, kc_name, json_obj=None, parser_info=None):
+
+        print_warnings = False
+
+        if parser_info == None:
+            assert(json_obj != None)
+            print_warnings = True
+            parser_info = KeyplusParserInfo(
+                "<EKCMouseKey Dict>",
+                {kc_name : json_obj}
+            )
+
+        parser_info.enter(kc_name)
+
+        # Get the tap key field
+        self.keycode = parser_info.try_get(
+            'keycode',
+            field_type=str
+        )
+        assert_equal(self.keycode, 'mouse_key')
+
+        # The mouse movement keycode this key acts like
+        self.direction = parser_info.try_get('direction', field_type=str)
+
+        # Get the acceleration profile and its parameters
+        self.profile = parser_info.try_get(
+            'profile',
+            field_type=str,
+            field_valid_values=EKCMouseKey.PROFILE_MAP.keys(),
+            default=EKCMouseKey.DEFAULT_PROFILE,
+        )
+        self.interval = parser_info.try_get(
+            'interval',
+            field_type=int,
+            field_range=[1, 0xFF],
+            default=EKCMouseKey.DEFAULT_INTERVAL
+        )
+        self.speed = parser_info.try_get(
+            'speed',
+            field_type=[int, float],
+            field_range=[0, EKCMouseKey.SPEED_MAX],
+            default=EKCMouseKey.DEFAULT_SPEED
+        )
+        self.max_speed = parser_info.try_get(
+            'max_speed',
+            field_type=[int, float],
+            field_range=[0, EKCMouseKey.SPEED_MAX],
+            default=EKCMouseKey.DEFAULT_MAX_SPEED
+        )
+        if self.profile == 'constant_then_ramp':
+            default_delay = EKCMouseKey.DEFAULT_RAMP_DELAY
+        else:
+            default_delay = EKCMouseKey.DEFAULT_DELAY
+        self.delay = parser_info.try_get(
+            'delay',
+            field_type=int,
+            field_range=[0, EKCMouseKey.TIME_MAX],
+            default=default_delay
+        )
+        self.ramp_time = parser_info.try_get(
+            'ramp_time',
+            field_type=int,
+            field_range=[0, EKCMouseKey.TIME_MAX],
+            default=EKCMouseKey.DEFAULT_RAMP_TIME
+        )
+
+        # Finish parsing `device_name`
+        parser_info.exit()
+
+        # If this is debug code, print the warnings
+        if print_warnings:
+            for warn in parser_info.warnings:
+                print(warn, file=sys.stderr)
+
+
 class EKCHoldKey(EKCData):
     # Layout option:
     #   1: kc_hold_key
@@ -603,6 +877,7 @@ class EKCDataTable(EKCData):
 EKCKeycodeTable = {
     'hold': EKCHoldKey,
     'mouse_gesture': EKCMouseGestureKey,
+    'mouse_key': EKCMouseKey,
     'macro': EKCMacroKey,
 }
 
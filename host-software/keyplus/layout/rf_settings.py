@@ -28,6 +28,19 @@ PWR_0DB = 0x03
 
 MAX_RF_CHANNEL = 127
 
+# Power settings for wireless keyboards, 0 picks the firmware default. Each
+# one is a single byte in the firmware's units:
+#   power_idle_time: units of 10ms before the idle state (default 50)
+#   power_sleep_time: seconds without changes before sleeping (default 3)
+#   power_idle_scan_interval: ms between scans when idle (default 10)
+#   power_max_backoff: longest ms to wait before resending (default 32)
+RF_POWER_SETTINGS = [
+    'power_idle_time',
+    'power_sleep_time',
+    'power_idle_scan_interval',
+    'power_max_backoff',
+]
+
 # all possible channels?
 UNIFYING_RF_CHANNELS = [
 5  , 8  , 11 , 14 , 17 , 20 , 23 , 26 ,
@@ -94,6 +107,9 @@ class LayoutRFSettings(object):
         self.data_rate = RF_DR_2MBPS
         self.power = PWR_0DB
 
+        for field in RF_POWER_SETTINGS:
+            setattr(self, field, 0)
+
     def generate_random_channel(self):
         """ Returns a random RF channel """
         index = 255
@@ -152,6 +168,11 @@ class LayoutRFSettings(object):
             errors.append("Power must be <4, got: {}".format(self.power))
         if self.data_rate not in RF_DATA_RATE_MAP.values():
             errors.append("Power must be <4, got: {}".format(self.data_rate))
+        for field in RF_POWER_SETTINGS:
+            if not 0 <= getattr(self, field) <= 255:
+                errors.append("{} must be <256, got: {}".format(
+                    field, getattr(self, field)
+                ))
         # if sum([i == 0 for i in self.encryption_key]) == 16:
         #     errors.append("Warning got null encryption key! {}".format(self.encryption_key))
 
@@ -162,7 +183,7 @@ class LayoutRFSettings(object):
     def to_json(self):
         self.check_settings()
 
-        return {
+        result = {
             'rf_settings' : {
                 'pipe0': to_hex_string(self.pipe0),
                 'pipe1': to_hex_string(self.pipe1),
@@ -178,6 +199,12 @@ class LayoutRFSettings(object):
             }
         }
 
+        for field in RF_POWER_SETTINGS:
+            if getattr(self, field) != 0:
+                result['rf_settings'][field] = getattr(self, field)
+
+        return result
+
     def load_raw_data(self, rf_settings):
         self.pipe0 = rf_settings.pipe_addr_0
         self.pipe1 = rf_settings.pipe_addr_1
@@ -189,6 +216,8 @@ class LayoutRFSettings(object):
         self.auto_retransmit_count = rf_settings.arc;
         self.data_rate = rf_settings.data_rate;
         self.power = rf_settings.power;
+        for field in RF_POWER_SETTINGS:
+            setattr(self, field, getattr(rf_settings, field))
         self.encryption_key = rf_settings.ekey
         self.check_settings()
 
@@ -257,6 +286,15 @@ class LayoutRFSettings(object):
             field_range = [0, MAX_RF_CHANNEL]
         )
 
+        for field in RF_POWER_SETTINGS:
+            setattr(self, field, parser_info.try_get(
+                    field,
+                    default = 0,
+                    field_type = int,
+                    field_range = [0, 255],
+                )
+            )
+
         # Finish parsing `rf_settings`
         parser_info.exit()
 
@@ -280,6 +318,8 @@ class LayoutRFSettings(object):
         result.arc = self.auto_retransmit_count
         result.data_rate = self.data_rate
         result.power = self.power
+        for field in RF_POWER_SETTINGS:
+            setattr(result, field, getattr(self, field))
 
         decryption_key = list(gen_final_round_key(self.encryption_key))
         result.ekey = list(self.encryption_key)
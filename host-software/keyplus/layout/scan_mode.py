@@ -43,6 +43,8 @@ INV_MODE_MAP = {}
 for key in MODE_MAP:
     INV_MODE_MAP[MODE_MAP[key]] = key
 
+INV_DEBOUNCE_MODE_MAP = inverse_map(DEBOUNCE_MODE_NAME_MAP)
+
 def fullmatch(regex, string, flags=0):
     """Emulate python-3.4 re.fullmatch()."""
     return re.match("(?:" + regex + r")\Z", string, flags=flags)
@@ -62,6 +64,7 @@ class ScanMode(object):
 
         self.matrix_map = {}
         self.matrix_pin_map = {}
+        self.anti_ghosting = False
 
         self.virtual_device = {}
 
@@ -324,6 +327,29 @@ class ScanMode(object):
             self._scale_microseconds(self.parasitic_discharge_delay_idle)
         scan_plan.parasitic_discharge_delay_debouncing = \
             self._scale_microseconds(self.parasitic_discharge_delay_debouncing)
+        scan_plan.debounce_mode = DEBOUNCE_MODE_NAME_MAP[self.debounce_mode]
+        scan_plan.debounce_adapt_limit = self.debounce_adapt_limit
+        scan_plan.scan_idle_time = self.scan_idle_time
+        scan_plan.anti_ghosting = int(
+            self.anti_ghosting and self.mode in [ROW_COL, COL_ROW]
+        )
+
+        if scan_plan.debounce_mode == DEBOUNCE_MODE_INTEGRATOR:
+            counter_times = [self.debounce_time_press, self.debounce_time_release]
+        elif scan_plan.debounce_mode == DEBOUNCE_MODE_EAGER:
+            counter_times = [
+                self.debounce_time_press, self.debounce_time_release,
+                self.trigger_time_release
+            ]
+        else:
+            counter_times = []
+
+        if counter_times and max(counter_times) > DEBOUNCE_COUNTER_MAX_TIME:
+            raise KeyplusSettingsError(
+                "The `{}` debounce mode only supports debounce and trigger "
+                "times up to {}ms."
+                .format(self.debounce_mode, DEBOUNCE_COUNTER_MAX_TIME)
+            )
 
         return scan_plan
 
@@ -489,6 +515,12 @@ class ScanMode(object):
         self.parasitic_discharge_delay_debouncing = self._to_microseconds(
             scan_plan.parasitic_discharge_delay_debouncing
         )
+        self.debounce_mode = INV_DEBOUNCE_MODE_MAP.get(
+            scan_plan.debounce_mode, 'timer'
+        )
+        self.debounce_adapt_limit = scan_plan.debounce_adapt_limit
+        self.scan_idle_time = scan_plan.scan_idle_time
+        self.anti_ghosting = bool(scan_plan.anti_ghosting)
 
     def debounce_to_json(self):
         result = {}
@@ -499,6 +531,9 @@ class ScanMode(object):
         result['trigger_time_release'] = self.trigger_time_release
         result['parasitic_discharge_delay_idle'] = self.parasitic_discharge_delay_idle
         result['parasitic_discharge_delay_debouncing'] = self.parasitic_discharge_delay_debouncing
+        result['debounce_mode'] = self.debounce_mode
+        result['debounce_adapt_limit'] = self.debounce_adapt_limit
+        result['scan_idle_time'] = self.scan_idle_time
 
         matches_debounce_profile = True
         for field in result:
@@ -579,6 +614,9 @@ class ScanMode(object):
                 field_type=list,
                 remap_function=self.parse_matrix_map,
             )
+            self.anti_ghosting = parser_info.try_get(
+                "anti_ghosting", field_type=bool, default=False
+            )
         elif self.mode in [PIN_GND, PIN_VCC]:
             self.direct_wiring_pins = parser_info.try_get("pins", field_type=[list, int])
         elif self.mode == VIRTUAL:
@@ -674,6 +712,23 @@ class ScanMode(object):
                 field_range=[0, 48.0]
             )
 
+            self.debounce_mode = parser_info.try_get(
+                "debounce_mode",
+                default=self.debounce_mode,
+                field_type=str,
+                field_valid_values=list(DEBOUNCE_MODE_NAME_MAP),
+            )
+
+            self.debounce_adapt_limit = parser_info.try_get(
+                "debounce_adapt_limit", default=self.debounce_adapt_limit,
+                field_type=int, field_range=[0, 255]
+            )
+
+            self.scan_idle_time = parser_info.try_get(
+                "scan_idle_time", default=self.scan_idle_time,
+                field_type=int, field_range=[0, 255]
+            )
+
             parser_info.exit()
 
         parser_info.exit()
@@ -751,6 +806,8 @@ class ScanMode(object):
                 matrix_pos_str = "r{}c{}".format(matrix_pos.row, matrix_pos.col)
                 matrix_map[key_number] = matrix_pos_str
             result['matrix_map'] = matrix_map
+            if self.anti_ghosting:
+                result['anti_ghosting'] = True
         elif self.mode in [PIN_GND, PIN_VCC]:
             result['pins'] = copy(self.direct_wiring_pins)
         elif self.mode == VIRTUAL:
@@ -7,10 +7,7 @@
 #include <util/delay.h>
 
 #include "usb_keyboard.h"
-#include "hid_reports/keyboard_report.h"
-#include "hid_reports/media_report.h"
-#include "hid_reports/mouse_report.h"
-#include "hid_reports/vendor_report.h"
+#include "hid_reports/hid_reports.h"
 
 #include "core/error.h"
 #include "core/flash.h"
@@ -52,7 +49,7 @@ void setup_everything(void) {
 void recovery_mode_main_loop(void) {
     while (1) {
         // usb out reports
-        send_vendor_report();
+        send_hid_reports();
         handle_vendor_out_reports();
         // TODO: sleep
         wdt_kick();
@@ -69,7 +66,7 @@ int main(void) {
         // TODO: Remove this, use idle sleep instead
         _delay_ms(2);
 
-        bool scan_changed = matrix_scan();
+        bool scan_changed = matrix_scan_task();
 
         // TODO: need to clean this up
         if (scan_changed) {
@@ -86,10 +83,7 @@ int main(void) {
         mouse_key_task();
         macro_task();
 
-        send_keyboard_report();
-        send_media_report();
-        send_mouse_report();
-        send_vendor_report();
+        send_hid_reports();
 
         // usb out reports
         handle_vendor_out_reports();
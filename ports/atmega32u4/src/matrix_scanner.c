@@ -280,3 +280,62 @@ bool matrix_scan(void) {
     }
     return false;
 }
+
+/// make all rows output low
+static void select_all_rows(void) {
+    PORT(B).DDR |= s_row_port_masks[PORT_B_NUM];
+    PORT(C).DDR |= s_row_port_masks[PORT_C_NUM];
+    PORT(D).DDR |= s_row_port_masks[PORT_D_NUM];
+    PORT(E).DDR |= s_row_port_masks[PORT_E_NUM];
+    PORT(F).DDR |= s_row_port_masks[PORT_F_NUM];
+}
+
+/// disconnect all the rows
+static void unselect_all_rows(void) {
+    PORT(B).DDR &= ~s_row_port_masks[PORT_B_NUM];
+    PORT(C).DDR &= ~s_row_port_masks[PORT_C_NUM];
+    PORT(D).DDR &= ~s_row_port_masks[PORT_D_NUM];
+    PORT(E).DDR &= ~s_row_port_masks[PORT_E_NUM];
+    PORT(F).DDR &= ~s_row_port_masks[PORT_F_NUM];
+}
+
+/// When `select_all_rows()` has been called, this function can be used to
+/// check if any key is down in any row.
+bool matrix_has_active_row(void) {
+    return (~PORT(B).IN & s_col_masks[PORT_B_NUM]) ||
+           (~PORT(C).IN & s_col_masks[PORT_C_NUM]) ||
+           (~PORT(D).IN & s_col_masks[PORT_D_NUM]) ||
+           (~PORT(E).IN & s_col_masks[PORT_E_NUM]) ||
+           (~PORT(F).IN & s_col_masks[PORT_F_NUM]);
+}
+
+// Only port B has pin change interrupts on the atmega32u4, and this port
+// never sleeps, so instead of an interrupt the column pins are read while all
+// the rows are selected. That is much cheaper than scanning every row.
+void matrix_scan_irq_enable(void) {
+    if (
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW ||
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_ROW_COL
+    ) {
+        select_all_rows();
+        PARASITIC_DISCHARGE_DELAY_FAST_CLOCK(
+            s_parasitic_discharge_delay_idle
+        );
+    }
+}
+
+void matrix_scan_irq_disable(void) {
+    if (
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW ||
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_ROW_COL
+    ) {
+        unselect_all_rows();
+    }
+}
+
+bool matrix_scan_irq_has_triggered(void) {
+    return matrix_has_active_row();
+}
+
+void matrix_scan_irq_clear(void) {
+}
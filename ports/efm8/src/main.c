@@ -26,10 +26,7 @@
 #include "key_handlers/key_mouse.h"
 #include "key_handlers/key_hold.h"
 
-#include "hid_reports/keyboard_report.h"
-#include "hid_reports/mouse_report.h"
-#include "hid_reports/media_report.h"
-#include "hid_reports/vendor_report.h"
+#include "hid_reports/hid_reports.h"
 
 /// USB interrupt handler
 void usb_isr(void) __interrupt (USB0_IRQn);
@@ -114,7 +111,7 @@ void setup(void) {
 void recovery_mode_main_loop(void) {
     while (1) {
         // usb out reports
-        send_vendor_report();
+        send_hid_reports();
         handle_vendor_out_reports();
         wdt_kick();
         efm8_delay_ms(2);
@@ -132,7 +129,7 @@ void main(void) {
             recovery_mode_main_loop();
         }
 
-        scan_changed = matrix_scan();
+        scan_changed = matrix_scan_task();
 
         // TODO: need to clean this up
         if (scan_changed) {
@@ -149,10 +146,7 @@ void main(void) {
         mouse_key_task();
         macro_task();
 
-        send_keyboard_report();
-        send_media_report();
-        send_mouse_report();
-        send_vendor_report();
+        send_hid_reports();
 
         // usb out reports
         handle_vendor_out_reports();
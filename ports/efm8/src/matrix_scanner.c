@@ -166,3 +166,54 @@ bool matrix_scan(void) {
 
     return false;
 }
+
+/// When all the rows are selected, this function can be used to check if any
+/// key is down in any row.
+bool matrix_has_active_row(void) {
+    return (~P0 & s_col_masks[0]) ||
+           (~P1 & s_col_masks[1]) ||
+#if IO_PORT_MAX_PORT_NUM >= 3
+           (~P3 & s_col_masks[3]) ||
+#endif
+#if IO_PORT_MAX_PORT_NUM >= 4
+           (~P4 & s_col_masks[4]) ||
+#endif
+           (~P2 & s_col_masks[2]);
+}
+
+// The main loop never sleeps, so instead of using the port match interrupt
+// the column pins are read while all the rows are selected. That is much
+// cheaper than scanning every row.
+void matrix_scan_irq_enable(void) {
+    uint8_t row;
+
+    if (
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW ||
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_ROW_COL
+    ) {
+        for (row = 0; row < g_scan_plan.rows; ++row) {
+            select_row(row);
+        }
+        efm8_delay_us(s_parasitic_discharge_delay_idle);
+    }
+}
+
+void matrix_scan_irq_disable(void) {
+    uint8_t row;
+
+    if (
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW ||
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_ROW_COL
+    ) {
+        for (row = 0; row < g_scan_plan.rows; ++row) {
+            unselect_row(row);
+        }
+    }
+}
+
+bool matrix_scan_irq_has_triggered(void) {
+    return matrix_has_active_row();
+}
+
+void matrix_scan_irq_clear(void) {
+}
@@ -60,6 +60,12 @@ static size_t m_udev_targets_len;
 /// The list of devices being tracket
 virtual_device_header_t m_udev_targets[MAX_NUM_DEVICES];
 
+/// Relative motion is sent straight to the virtual mouse for the current
+/// batch of events, see `mouse_can_pass_through()`
+static bool m_mouse_pass_through;
+/// Motion has been passed through and still needs a SYN_REPORT
+static bool m_mouse_pass_through_pending;
+
 /// Reset the list of tracked devices
 void device_manager_targets_reset(void) {
     m_udev_targets_len = 0;
@@ -145,6 +151,10 @@ static int kp_evdev_array_add(const char *path, int match_id) {
             m_dev_array[i].evdev = evdev;
             m_dev_array[i].dev_id = dev_id;
             m_dev_array[i].layout_id = layout_id;
+            m_dev_array[i].has_hi_res_wheel =
+                libevdev_has_event_code(evdev, EV_REL, REL_WHEEL_HI_RES);
+            m_dev_array[i].has_hi_res_hwheel =
+                libevdev_has_event_code(evdev, EV_REL, REL_HWHEEL_HI_RES);
             m_highest_event_count = KP_MAX(m_highest_event_count, i+1);
         }
 
@@ -417,7 +427,23 @@ cleanup:
     udev_device_unref(dev);
     return rc;
 }
-static int map_event(int dev_id, struct input_event ev) {
+/// Check if a relative event is one the virtual mouse can send unchanged
+static bool is_pass_through_rel(unsigned int code) {
+    switch (code) {
+        case REL_X:
+        case REL_Y:
+        case REL_WHEEL:
+        case REL_HWHEEL:
+        case REL_WHEEL_HI_RES:
+        case REL_HWHEEL_HI_RES:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static int map_event(const struct kp_evdev_device *dev, struct input_event ev) {
+    const int dev_id = dev->dev_id;
     int rc;
 
 #if DEBUG >= 1 && DEBUG_EXIT_KEY != 0
@@ -431,6 +457,11 @@ static int map_event(int dev_id, struct input_event ev) {
     }
 
     if (ev.type == EV_SYN) {
+        if (ev.code == SYN_REPORT && m_mouse_pass_through_pending) {
+            rc = kp_virtual_mouse_send(EV_SYN, SYN_REPORT, 0);
+            KP_CHECK_ERRNO(rc);
+            m_mouse_pass_through_pending = false;
+        }
         return 0;
     }
 
@@ -438,7 +469,11 @@ static int map_event(int dev_id, struct input_event ev) {
         stats_add_key(dev_id, ev.code);
     }
 
-    if (ev.type == EV_REL) {
+    if (ev.type == EV_REL && m_mouse_pass_through && is_pass_through_rel(ev.code)) {
+        rc = kp_virtual_mouse_send(ev.type, ev.code, ev.value);
+        KP_CHECK_ERRNO(rc);
+        m_mouse_pass_through_pending = true;
+    } else if (ev.type == EV_REL) {
         const int v = ev.value;
         // rc = kp_virtual_mouse_send(ev.type, ev.code, ev.value);
         // KP_CHECK_ERRNO(rc);
@@ -447,12 +482,20 @@ static int map_event(int dev_id, struct input_event ev) {
         switch (ev.code) {
             case REL_X:             { mouse_move(v, 0, 0, 0); } break;
             case REL_Y:             { mouse_move(0, v, 0, 0); } break;
-            case REL_WHEEL:         { mouse_move(0, 0, v, 0); } break;
-            case REL_HWHEEL:        { mouse_move(0, 0, 0, v); } break;
-            // case REL_WHEEL_HI_RES:  { mouse_move(0, 0, v/15, 0); } break;
-            // case REL_HWHEEL_HI_RES: { mouse_move(0, 0, 0, v/15); } break;
-            case REL_WHEEL_HI_RES:  { /* ignore for now */ } break;
-            case REL_HWHEEL_HI_RES: { /* ignore for now */ } break;
+            // Devices with a hi-res wheel send both events for the same
+            // motion, so only use the legacy event when there is no hi-res one.
+            case REL_WHEEL: {
+                if (!dev->has_hi_res_wheel) {
+                    mouse_move(0, 0, v * MOUSE_WHEEL_HI_RES_DETENT, 0);
+                }
+            } break;
+            case REL_HWHEEL: {
+                if (!dev->has_hi_res_hwheel) {
+                    mouse_move(0, 0, 0, v * MOUSE_WHEEL_HI_RES_DETENT);
+                }
+            } break;
+            case REL_WHEEL_HI_RES:  { mouse_move(0, 0, v, 0); } break;
+            case REL_HWHEEL_HI_RES: { mouse_move(0, 0, 0, v); } break;
 
             default: {
                 KP_LOG_INFO("got unsupported EV_REL == %s<%d>",
@@ -523,6 +566,10 @@ static int handle_evdev_event(int i) {
     struct libevdev *evdev = m_dev_array[i].evdev;
     m_event_fds[i].revents = 0;
 
+    // Decide once per batch, button events in this batch are still
+    // interpreted before the next one.
+    m_mouse_pass_through = mouse_can_pass_through();
+
     do {
         rc = libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_BLOCKING, &ev);
         if (rc < 0) {
@@ -531,10 +578,16 @@ static int handle_evdev_event(int i) {
             return -1;
         }
 
-        updated += map_event(m_dev_array[i].dev_id, ev);
+        updated += map_event(&m_dev_array[i], ev);
 
     } while (libevdev_has_event_pending(evdev));
 
+    if (m_mouse_pass_through_pending) {
+        rc = kp_virtual_mouse_send(EV_SYN, SYN_REPORT, 0);
+        KP_CHECK_ERRNO(rc);
+        m_mouse_pass_through_pending = false;
+    }
+
     return updated;
 }
 
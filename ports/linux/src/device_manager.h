@@ -14,6 +14,10 @@ struct kp_evdev_device {
     int layout_id;
     char *path;
     struct libevdev *evdev;
+    /// The device reports REL_WHEEL_HI_RES as well as REL_WHEEL
+    bool has_hi_res_wheel;
+    /// The device reports REL_HWHEEL_HI_RES as well as REL_HWHEEL
+    bool has_hi_res_hwheel;
 };
 
 int device_manager_init(void);
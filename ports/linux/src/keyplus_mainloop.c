@@ -146,13 +146,16 @@ int kp_mainloop(int argc, const char **argv){
 
         busy |= macro_task();
         busy |= mouse_key_task();
+#if USE_MOUSE_GESTURE
+        busy |= gesture_task();
+#endif
 
-        send_hid_reports();
+        busy |= send_hid_reports();
 
         busy |= sticky_key_task();
         busy |= hold_key_task(false);
 
-        send_hid_reports();
+        busy |= send_hid_reports();
 
         should_sleep = !busy;
     }
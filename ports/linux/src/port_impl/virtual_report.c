@@ -17,6 +17,10 @@ static hid_report_mouse_t s_last_mouse_report;
 static uint8_t s_last_report_id;
 static uint16_t s_last_system;
 static uint16_t s_last_consumer;
+/// High resolution wheel motion not yet sent as a whole REL_WHEEL detent
+static int s_wheel_remainder;
+/// High resolution wheel motion not yet sent as a whole REL_HWHEEL detent
+static int s_hwheel_remainder;
 
 void kp_virtual_hid_reports_reset(void) {
     memset(&s_last_boot_report, 0, sizeof(s_last_boot_report));
@@ -25,6 +29,8 @@ void kp_virtual_hid_reports_reset(void) {
     s_last_report_id = 0;
     s_last_system = 0;
     s_last_consumer = 0;
+    s_wheel_remainder = 0;
+    s_hwheel_remainder = 0;
 }
 
 static int handle_mods(uint8_t old_mods, uint8_t new_mods) {
@@ -79,9 +85,15 @@ void kp_virtual_hid_boot_keyboard_report_send(void) {
 
     updated |= handle_mods(s_last_boot_report.modifiers, g_boot_keyboard_report.modifiers);
 
+    // Only the slots touched since the last report can differ
     for (int i = 0; i < BOOT_REPORT_KEY_COUNT; ++i) {
-        int old_key = s_last_boot_report.keys[i];
-        int new_key = g_boot_keyboard_report.keys[i];
+        int old_key;
+        int new_key;
+        if (!(g_keyboard_report_dirty.boot_slots & (1 << i))) {
+            continue;
+        }
+        old_key = s_last_boot_report.keys[i];
+        new_key = g_boot_keyboard_report.keys[i];
         if ( old_key != new_key ) {
             updated = 1;
             if (old_key == 0 && new_key != 0) { // press new key
@@ -109,7 +121,10 @@ void kp_virtual_hid_nkro_keyboard_report_send(void) {
 
     updated |= handle_mods(s_last_nkro_report.modifiers, g_nkro_keyboard_report.modifiers);
 
-    for (int i = 0; i < NKRO_REPORT_BYTES; ++i) {
+    // Only the bytes touched since the last report can differ
+    for (int i = g_keyboard_report_dirty.nkro_start;
+         i < g_keyboard_report_dirty.nkro_end;
+         ++i) {
         int old_bits = s_last_nkro_report.bitmask[i];
         int new_bits = g_nkro_keyboard_report.bitmask[i];
         int changed = old_bits ^ new_bits;
@@ -138,8 +153,23 @@ void kp_virtual_hid_nkro_keyboard_report_send(void) {
     }
 }
 
+/// Send high resolution wheel motion, and the legacy wheel event once a whole
+/// detent has built up, the same as the kernel does for hi-res HID mice.
+static void send_wheel(int *remainder, int code_hi_res, int code, int value) {
+    int detents;
+
+    kp_virtual_mouse_send(EV_REL, code_hi_res, value);
+
+    *remainder += value;
+    detents = *remainder / MOUSE_WHEEL_HI_RES_DETENT;
+    if (detents != 0) {
+        kp_virtual_mouse_send(EV_REL, code, detents);
+        *remainder -= detents * MOUSE_WHEEL_HI_RES_DETENT;
+    }
+}
+
 void kp_virtual_hid_mouse_report_send(void) {
-    int changed;
+    int changed = 0;
 #if DEBUG > 5
     hexDump("mouse_report:", &g_mouse_report, sizeof(g_mouse_report));
 #endif
@@ -172,12 +202,14 @@ void kp_virtual_hid_mouse_report_send(void) {
     }
 
     if (g_mouse_report.wheel_x != 0) {
-        kp_virtual_mouse_send(EV_REL, REL_HWHEEL, g_mouse_report.wheel_x);
+        send_wheel(&s_hwheel_remainder, REL_HWHEEL_HI_RES, REL_HWHEEL,
+                   g_mouse_report.wheel_x);
         changed = 1;
     }
 
     if (g_mouse_report.wheel_y != 0) {
-        kp_virtual_mouse_send(EV_REL, REL_WHEEL, g_mouse_report.wheel_y);
+        send_wheel(&s_wheel_remainder, REL_WHEEL_HI_RES, REL_WHEEL,
+                   g_mouse_report.wheel_y);
         changed = 1;
     }
 
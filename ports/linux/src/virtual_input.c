@@ -113,6 +113,8 @@ int create_virtual_mouse(void) {
     libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
     libevdev_enable_event_code(dev, EV_REL, REL_HWHEEL, NULL);
     libevdev_enable_event_code(dev, EV_REL, REL_WHEEL, NULL);
+    libevdev_enable_event_code(dev, EV_REL, REL_HWHEEL_HI_RES, NULL);
+    libevdev_enable_event_code(dev, EV_REL, REL_WHEEL_HI_RES, NULL);
 
     // libevdev_enable_event_type(dev, EV_SYN);
 
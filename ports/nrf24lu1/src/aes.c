@@ -76,11 +76,23 @@ void aes_encrypt(uint8_t *block) {
     aes_block_go(block);
 }
 
-void aes_decrypt(uint8_t *block) {
+static void aes_decrypt_mode(void) {
     if (aes_mode != AES_DECRYPT) {
         aes_mode = AES_DECRYPT;
         AESCS = AESCS_ECB_DEC;
         aes_keyin_write_buf(aes_dkey);
     }
+}
+
+void aes_decrypt(uint8_t *block) {
+    aes_decrypt_mode();
     aes_block_go(block);
 }
+
+void aes_decrypt_blocks(uint8_t *XRAM *blocks, uint8_t count) {
+    uint8_t i;
+    aes_decrypt_mode();
+    for (i = 0; i < count; ++i) {
+        aes_block_go(blocks[i]);
+    }
+}
@@ -18,6 +18,7 @@
 #include "core/hardware.h"
 #include "core/led.h"
 #include "core/matrix_interpret.h"
+#include "core/mouse.h"
 #include "core/rf.h"
 #include "core/settings.h"
 #include "core/timer.h"
@@ -30,10 +31,7 @@
 #include "key_handlers/key_hold.h"
 #include "key_handlers/key_mouse.h"
 
-#include "hid_reports/keyboard_report.h"
-#include "hid_reports/media_report.h"
-#include "hid_reports/mouse_report.h"
-#include "hid_reports/vendor_report.h"
+#include "hid_reports/hid_reports.h"
 
 #include "usb/common.h"
 
@@ -118,9 +116,9 @@ void main(void) {
 
                 // send reports
                 handle_mouse_events();
-                send_keyboard_report();
-                send_media_report();
-                send_mouse_report();
+#if USE_MOUSE_GESTURE
+                gesture_task();
+#endif
 
                 // handle special key tasks
                 sticky_key_task();
@@ -129,10 +127,12 @@ void main(void) {
             irq_on();
         }
 
-        // Disable usb interrupt while processing USB events
+        // Disable usb interrupt while processing USB events. The vendor
+        // report is sent with the other reports, so it has to be sent when
+        // input is disabled as well.
         irq_off();
         {
-            send_vendor_report();
+            send_hid_reports();
             handle_vendor_out_reports();
         }
         irq_on();
@@ -927,7 +927,7 @@ static void timers_start(void) {
     APP_ERROR_CHECK(err_code);
 }
 
-void kp_ble_hids_input_report_send(
+bool kp_ble_hids_input_report_send(
     uint8_t report_index,
     uint8_t report_size,
     uint8_t* data
@@ -955,6 +955,10 @@ void kp_ble_hids_input_report_send(
        ) {
         APP_ERROR_HANDLER(err_code);
     }
+
+    // The notification queue is full, so the report needs to be sent again
+    // once a notification has finished sending.
+    return (err_code != NRF_ERROR_RESOURCES) && (err_code != NRF_ERROR_BUSY);
 }
 
 uint8_t m_output_ready[BLE_OUTPUT_REPORT_COUNT];
@@ -1634,11 +1638,13 @@ int ble_test_main(uint8_t x) {
                     if (time_sec % 5 == 0) {
                         struct timeslot_stats_t stats = get_timeslot_stats();
                         NRF_LOG_INFO(
-                            "timeslot stats: {start: %04d, end: %04d, "
-                            "tx: %04d, rx: %04d, ext: %04d}",
-                            stats.start, stats.end,
+                            "timeslot stats: {granted: %04d, end: %04d, "
+                            "tx: %04d, rx: %04d, ext: %04d, blocked: %04d, "
+                            "canceled: %04d}",
+                            stats.granted, stats.end,
                             stats.tx, stats.rx,
-                            stats.extensions
+                            stats.extensions, stats.blocked,
+                            stats.canceled
                             );
                         NRF_LOG_INFO(
                             "conn stats: {handle: %d, established: %d, sec: %d}",
@@ -1702,6 +1708,9 @@ int ble_test_main(uint8_t x) {
                 rf_task();
             }
             handle_mouse_events();
+#if USE_MOUSE_GESTURE
+            gesture_task();
+#endif
 #else
             rf_task();
 #endif
@@ -21,9 +21,6 @@
 #define TIMESLOT_END_IRQHandler    QDEC_IRQHandler
 #define TIMESLOT_END_IRQPriority   APP_IRQ_PRIORITY_HIGH
 
-#define TS_LEN_US            (5000UL)   //< Starting timeslot length in µs
-#define TX_LEN_EXTENSION_US  (5000UL)   //< Length of timeslot extension in µs
-
 /// The timeslot activity should be finished with this much to spare.
 #define TS_SAFETY_MARGIN_US  (500UL)
 /// The timeslot activity should request an extension this long before end of timeslot.
@@ -34,7 +31,6 @@
 
 static volatile bool        m_timeslot_session_open;
 static uint32_t             m_tx_attempts = 0;
-static volatile uint32_t    m_total_timeslot_length = 0;
 static fifo_t               m_transmit_fifo;
 static nrf_esb_config_t     m_esb_config;
 static volatile bool        m_flash_busy = false;
@@ -47,7 +43,7 @@ typedef enum {
 
 static volatile timeslot_state_t m_state = TIMESLOT_STATE_IDLE;
 
-static timeslot_stats_t m_stats;
+timeslot_sched_t g_timeslot_sched;
 
 // Function prototypes
 void RADIO_IRQHandler(void);
@@ -58,18 +54,30 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
 // Timeslot requests
 //
 
-/// This will be used when requesting the first timeslot or any time a timeslot
-/// is blocked or cancelled.
+/// This will be used when requesting the first timeslot, any time a timeslot
+/// is blocked or cancelled, and after a busy timeslot.
 static nrf_radio_request_t m_timeslot_req_earliest = {
     NRF_RADIO_REQ_TYPE_EARLIEST,
     .params.earliest = {
         NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED,
         NRF_RADIO_PRIORITY_NORMAL,
-        TS_LEN_US,
+        TIMESLOT_DEFAULT_MAX_LEN_US,
         NRF_RADIO_EARLIEST_TIMEOUT_MAX_US
     }
 };
 
+/// This will be used after an idle timeslot, to leave a gap before the next
+/// one.
+static nrf_radio_request_t m_timeslot_req_normal = {
+    NRF_RADIO_REQ_TYPE_NORMAL,
+    .params.normal = {
+        NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED,
+        NRF_RADIO_PRIORITY_NORMAL,
+        TIMESLOT_DEFAULT_MAX_LEN_US,
+        TIMESLOT_DEFAULT_MAX_LEN_US
+    }
+};
+
 /// This will be used at the end of each timeslot to request the next timeslot.
 static nrf_radio_signal_callback_return_param_t m_rsc_return_sched_next = {
     NRF_RADIO_SIGNAL_CALLBACK_ACTION_REQUEST_AND_END,
@@ -82,7 +90,7 @@ static nrf_radio_signal_callback_return_param_t m_rsc_return_sched_next = {
 /// the timeslot.
 static nrf_radio_signal_callback_return_param_t m_rsc_extend = {
     NRF_RADIO_SIGNAL_CALLBACK_ACTION_EXTEND,
-    .params.extend = {TX_LEN_EXTENSION_US}
+    .params.extend = {TIMESLOT_EXTENSION_US}
 };
 
 /// This will be used at the end of each timeslot to request the next timeslot.
@@ -91,6 +99,18 @@ static nrf_radio_signal_callback_return_param_t m_rsc_return_no_action = {
     .params.request = {NULL}
 };
 
+/// @brief Fill in the request for the next timeslot from `g_timeslot_sched`
+static nrf_radio_request_t *next_timeslot_request(void) {
+    if (g_timeslot_sched.distance_us == 0) {
+        m_timeslot_req_earliest.params.earliest.length_us = g_timeslot_sched.len_us;
+        return &m_timeslot_req_earliest;
+    } else {
+        m_timeslot_req_normal.params.normal.distance_us = g_timeslot_sched.distance_us;
+        m_timeslot_req_normal.params.normal.length_us = g_timeslot_sched.len_us;
+        return &m_timeslot_req_normal;
+    }
+}
+
 // TODO: integrate this with non-timesloted ESB code
 #include "core/settings.h"
 #include "core/rf.h"
@@ -217,8 +237,6 @@ uint32_t esb_timeslot_init(void) {
         nrf52_esb_config_init_tx();
     }
 
-    m_total_timeslot_length = 0;
-
     // m_uesb_config.retransmit_count   = 2;
     // m_uesb_config.event_handler      = uesb_event_handler;
     // m_uesb_config.radio_irq_priority = 0; // Needs to match softdevice priority
@@ -241,7 +259,7 @@ uint32_t esb_timeslot_init(void) {
 
 /// @brief Get timeslot execution stats
 struct timeslot_stats_t get_timeslot_stats(void) {
-    return m_stats;
+    return g_timeslot_sched.stats;
 }
 
 /// @brief Start requesting ESB timeslots
@@ -257,20 +275,13 @@ uint32_t esb_timeslot_start(void) {
         return err_code;
     }
 
-    err_code = sd_radio_request(&m_timeslot_req_earliest);
+    timeslot_sched_init(&g_timeslot_sched);
+
+    err_code = sd_radio_request(next_timeslot_request());
     if (err_code != NRF_SUCCESS) {
         return err_code;
     }
 
-    m_stats.start = 0;
-    m_stats.end = 0;
-    m_stats.rx = 0;
-    m_stats.tx = 0;
-    m_stats.extensions = 0;
-
-    m_stats.blocked  = 0;
-    m_stats.canceled  = 0;
-
     m_timeslot_session_open = true;
 
     return NRF_SUCCESS;
@@ -319,7 +330,7 @@ void nrf_timeslot_esb_event_handler(nrf_esb_evt_t const * p_event) {
     switch (p_event->evt_id) {
         case NRF_ESB_EVENT_TX_SUCCESS: {
             NRF_LOG_DEBUG("TX SUCCESS EVENT");
-            m_stats.tx++;
+            timeslot_sched_tx(&g_timeslot_sched);
 
             // Successful transmission. Can now remove packet from our FIFO
             remove_ack_payload();
@@ -338,7 +349,7 @@ void nrf_timeslot_esb_event_handler(nrf_esb_evt_t const * p_event) {
             NRF_LOG_DEBUG("RX RECEIVED EVENT");
 
             while (nrf_esb_read_rx_payload(&m_rx_payload) == NRF_SUCCESS) {
-                m_stats.rx++;
+                timeslot_sched_rx(&g_timeslot_sched);
                 if (m_rx_payload.length > 0) {
                     NRF_LOG_DEBUG("RX RECEIVED PAYLOAD");
                     // rx_packet_count++;
@@ -386,6 +397,8 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
     // NOTE: This callback runs at lower-stack priority (the highest priority possible).
     switch (signal_type) {
     case NRF_RADIO_CALLBACK_SIGNAL_TYPE_START: {
+        timeslot_sched_start(&g_timeslot_sched);
+
         // TIMER0 is pre-configured for 1Mhz.
         NRF_TIMER0->TASKS_STOP          = 1;
         NRF_TIMER0->TASKS_CLEAR         = 1;
@@ -393,8 +406,8 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
         NRF_TIMER0->EVENTS_COMPARE[0]   = 0;
         NRF_TIMER0->EVENTS_COMPARE[1]   = 0;
         NRF_TIMER0->INTENSET            = TIMER_INTENSET_COMPARE0_Msk | TIMER_INTENSET_COMPARE1_Msk ;
-        NRF_TIMER0->CC[0]               = (TS_LEN_US - TS_SAFETY_MARGIN_US);
-        NRF_TIMER0->CC[1]               = (TS_LEN_US - TS_EXTEND_MARGIN_US);
+        NRF_TIMER0->CC[0]               = (g_timeslot_sched.slot_len_us - TS_SAFETY_MARGIN_US);
+        NRF_TIMER0->CC[1]               = (g_timeslot_sched.slot_len_us - TS_EXTEND_MARGIN_US);
         NRF_TIMER0->BITMODE             = (TIMER_BITMODE_BITMODE_24Bit << TIMER_BITMODE_BITMODE_Pos);
         NRF_TIMER0->TASKS_START         = 1;
 
@@ -424,6 +437,8 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
 
 
             // Schedule next timeslot
+            timeslot_sched_end(&g_timeslot_sched);
+            m_rsc_return_sched_next.params.request.p_next = next_timeslot_request();
             return (nrf_radio_signal_callback_return_param_t*) &m_rsc_return_sched_next;
         }
 
@@ -432,12 +447,9 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
         ) {
             NRF_TIMER0->EVENTS_COMPARE[1] = 0;
 
-            // This is the "try to extend timeslot" timeout
-
-            // if (m_total_timeslot_length < (128000000UL - 1UL - TX_LEN_EXTENSION_US)) {
-                // Request timeslot extension if total length does not exceed 128 seconds
-
-            if ( m_total_timeslot_length <= 2*TX_LEN_EXTENSION_US ) {
+            // This is the "try to extend timeslot" timeout. Keep the slot
+            // going while packets are arriving in it.
+            if (timeslot_sched_should_extend(&g_timeslot_sched)) {
                 return (nrf_radio_signal_callback_return_param_t*) &m_rsc_extend;
             } else {
                 NVIC_SetPendingIRQ(TIMESLOT_END_IRQn);
@@ -450,6 +462,7 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
 
     case NRF_RADIO_CALLBACK_SIGNAL_TYPE_EXTEND_FAILED: {
         // Don't do anything. Our timer will expire before timeslot ends
+        timeslot_sched_extend_failed(&g_timeslot_sched);
         NVIC_SetPendingIRQ(TIMESLOT_END_IRQn);
         return (nrf_radio_signal_callback_return_param_t*) &m_rsc_return_no_action;
     } break;
@@ -459,14 +472,12 @@ static nrf_radio_signal_callback_return_param_t * radio_callback (uint8_t signal
         NRF_TIMER0->TASKS_STOP          = 1;
         NRF_TIMER0->EVENTS_COMPARE[0]   = 0;
         NRF_TIMER0->EVENTS_COMPARE[1]   = 0;
-        NRF_TIMER0->CC[0]               += (TX_LEN_EXTENSION_US - 25);
-        NRF_TIMER0->CC[1]               += (TX_LEN_EXTENSION_US - 25);
+        NRF_TIMER0->CC[0]               += (TIMESLOT_EXTENSION_US - 25);
+        NRF_TIMER0->CC[1]               += (TIMESLOT_EXTENSION_US - 25);
         NRF_TIMER0->TASKS_START         = 1;
 
         // Keep track of total length
-        m_total_timeslot_length += TX_LEN_EXTENSION_US;
-
-        m_stats.extensions++;
+        timeslot_sched_extended(&g_timeslot_sched);
     } break;
 
     default: {
@@ -503,13 +514,13 @@ void soc_evt_handler(uint32_t sys_evt, void *p_context) {
         case NRF_EVT_RADIO_BLOCKED:
         case NRF_EVT_RADIO_CANCELED: {
             if (sys_evt == NRF_EVT_RADIO_BLOCKED) {
-                m_stats.blocked++;
+                timeslot_sched_blocked(&g_timeslot_sched);
             } else {
-                m_stats.canceled++;
+                timeslot_sched_canceled(&g_timeslot_sched);
             }
             // Blocked events are rescheduled with normal priority. They could also
             // be rescheduled with high priority if necessary.
-            uint32_t err_code = sd_radio_request((nrf_radio_request_t*) &m_timeslot_req_earliest);
+            uint32_t err_code = sd_radio_request(next_timeslot_request());
             APP_ERROR_CHECK(err_code);
 
         } break;
@@ -551,7 +562,6 @@ void soc_evt_handler(uint32_t sys_evt, void *p_context) {
 /// @brief IRQHandler called at the start of the time slot
 void TIMESLOT_BEGIN_IRQHandler(void) {
     led_testing_toggle(3);
-    m_stats.start++;
 
     nrf52_esb_timeslot_start_rx();
     m_state = TIMESLOT_STATE_ACTIVE;
@@ -575,7 +585,6 @@ void TIMESLOT_BEGIN_IRQHandler(void) {
 /// @brief IRQHandler handler called when ending the timeslot
 void TIMESLOT_END_IRQHandler(void) {
     uint32_t err_code;
-    m_stats.end++;
     led_testing_toggle(3);
 
     // Infrequently nrf_esb_stop_rx() will fail with NRF_ESB_ERROR_NOT_IN_RX_MODE
@@ -603,6 +612,4 @@ void TIMESLOT_END_IRQHandler(void) {
 
 cleanup:
     m_state = TIMESLOT_STATE_IDLE;
-
-    m_total_timeslot_length = 0;
 }
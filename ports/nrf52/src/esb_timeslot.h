@@ -7,16 +7,7 @@
 
 #include "extra/fifo.h"
 
-typedef struct timeslot_stats_t {
-    uint32_t start;
-    uint32_t end;
-    uint32_t rx;
-    uint32_t tx;
-    uint32_t extensions;
-    uint32_t blocked;
-    uint32_t canceled;
-} timeslot_stats_t;
-
+#include "core/timeslot_sched.h"
 
 struct timeslot_stats_t get_timeslot_stats(void);
 
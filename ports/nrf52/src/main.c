@@ -30,10 +30,7 @@
 #include "key_handlers/key_hold.h"
 #include "key_handlers/key_mouse.h"
 
-#include "hid_reports/keyboard_report.h"
-#include "hid_reports/media_report.h"
-#include "hid_reports/mouse_report.h"
-#include "hid_reports/vendor_report.h"
+#include "hid_reports/hid_reports.h"
 
 
 void init_logging(void) {
@@ -93,10 +90,7 @@ NO_RETURN_ATTR void recovery_mode_main_loop(void) {
 
     while (1) {
         if (is_usb_configured()) {
-            // send_keyboard_report();
-            // send_media_report();
-            // send_mouse_report();
-            send_vendor_report();
+            send_hid_reports();
         }
 
         handle_vendor_out_reports();
@@ -174,6 +168,14 @@ int main(void) {
             recovery_mode_main_loop();
         }
 
+#if USB_LOW_LATENCY
+        // Refill the endpoints the host polled during the last pass before
+        // doing anything else
+        if (is_usb_configured()) {
+            send_hid_reports();
+        }
+#endif
+
         // Log current time (for debugging)
         {
             uint32_t new_time = timer_read_ms();
@@ -198,6 +200,12 @@ int main(void) {
 
             interpret_all_keyboard_matrices();
 
+#if USB_LOW_LATENCY
+            // Don't make key changes wait for the RF and mouse tasks
+            if (is_usb_configured()) {
+                send_hid_reports();
+            }
+#endif
         }
 
 #if USE_NRF24
@@ -209,6 +217,9 @@ int main(void) {
                     rf_task();
                 }
                 handle_mouse_events();
+#if USE_MOUSE_GESTURE
+                gesture_task();
+#endif
             #else
                 rf_task();
             #endif
@@ -219,10 +230,7 @@ int main(void) {
         mouse_key_task();
 
         if (is_usb_configured()) {
-            send_keyboard_report();
-            send_media_report();
-            send_mouse_report();
-            send_vendor_report();
+            send_hid_reports();
         }
 
         // TODO: testing needed
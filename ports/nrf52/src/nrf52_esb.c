@@ -79,45 +79,34 @@ static uint32_t tx_failed_count;
 static bool esb_data_flag;
 
 #if 1
-    #include "core/ring_buf.h"
     #include "core/packet.h"
     #include "core/settings.h"
     #include "core/aes.h"
-    #define PACKET_BUFFER_MAX_LEN 22
     #define MAX_ESB_PIPE 5
-
-    typedef struct packet_id_t {
-        uint8_t sync_state;
-        uint32_t check_id;
-    } packet_id_t;
-
-    extern XRAM packet_id_t device_uid_list[MAX_NUM_DEVICES];
 #endif
 
 void nrf52_esb_packet_buffer_add(nrf_esb_payload_t *packet) {
+    uint8_t *dest;
+
     if (packet->pipe > MAX_ESB_PIPE) {
         // no data in rx fifo
         return;
     }
 
-    if (packet_buffer_free_space() < packet->length+2) {
-        // no space left in buffer
-        // nrf_esb_flush_rx();
-        // drop packet
+#if USE_UNIFYING
+    if (packet->pipe == UNIFYING_RF_PIPE_MOUSE || packet->pipe == UNIFYING_RF_PIPE_DONGLE) {
+        unifying_rx_packet(packet->pipe, packet->data, packet->length);
         return;
     }
+#endif
 
-    if (packet->length > PACKET_BUFFER_MAX_LEN) {
+    dest = packet_buffer_alloc(packet->pipe, packet->length);
+    if (dest == NULL) {
         // drop packets that are too large
         return;
     }
 
-    packet_buffer_add_byte(packet->pipe);
-    packet_buffer_add_byte(packet->length);
-
-    for (int i = 0; i < packet->length; ++i) {
-        packet_buffer_add_byte(packet->data[i]);
-    }
+    memcpy(dest, packet->data, packet->length);
 }
 
 void rf_esb_write_ack_payload(nrf_esb_payload_t *tx_payload) {
@@ -74,3 +74,40 @@ void aes_decrypt(uint8_t *aes_block) {
 
     memcpy(aes_block, decrypted_text, AES_BLOCK_SIZE);
 }
+
+/// Decrypt `count` blocks (in-place), sharing one context and key setup
+void aes_decrypt_blocks(uint8_t *XRAM *blocks, uint8_t count) {
+    ret_code_t  ret_val;
+    uint8_t     decrypted_text[AES_BLOCK_SIZE];
+    uint8_t     i;
+
+    nrf_crypto_aes_context_t      ecb_decr_ctx;
+
+    if (count == 0) {
+        return;
+    }
+
+    ret_val = nrf_crypto_aes_init(
+        &ecb_decr_ctx,
+        &g_nrf_crypto_aes_ecb_128_info,
+        NRF_CRYPTO_DECRYPT
+    );
+    APP_ERROR_CHECK(ret_val);
+
+    ret_val = nrf_crypto_aes_key_set(&ecb_decr_ctx, s_ekey_ptr);
+    APP_ERROR_CHECK(ret_val);
+
+    for (i = 0; i < count; ++i) {
+        ret_val = nrf_crypto_aes_update(
+            &ecb_decr_ctx,
+            blocks[i],
+            AES_BLOCK_SIZE,
+            decrypted_text
+        );
+        APP_ERROR_CHECK(ret_val);
+        memcpy(blocks[i], decrypted_text, AES_BLOCK_SIZE);
+    }
+
+    ret_val = nrf_crypto_aes_uninit(&ecb_decr_ctx);
+    APP_ERROR_CHECK(ret_val);
+}
@@ -25,6 +25,8 @@ static io_port_t *s_row_ports[MAX_NUM_ROWS];
 static bool s_col_read_invert;
 static bool s_row_drive;
 
+static volatile bool s_has_scan_irq_triggered;
+
 static inline void unselect_all_rows(void);
 static inline void select_all_rows(void);
 
@@ -346,6 +348,7 @@ void GPIOTE_IRQHandler(void) {
     if(nrf_gpiote_event_is_set(NRF_GPIOTE_EVENTS_PORT)){
         nrf_gpiote_event_clear(NRF_GPIOTE_EVENTS_PORT);
         NRF_LOG_INFO("PORT IRQ CALLED");
+        s_has_scan_irq_triggered = true;
     }
 }
 
@@ -355,6 +358,7 @@ void matrix_scan_irq_enable(void) {
         NVIC_ClearPendingIRQ(GPIOTE_IRQn);
         NVIC_SetPriority(GPIOTE_IRQn, GPIOTE_IRQPriority);
         nrf_gpiote_event_clear(NRF_GPIOTE_EVENTS_PORT);
+        s_has_scan_irq_triggered = false;
         NVIC_EnableIRQ(GPIOTE_IRQn);
     }
     nrf_gpiote_int_enable(NRF_GPIOTE_INT_PORT_MASK);
@@ -369,9 +373,9 @@ void matrix_scan_irq_disable(void) {
 }
 
 bool matrix_scan_irq_has_triggered(void) {
-    return false;
+    return s_has_scan_irq_triggered;
 }
 
 void matrix_scan_irq_clear(void) {
-
+    s_has_scan_irq_triggered = false;
 }
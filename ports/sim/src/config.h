@@ -0,0 +1,14 @@
+#pragma once
+
+#define BOOTLOADER_VID 0
+#define BOOTLOADER_PID 0
+
+#define SCANNER_MATRIX_DELTA 1
+
+#define INTERNAL_SCAN_METHOD MATRIX_SCANNER_INTERNAL_FAST_ROW_COL
+
+// The simulated nRF24 raises its IRQ line like the real chip
+#define RF_POLLING 0
+
+// Use the SPI handling provided by core/nrf24.c
+#define NRF24_INBUILT_SPI_HANDLING 1
@@ -0,0 +1,110 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file crc_check.c
+///
+/// Checks the table driven CRC16 in `core/crc.c`. `crc16_byte()` is
+/// compared against the bitwise `crc16_step()` for every crc and data byte,
+/// and `crc16_buffer()` and `crc16_flash_buffer()` against the test vectors
+/// documented in `core/crc.h`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/flash.h"
+#include "core/crc.h"
+#include "core/settings.h"
+
+#include "port_impl/sim_hardware.h"
+
+typedef struct crc_vector_t {
+    const char *name;
+    uint8_t data[32];
+    uint8_t len;
+    uint16_t crc;
+} crc_vector_t;
+
+static const crc_vector_t s_vectors[] = {
+    { "\"\"", { 0 }, 0, 0xffff },
+    { "\"123456789\"", { '1', '2', '3', '4', '5', '6', '7', '8', '9' }, 9, 0x29b1 },
+    {
+        "bytes 0x00..0x1f",
+        {
+            0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+            0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+            0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+            0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+        },
+        32,
+        0x23b3
+    },
+};
+
+#define NUM_VECTORS (sizeof(s_vectors) / sizeof(s_vectors[0]))
+
+static bool check_table(void) {
+    uint32_t crc;
+    uint32_t data;
+    uint32_t errors = 0;
+
+    for (crc = 0; crc <= 0xffff; ++crc) {
+        for (data = 0; data <= 0xff; ++data) {
+            const uint16_t expected = crc16_step(crc, data, 8);
+            const uint16_t result = crc16_byte(crc, data);
+
+            if (result != expected) {
+                if (errors == 0) {
+                    printf("  crc16_byte(0x%04x, 0x%02x): 0x%04x, expected 0x%04x\n",
+                        crc, data, result, expected);
+                }
+                errors++;
+            }
+        }
+    }
+
+    printf("crc16_byte() against crc16_step(): %s", errors ? "FAIL" : "ok");
+    if (errors) {
+        printf(" (%u mismatches)", errors);
+    }
+    printf("\n");
+    return errors == 0;
+}
+
+static bool check_vector(const crc_vector_t *vector) {
+    uint16_t bitwise = 0xffff;
+    uint16_t buffer;
+    uint16_t flash;
+    uint8_t i;
+    bool is_ok;
+
+    for (i = 0; i < vector->len; ++i) {
+        bitwise = crc16_step(bitwise, vector->data[i], 8);
+    }
+    buffer = crc16_buffer(vector->data, vector->len);
+
+    memcpy(g_sim_flash, vector->data, vector->len);
+    flash = crc16_flash_buffer(LAYOUT_ADDR, vector->len);
+
+    is_ok = (bitwise == vector->crc && buffer == vector->crc && flash == vector->crc);
+    printf("%-18s expected 0x%04x, bitwise 0x%04x, buffer 0x%04x, flash 0x%04x: %s\n",
+        vector->name,
+        vector->crc,
+        bitwise,
+        buffer,
+        flash,
+        is_ok ? "ok" : "FAIL"
+    );
+    return is_ok;
+}
+
+int main(void) {
+    bool is_ok = check_table();
+    uint8_t i;
+
+    for (i = 0; i < NUM_VECTORS; ++i) {
+        is_ok &= check_vector(&s_vectors[i]);
+    }
+
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
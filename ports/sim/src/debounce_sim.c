@@ -0,0 +1,361 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file debounce_sim.c
+///
+/// Feeds recorded switch waveforms through `scanner_debounce_row()` and checks
+/// that every keystroke in the recording produces exactly one press and one
+/// release event.
+///
+/// Waveform file format, one item per line:
+///
+///     # comment
+///     press           marks where the user pressed the key
+///     release         marks where the user released the key
+///     <level> <us>    the pin reads <level> (1 = down) for <us> microseconds
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/layout.h"
+#include "core/matrix_scanner.h"
+
+#include "port_impl/sim_hardware.h"
+
+#define MAX_SEGMENTS 4096
+#define MAX_MARKERS 256
+
+/// Time to keep scanning after the end of a waveform so that the debouncer
+/// can settle.
+#define SETTLE_TIME_US 50000
+
+typedef struct segment_t {
+    uint8_t level;
+    uint32_t duration;
+} segment_t;
+
+typedef struct marker_t {
+    uint8_t is_press;
+    uint32_t time;
+} marker_t;
+
+typedef struct waveform_t {
+    segment_t segments[MAX_SEGMENTS];
+    uint16_t num_segments;
+    marker_t markers[MAX_MARKERS];
+    uint16_t num_markers;
+    uint32_t length;
+} waveform_t;
+
+typedef struct latency_t {
+    uint16_t count;
+    uint32_t total;
+    uint32_t max;
+} latency_t;
+
+static const char *s_mode_names[] = {
+    [MATRIX_DEBOUNCE_MODE_TIMER] = "timer",
+    [MATRIX_DEBOUNCE_MODE_INTEGRATOR] = "integrator",
+    [MATRIX_DEBOUNCE_MODE_EAGER] = "eager",
+};
+
+static waveform_t s_waveform;
+static uint32_t s_scan_period_us = 500;
+static bool s_verbose = false;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options] WAVEFORM...\n"
+        "\n"
+        "  -m MODE  debounce mode: timer, integrator or eager (default: eager)\n"
+        "  -s US    time between scans in microseconds (default: 500)\n"
+        "  -p MS    debounce_time_press (default: 5)\n"
+        "  -r MS    debounce_time_release (default: 5)\n"
+        "  -P MS    trigger_time_press (default: 0)\n"
+        "  -R MS    trigger_time_release (default: 2)\n"
+        "  -a MS    debounce_adapt_limit, timer mode only (default: 0)\n"
+        "  -v       print every event\n",
+        name
+    );
+}
+
+static int parse_mode(const char *name) {
+    uint8_t i;
+    for (i = 0; i < sizeof(s_mode_names) / sizeof(s_mode_names[0]); ++i) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int load_waveform(const char *path, waveform_t *waveform) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    uint32_t line_num = 0;
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    memset(waveform, 0, sizeof(waveform_t));
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        char word[16];
+        unsigned level;
+        unsigned long duration;
+
+        line_num++;
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        if (sscanf(line, "%u %lu", &level, &duration) == 2) {
+            if (level > 1 || waveform->num_segments == MAX_SEGMENTS) {
+                goto bad_line;
+            }
+            waveform->segments[waveform->num_segments].level = level;
+            waveform->segments[waveform->num_segments].duration = duration;
+            waveform->num_segments++;
+            waveform->length += duration;
+        } else if (sscanf(line, "%15s", word) == 1) {
+            const bool is_press = (strcmp(word, "press") == 0);
+            if (!is_press && strcmp(word, "release") != 0) {
+                goto bad_line;
+            }
+            if (waveform->num_markers == MAX_MARKERS) {
+                goto bad_line;
+            }
+            waveform->markers[waveform->num_markers].is_press = is_press;
+            waveform->markers[waveform->num_markers].time = waveform->length;
+            waveform->num_markers++;
+        }
+    }
+
+    fclose(file);
+    return 0;
+
+bad_line:
+    fprintf(stderr, "%s:%u: can't parse line: %s", path, line_num, line);
+    fclose(file);
+    return -1;
+}
+
+static uint8_t get_level(const waveform_t *waveform, uint32_t time) {
+    uint32_t start = 0;
+    uint16_t i;
+
+    for (i = 0; i < waveform->num_segments; ++i) {
+        start += waveform->segments[i].duration;
+        if (time < start) {
+            return waveform->segments[i].level;
+        }
+    }
+
+    // hold the final level after the end of the recording
+    return waveform->num_segments ? waveform->segments[i-1].level : 0;
+}
+
+/// Find the time of the `n`th press or release marker
+static bool get_marker_time(
+    const waveform_t *waveform,
+    uint8_t is_press,
+    uint16_t n,
+    uint32_t *time
+) {
+    uint16_t i;
+    for (i = 0; i < waveform->num_markers; ++i) {
+        if (waveform->markers[i].is_press != is_press) {
+            continue;
+        }
+        if (n == 0) {
+            *time = waveform->markers[i].time;
+            return true;
+        }
+        n--;
+    }
+    return false;
+}
+
+static uint16_t count_markers(const waveform_t *waveform, uint8_t is_press) {
+    uint16_t count = 0;
+    uint16_t i;
+    for (i = 0; i < waveform->num_markers; ++i) {
+        count += (waveform->markers[i].is_press == is_press);
+    }
+    return count;
+}
+
+static void reset_scanner(void) {
+    // A single key at row 0, column 0 with key number 0
+    memset(g_sim_flash, INVALID_KEY_NUMBER, sizeof(g_sim_flash));
+    g_sim_flash[LAYOUT_PORT_KEY_NUM_MAP_ADDR - LAYOUT_ADDR] = 0;
+
+    g_scan_plan.mode = MATRIX_SCANNER_MODE_COL_ROW;
+    g_scan_plan.rows = 1;
+    g_scan_plan.cols = 1;
+    g_scan_plan.max_col_pin_num = 7;
+    g_scan_plan.max_key_num = 0;
+
+    g_sim_time_us = 0;
+    init_matrix_scanner_utils();
+}
+
+static void print_latency(const char *name, const latency_t *latency) {
+    if (latency->count == 0) {
+        return;
+    }
+    printf("  %s latency: avg %.2f ms, max %.2f ms\n",
+        name,
+        latency->total / 1000.0 / latency->count,
+        latency->max / 1000.0
+    );
+}
+
+/// Run a waveform through the debouncer.
+///
+/// @return true if each keystroke produced exactly one press and release
+static bool simulate(const char *path) {
+    const waveform_t *waveform = &s_waveform;
+    const uint32_t end_time = waveform->length + SETTLE_TIME_US;
+    const uint16_t expected_presses = count_markers(waveform, true);
+    const uint16_t expected_releases = count_markers(waveform, false);
+    latency_t press_latency = {0};
+    latency_t release_latency = {0};
+    uint16_t num_presses = 0;
+    uint16_t num_releases = 0;
+    bool is_down = false;
+    bool is_early = false;
+    bool ok;
+
+    reset_scanner();
+
+    for (g_sim_time_us = 0; g_sim_time_us < end_time; g_sim_time_us += s_scan_period_us) {
+        const uint8_t row = get_level(waveform, g_sim_time_us);
+        const bool key_down = bitmap_get_bit(g_key_num_bitmap, 0);
+        latency_t *latency;
+        uint16_t *count;
+        uint32_t marker_time;
+
+        scanner_debounce_row(0, &row, 1);
+
+        if (bitmap_get_bit(g_key_num_bitmap, 0) == key_down) {
+            continue;
+        }
+
+        is_down = !key_down;
+        latency = is_down ? &press_latency : &release_latency;
+        count = is_down ? &num_presses : &num_releases;
+
+        if (s_verbose) {
+            printf("  %8.3f ms: %s\n",
+                g_sim_time_us / 1000.0, is_down ? "press" : "release"
+            );
+        }
+
+        if (get_marker_time(waveform, is_down, *count, &marker_time)) {
+            const uint32_t delay = g_sim_time_us - marker_time;
+            if (g_sim_time_us < marker_time) {
+                // registered before the user actually pressed/released
+                is_early = true;
+            } else {
+                latency->count++;
+                latency->total += delay;
+                if (delay > latency->max) {
+                    latency->max = delay;
+                }
+            }
+        }
+        (*count)++;
+    }
+
+    if (get_matrix_num_keys_debouncing() != 0 || get_matrix_num_keys_down() != is_down) {
+        printf("%s: debouncer didn't settle\n", path);
+        return false;
+    }
+
+    ok = !is_early &&
+        (num_presses == expected_presses) &&
+        (num_releases == expected_releases);
+
+    printf("%s: %s\n", path, ok ? "OK" :
+        (is_early || num_presses > expected_presses || num_releases > expected_releases) ?
+        "CHATTER" : "MISSED"
+    );
+    printf("  presses: %u (expected %u), releases: %u (expected %u)\n",
+        num_presses, expected_presses, num_releases, expected_releases
+    );
+    print_latency("press", &press_latency);
+    print_latency("release", &release_latency);
+    if (g_scan_plan.debounce_adapt_limit) {
+        printf("  extra debounce time: %u ms, %u bounces, longest %u ms\n",
+            g_debounce_stats[0].extra_time,
+            g_debounce_stats[0].bounce_count,
+            g_debounce_stats[0].max_bounce_time
+        );
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int failures = 0;
+    int opt;
+    int i;
+
+    memset(&g_scan_plan, 0, sizeof(g_scan_plan));
+    g_scan_plan.debounce_mode = MATRIX_DEBOUNCE_MODE_EAGER;
+    g_scan_plan.debounce_time_press = 5;
+    g_scan_plan.debounce_time_release = 5;
+    g_scan_plan.trigger_time_press = 0;
+    g_scan_plan.trigger_time_release = 2;
+
+    while ((opt = getopt(argc, argv, "m:s:p:r:P:R:a:vh")) != -1) {
+        switch (opt) {
+            case 'm': {
+                const int mode = parse_mode(optarg);
+                if (mode < 0) {
+                    fprintf(stderr, "Unknown debounce mode '%s'\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                g_scan_plan.debounce_mode = mode;
+            } break;
+            case 's': s_scan_period_us = strtoul(optarg, NULL, 0); break;
+            case 'p': g_scan_plan.debounce_time_press = strtoul(optarg, NULL, 0); break;
+            case 'r': g_scan_plan.debounce_time_release = strtoul(optarg, NULL, 0); break;
+            case 'P': g_scan_plan.trigger_time_press = strtoul(optarg, NULL, 0); break;
+            case 'R': g_scan_plan.trigger_time_release = strtoul(optarg, NULL, 0); break;
+            case 'a': g_scan_plan.debounce_adapt_limit = strtoul(optarg, NULL, 0); break;
+            case 'v': s_verbose = true; break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || s_scan_period_us == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("mode: %s, scan period: %u us, debounce: %u/%u ms, trigger: %u/%u ms\n\n",
+        s_mode_names[g_scan_plan.debounce_mode],
+        s_scan_period_us,
+        g_scan_plan.debounce_time_press,
+        g_scan_plan.debounce_time_release,
+        g_scan_plan.trigger_time_press,
+        g_scan_plan.trigger_time_release
+    );
+
+    for (i = optind; i < argc; ++i) {
+        if (load_waveform(argv[i], &s_waveform) != 0 || !simulate(argv[i])) {
+            failures++;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
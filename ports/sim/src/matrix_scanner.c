@@ -0,0 +1,365 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file matrix_scanner.c
+///
+/// Matrix scanner for the simulated GPIO ports. It drives the simulated pins
+/// the same way the AVR ports drive real ones, and the pin inputs are worked
+/// out from the state of the simulated switches.
+
+#include "core/io_map.h"
+
+#include <string.h>
+
+#include "core/error.h"
+#include "core/matrix_scanner.h"
+
+#include "port_impl/sim_hardware.h"
+#include "port_impl/sim_matrix.h"
+
+#if IO_MAP_GPIO_COUNT > 32
+#error "The simulated switch matrix only supports 32 pins"
+#endif
+
+static XRAM port_mask_t s_col_masks[IO_PORT_COUNT];
+
+static uint8_t s_row_pin_mask[MAX_NUM_ROWS];
+static io_port_t *s_row_ports[MAX_NUM_ROWS];
+
+static uint8_t s_bytes_per_row;
+
+/// Bit `b` of `s_switches[a]` is set when a closed switch connects pin `a`
+/// and pin `b`.
+static uint32_t s_switches[IO_MAP_GPIO_COUNT];
+/// Pins connected to ground by a closed switch (pin modes)
+static uint32_t s_ground_switches;
+static bool s_has_diodes = true;
+
+static bool s_irq_enabled;
+static bool s_irq_triggered;
+
+/*********************************************************************
+ *                       simulated electronics                       *
+ *********************************************************************/
+
+static uint32_t get_driven_low_pins(void) {
+    uint32_t low_pins = 0;
+    uint8_t port_num;
+    for (port_num = 0; port_num < IO_PORT_COUNT; ++port_num) {
+        const io_port_t *port = IO_MAP_GET_PORT(port_num);
+        const uint32_t driven_low = port->DIR & ~port->OUT;
+        low_pins |= driven_low << (port_num * IO_PORT_SIZE);
+    }
+    return low_pins;
+}
+
+/// Work out which pins are pulled low through the switches
+static uint32_t get_low_pins(void) {
+    const uint32_t driven_low = get_driven_low_pins();
+    uint32_t low_pins = driven_low | s_ground_switches;
+    uint32_t last_low_pins;
+    uint8_t pin;
+
+    if (s_has_diodes) {
+        // Current can only flow from a column into the row it's switched
+        // to, so only columns directly connected to a low row are pulled low.
+        for (pin = 0; pin < IO_MAP_GPIO_COUNT; ++pin) {
+            if (s_switches[pin] & driven_low) {
+                low_pins |= (uint32_t)1 << pin;
+            }
+        }
+        return low_pins;
+    }
+
+    // Without diodes every pin connected to a low pin by any path of closed
+    // switches is pulled low.
+    do {
+        last_low_pins = low_pins;
+        for (pin = 0; pin < IO_MAP_GPIO_COUNT; ++pin) {
+            if (low_pins & ((uint32_t)1 << pin)) {
+                low_pins |= s_switches[pin];
+            }
+        }
+    } while (low_pins != last_low_pins);
+
+    return low_pins;
+}
+
+/// Update the `IN` registers of the ports after the pins or switches change
+static void update_port_inputs(void) {
+    const uint32_t low_pins = get_low_pins();
+    uint8_t port_num;
+
+    for (port_num = 0; port_num < IO_PORT_COUNT; ++port_num) {
+        io_port_t *port = IO_MAP_GET_PORT(port_num);
+        const port_mask_t port_low = low_pins >> (port_num * IO_PORT_SIZE);
+        const port_mask_t falling = port->IN & port_low;
+
+        // Column pins are pulled up, so they read high unless pulled low
+        port->IN = ~port_low;
+
+        // The interrupt fires on a falling edge, like a pin change interrupt
+        if (s_irq_enabled && (falling & s_col_masks[port_num])) {
+            s_irq_triggered = true;
+        }
+    }
+}
+
+void sim_matrix_reset(void) {
+    memset(s_switches, 0, sizeof(s_switches));
+    s_ground_switches = 0;
+    update_port_inputs();
+}
+
+void sim_matrix_set_switch(uint8_t row, uint8_t col, bool closed) {
+    const uint8_t col_pin = io_map_get_col_pin(col);
+    const uint32_t col_bit = (uint32_t)1 << col_pin;
+
+    switch (g_scan_plan.mode) {
+        case MATRIX_SCANNER_MODE_COL_ROW:
+        case MATRIX_SCANNER_MODE_ROW_COL: {
+            const uint8_t row_pin = io_map_get_row_pin(row);
+            const uint32_t row_bit = (uint32_t)1 << row_pin;
+            if (closed) {
+                s_switches[col_pin] |= row_bit;
+                s_switches[row_pin] |= col_bit;
+            } else {
+                s_switches[col_pin] &= ~row_bit;
+                s_switches[row_pin] &= ~col_bit;
+            }
+        } break;
+
+        default: {
+            if (closed) {
+                s_ground_switches |= col_bit;
+            } else {
+                s_ground_switches &= ~col_bit;
+            }
+        } break;
+    }
+
+    update_port_inputs();
+}
+
+void sim_matrix_set_diodes(bool has_diodes) {
+    s_has_diodes = has_diodes;
+    update_port_inputs();
+}
+
+/*********************************************************************
+ *                         matrix setup code                         *
+ *********************************************************************/
+
+static void setup_columns(void) {
+    memset(s_col_masks, 0, sizeof(s_col_masks));
+
+    for (uint8_t col_pin_i=0; col_pin_i < g_scan_plan.cols; col_pin_i++) {
+        const uint8_t pin_number = io_map_get_col_pin(col_pin_i);
+        const uint8_t col_port_num = IO_MAP_GET_PIN_PORT(pin_number);
+        const uint8_t col_pin_bit = IO_MAP_GET_PIN_BIT(pin_number);
+        s_col_masks[col_port_num] |= (1 << col_pin_bit);
+    }
+
+    for (uint8_t port_ii = 0; port_ii < IO_PORT_COUNT; ++port_ii) {
+        io_port_t *port = IO_MAP_GET_PORT(port_ii);
+        const port_mask_t col_mask = s_col_masks[port_ii];
+
+        if (col_mask == 0) {
+            continue;
+        }
+
+        if (io_map_claim_pins(port_ii, col_mask)) {
+            return; // return on error
+        }
+
+        switch (g_scan_plan.mode) {
+            case MATRIX_SCANNER_MODE_COL_ROW:
+            case MATRIX_SCANNER_MODE_PIN_GND: {
+                // inputs with pull-up resistors
+                port->DIR &= ~col_mask;
+                port->OUT |= col_mask;
+            } break;
+
+            default: {
+                register_error(ERROR_UNSUPPORTED_SCAN_MODE);
+                return;
+            } break;
+        }
+    }
+}
+
+static void setup_rows(void) {
+    for (uint8_t row_pin_i=0; row_pin_i < g_scan_plan.rows; row_pin_i++) {
+        const uint8_t pin_number = io_map_get_row_pin(row_pin_i);
+        const uint8_t row_port_num = IO_MAP_GET_PIN_PORT(pin_number);
+        const uint8_t row_bit_mask = (1 << IO_MAP_GET_PIN_BIT(pin_number));
+        io_port_t *const port = IO_MAP_GET_PORT(row_port_num);
+
+        if (io_map_claim_pins(row_port_num, row_bit_mask)) {
+            return;
+        }
+
+        s_row_pin_mask[row_pin_i] = row_bit_mask;
+        s_row_ports[row_pin_i] = port;
+
+        switch (g_scan_plan.mode) {
+            case MATRIX_SCANNER_MODE_COL_ROW: {
+                // rows are disconnected inputs until they are selected
+                port->DIR &= ~row_bit_mask;
+                port->OUT &= ~row_bit_mask;
+            } break;
+
+            default: {
+                register_error(ERROR_UNSUPPORTED_SCAN_MODE);
+                return;
+            } break;
+        }
+    }
+}
+
+/// Selecting a row makes it an output driven low
+static void select_row(uint8_t row) {
+    io_port_t *port = s_row_ports[row];
+    const uint8_t pin_mask = s_row_pin_mask[row];
+    port->DIR |= pin_mask;
+    port->OUT &= ~pin_mask;
+    update_port_inputs();
+}
+
+/// Unselecting a row disconnects it
+static void unselect_row(uint8_t row) {
+    io_port_t *const port = s_row_ports[row];
+    const uint8_t pin_mask = s_row_pin_mask[row];
+    port->DIR &= ~pin_mask;
+    port->OUT &= ~pin_mask;
+    update_port_inputs();
+}
+
+void matrix_scanner_init(void) {
+    if (
+        g_scan_plan.rows > MAX_NUM_ROWS ||
+        g_scan_plan.max_col_pin_num > IO_PORT_MAX_PIN_NUM
+    ) {
+        memset((uint8_t*)&g_scan_plan, 0, sizeof(matrix_scan_plan_t));
+        register_error(ERROR_MATRIX_PINS_CONFIG_TOO_LARGE);
+        return;
+    }
+
+    memset(g_sim_ports, 0, sizeof(g_sim_ports));
+    s_irq_enabled = false;
+    s_irq_triggered = false;
+
+    s_bytes_per_row = INT_DIV_ROUND_UP(g_scan_plan.max_col_pin_num+1, IO_PORT_SIZE);
+
+    if (g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW) {
+        setup_rows();
+    }
+    setup_columns();
+    update_port_inputs();
+
+    init_matrix_scanner_utils();
+}
+
+port_mask_t get_col_mask(uint8_t port_num) {
+    return s_col_masks[port_num];
+}
+
+static uint8_t scan_row(uint8_t row) {
+    uint8_t new_row[IO_PORT_COUNT];
+    uint8_t port_num;
+
+    for (port_num = 0; port_num < IO_PORT_COUNT; ++port_num) {
+        new_row[port_num] = ~IO_MAP_GET_PORT(port_num)->IN & s_col_masks[port_num];
+    }
+
+    return scanner_debounce_row(row, new_row, s_bytes_per_row);
+}
+
+static bool matrix_scan_row_col_mode(void) {
+    uint8_t row;
+    bool scan_changed = false;
+
+    // The parasitic discharge delay isn't needed here, the simulated pins
+    // settle as soon as a row is selected.
+    for (row = 0; row < g_scan_plan.rows; ++row) {
+        select_row(row);
+        scan_changed |= scan_row(row);
+        unselect_row(row);
+    }
+
+    return scan_changed;
+}
+
+bool matrix_scan(void) {
+    switch (g_scan_plan.mode) {
+        case MATRIX_SCANNER_MODE_COL_ROW: {
+            return matrix_scan_row_col_mode();
+        }
+
+        case MATRIX_SCANNER_MODE_PIN_GND: {
+            return scan_row(0);
+        }
+
+        default: {
+        } break;
+    }
+    return false;
+}
+
+bool matrix_has_active_row(void) {
+    uint8_t port_num;
+    for (port_num = 0; port_num < IO_PORT_COUNT; ++port_num) {
+        if (~IO_MAP_GET_PORT(port_num)->IN & s_col_masks[port_num]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*********************************************************************
+ *                        interrupt simulation                       *
+ *********************************************************************/
+
+// While the interrupts are enabled all the rows are driven low, so pressing
+// any key pulls its column low and sets the interrupt flag. A key that is
+// already down when the interrupt is enabled doesn't set the flag.
+void matrix_scan_irq_enable(void) {
+    uint8_t row;
+
+    if (g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW) {
+        for (row = 0; row < g_scan_plan.rows; ++row) {
+            s_row_ports[row]->DIR |= s_row_pin_mask[row];
+            s_row_ports[row]->OUT &= ~s_row_pin_mask[row];
+        }
+    }
+    update_port_inputs();
+
+    s_irq_triggered = false;
+    s_irq_enabled = true;
+}
+
+void matrix_scan_irq_disable(void) {
+    uint8_t row;
+
+    s_irq_enabled = false;
+
+    if (g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW) {
+        for (row = 0; row < g_scan_plan.rows; ++row) {
+            s_row_ports[row]->DIR &= ~s_row_pin_mask[row];
+        }
+    }
+
+    update_port_inputs();
+}
+
+bool sim_matrix_is_irq_enabled(void) {
+    return s_irq_enabled;
+}
+
+bool matrix_scan_irq_has_triggered(void) {
+    return s_irq_triggered;
+}
+
+void matrix_scan_irq_clear(void) {
+    s_irq_triggered = false;
+}
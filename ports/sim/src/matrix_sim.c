@@ -0,0 +1,713 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file matrix_sim.c
+///
+/// Runs the whole scanning path on the simulated GPIO ports: the matrix
+/// scanner, the debouncer, and the matrix packets from `get_matrix_data()`.
+/// Switch presses in a scenario are turned into pin changes, the packets are
+/// decoded like a receiving device would, and each key event that comes out
+/// is checked against the keystrokes in the scenario.
+///
+/// Scenario file format, one item per line:
+///
+///     # comment
+///     matrix <rows> <cols>    size of the key matrix (default 1 1)
+///     diodes on|off           whether the switches have diodes (default on)
+///     anti_ghosting on|off    the scan plan's anti-ghosting filter (default off)
+///     expect ghosts           ghost keys are reported but aren't failures
+///     expect missed <count>   exactly `<count>` keystrokes are missed
+///     <us> press <row> <col> [bounce <count> <us>]
+///     <us> release <row> <col> [bounce <count> <us>]
+///
+/// A keystroke at time `<us>` changes the switch at `<row>` and `<col>`. With
+/// `bounce`, the contact then flips back and forth `<count>` times, spending
+/// `<us>` in each state, before it settles.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/io_map.h"
+#include "core/layout.h"
+#include "core/matrix_scanner.h"
+#include "core/packet.h"
+
+#include "port_impl/sim_hardware.h"
+#include "port_impl/sim_matrix.h"
+
+#define MAX_TRANSITIONS 4096
+#define MAX_KEYSTROKES 1024
+
+/// First pin used for the columns, the rows use the pins before it
+#define FIRST_COL_PIN 8
+#define MAX_SIM_COLS (IO_MAP_GPIO_COUNT - FIRST_COL_PIN)
+
+/// Time to keep scanning after the last switch change so that the debouncer
+/// can settle.
+#define SETTLE_TIME_US 50000
+
+typedef struct transition_t {
+    uint32_t time;
+    uint16_t order;
+    uint8_t row;
+    uint8_t col;
+    uint8_t closed;
+} transition_t;
+
+typedef struct keystroke_t {
+    uint32_t time;
+    uint8_t key_num;
+    uint8_t is_press;
+} keystroke_t;
+
+typedef struct scenario_t {
+    uint8_t rows;
+    uint8_t cols;
+    bool has_diodes;
+    bool anti_ghosting;
+    bool expect_ghosts;
+    uint16_t expect_missed;
+    transition_t transitions[MAX_TRANSITIONS];
+    uint16_t num_transitions;
+    keystroke_t keystrokes[MAX_KEYSTROKES];
+    uint16_t num_keystrokes;
+    uint32_t length;
+} scenario_t;
+
+typedef struct latency_t {
+    uint16_t count;
+    uint32_t total;
+    uint32_t max;
+} latency_t;
+
+typedef struct scan_cost_t {
+    uint32_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t flash_reads;
+} scan_cost_t;
+
+typedef struct results_t {
+    latency_t press_latency;
+    latency_t release_latency;
+    /// scans while no key was debouncing, and while keys were debouncing
+    scan_cost_t idle_cost;
+    scan_cost_t debouncing_cost;
+    /// calls to `matrix_scan_task()` while it was waiting for a pin change
+    scan_cost_t waiting_cost;
+    uint32_t packet_count[4];
+    uint32_t packet_bytes;
+    uint16_t ghosts;
+    uint16_t chatter;
+    uint16_t early;
+    uint16_t missed;
+    uint16_t bad_packets;
+} results_t;
+
+static const char *s_mode_names[] = {
+    [MATRIX_DEBOUNCE_MODE_TIMER] = "timer",
+    [MATRIX_DEBOUNCE_MODE_INTEGRATOR] = "integrator",
+    [MATRIX_DEBOUNCE_MODE_EAGER] = "eager",
+};
+
+static const char *s_packet_names[] = {
+    [PACKET_MATRIX_RAW] = "raw",
+    [PACKET_MATRIX_KEY_LIST] = "key list",
+    [PACKET_MATRIX_DELTA_LIST] = "delta list",
+    [PACKET_MATRIX_RESERVED] = "reserved",
+};
+
+static scenario_t s_scenario;
+static uint32_t s_scan_period_us = 500;
+static bool s_verbose = false;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options] SCENARIO...\n"
+        "\n"
+        "  -m MODE  debounce mode: timer, integrator or eager (default: eager)\n"
+        "  -s US    time between scans in microseconds (default: 500)\n"
+        "  -p MS    debounce_time_press (default: 5)\n"
+        "  -r MS    debounce_time_release (default: 5)\n"
+        "  -P MS    trigger_time_press (default: 0)\n"
+        "  -R MS    trigger_time_release (default: 2)\n"
+        "  -i MS    scan_idle_time (default: 20)\n"
+        "  -v       print every event\n",
+        name
+    );
+}
+
+static int parse_mode(const char *name) {
+    uint8_t i;
+    for (i = 0; i < sizeof(s_mode_names) / sizeof(s_mode_names[0]); ++i) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t get_key_num(const scenario_t *scenario, uint8_t row, uint8_t col) {
+    return row * scenario->cols + col;
+}
+
+static bool add_transition(
+    scenario_t *scenario,
+    uint32_t time,
+    uint8_t row,
+    uint8_t col,
+    uint8_t closed
+) {
+    transition_t *transition;
+
+    if (scenario->num_transitions == MAX_TRANSITIONS) {
+        return false;
+    }
+
+    transition = &scenario->transitions[scenario->num_transitions];
+    transition->time = time;
+    transition->order = scenario->num_transitions;
+    transition->row = row;
+    transition->col = col;
+    transition->closed = closed;
+    scenario->num_transitions++;
+
+    if (time > scenario->length) {
+        scenario->length = time;
+    }
+    return true;
+}
+
+static int compare_transitions(const void *a, const void *b) {
+    const transition_t *x = a;
+    const transition_t *y = b;
+    if (x->time != y->time) {
+        return (x->time < y->time) ? -1 : 1;
+    }
+    return (int)x->order - (int)y->order;
+}
+
+static int compare_keystrokes(const void *a, const void *b) {
+    const keystroke_t *x = a;
+    const keystroke_t *y = b;
+    if (x->time != y->time) {
+        return (x->time < y->time) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int load_scenario(const char *path, scenario_t *scenario) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    uint32_t line_num = 0;
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    memset(scenario, 0, sizeof(scenario_t));
+    scenario->rows = 1;
+    scenario->cols = 1;
+    scenario->has_diodes = true;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        char word[16];
+        char extra[16];
+        unsigned long time;
+        unsigned row, col;
+        unsigned bounces = 0;
+        unsigned long bounce_time = 0;
+        int fields;
+
+        line_num++;
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        if (sscanf(line, "matrix %u %u", &row, &col) == 2) {
+            if (
+                scenario->num_keystrokes != 0 ||
+                row == 0 || row > MAX_NUM_ROWS || row > FIRST_COL_PIN ||
+                col == 0 || col > MAX_SIM_COLS ||
+                row * col > MAX_NUM_KEYS
+            ) {
+                goto bad_line;
+            }
+            scenario->rows = row;
+            scenario->cols = col;
+        } else if (sscanf(line, "diodes %15s", word) == 1) {
+            if (strcmp(word, "on") != 0 && strcmp(word, "off") != 0) {
+                goto bad_line;
+            }
+            scenario->has_diodes = (strcmp(word, "on") == 0);
+        } else if (sscanf(line, "anti_ghosting %15s", word) == 1) {
+            if (strcmp(word, "on") != 0 && strcmp(word, "off") != 0) {
+                goto bad_line;
+            }
+            scenario->anti_ghosting = (strcmp(word, "on") == 0);
+        } else if ((fields = sscanf(line, "expect %15s %u", word, &row)) >= 1) {
+            if (fields == 1 && strcmp(word, "ghosts") == 0) {
+                scenario->expect_ghosts = true;
+            } else if (fields == 2 && strcmp(word, "missed") == 0) {
+                scenario->expect_missed = row;
+            } else {
+                goto bad_line;
+            }
+        } else if (
+            (fields = sscanf(line, "%lu %15s %u %u %15s %u %lu",
+                &time, word, &row, &col, extra, &bounces, &bounce_time)) >= 4
+        ) {
+            const bool is_press = (strcmp(word, "press") == 0);
+            keystroke_t *keystroke;
+            unsigned i;
+
+            if (!is_press && strcmp(word, "release") != 0) {
+                goto bad_line;
+            }
+            if (fields != 4 && (fields != 7 || strcmp(extra, "bounce") != 0)) {
+                goto bad_line;
+            }
+            if (
+                row >= scenario->rows || col >= scenario->cols ||
+                scenario->num_keystrokes == MAX_KEYSTROKES
+            ) {
+                goto bad_line;
+            }
+
+            keystroke = &scenario->keystrokes[scenario->num_keystrokes];
+            keystroke->time = time;
+            keystroke->key_num = get_key_num(scenario, row, col);
+            keystroke->is_press = is_press;
+            scenario->num_keystrokes++;
+
+            for (i = 0; i <= 2*bounces; ++i) {
+                // Even steps are the new state, odd steps are bounces back
+                // to the old state.
+                const uint8_t closed = (i % 2 == 0) ? is_press : !is_press;
+                if (!add_transition(scenario, time + i*bounce_time, row, col, closed)) {
+                    goto bad_line;
+                }
+            }
+        } else if (sscanf(line, "%15s", word) == 1) {
+            goto bad_line;
+        }
+    }
+
+    fclose(file);
+
+    qsort(
+        scenario->transitions, scenario->num_transitions,
+        sizeof(transition_t), compare_transitions
+    );
+    qsort(
+        scenario->keystrokes, scenario->num_keystrokes,
+        sizeof(keystroke_t), compare_keystrokes
+    );
+    return 0;
+
+bad_line:
+    fprintf(stderr, "%s:%u: can't parse line: %s", path, line_num, line);
+    fclose(file);
+    return -1;
+}
+
+/// Write the pin and key number maps for the scenario into the simulated
+/// layout, then initialize the scanner from them.
+static void setup_matrix(const scenario_t *scenario) {
+    const uint8_t max_col_pin_num = FIRST_COL_PIN + scenario->cols - 1;
+    uint8_t row, col;
+
+    memset(g_sim_flash, INVALID_KEY_NUMBER, sizeof(g_sim_flash));
+
+    for (row = 0; row < scenario->rows; ++row) {
+        g_sim_flash[LAYOUT_PORT_ROW_PINS_ADDR - LAYOUT_ADDR + row] = row;
+    }
+
+    for (col = 0; col < scenario->cols; ++col) {
+        const uint8_t col_pin = FIRST_COL_PIN + col;
+        g_sim_flash[LAYOUT_PORT_COL_PINS_ADDR - LAYOUT_ADDR + col] = col_pin;
+        for (row = 0; row < scenario->rows; ++row) {
+            g_sim_flash[
+                LAYOUT_PORT_KEY_NUM_MAP_ADDR - LAYOUT_ADDR +
+                row*(max_col_pin_num+1) + col_pin
+            ] = get_key_num(scenario, row, col);
+        }
+    }
+
+    g_scan_plan.mode = MATRIX_SCANNER_MODE_COL_ROW;
+    g_scan_plan.rows = scenario->rows;
+    g_scan_plan.cols = scenario->cols;
+    g_scan_plan.max_col_pin_num = max_col_pin_num;
+    g_scan_plan.max_key_num = scenario->rows * scenario->cols - 1;
+    g_scan_plan.anti_ghosting = scenario->anti_ghosting;
+
+    g_sim_time_us = 0;
+    io_map_init();
+    matrix_scanner_init();
+    sim_matrix_set_diodes(scenario->has_diodes);
+    sim_matrix_reset();
+}
+
+/// Update `matrix` from a matrix packet, the same way a receiving device
+/// does in `keyboard_update_device_matrix()`.
+///
+/// @return false if the packet is malformed
+static bool decode_matrix_packet(
+    const uint8_t *packet,
+    uint8_t packet_len,
+    uint8_t *matrix
+) {
+    const uint8_t packet_type = packet[0] >> PACKET_MATRIX_TYPE_BIT_POS;
+    const uint8_t data_size = packet[0] & PACKET_MATRIX_SIZE_MASK;
+    const uint8_t *data = &packet[1];
+    uint8_t i;
+
+    if (packet_len != data_size + 1) {
+        return false;
+    }
+
+    switch (packet_type) {
+        case PACKET_MATRIX_DELTA_LIST: {
+            for (i = 0; i < data_size; ++i) {
+                const uint8_t key_num = data[i] & MATRIX_DELTA_KEY_MASK;
+                if (data[i] & MATRIX_DELTA_TYPE_MASK) {
+                    bitmap_set_bit(matrix, key_num);
+                } else {
+                    bitmap_clear_bit(matrix, key_num);
+                }
+            }
+        } break;
+
+        case PACKET_MATRIX_KEY_LIST: {
+            memset(matrix, 0, KEY_NUMBER_BITMAP_SIZE);
+            for (i = 0; i < data_size; ++i) {
+                if (data[i] >= MAX_NUM_KEYS) {
+                    return false;
+                }
+                bitmap_set_bit(matrix, data[i]);
+            }
+        } break;
+
+        case PACKET_MATRIX_RAW: {
+            if (data_size > KEY_NUMBER_BITMAP_SIZE) {
+                return false;
+            }
+            memset(matrix, 0, KEY_NUMBER_BITMAP_SIZE);
+            memcpy(matrix, data, data_size);
+        } break;
+
+        default: {
+            return false;
+        } break;
+    }
+
+    return true;
+}
+
+static void add_latency(latency_t *latency, uint32_t delay) {
+    latency->count++;
+    latency->total += delay;
+    if (delay > latency->max) {
+        latency->max = delay;
+    }
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/// Find the `n`th keystroke for a key
+static const keystroke_t *get_keystroke(
+    const scenario_t *scenario,
+    uint8_t key_num,
+    uint16_t n
+) {
+    uint16_t i;
+    for (i = 0; i < scenario->num_keystrokes; ++i) {
+        if (scenario->keystrokes[i].key_num != key_num) {
+            continue;
+        }
+        if (n == 0) {
+            return &scenario->keystrokes[i];
+        }
+        n--;
+    }
+    return NULL;
+}
+
+static uint16_t count_keystrokes(const scenario_t *scenario, uint8_t key_num) {
+    uint16_t count = 0;
+    uint16_t i;
+    for (i = 0; i < scenario->num_keystrokes; ++i) {
+        count += (scenario->keystrokes[i].key_num == key_num);
+    }
+    return count;
+}
+
+/// Check a key event decoded from a matrix packet against the scenario
+static void check_key_event(
+    const scenario_t *scenario,
+    uint8_t key_num,
+    bool is_down,
+    uint16_t *event_count,
+    results_t *results
+) {
+    const keystroke_t *keystroke;
+
+    if (s_verbose) {
+        printf("  %8.3f ms: key %u %s\n",
+            g_sim_time_us / 1000.0, key_num, is_down ? "press" : "release"
+        );
+    }
+
+    if (count_keystrokes(scenario, key_num) == 0) {
+        // a key that was never touched
+        results->ghosts++;
+        return;
+    }
+
+    keystroke = get_keystroke(scenario, key_num, event_count[key_num]);
+    event_count[key_num]++;
+
+    if (keystroke == NULL || keystroke->is_press != is_down) {
+        results->chatter++;
+    } else if (g_sim_time_us < keystroke->time) {
+        // registered before the user actually pressed/released
+        results->early++;
+    } else {
+        add_latency(
+            is_down ? &results->press_latency : &results->release_latency,
+            g_sim_time_us - keystroke->time
+        );
+    }
+}
+
+static bool do_scan(results_t *results) {
+    const bool is_debouncing = (get_matrix_num_keys_debouncing() != 0);
+    scan_cost_t *cost = sim_matrix_is_irq_enabled() ? &results->waiting_cost :
+        is_debouncing ? &results->debouncing_cost : &results->idle_cost;
+    const uint32_t start_reads = g_sim_flash_reads;
+    const uint64_t start_ns = get_time_ns();
+    uint64_t scan_ns;
+    bool scan_changed;
+
+    scan_changed = matrix_scan_task();
+
+    scan_ns = get_time_ns() - start_ns;
+    cost->count++;
+    cost->total_ns += scan_ns;
+    cost->flash_reads += g_sim_flash_reads - start_reads;
+    if (scan_ns > cost->max_ns) {
+        cost->max_ns = scan_ns;
+    }
+
+    return scan_changed;
+}
+
+static void print_latency(const char *name, const latency_t *latency) {
+    if (latency->count == 0) {
+        return;
+    }
+    printf("  %s latency: avg %.2f ms, max %.2f ms\n",
+        name,
+        latency->total / 1000.0 / latency->count,
+        latency->max / 1000.0
+    );
+}
+
+static void print_scan_cost(const char *name, const scan_cost_t *cost) {
+    if (cost->count == 0) {
+        return;
+    }
+    printf("  %s scans: %u, avg %.0f ns, max %llu ns, %.1f flash reads/scan\n",
+        name,
+        cost->count,
+        (double)cost->total_ns / cost->count,
+        (unsigned long long)cost->max_ns,
+        (double)cost->flash_reads / cost->count
+    );
+}
+
+/// Run a scenario through the scanner.
+///
+/// @return true if each keystroke produced exactly one event and every
+/// matrix packet decoded to the scanner's key state
+static bool simulate(const char *path) {
+    const scenario_t *scenario = &s_scenario;
+    const uint32_t end_time = scenario->length + SETTLE_TIME_US;
+    uint8_t host_matrix[KEY_NUMBER_BITMAP_SIZE] = {0};
+    uint16_t event_count[MAX_NUM_KEYS] = {0};
+    uint16_t next_transition = 0;
+    results_t results;
+    bool ok;
+    uint8_t key_num;
+    uint8_t i;
+
+    memset(&results, 0, sizeof(results));
+    setup_matrix(scenario);
+
+    for (g_sim_time_us = 0; g_sim_time_us < end_time; g_sim_time_us += s_scan_period_us) {
+        uint8_t matrix_data[32];
+        uint8_t old_matrix[KEY_NUMBER_BITMAP_SIZE];
+        uint8_t data_size;
+
+        while (
+            next_transition < scenario->num_transitions &&
+            scenario->transitions[next_transition].time <= g_sim_time_us
+        ) {
+            const transition_t *transition = &scenario->transitions[next_transition];
+            sim_matrix_set_switch(transition->row, transition->col, transition->closed);
+            next_transition++;
+        }
+
+        // Like the firmware main loops, send a packet when the scan changed,
+        // always ask for deltas and let `get_matrix_data()` pick the encoding.
+        if (!do_scan(&results)) {
+            continue;
+        }
+
+        data_size = get_matrix_data(matrix_data, true);
+        results.packet_count[matrix_data[0] >> PACKET_MATRIX_TYPE_BIT_POS]++;
+        results.packet_bytes += data_size;
+
+        memcpy(old_matrix, host_matrix, sizeof(host_matrix));
+        if (
+            !decode_matrix_packet(matrix_data, data_size, host_matrix) ||
+            memcmp(host_matrix, g_key_num_bitmap, sizeof(host_matrix)) != 0
+        ) {
+            if (s_verbose) {
+                printf("  %8.3f ms: bad %s packet\n",
+                    g_sim_time_us / 1000.0,
+                    s_packet_names[matrix_data[0] >> PACKET_MATRIX_TYPE_BIT_POS]
+                );
+            }
+            results.bad_packets++;
+            // carry on from the scanner's state
+            memcpy(host_matrix, g_key_num_bitmap, sizeof(host_matrix));
+        }
+
+        for (key_num = 0; key_num < scenario->rows * scenario->cols; ++key_num) {
+            const bool is_down = bitmap_get_bit(host_matrix, key_num);
+            if ((bool)bitmap_get_bit(old_matrix, key_num) != is_down) {
+                check_key_event(scenario, key_num, is_down, event_count, &results);
+            }
+        }
+    }
+
+    for (key_num = 0; key_num < scenario->rows * scenario->cols; ++key_num) {
+        const uint16_t expected = count_keystrokes(scenario, key_num);
+        if (event_count[key_num] < expected) {
+            results.missed += expected - event_count[key_num];
+        }
+    }
+
+    ok = (results.chatter == 0) &&
+        (results.early == 0) &&
+        (results.missed == scenario->expect_missed) &&
+        (results.bad_packets == 0) &&
+        (results.ghosts == 0 || scenario->expect_ghosts);
+
+    if (get_matrix_num_keys_debouncing() != 0) {
+        printf("%s: debouncer didn't settle\n", path);
+        return false;
+    }
+
+    printf("%s: %s\n", path, ok ? "OK" : "FAILED");
+    printf("  %ux%u matrix, %s diodes%s, %u keystrokes\n",
+        scenario->rows, scenario->cols,
+        scenario->has_diodes ? "with" : "no",
+        scenario->anti_ghosting ? ", anti-ghosting" : "",
+        scenario->num_keystrokes
+    );
+    printf("  ghosts: %u%s, chatter: %u, early: %u, missed: %u%s, bad packets: %u\n",
+        results.ghosts,
+        (results.ghosts && scenario->expect_ghosts) ? " (expected)" : "",
+        results.chatter,
+        results.early,
+        results.missed,
+        (results.missed && results.missed == scenario->expect_missed) ? " (expected)" : "",
+        results.bad_packets
+    );
+    print_latency("press", &results.press_latency);
+    print_latency("release", &results.release_latency);
+    print_scan_cost("idle", &results.idle_cost);
+    print_scan_cost("debouncing", &results.debouncing_cost);
+    print_scan_cost("waiting", &results.waiting_cost);
+
+    printf("  packets:");
+    for (i = 0; i < sizeof(s_packet_names) / sizeof(s_packet_names[0]); ++i) {
+        if (results.packet_count[i]) {
+            printf(" %s %u,", s_packet_names[i], results.packet_count[i]);
+        }
+    }
+    printf(" %u bytes total\n", results.packet_bytes);
+
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int failures = 0;
+    int opt;
+    int i;
+
+    memset(&g_scan_plan, 0, sizeof(g_scan_plan));
+    g_scan_plan.debounce_mode = MATRIX_DEBOUNCE_MODE_EAGER;
+    g_scan_plan.debounce_time_press = 5;
+    g_scan_plan.debounce_time_release = 5;
+    g_scan_plan.trigger_time_press = 0;
+    g_scan_plan.trigger_time_release = 2;
+    g_scan_plan.scan_idle_time = 20;
+
+    while ((opt = getopt(argc, argv, "m:s:p:r:P:R:i:vh")) != -1) {
+        switch (opt) {
+            case 'm': {
+                const int mode = parse_mode(optarg);
+                if (mode < 0) {
+                    fprintf(stderr, "Unknown debounce mode '%s'\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                g_scan_plan.debounce_mode = mode;
+            } break;
+            case 's': s_scan_period_us = strtoul(optarg, NULL, 0); break;
+            case 'p': g_scan_plan.debounce_time_press = strtoul(optarg, NULL, 0); break;
+            case 'r': g_scan_plan.debounce_time_release = strtoul(optarg, NULL, 0); break;
+            case 'P': g_scan_plan.trigger_time_press = strtoul(optarg, NULL, 0); break;
+            case 'R': g_scan_plan.trigger_time_release = strtoul(optarg, NULL, 0); break;
+            case 'i': g_scan_plan.scan_idle_time = strtoul(optarg, NULL, 0); break;
+            case 'v': s_verbose = true; break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || s_scan_period_us == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("mode: %s, scan period: %u us, debounce: %u/%u ms, trigger: %u/%u ms, idle time: %u ms\n\n",
+        s_mode_names[g_scan_plan.debounce_mode],
+        s_scan_period_us,
+        g_scan_plan.debounce_time_press,
+        g_scan_plan.debounce_time_release,
+        g_scan_plan.trigger_time_press,
+        g_scan_plan.trigger_time_release,
+        g_scan_plan.scan_idle_time
+    );
+
+    for (i = optind; i < argc; ++i) {
+        if (load_scenario(argv[i], &s_scenario) != 0 || !simulate(argv[i])) {
+            failures++;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
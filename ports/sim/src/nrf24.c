@@ -0,0 +1,530 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file nrf24.c
+///
+/// A simulated nRF24L01+ on the end of the SPI bus. It decodes the SPI
+/// commands sent by `core/nrf24.c` and keeps the registers, the RX FIFO and
+/// the ACK payloads like the real chip, so that `core/rf.c` can run unchanged.
+/// Packets arrive from the harness through `sim_nrf24_receive()`.
+
+#include "core/hardware.h"
+
+#include <string.h>
+
+#include "core/nrf24.h"
+#include "core/rf.h"
+#include "core/settings.h"
+
+#include "port_impl/sim_nrf24.h"
+
+#define NRF24_REGISTER_COUNT 0x20
+#define STATUS_FLAGS_MASK (STATUS_RX_DR_bm | STATUS_TX_DS_bm | STATUS_MAX_RT_bm)
+
+typedef struct fifo_entry_t {
+    uint8_t pipe;
+    uint8_t width;
+    /// ACK payloads only: the payload has been sent in an ACK, and is removed
+    /// when the next new packet arrives on its pipe
+    bool is_sent;
+    uint8_t payload[MAX_PAYLOAD_LENGTH];
+} fifo_entry_t;
+
+typedef struct fifo_t {
+    fifo_entry_t entries[SIM_NRF24_FIFO_SIZE];
+    uint8_t len;
+} fifo_t;
+
+/// The last packet received on a pipe, used to detect retransmissions
+typedef struct last_packet_t {
+    bool is_valid;
+    uint8_t pid;
+    uint8_t width;
+    uint8_t payload[MAX_PAYLOAD_LENGTH];
+} last_packet_t;
+
+sim_nrf24_stats_t g_sim_nrf24_stats;
+
+static uint8_t s_regs[NRF24_REGISTER_COUNT];
+static uint8_t s_rx_addr_p0[NRF_ADDR_LEN];
+static uint8_t s_rx_addr_p1[NRF_ADDR_LEN];
+static uint8_t s_tx_addr[NRF_ADDR_LEN];
+
+static fifo_t s_rx_fifo;
+static fifo_t s_tx_fifo;
+static last_packet_t s_last_packet[NRF24_NUMBER_PIPES];
+
+static bool s_is_initialized;
+static bool s_ce;
+
+static bool s_csn_active;
+static uint8_t s_cmd;
+static uint8_t s_byte_count;
+static uint8_t s_write_buf[MAX_PAYLOAD_LENGTH];
+
+static bool s_irq_enabled;
+static bool s_in_isr;
+
+/*********************************************************************
+ *                          fifo functions                           *
+ *********************************************************************/
+
+static void fifo_pop(fifo_t *fifo, uint8_t pos) {
+    fifo->len--;
+    memmove(
+        &fifo->entries[pos],
+        &fifo->entries[pos+1],
+        (fifo->len - pos) * sizeof(fifo_entry_t)
+    );
+}
+
+static bool fifo_push(fifo_t *fifo, uint8_t pipe, const uint8_t *data, uint8_t width) {
+    fifo_entry_t *entry;
+
+    if (fifo->len == SIM_NRF24_FIFO_SIZE) {
+        return false;
+    }
+
+    entry = &fifo->entries[fifo->len++];
+    entry->pipe = pipe;
+    entry->width = width;
+    entry->is_sent = false;
+    memcpy(entry->payload, data, width);
+    return true;
+}
+
+/// Find the first ACK payload queued for `pipe`
+static fifo_entry_t *find_ack_payload(uint8_t pipe, uint8_t *pos) {
+    uint8_t i;
+    for (i = 0; i < s_tx_fifo.len; ++i) {
+        if (s_tx_fifo.entries[i].pipe == pipe) {
+            *pos = i;
+            return &s_tx_fifo.entries[i];
+        }
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ *                         register access                           *
+ *********************************************************************/
+
+static uint8_t get_status(void) {
+    uint8_t status = s_regs[NRF_STATUS] & STATUS_FLAGS_MASK;
+
+    if (s_rx_fifo.len) {
+        status |= s_rx_fifo.entries[0].pipe << STATUS_RX_P_NO;
+    } else {
+        status |= STATUS_RX_FIFO_EMPTY << STATUS_RX_P_NO;
+    }
+
+    if (s_tx_fifo.len == SIM_NRF24_FIFO_SIZE) {
+        status |= STATUS_TX_FULL_bm;
+    }
+
+    return status;
+}
+
+static uint8_t get_fifo_status(void) {
+    uint8_t fifo_status = 0;
+
+    if (s_tx_fifo.len == SIM_NRF24_FIFO_SIZE) {
+        fifo_status |= FIFO_TX_FULL_bm;
+    } else if (s_tx_fifo.len == 0) {
+        fifo_status |= FIFO_TX_EMPTY_bm;
+    }
+
+    if (s_rx_fifo.len == SIM_NRF24_FIFO_SIZE) {
+        fifo_status |= FIFO_RX_FULL_bm;
+    } else if (s_rx_fifo.len == 0) {
+        fifo_status |= FIFO_RX_EMPTY_bm;
+    }
+
+    return fifo_status;
+}
+
+static uint8_t *get_addr_reg(uint8_t reg) {
+    switch (reg) {
+        case RX_ADDR_P0: return s_rx_addr_p0;
+        case RX_ADDR_P1: return s_rx_addr_p1;
+        case TX_ADDR: return s_tx_addr;
+        default: return NULL;
+    }
+}
+
+/// Read byte `i` of a register
+static uint8_t read_reg_byte(uint8_t reg, uint8_t i) {
+    uint8_t *addr = get_addr_reg(reg);
+
+    if (addr) {
+        return (i < NRF_ADDR_LEN) ? addr[i] : 0;
+    } else if (i != 0) {
+        return 0;
+    }
+
+    switch (reg) {
+        case NRF_STATUS: return get_status();
+        case FIFO_STATUS: return get_fifo_status();
+        default: return s_regs[reg];
+    }
+}
+
+/// Write byte `i` of a register
+static void write_reg_byte(uint8_t reg, uint8_t i, uint8_t val) {
+    uint8_t *addr = get_addr_reg(reg);
+
+    if (addr) {
+        if (i < NRF_ADDR_LEN) {
+            addr[i] = val;
+        }
+        return;
+    } else if (i != 0) {
+        return;
+    }
+
+    switch (reg) {
+        case NRF_STATUS: {
+            // interrupt flags are cleared by writing 1 to them
+            s_regs[NRF_STATUS] &= ~(val & STATUS_FLAGS_MASK);
+        } break;
+
+        case OBSERVE_TX:
+        case RPD:
+        case FIFO_STATUS: {
+            // read only
+        } break;
+
+        default: {
+            s_regs[reg] = val;
+        } break;
+    }
+}
+
+/*********************************************************************
+ *                         interrupt handling                        *
+ *********************************************************************/
+
+/// The IRQ pin is active while an unmasked interrupt flag is set
+static bool is_irq_asserted(void) {
+    // The mask bits in CONFIG line up with the flags in STATUS
+    return (s_regs[NRF_STATUS] & ~s_regs[CONFIG] & STATUS_FLAGS_MASK) != 0;
+}
+
+static void check_irq(void) {
+    if (s_irq_enabled && !s_in_isr && is_irq_asserted()) {
+        s_in_isr = true;
+        rf_isr();
+        s_in_isr = false;
+    }
+}
+
+void rf_init_receive_irq(void) {
+    s_irq_enabled = false;
+}
+
+void rf_enable_receive_irq(void) {
+    s_irq_enabled = true;
+    // The interrupt is level triggered, so it fires straight away if a
+    // packet arrived while it was disabled.
+    check_irq();
+}
+
+void rf_disable_receive_irq(void) {
+    s_irq_enabled = false;
+}
+
+uint8_t nrf24_irq(void) {
+    // active low
+    return !is_irq_asserted();
+}
+
+/*********************************************************************
+ *                          SPI interface                            *
+ *********************************************************************/
+
+/// Run a command when CSN goes high at the end of an SPI transaction
+static void finish_command(void) {
+    const uint8_t data_len = (s_byte_count > 0) ? s_byte_count - 1 : 0;
+
+    if (s_byte_count == 0) {
+        return;
+    }
+
+    if ((s_cmd & ~0x07) == W_ACK_PAYLOAD) {
+        fifo_push(&s_tx_fifo, s_cmd & 0x07, s_write_buf, data_len);
+        return;
+    }
+
+    switch (s_cmd) {
+        case R_RX_PAYLOAD: {
+            if (s_rx_fifo.len) {
+                fifo_pop(&s_rx_fifo, 0);
+                g_sim_nrf24_stats.read++;
+            }
+        } break;
+
+        case W_TX_PAYLOAD:
+        case W_TX_PAYLOAD_NO_ACK: {
+            fifo_push(&s_tx_fifo, 0, s_write_buf, data_len);
+        } break;
+
+        case FLUSH_RX: {
+            g_sim_nrf24_stats.flushed += s_rx_fifo.len;
+            s_rx_fifo.len = 0;
+        } break;
+
+        case FLUSH_TX: {
+            s_tx_fifo.len = 0;
+        } break;
+
+        default: {
+        } break;
+    }
+}
+
+uint8_t nrf24_spi_send_byte(uint8_t byte) {
+    uint8_t i;
+
+    if (!s_csn_active) {
+        return 0xff;
+    }
+
+    if (s_byte_count == 0) {
+        s_cmd = byte;
+        s_byte_count = 1;
+        return get_status();
+    }
+
+    i = s_byte_count - 1;
+    if (s_byte_count < 0xff) {
+        s_byte_count++;
+    }
+
+    if (s_cmd < W_REGISTER) {
+        return read_reg_byte(s_cmd & REGISTER_MASK, i);
+    } else if (s_cmd < W_REGISTER + NRF24_REGISTER_COUNT) {
+        write_reg_byte(s_cmd & REGISTER_MASK, i, byte);
+        return 0;
+    }
+
+    switch (s_cmd) {
+        case R_RX_PAYLOAD: {
+            if (s_rx_fifo.len && i < s_rx_fifo.entries[0].width) {
+                return s_rx_fifo.entries[0].payload[i];
+            }
+        } break;
+
+        case R_RX_PL_WID: {
+            if (s_rx_fifo.len) {
+                return s_rx_fifo.entries[0].width;
+            }
+        } break;
+
+        default: {
+            if (i < MAX_PAYLOAD_LENGTH) {
+                s_write_buf[i] = byte;
+            }
+        } break;
+    }
+
+    return 0;
+}
+
+void nrf24_csn(uint8_t val) {
+    if (val) {
+        if (s_csn_active) {
+            finish_command();
+        }
+        s_csn_active = false;
+    } else {
+        s_csn_active = true;
+        s_byte_count = 0;
+    }
+}
+
+void nrf24_ce(uint8_t val) {
+    s_ce = val;
+}
+
+void nrf24_init(void) {
+    if (s_is_initialized || g_runtime_settings.feature.ctrl.rf_disabled) {
+        return;
+    }
+    s_is_initialized = true;
+    s_ce = false;
+}
+
+void nrf24_disable(void) {
+    if (s_is_initialized) {
+        nrf24_power_set(0);
+        s_is_initialized = false;
+    }
+}
+
+/*********************************************************************
+ *                        simulator interface                        *
+ *********************************************************************/
+
+void sim_nrf24_reset(void) {
+    static const uint8_t s_reset_rx_addr_p0[NRF_ADDR_LEN] = { 0xe7, 0xe7, 0xe7, 0xe7, 0xe7 };
+    static const uint8_t s_reset_rx_addr_p1[NRF_ADDR_LEN] = { 0xc2, 0xc2, 0xc2, 0xc2, 0xc2 };
+
+    memset(s_regs, 0, sizeof(s_regs));
+    s_regs[CONFIG] = EN_CRC_bm;
+    s_regs[EN_AA] = 0x3f;
+    s_regs[EN_RXADDR] = 0x03;
+    s_regs[SETUP_AW] = 0x03;
+    s_regs[SETUP_RETR] = 0x03;
+    s_regs[RF_CH] = 0x02;
+    s_regs[RF_SETUP] = 0x0e;
+    s_regs[RX_ADDR_P2] = 0xc3;
+    s_regs[RX_ADDR_P3] = 0xc4;
+    s_regs[RX_ADDR_P4] = 0xc5;
+    s_regs[RX_ADDR_P5] = 0xc6;
+    memcpy(s_rx_addr_p0, s_reset_rx_addr_p0, NRF_ADDR_LEN);
+    memcpy(s_rx_addr_p1, s_reset_rx_addr_p1, NRF_ADDR_LEN);
+    memcpy(s_tx_addr, s_reset_rx_addr_p0, NRF_ADDR_LEN);
+
+    s_rx_fifo.len = 0;
+    s_tx_fifo.len = 0;
+    memset(s_last_packet, 0, sizeof(s_last_packet));
+    memset(&g_sim_nrf24_stats, 0, sizeof(g_sim_nrf24_stats));
+
+    s_is_initialized = false;
+    s_ce = false;
+    s_csn_active = false;
+    s_irq_enabled = false;
+    s_in_isr = false;
+}
+
+bool sim_nrf24_is_listening(void) {
+    const uint8_t config = s_regs[CONFIG];
+    return s_ce && (config & PWR_UP_bm) && (config & PRIM_RX_bm);
+}
+
+uint8_t sim_nrf24_rx_fifo_len(void) {
+    return s_rx_fifo.len;
+}
+
+/// Find the pipe that listens on `addr`
+///
+/// @return the pipe number, or `STATUS_RX_FIFO_EMPTY` if no pipe matches
+static uint8_t match_pipe(const uint8_t *addr) {
+    const uint8_t addr_width = (s_regs[SETUP_AW] & 0x03) + 2;
+    uint8_t pipe;
+
+    if (addr_width < 3) {
+        return STATUS_RX_FIFO_EMPTY;
+    }
+
+    for (pipe = 0; pipe < NRF24_NUMBER_PIPES; ++pipe) {
+        if (!(s_regs[EN_RXADDR] & (1 << pipe))) {
+            continue;
+        }
+
+        if (pipe == 0) {
+            if (memcmp(addr, s_rx_addr_p0, addr_width) == 0) {
+                return pipe;
+            }
+        } else if (pipe == 1) {
+            if (memcmp(addr, s_rx_addr_p1, addr_width) == 0) {
+                return pipe;
+            }
+        } else {
+            // pipes P2-P5 share the upper bytes of P1, the least significant
+            // byte is sent first
+            if (addr[0] == s_regs[RX_ADDR_P0 + pipe] &&
+                    memcmp(addr+1, s_rx_addr_p1+1, addr_width-1) == 0) {
+                return pipe;
+            }
+        }
+    }
+
+    return STATUS_RX_FIFO_EMPTY;
+}
+
+static void load_ack(uint8_t pipe, sim_nrf24_ack_t *ack) {
+    fifo_entry_t *entry;
+    uint8_t pos;
+
+    if (!(s_regs[EN_AA] & (1 << pipe))) {
+        return;
+    }
+
+    ack->is_acked = true;
+
+    if (!(s_regs[FEATURE] & EN_ACK_PAY_bm)) {
+        return;
+    }
+
+    entry = find_ack_payload(pipe, &pos);
+    if (entry) {
+        entry->is_sent = true;
+        ack->width = entry->width;
+        memcpy(ack->payload, entry->payload, entry->width);
+        g_sim_nrf24_stats.ack_payloads++;
+    }
+}
+
+void sim_nrf24_receive(
+    uint8_t channel,
+    const uint8_t *addr,
+    uint8_t pid,
+    const uint8_t *payload,
+    uint8_t width,
+    sim_nrf24_ack_t *ack
+) {
+    uint8_t pipe;
+    last_packet_t *last;
+    fifo_entry_t *sent_payload;
+    uint8_t pos;
+
+    ack->is_acked = false;
+    ack->width = 0;
+
+    if (!sim_nrf24_is_listening() || channel != s_regs[RF_CH] || width > MAX_PAYLOAD_LENGTH) {
+        return;
+    }
+
+    pipe = match_pipe(addr);
+    if (pipe == STATUS_RX_FIFO_EMPTY) {
+        return;
+    }
+
+    // only dynamic payload lengths are simulated
+    if (!(s_regs[FEATURE] & EN_DPL_bm) || !(s_regs[DYNPD] & (1 << pipe))) {
+        return;
+    }
+
+    // A retransmission of the last packet is acknowledged again, with the
+    // same ACK payload, but it isn't stored.
+    last = &s_last_packet[pipe];
+    if (last->is_valid && last->pid == pid && last->width == width &&
+            memcmp(last->payload, payload, width) == 0) {
+        g_sim_nrf24_stats.duplicates++;
+        load_ack(pipe, ack);
+        return;
+    }
+
+    // A new packet on the pipe means the last ACK payload was received
+    sent_payload = find_ack_payload(pipe, &pos);
+    if (sent_payload && sent_payload->is_sent) {
+        fifo_pop(&s_tx_fifo, pos);
+    }
+
+    if (!fifo_push(&s_rx_fifo, pipe, payload, width)) {
+        g_sim_nrf24_stats.rx_fifo_full++;
+        return;
+    }
+    g_sim_nrf24_stats.received++;
+
+    last->is_valid = true;
+    last->pid = pid;
+    last->width = width;
+    memcpy(last->payload, payload, width);
+
+    load_ack(pipe, ack);
+
+    s_regs[NRF_STATUS] |= STATUS_RX_DR_bm;
+    check_irq();
+}
@@ -0,0 +1,44 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define F_CPU 0
+
+#define enable_interrupts()
+#define disable_interrupts()
+
+#define static_delay_us(x) ((void)0)
+#define static_delay_ms(x) ((void)0)
+
+/// The simulated MCU has four 8 bit ports
+#define MCU_BITNESS 8
+#define IO_PORT_COUNT 4
+#define IO_PORT_MAX_PIN_NUM 31
+#define IO_MAP_GPIO_COUNT 32
+#define IO_USABLE_PINS { 0xff, 0xff, 0xff, 0xff }
+
+/// The simulated settings, see `g_sim_settings`
+extern uint8_t g_sim_settings[];
+
+#define SETTINGS_ADDR ((flash_addr_t)g_sim_settings)
+#define LAYOUT_ADDR (0)
+#define LAYOUT_SIZE (4096)
+
+#define PAGE_SIZE 4096
+
+/// A simulated GPIO port. Pins with a `DIR` bit set are outputs that drive
+/// their `OUT` level. Input pins have pull-up resistors, and `IN` is updated
+/// from the simulated switch matrix.
+typedef struct io_port_t {
+    uint8_t DIR;
+    uint8_t OUT;
+    uint8_t IN;
+} io_port_t;
+
+typedef size_t flash_addr_t;
+typedef size_t flash_size_t;
+typedef size_t flash_ptr_t;
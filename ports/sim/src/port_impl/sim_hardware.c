@@ -0,0 +1,81 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+#include "port_impl/sim_hardware.h"
+
+#include <stdio.h>
+
+#include "core/error.h"
+#include "core/flash.h"
+#include "core/io_map.h"
+#include "core/nonce.h"
+#include "core/settings.h"
+#include "core/timer.h"
+#include "core/usb_commands.h"
+
+uint32_t g_sim_time_us;
+uint8_t g_sim_flash[LAYOUT_SIZE];
+uint32_t g_sim_flash_reads;
+uint8_t g_sim_settings[sizeof(settings_t)];
+
+bit_t g_slow_clock_mode;
+
+// These are normally loaded from flash in `core/settings.c`
+XRAM rf_settings_t g_rf_settings;
+XRAM runtime_settings_t g_runtime_settings;
+
+static uint16_t s_session_id;
+
+io_port_t g_sim_ports[IO_PORT_COUNT];
+
+io_port_t * const g_io_port_map[IO_PORT_COUNT] = {
+    &g_sim_ports[0],
+    &g_sim_ports[1],
+    &g_sim_ports[2],
+    &g_sim_ports[3],
+};
+
+uint8_t timer_read8_ms(void) {
+    return g_sim_time_us / 1000;
+}
+
+uint16_t timer_read16_ms(void) {
+    return g_sim_time_us / 1000;
+}
+
+uint32_t timer_read_ms(void) {
+    return g_sim_time_us / 1000;
+}
+
+uint16_t load_session_id(void) {
+    return s_session_id;
+}
+
+uint16_t increment_session_id(void) {
+    return ++s_session_id;
+}
+
+uint8_t flash_read_byte(flash_addr_t addr) {
+    g_sim_flash_reads++;
+    return g_sim_flash[addr - LAYOUT_ADDR];
+}
+
+void register_error(uint8_t code) {
+    fprintf(stderr, "error: firmware registered error code %d\n", code);
+}
+
+bit_t has_critical_error(void) {
+    return false;
+}
+
+bit_t is_passthrough_enabled(void) {
+    return false;
+}
+
+void queue_vendor_in_packet(
+    uint8_t cmd,
+    const uint8_t *data,
+    uint8_t len,
+    bool is_variable_length
+) {
+}
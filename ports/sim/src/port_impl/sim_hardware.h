@@ -0,0 +1,24 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include <stdint.h>
+
+#include "port_impl/hardware.h"
+
+/// Simulated time in microseconds. The firmware timers are derived from it.
+extern uint32_t g_sim_time_us;
+
+/// Simulated flash memory, the layout data starts at `LAYOUT_ADDR`
+extern uint8_t g_sim_flash[LAYOUT_SIZE];
+
+/// Simulated settings storage, `GET_SETTING()` reads from here. Fill it in
+/// as a `settings_t` before starting the firmware modules that use it.
+extern uint8_t g_sim_settings[];
+
+/// Number of calls to `flash_read_byte()`, used to measure scan cost
+extern uint32_t g_sim_flash_reads;
+
+/// The simulated GPIO ports
+extern io_port_t g_sim_ports[IO_PORT_COUNT];
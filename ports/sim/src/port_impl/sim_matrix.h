@@ -0,0 +1,25 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Open every switch in the simulated matrix
+void sim_matrix_reset(void);
+
+/// Open or close the switch at `row` and `col` of the scan plan. In the pin
+/// modes the switch connects the column pin to ground, and `row` is ignored.
+void sim_matrix_set_switch(uint8_t row, uint8_t col, bool closed);
+
+/// Choose whether the switches have diodes (col -->|-- row).
+///
+/// Without diodes, current can flow backwards through closed switches, so
+/// three keys at the corners of a rectangle make the fourth corner read as
+/// pressed.
+void sim_matrix_set_diodes(bool has_diodes);
+
+/// True while the matrix interrupt is enabled, i.e. while `matrix_scan_task()`
+/// is waiting for a pin change instead of scanning
+bool sim_matrix_is_irq_enabled(void);
@@ -0,0 +1,68 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "core/rf.h"
+
+/// Depth of the RX and TX FIFOs in the nRF24L01+
+#define SIM_NRF24_FIFO_SIZE 3
+
+/// The acknowledgement the simulated receiver sends back for a packet
+typedef struct sim_nrf24_ack_t {
+    /// True if the receiver sent an ACK. Packets that arrive while the RX
+    /// FIFO is full are not acknowledged.
+    bool is_acked;
+    /// Length of the ACK payload, 0 for an empty ACK
+    uint8_t width;
+    uint8_t payload[MAX_PAYLOAD_LENGTH];
+} sim_nrf24_ack_t;
+
+/// Counters kept by the simulated nRF24
+typedef struct sim_nrf24_stats_t {
+    /// Packets stored in the RX FIFO
+    uint32_t received;
+    /// Retransmitted packets that were acknowledged but not stored again
+    uint32_t duplicates;
+    /// Packets that weren't acknowledged because the RX FIFO was full
+    uint32_t rx_fifo_full;
+    /// Packets thrown away by `FLUSH_RX` before the firmware read them
+    uint32_t flushed;
+    /// Packets read out of the RX FIFO by the firmware
+    uint32_t read;
+    /// ACK payloads sent, counting every retransmission of one
+    uint32_t ack_payloads;
+} sim_nrf24_stats_t;
+
+/// Power on the simulated nRF24 with its reset register values
+void sim_nrf24_reset(void);
+
+/// A packet arrives over the air on `channel` for the address `addr`.
+///
+/// The packet is matched against the pipe addresses like the real chip does,
+/// so it is only received if the firmware configured the radio to listen for
+/// it. `pid` is the 2 bit ESB packet id, which the chip uses to spot
+/// retransmitted packets. If the packet is received, the chip's IRQ line is
+/// raised, and `rf_isr()` runs at once when the firmware has the receive
+/// interrupt enabled.
+///
+/// @param ack Filled in with the ACK sent back to the transmitter
+void sim_nrf24_receive(
+    uint8_t channel,
+    const uint8_t *addr,
+    uint8_t pid,
+    const uint8_t *payload,
+    uint8_t width,
+    sim_nrf24_ack_t *ack
+);
+
+/// True if the firmware has powered up the radio in receive mode
+bool sim_nrf24_is_listening(void);
+
+/// Number of packets waiting in the RX FIFO
+uint8_t sim_nrf24_rx_fifo_len(void);
+
+extern sim_nrf24_stats_t g_sim_nrf24_stats;
@@ -0,0 +1,719 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file power_sim.c
+///
+/// An energy model of a wireless keyboard. A simulated user types on the
+/// simulated switch matrix, and a copy of the battery mode main loop of the
+/// xmega port runs the core scanner and `core/power_manager.c` on it once per
+/// 1ms timer tick. The nRF24 transmitter is modelled at the level of its ESB
+/// attempts: each attempt is on the air for the time its packet takes at
+/// 2Mbps, then waits for the ACK, and a packet that isn't acknowledged
+/// after the automatic retransmit count raises MAX_RT like the real chip.
+///
+/// The program adds up the charge drawn by the MCU and the radio in each of
+/// their states, using the currents in the table below, and estimates the
+/// battery life for a number of hours of typing per day. The keyboard is
+/// assumed to spend the rest of the day in deep sleep.
+///
+/// The receiver isn't modelled, every acknowledged packet counts as
+/// delivered. `rf_sim` covers the wireless protocol.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/io_map.h"
+#include "core/layout.h"
+#include "core/matrix_scanner.h"
+#include "core/power_manager.h"
+#include "core/settings.h"
+#include "core/timer.h"
+
+#include "port_impl/sim_hardware.h"
+#include "port_impl/sim_matrix.h"
+
+/// Size of the simulated keyboard matrix
+#define ROWS 6
+#define COLS 16
+#define NUM_KEYS (ROWS * COLS)
+/// First pin used for the columns, the rows use the pins before it
+#define FIRST_COL_PIN 8
+
+/// The timer tick that wakes up the main loop
+#define TICK_US 1000
+
+/// The same as `MAX_RETRY_COUNT` in the xmega battery mode loop
+#define MAX_RETRY_COUNT 10
+
+/// Shortest and longest time a key is held down
+#define MIN_HOLD_TIME_US 40000
+#define MAX_HOLD_TIME_US 160000
+/// Shortest and longest time a long hold lasts, e.g. a held arrow key
+#define MIN_LONG_HOLD_TIME_US 500000
+#define MAX_LONG_HOLD_TIME_US 3000000
+
+// ESB timing at 2Mbps, the same as in `rf_sim`
+#define TX_SETTLE_US 130
+#define US_PER_BYTE 4
+#define ESB_OVERHEAD_BYTES (1 + 5 + 2 + 2)
+#define ESB_AIR_TIME_US(width) (((width) + ESB_OVERHEAD_BYTES) * US_PER_BYTE)
+#define PACKET_WIDTH 32
+/// The receiver's ACK payloads aren't modelled, so the ACKs are empty
+#define ACK_WIDTH 0
+#define ARD_US 500
+#define RETRANSMIT_COUNT 15
+/// How long the radio listens for an ACK before it gives up on an attempt
+#define ACK_TIMEOUT_US 250
+/// Time for the radio to start up after it is powered on
+#define RADIO_STARTUP_US 1500
+
+/// Shortest and longest burst of interference, e.g. from WiFi
+#define MIN_BURST_US 2000
+#define MAX_BURST_US 20000
+
+/// Depth of the nRF24 TX FIFO
+#define TX_FIFO_SIZE 3
+
+// Currents in uA, for an ATxmega A4U at 12MHz and an nRF24L01+ at 0dBm,
+// both at 3V. Change them to match a different board.
+#define MCU_RUN_UA 4000.0
+#define MCU_POWER_SAVE_UA 2.0
+#define MCU_POWER_DOWN_UA 0.5
+#define RADIO_TX_UA 11300.0
+#define RADIO_RX_UA 13500.0
+#define RADIO_STANDBY_UA 26.0
+#define RADIO_POWER_DOWN_UA 0.9
+
+// Time the MCU is running for each part of the main loop, in us
+/// reading the radio status registers on every tick
+#define LOOP_US 20
+/// scanning one row of the matrix
+#define SCAN_ROW_US 6
+/// building and encrypting a matrix packet
+#define PACKET_US 100
+
+typedef enum charge_type_t {
+    CHARGE_MCU_RUN,
+    CHARGE_MCU_POWER_SAVE,
+    CHARGE_RADIO_TX,
+    CHARGE_RADIO_RX,
+    CHARGE_RADIO_STANDBY,
+    CHARGE_DEEP_SLEEP,
+    CHARGE_TYPE_COUNT,
+} charge_type_t;
+
+typedef struct latency_t {
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+} latency_t;
+
+typedef struct results_t {
+    /// Charge drawn in uA*us
+    double charge[CHARGE_TYPE_COUNT];
+    /// Time spent in each `power_state_t` in ms
+    uint32_t state_time[3];
+    latency_t press_latency;
+    uint32_t keystrokes;
+    uint32_t scans;
+    uint32_t wakeups;
+    uint32_t packets;
+    uint32_t resync_packets;
+    uint32_t attempts;
+    uint32_t max_rt;
+    uint32_t backoffs;
+    uint32_t dropped;
+    uint32_t tx_fifo_full;
+} results_t;
+
+/// The simulated nRF24 transmitter
+typedef struct radio_t {
+    bool is_sending;
+    bool is_delivered;
+    bool is_max_rt;
+    /// Time the current packet is acknowledged, or reaches MAX_RT
+    uint32_t done_time;
+    uint8_t tx_len;
+    /// For each packet in the TX FIFO, the keys it reports as newly pressed
+    uint8_t presses[TX_FIFO_SIZE][KEY_NUMBER_BITMAP_SIZE];
+} radio_t;
+
+static const char *s_charge_names[] = {
+    [CHARGE_MCU_RUN] = "MCU running",
+    [CHARGE_MCU_POWER_SAVE] = "MCU power save",
+    [CHARGE_RADIO_TX] = "radio TX",
+    [CHARGE_RADIO_RX] = "radio RX",
+    [CHARGE_RADIO_STANDBY] = "radio standby",
+    [CHARGE_DEEP_SLEEP] = "deep sleep",
+};
+
+static const char *s_state_names[] = {
+    [POWER_STATE_ACTIVE] = "active",
+    [POWER_STATE_IDLE] = "idle",
+    [POWER_STATE_SLEEP] = "sleep",
+};
+
+static results_t s_results;
+static radio_t s_radio;
+
+/// Time each key that is down will be released, 0 for keys that are up
+static uint32_t s_release_at[NUM_KEYS];
+static uint32_t s_press_time[NUM_KEYS];
+static uint32_t s_next_keystroke;
+
+static uint32_t s_typing_time_us = 60000000;
+static uint32_t s_keystroke_interval_us = 150000;
+static double s_pause_percent = 5;
+static uint32_t s_max_pause_us = 10000000;
+static double s_long_hold_percent = 2;
+static double s_loss_percent = 0;
+static double s_busy_percent = 0;
+static bool s_receiver_off = false;
+/// The next burst of interference
+static uint32_t s_burst_start;
+static uint32_t s_burst_end;
+static double s_hours_per_day = 4;
+static double s_battery_mah = 1000;
+static uint32_t s_rand_state = 1;
+/// The interference has its own random numbers, so that the typing is the
+/// same with and without it
+static uint32_t s_air_rand_state;
+static bool s_verbose = false;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\n"
+        "  -d S     how long to type for in seconds (default: 60)\n"
+        "  -k MS    average time between keystrokes (default: 150)\n"
+        "  -p PCT   chance of a pause after a keystroke (default: 5)\n"
+        "  -P S     longest pause in seconds (default: 10)\n"
+        "  -L PCT   chance that a key is held down for 0.5-3 s (default: 2)\n"
+        "  -l PCT   chance that a packet or ACK is lost (default: 0)\n"
+        "  -j PCT   share of the time the channel is busy with bursts of\n"
+        "           interference (default: 0)\n"
+        "  -x       the receiver is switched off, every packet is lost\n"
+        "  -i NUM   power_idle_time setting, units of 10ms (default: 0)\n"
+        "  -z NUM   power_sleep_time setting, seconds (default: 0)\n"
+        "  -r NUM   power_idle_scan_interval setting, ms (default: 0)\n"
+        "  -b NUM   power_max_backoff setting, ms (default: 0)\n"
+        "  -u H     hours of typing per day (default: 4)\n"
+        "  -c MAH   battery capacity in mAh (default: 1000)\n"
+        "  -s SEED  random seed (default: 1)\n"
+        "  -v       print every power state change\n",
+        name
+    );
+}
+
+/*********************************************************************
+ *                          random numbers                           *
+ *********************************************************************/
+
+/// xorshift32, so that runs are the same on every machine
+static uint32_t random_u32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/// A random number in [`low`, `high`]
+static uint32_t random_range(uint32_t *state, uint32_t low, uint32_t high) {
+    return low + random_u32(state) % (high - low + 1);
+}
+
+static bool random_chance(uint32_t *state, double percent) {
+    return percent > 0 && (random_u32(state) % 1000000) < percent * 10000;
+}
+
+/*********************************************************************
+ *                              energy                               *
+ *********************************************************************/
+
+static void add_charge(charge_type_t type, double current_ua, uint32_t time_us) {
+    s_results.charge[type] += current_ua * time_us;
+}
+
+static double get_total_charge(void) {
+    double total = 0;
+    uint8_t i;
+    for (i = 0; i < CHARGE_TYPE_COUNT; ++i) {
+        total += s_results.charge[i];
+    }
+    return total;
+}
+
+static void add_latency(latency_t *latency, uint32_t delay) {
+    latency->count++;
+    latency->total += delay;
+    if (delay > latency->max) {
+        latency->max = delay;
+    }
+}
+
+/*********************************************************************
+ *                              typist                               *
+ *********************************************************************/
+
+static void setup_matrix(void) {
+    const uint8_t max_col_pin_num = FIRST_COL_PIN + COLS - 1;
+    uint8_t row, col;
+
+    memset(g_sim_flash, INVALID_KEY_NUMBER, sizeof(g_sim_flash));
+
+    for (row = 0; row < ROWS; ++row) {
+        g_sim_flash[LAYOUT_PORT_ROW_PINS_ADDR - LAYOUT_ADDR + row] = row;
+    }
+
+    for (col = 0; col < COLS; ++col) {
+        const uint8_t col_pin = FIRST_COL_PIN + col;
+        g_sim_flash[LAYOUT_PORT_COL_PINS_ADDR - LAYOUT_ADDR + col] = col_pin;
+        for (row = 0; row < ROWS; ++row) {
+            g_sim_flash[
+                LAYOUT_PORT_KEY_NUM_MAP_ADDR - LAYOUT_ADDR +
+                row*(max_col_pin_num+1) + col_pin
+            ] = row * COLS + col;
+        }
+    }
+
+    memset(&g_scan_plan, 0, sizeof(g_scan_plan));
+    g_scan_plan.mode = MATRIX_SCANNER_MODE_COL_ROW;
+    g_scan_plan.rows = ROWS;
+    g_scan_plan.cols = COLS;
+    g_scan_plan.max_col_pin_num = max_col_pin_num;
+    g_scan_plan.max_key_num = NUM_KEYS - 1;
+    g_scan_plan.debounce_mode = MATRIX_DEBOUNCE_MODE_EAGER;
+    g_scan_plan.debounce_time_press = 5;
+    g_scan_plan.debounce_time_release = 5;
+    g_scan_plan.trigger_time_release = 2;
+
+    g_sim_time_us = 0;
+    io_map_init();
+    matrix_scanner_init();
+    sim_matrix_reset();
+}
+
+/// Press and release keys like a person typing, with the odd pause and the
+/// odd key held down for a long time
+static void type_keys(void) {
+    uint8_t key_num;
+
+    for (key_num = 0; key_num < NUM_KEYS; ++key_num) {
+        if (s_release_at[key_num] && g_sim_time_us >= s_release_at[key_num]) {
+            sim_matrix_set_switch(key_num / COLS, key_num % COLS, false);
+            s_release_at[key_num] = 0;
+        }
+    }
+
+    if (g_sim_time_us < s_next_keystroke || g_sim_time_us >= s_typing_time_us) {
+        return;
+    }
+
+    key_num = random_range(&s_rand_state, 0, NUM_KEYS - 1);
+    if (!s_release_at[key_num]) {
+        const bool is_long = random_chance(&s_rand_state, s_long_hold_percent);
+        s_release_at[key_num] = g_sim_time_us + (is_long ?
+            random_range(&s_rand_state, MIN_LONG_HOLD_TIME_US, MAX_LONG_HOLD_TIME_US) :
+            random_range(&s_rand_state, MIN_HOLD_TIME_US, MAX_HOLD_TIME_US));
+        s_press_time[key_num] = g_sim_time_us;
+        sim_matrix_set_switch(key_num / COLS, key_num % COLS, true);
+        s_results.keystrokes++;
+    }
+
+    s_next_keystroke = g_sim_time_us +
+        random_range(&s_rand_state, s_keystroke_interval_us / 2, s_keystroke_interval_us * 3 / 2);
+    if (random_chance(&s_rand_state, s_pause_percent)) {
+        s_next_keystroke += random_range(&s_rand_state, s_max_pause_us / 10, s_max_pause_us);
+    }
+}
+
+/*********************************************************************
+ *                               radio                               *
+ *********************************************************************/
+
+/// Check if a burst of interference is on the air at `time`. The times
+/// asked about only go forwards, so the bursts are made up as they are
+/// needed, with gaps that keep the channel busy for `s_busy_percent` of the
+/// time.
+static bool is_busy(uint32_t time) {
+    const uint32_t mean_burst = (MIN_BURST_US + MAX_BURST_US) / 2;
+
+    if (s_busy_percent <= 0) {
+        return false;
+    }
+
+    while (time >= s_burst_end) {
+        const uint32_t mean_gap = mean_burst * (100 - s_busy_percent) / s_busy_percent;
+        s_burst_start = s_burst_end + random_range(&s_air_rand_state, 0, 2 * mean_gap);
+        s_burst_end = s_burst_start + random_range(&s_air_rand_state, MIN_BURST_US, MAX_BURST_US);
+    }
+
+    return time >= s_burst_start;
+}
+
+static bool is_lost(uint32_t time) {
+    return s_receiver_off || is_busy(time) || random_chance(&s_air_rand_state, s_loss_percent);
+}
+
+/// Pulse CE, the radio sends the packet at the front of its TX FIFO with up
+/// to `RETRANSMIT_COUNT` retransmits. The whole sequence of attempts is worked out at
+/// once, and its result shows up in the status flags at `done_time`.
+static void radio_send_one(void) {
+    uint32_t time_us = 0;
+    uint8_t attempt;
+
+    s_radio.is_sending = true;
+    s_radio.is_delivered = false;
+
+    for (attempt = 0; attempt <= RETRANSMIT_COUNT; ++attempt) {
+        const uint32_t start = g_sim_time_us + time_us;
+
+        add_charge(CHARGE_RADIO_TX, RADIO_TX_UA, TX_SETTLE_US + ESB_AIR_TIME_US(PACKET_WIDTH));
+        time_us += TX_SETTLE_US + ESB_AIR_TIME_US(PACKET_WIDTH);
+        s_results.attempts++;
+
+        if (!is_lost(start) && !is_lost(g_sim_time_us + time_us)) {
+            // the packet and its ACK both got through
+            add_charge(CHARGE_RADIO_RX, RADIO_RX_UA, TX_SETTLE_US + ESB_AIR_TIME_US(ACK_WIDTH));
+            time_us += TX_SETTLE_US + ESB_AIR_TIME_US(ACK_WIDTH);
+            s_radio.is_delivered = true;
+            break;
+        }
+
+        add_charge(CHARGE_RADIO_RX, RADIO_RX_UA, ACK_TIMEOUT_US);
+        time_us += ARD_US;
+    }
+
+    s_radio.done_time = g_sim_time_us + time_us;
+}
+
+/// Check if the radio has finished with the packet it was sending
+static void radio_update(void) {
+    uint8_t key_num;
+
+    if (!s_radio.is_sending || g_sim_time_us < s_radio.done_time) {
+        return;
+    }
+
+    s_radio.is_sending = false;
+
+    if (!s_radio.is_delivered) {
+        s_radio.is_max_rt = true;
+        s_results.max_rt++;
+        return;
+    }
+
+    for (key_num = 0; key_num < NUM_KEYS; ++key_num) {
+        if (bitmap_get_bit(s_radio.presses[0], key_num)) {
+            add_latency(
+                &s_results.press_latency,
+                s_radio.done_time - s_press_time[key_num]
+            );
+        }
+    }
+    s_radio.tx_len--;
+    memmove(
+        s_radio.presses[0],
+        s_radio.presses[1],
+        s_radio.tx_len * KEY_NUMBER_BITMAP_SIZE
+    );
+}
+
+static void radio_flush_tx(void) {
+    s_results.dropped += s_radio.tx_len;
+    s_radio.tx_len = 0;
+}
+
+/// The same as `rf_send_matrix_packet()`, the packet carries the presses
+/// the scanner registered since the last one
+static void send_matrix_packet(uint8_t *old_matrix) {
+    uint8_t presses[KEY_NUMBER_BITMAP_SIZE];
+    uint8_t i;
+
+    add_charge(CHARGE_MCU_RUN, MCU_RUN_UA, PACKET_US);
+
+    for (i = 0; i < KEY_NUMBER_BITMAP_SIZE; ++i) {
+        presses[i] = g_key_num_bitmap[i] & ~old_matrix[i];
+    }
+    memcpy(old_matrix, g_key_num_bitmap, KEY_NUMBER_BITMAP_SIZE);
+
+    if (s_radio.tx_len == TX_FIFO_SIZE) {
+        s_results.tx_fifo_full++;
+        return;
+    }
+    memcpy(s_radio.presses[s_radio.tx_len], presses, KEY_NUMBER_BITMAP_SIZE);
+    s_radio.tx_len++;
+    s_results.packets++;
+}
+
+/*********************************************************************
+ *                             main loop                             *
+ *********************************************************************/
+
+/// Run the typing session through the battery mode main loop. Each pass of
+/// the loop below is one timer tick.
+static void simulate(void) {
+    // leave time for the last keys to be released
+    const uint32_t end_time = s_typing_time_us + MAX_LONG_HOLD_TIME_US;
+    XRAM power_manager_t power;
+    uint8_t old_matrix[KEY_NUMBER_BITMAP_SIZE] = {0};
+    uint8_t err_count = 0;
+    uint8_t last_state = POWER_STATE_ACTIVE;
+    bool matrix_needs_scanning = true;
+    bool is_waiting_for_irq = false;
+    bool is_deep_sleeping = false;
+    bool deep_sleep_resync_packet = false;
+
+    setup_matrix();
+    power_manager_init(&power, timer_read16_ms());
+    // channel hopping isn't modelled, so there is no hop schedule to search
+    power.free_retries = 0;
+
+    for (; g_sim_time_us < end_time; g_sim_time_us += TICK_US) {
+        uint32_t run_us = LOOP_US;
+        uint16_t now = timer_read16_ms();
+        bool scan_changed = false;
+        uint8_t state;
+
+        type_keys();
+
+        if (is_deep_sleeping) {
+            if (!matrix_scan_irq_has_triggered()) {
+                add_charge(CHARGE_DEEP_SLEEP, MCU_POWER_DOWN_UA + RADIO_POWER_DOWN_UA, TICK_US);
+                s_results.state_time[POWER_STATE_SLEEP]++;
+                continue;
+            }
+            // the same as the end of `deep_sleep()`
+            matrix_scan_irq_disable();
+            add_charge(CHARGE_RADIO_STANDBY, RADIO_STANDBY_UA, RADIO_STARTUP_US);
+            is_deep_sleeping = false;
+            power_manager_activity(&power, now);
+            matrix_needs_scanning = true;
+            deep_sleep_resync_packet = true;
+            s_results.wakeups++;
+        } else if (is_waiting_for_irq) {
+            is_waiting_for_irq = false;
+            if (matrix_has_active_row()) {
+                matrix_needs_scanning = true;
+                matrix_scan_irq_disable();
+                power_manager_activity(&power, now);
+            } else {
+                matrix_needs_scanning = false;
+            }
+        }
+
+        if (
+            matrix_needs_scanning &&
+            (
+                get_matrix_num_keys_debouncing() != 0 ||
+                power_manager_should_scan(&power, now)
+            )
+        ) {
+            scan_changed = matrix_scan();
+            run_us += ROWS * SCAN_ROW_US;
+            s_results.scans++;
+        }
+
+        radio_update();
+
+        if (s_radio.is_max_rt) {
+            s_radio.is_max_rt = false;
+            err_count++;
+            if (err_count > MAX_RETRY_COUNT) {
+                radio_flush_tx();
+                err_count = 0;
+                power_manager_tx_done(&power);
+            } else {
+                power_manager_tx_failed(&power, now, err_count);
+                s_results.backoffs += (power.backoff_time != 0);
+            }
+        }
+
+        if (scan_changed) {
+            send_matrix_packet(old_matrix);
+            power_manager_activity(&power, now);
+            deep_sleep_resync_packet = false;
+        }
+
+        if (s_radio.tx_len == 0) {
+            err_count = 0;
+            power_manager_tx_done(&power);
+        } else if (!s_radio.is_sending && power_manager_tx_ready(&power, now)) {
+            radio_send_one();
+        }
+
+        state = power_manager_update(
+            &power,
+            now,
+            get_matrix_num_keys_down() == 0 &&
+            get_matrix_num_keys_debouncing() == 0 &&
+            !scan_changed &&
+            s_radio.tx_len == 0
+        );
+
+        if (s_verbose && state != last_state) {
+            printf("  %10.3f s: %s\n", g_sim_time_us / 1000000.0, s_state_names[state]);
+        }
+        last_state = state;
+        s_results.state_time[state]++;
+
+        add_charge(CHARGE_MCU_RUN, MCU_RUN_UA, run_us);
+        add_charge(CHARGE_MCU_POWER_SAVE, MCU_POWER_SAVE_UA, TICK_US - run_us);
+        add_charge(CHARGE_RADIO_STANDBY, RADIO_STANDBY_UA, TICK_US);
+
+        if (state == POWER_STATE_SLEEP) {
+            // the same as the start of `deep_sleep()`
+            matrix_scan_irq_enable();
+            is_deep_sleeping = true;
+        } else if (
+            get_matrix_num_keys_down() == 0 &&
+            get_matrix_num_keys_debouncing() == 0
+        ) {
+            // sleep until the next tick or a key press
+            matrix_scan_irq_enable();
+            is_waiting_for_irq = true;
+        } else {
+            matrix_needs_scanning = true;
+        }
+
+        if (state != POWER_STATE_SLEEP && deep_sleep_resync_packet) {
+            send_matrix_packet(old_matrix);
+            deep_sleep_resync_packet = false;
+            s_results.resync_packets++;
+        }
+    }
+}
+
+static void print_results(void) {
+    const double session_s = g_sim_time_us / 1000000.0;
+    const double total_uc = get_total_charge() / 1000000.0;
+    const double typing_ua = total_uc / session_s;
+    const double asleep_ua = MCU_POWER_DOWN_UA + RADIO_POWER_DOWN_UA;
+    const double mah_per_day =
+        (typing_ua * s_hours_per_day + asleep_ua * (24 - s_hours_per_day)) / 1000;
+    const results_t *results = &s_results;
+    uint8_t i;
+
+    printf("  keystrokes: %u, presses delivered: %u\n",
+        results->keystrokes,
+        results->press_latency.count
+    );
+    if (results->press_latency.count) {
+        printf("  press latency: avg %.2f ms, max %.2f ms\n",
+            results->press_latency.total / 1000.0 / results->press_latency.count,
+            results->press_latency.max / 1000.0
+        );
+    }
+    printf("  time: %.1f s, %.1f%% active, %.1f%% idle, %.1f%% sleep, %u wakeups\n",
+        session_s,
+        results->state_time[POWER_STATE_ACTIVE] * 100.0 / (g_sim_time_us / TICK_US),
+        results->state_time[POWER_STATE_IDLE] * 100.0 / (g_sim_time_us / TICK_US),
+        results->state_time[POWER_STATE_SLEEP] * 100.0 / (g_sim_time_us / TICK_US),
+        results->wakeups
+    );
+    printf("  scans: %u (%.1f/s)\n", results->scans, results->scans / session_s);
+    printf("  radio: %u packets, %u resync packets, %u attempts, %u max retransmits, "
+            "%u backoffs, %u dropped, %u TX FIFO full\n",
+        results->packets,
+        results->resync_packets,
+        results->attempts,
+        results->max_rt,
+        results->backoffs,
+        results->dropped,
+        results->tx_fifo_full
+    );
+
+    printf("  charge: %.1f uC\n", total_uc);
+    for (i = 0; i < CHARGE_TYPE_COUNT; ++i) {
+        printf("    %s: %.1f uC (%.1f%%)\n",
+            s_charge_names[i],
+            results->charge[i] / 1000000.0,
+            results->charge[i] / 1000000.0 * 100 / total_uc
+        );
+    }
+    printf("  average current: %.1f uA while typing, %.1f uA asleep\n",
+        typing_ua,
+        asleep_ua
+    );
+    printf("  battery life: %.0f days at %.1f hours of typing per day on %.0f mAh\n",
+        s_battery_mah / mah_per_day,
+        s_hours_per_day,
+        s_battery_mah
+    );
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:k:p:P:L:l:j:xi:z:r:b:u:c:s:vh")) != -1) {
+        switch (opt) {
+            case 'd': s_typing_time_us = strtod(optarg, NULL) * 1000000; break;
+            case 'k': s_keystroke_interval_us = strtod(optarg, NULL) * 1000; break;
+            case 'p': s_pause_percent = strtod(optarg, NULL); break;
+            case 'P': s_max_pause_us = strtod(optarg, NULL) * 1000000; break;
+            case 'L': s_long_hold_percent = strtod(optarg, NULL); break;
+            case 'l': s_loss_percent = strtod(optarg, NULL); break;
+            case 'j': s_busy_percent = strtod(optarg, NULL); break;
+            case 'x': s_receiver_off = true; break;
+            case 'i': g_rf_settings.power_idle_time = strtoul(optarg, NULL, 0); break;
+            case 'z': g_rf_settings.power_sleep_time = strtoul(optarg, NULL, 0); break;
+            case 'r': g_rf_settings.power_idle_scan_interval = strtoul(optarg, NULL, 0); break;
+            case 'b': g_rf_settings.power_max_backoff = strtoul(optarg, NULL, 0); break;
+            case 'u': s_hours_per_day = strtod(optarg, NULL); break;
+            case 'c': s_battery_mah = strtod(optarg, NULL); break;
+            case 's': s_rand_state = strtoul(optarg, NULL, 0); break;
+            case 'v': s_verbose = true; break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // The simulated time is 32 bits of us, so keep the session under an hour
+    if (optind != argc ||
+            s_typing_time_us == 0 || s_typing_time_us > 3600000000 ||
+            s_max_pause_us > 60000000 ||
+            s_keystroke_interval_us < 2 ||
+            s_busy_percent < 0 || s_busy_percent >= 100 ||
+            s_hours_per_day <= 0 || s_hours_per_day > 24 ||
+            s_battery_mah <= 0 ||
+            s_rand_state == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    {
+        power_manager_t power;
+        power_manager_init(&power, 0);
+        printf("power settings: idle time %u ms, sleep time %u s, idle scan interval %u ms, "
+                "max backoff %u ms\n",
+            power.idle_time,
+            power.sleep_time,
+            power.idle_scan_interval,
+            power.max_backoff
+        );
+    }
+    printf("typing: %.0f s, keystroke every %.0f ms, pauses: %.1f%% up to %.0f s, "
+            "long holds: %.1f%%, loss: %.1f%%, busy channel: %.1f%%, receiver %s, "
+            "seed: %u\n\n",
+        s_typing_time_us / 1000000.0,
+        s_keystroke_interval_us / 1000.0,
+        s_pause_percent,
+        s_max_pause_us / 1000000.0,
+        s_long_hold_percent,
+        s_loss_percent,
+        s_busy_percent,
+        s_receiver_off ? "off" : "on",
+        s_rand_state
+    );
+
+    s_air_rand_state = s_rand_state;
+    simulate();
+    print_results();
+
+    return EXIT_SUCCESS;
+}
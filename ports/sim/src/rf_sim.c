@@ -0,0 +1,1025 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file rf_sim.c
+///
+/// Runs the receiver side of `core/rf.c` on a simulated nRF24 against a number
+/// of virtual keyboards. The keyboards type random keystrokes and send them
+/// the way the battery mode main loop on the xmega port does: one encrypted
+/// matrix packet for each change, answers to the sync challenge in the ACK
+/// payloads, and the same retry handling when a packet reaches the maximum
+/// retransmit count, with the backoff from `core/power_manager.c`. Their battery level drains as they type, and is sent
+/// along with the matrix in multi record packets. They use `core/rf_hop.c`
+/// to search for the receiver's channel and to ask it to hop when their
+/// packets need too many retransmits.
+///
+/// The air between them is an Enhanced ShockBurst link at 2Mbps over
+/// several channels. Packets and ACKs can be lost at random, the channel the
+/// link starts on can be made busy, keyboards that transmit on the same
+/// channel at the same time collide, and an old packet can be made to arrive
+/// late, after a newer one.
+/// The receiver runs `rf_task()` at a fixed period, and its matrix packets
+/// end up in `keyboard_update_device_matrix()` below, which checks them
+/// against the keys each keyboard really has down.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/aes.h"
+#include "core/matrix_interpret.h"
+#include "core/matrix_scanner.h"
+#include "core/packet.h"
+#include "core/power_manager.h"
+#include "core/rf.h"
+#include "core/rf_hop.h"
+#include "core/settings.h"
+#include "core/timer.h"
+
+#include "port_impl/sim_hardware.h"
+#include "port_impl/sim_nrf24.h"
+
+#define MAX_KEYBOARDS MAX_NUM_DEVICES
+#define KEYS_PER_KEYBOARD 48
+#define KEYBOARD_BITMAP_SIZE (KEYS_PER_KEYBOARD / 8)
+
+/// Resolution of the simulation
+#define SIM_STEP_US 10
+
+/// Time to keep running after the typing stops, so that every keyboard can
+/// deliver its last key releases
+#define SETTLE_TIME_US 1000000
+
+/// How often the keyboards run their main loop, the xmega port wakes up on
+/// every 1ms timer tick
+#define KEYBOARD_TICK_US 1000
+
+/// Failed retransmit rounds before a keyboard throws away its queued
+/// packets, the same as `MAX_RETRY_COUNT` in the xmega battery mode loop
+#define MAX_RETRY_COUNT 10
+
+/// Shortest and longest time a key is held down
+#define MIN_HOLD_TIME_US 40000
+#define MAX_HOLD_TIME_US 160000
+
+/// Average time for the battery level of a keyboard to drop by 1%
+#define BATTERY_DRAIN_US 2000000
+
+/// The same as `RF_BATTERY_REPORT_INTERVAL` in `core/rf.c`
+#define BATTERY_REPORT_INTERVAL 16
+
+#define RF_CHANNEL 76
+
+/// Time for the radio to switch between RX and TX
+#define TX_SETTLE_US 130
+/// Air time of one byte at 2Mbps
+#define US_PER_BYTE 4
+/// Preamble, address, packet control field and CRC of an ESB packet
+#define ESB_OVERHEAD_BYTES (1 + RF_ADDR_WIDTH + 2 + 2)
+
+#define ESB_AIR_TIME_US(width) (((width) + ESB_OVERHEAD_BYTES) * US_PER_BYTE)
+
+typedef enum attempt_state_t {
+    /// Not transmitting
+    ATTEMPT_IDLE,
+    /// The packet is on the air
+    ATTEMPT_SENDING,
+    /// Waiting for the ACK
+    ATTEMPT_WAITING_FOR_ACK,
+} attempt_state_t;
+
+typedef struct air_time_t {
+    uint8_t channel;
+    uint32_t start;
+    uint32_t end;
+} air_time_t;
+
+typedef struct virtual_keyboard_t {
+    uint8_t device_id;
+    uint8_t addr[RF_ADDR_WIDTH];
+    /// Automatic retransmit delay, set from the pipe like the firmware does
+    uint32_t ard_us;
+
+    /// Keys the user has down
+    uint8_t matrix[KEYBOARD_BITMAP_SIZE];
+    /// Keys the receiver thinks are down
+    uint8_t host_matrix[KEYBOARD_BITMAP_SIZE];
+    uint32_t press_time[KEYS_PER_KEYBOARD];
+    uint32_t release_time[KEYS_PER_KEYBOARD];
+    /// Time each key that is down will be released, 0 for keys that are up
+    uint32_t release_at[KEYS_PER_KEYBOARD];
+    uint32_t next_keystroke;
+    uint32_t next_tick;
+    bool matrix_changed;
+
+    /// Counter used for the packet ids, like `uid_generate()`
+    uint32_t uid;
+
+    uint8_t battery_level;
+    uint8_t battery_report_countdown;
+    uint32_t next_battery_drain;
+
+    /// The channel hopping state, the same as `g_rf_hop` in a keyboard
+    rf_hop_t hop;
+
+    /// The retransmit backoff, the same as in the battery mode loop
+    power_manager_t power;
+
+    /// The ESB transmitter
+    uint8_t tx_fifo[SIM_NRF24_FIFO_SIZE][PACKET_SIZE];
+    uint8_t tx_len;
+    uint8_t pid;
+    bool is_sending;
+    bool is_max_rt;
+    uint8_t retransmits;
+    uint8_t err_count;
+    uint32_t next_attempt;
+    attempt_state_t attempt_state;
+    uint32_t attempt_done;
+    sim_nrf24_ack_t ack;
+    /// The two most recent transmissions, used to detect collisions
+    air_time_t air[2];
+
+    /// ACK payloads received
+    uint8_t rx_fifo[SIM_NRF24_FIFO_SIZE][MAX_PAYLOAD_LENGTH];
+    uint8_t rx_width[SIM_NRF24_FIFO_SIZE];
+    uint8_t rx_len;
+
+    /// A copy of an old packet that arrives after the next packet
+    bool has_late_packet;
+    uint8_t late_packet[PACKET_SIZE];
+
+    bool has_transmitted;
+    uint32_t first_tx_time;
+    bool is_synced;
+} virtual_keyboard_t;
+
+typedef struct latency_t {
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+} latency_t;
+
+typedef struct results_t {
+    latency_t press_latency;
+    latency_t release_latency;
+    latency_t sync_time;
+    uint32_t keystrokes;
+    uint32_t host_presses;
+    uint32_t stuck_keys;
+    uint32_t never_synced;
+    uint32_t attempts;
+    uint32_t collisions;
+    uint32_t lost;
+    uint32_t acks_lost;
+    uint32_t max_rt;
+    uint32_t tx_fifo_full;
+    uint32_t tx_dropped;
+    uint32_t late_packets;
+    uint32_t accepted;
+    uint32_t bad_packets;
+    uint32_t multi_record_packets;
+    uint32_t wrong_battery_levels;
+    uint32_t interference;
+    uint32_t hop_requests;
+    uint32_t off_channel;
+} results_t;
+
+static virtual_keyboard_t s_keyboards[MAX_KEYBOARDS];
+static results_t s_results;
+
+static uint8_t s_num_keyboards = 4;
+static uint32_t s_typing_time_us = 10000000;
+static uint32_t s_keystroke_interval_us = 150000;
+static double s_loss_percent = 0;
+static double s_ack_loss_percent = 0;
+static double s_late_percent = 0;
+static double s_busy_percent = 0;
+static uint32_t s_task_period_us = 1000;
+static uint8_t s_arc = 15;
+static uint32_t s_rand_state = 1;
+static bool s_verbose = false;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\n"
+        "  -n NUM   number of keyboards, up to %u (default: 4)\n"
+        "  -d S     how long the keyboards type for in seconds (default: 10)\n"
+        "  -k MS    average time between keystrokes on each keyboard (default: 150)\n"
+        "  -l PCT   chance that a packet is lost (default: 0)\n"
+        "  -a PCT   chance that an ACK is lost (default: 0)\n"
+        "  -o PCT   chance that a copy of a packet arrives again after the\n"
+        "           next one, out of order (default: 0)\n"
+        "  -j PCT   chance that a packet or ACK on the channel the link starts\n"
+        "           on is lost to interference (default: 0)\n"
+        "  -t US    time between calls to rf_task() (default: 1000)\n"
+        "  -c NUM   automatic retransmit count, 0-15 (default: 15)\n"
+        "  -s SEED  random seed (default: 1)\n"
+        "  -v       print every event\n",
+        name, MAX_KEYBOARDS
+    );
+}
+
+/*********************************************************************
+ *                          random numbers                           *
+ *********************************************************************/
+
+/// xorshift32, so that runs are the same on every machine
+static uint32_t random_u32(void) {
+    uint32_t x = s_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rand_state = x;
+    return x;
+}
+
+/// A random number in [`low`, `high`]
+static uint32_t random_range(uint32_t low, uint32_t high) {
+    return low + random_u32() % (high - low + 1);
+}
+
+static bool random_chance(double percent) {
+    return percent > 0 && (random_u32() % 1000000) < percent * 10000;
+}
+
+/// Interference from other 2.4GHz devices, only the channel the link starts
+/// on is busy
+static bool is_interfered(uint8_t channel) {
+    return channel == RF_CHANNEL && random_chance(s_busy_percent);
+}
+
+/*********************************************************************
+ *                             results                               *
+ *********************************************************************/
+
+static void add_latency(latency_t *latency, uint32_t delay) {
+    latency->count++;
+    latency->total += delay;
+    if (delay > latency->max) {
+        latency->max = delay;
+    }
+}
+
+static void print_latency(const char *name, const latency_t *latency) {
+    if (latency->count == 0) {
+        return;
+    }
+    printf("  %s: avg %.2f ms, max %.2f ms\n",
+        name,
+        latency->total / 1000.0 / latency->count,
+        latency->max / 1000.0
+    );
+}
+
+static void print_event(const virtual_keyboard_t *kb, const char *event) {
+    if (s_verbose) {
+        printf("  %10.3f ms: keyboard %u: %s\n",
+            g_sim_time_us / 1000.0, kb->device_id, event
+        );
+    }
+}
+
+/*********************************************************************
+ *                        the receiving side                         *
+ *********************************************************************/
+
+static void setup_receiver(void) {
+    settings_t *settings = (settings_t*)g_sim_settings;
+    uint8_t i;
+
+    memset(g_sim_settings, 0, sizeof(settings_t));
+    settings->device_id = 0;
+    settings->layout.number_devices = s_num_keyboards;
+
+    memset(&g_rf_settings, 0, sizeof(g_rf_settings));
+    memset(&g_runtime_settings, 0, sizeof(g_runtime_settings));
+    for (i = 0; i < NRF_ADDR_LEN; ++i) {
+        g_rf_settings.pipe_addr_0[i] = random_u32();
+        g_rf_settings.pipe_addr_1[i] = random_u32();
+    }
+    g_rf_settings.pipe_addr_2 = g_rf_settings.pipe_addr_1[0] + 1;
+    g_rf_settings.pipe_addr_3 = g_rf_settings.pipe_addr_1[0] + 2;
+    g_rf_settings.pipe_addr_4 = g_rf_settings.pipe_addr_1[0] + 3;
+    g_rf_settings.pipe_addr_5 = g_rf_settings.pipe_addr_1[0] + 4;
+    g_rf_settings.channel = RF_CHANNEL;
+    g_rf_settings.arc = s_arc;
+    g_rf_settings.hw_type = RF_HW_NRF24L01;
+    for (i = 0; i < AES_KEY_LEN; ++i) {
+        g_rf_settings.ekey[i] = random_u32();
+    }
+    memcpy(g_rf_settings.dkey, g_rf_settings.ekey, AES_KEY_LEN);
+    aes_key_init(g_rf_settings.ekey, g_rf_settings.dkey);
+
+    sim_nrf24_reset();
+    rf_init_receive();
+}
+
+/// Update the receiver's copy of a keyboard's matrix from a packet, the same
+/// way the matrix packets are handled by the real receiver.
+///
+/// @return false if the packet is malformed
+static bool decode_matrix_packet(const uint8_t *packet, uint8_t *matrix) {
+    const uint8_t packet_type = packet[0] >> PACKET_MATRIX_TYPE_BIT_POS;
+    const uint8_t data_size = packet[0] & PACKET_MATRIX_SIZE_MASK;
+    const uint8_t *data = &packet[1];
+    uint8_t i;
+
+    if (data_size + 1 > PACKET_PAYLOAD_LENGTH) {
+        return false;
+    }
+
+    switch (packet_type) {
+        case PACKET_MATRIX_DELTA_LIST: {
+            for (i = 0; i < data_size; ++i) {
+                const uint8_t key_num = data[i] & MATRIX_DELTA_KEY_MASK;
+                if (key_num >= KEYS_PER_KEYBOARD) {
+                    return false;
+                }
+                if (data[i] & MATRIX_DELTA_TYPE_MASK) {
+                    bitmap_set_bit(matrix, key_num);
+                } else {
+                    bitmap_clear_bit(matrix, key_num);
+                }
+            }
+        } break;
+
+        case PACKET_MATRIX_KEY_LIST: {
+            memset(matrix, 0, KEYBOARD_BITMAP_SIZE);
+            for (i = 0; i < data_size; ++i) {
+                if (data[i] >= KEYS_PER_KEYBOARD) {
+                    return false;
+                }
+                bitmap_set_bit(matrix, data[i]);
+            }
+        } break;
+
+        case PACKET_MATRIX_RAW: {
+            if (data_size > KEYBOARD_BITMAP_SIZE) {
+                return false;
+            }
+            memset(matrix, 0, KEYBOARD_BITMAP_SIZE);
+            memcpy(matrix, data, data_size);
+        } break;
+
+        default: {
+            return false;
+        } break;
+    }
+
+    return true;
+}
+
+// Called by `handle_packet()` in `core/rf.c` for every matrix packet that
+// passes its checks.
+void keyboard_update_device_matrix(uint8_t device_id, const XRAM uint8_t *matrix_packet) REENT {
+    virtual_keyboard_t *kb;
+    uint8_t new_matrix[KEYBOARD_BITMAP_SIZE];
+    uint8_t key_num;
+
+    if (device_id >= s_num_keyboards) {
+        s_results.bad_packets++;
+        return;
+    }
+
+    kb = &s_keyboards[device_id];
+    s_results.accepted++;
+
+    if (!kb->is_synced) {
+        kb->is_synced = true;
+        add_latency(&s_results.sync_time, g_sim_time_us - kb->first_tx_time);
+        print_event(kb, "synced");
+    }
+
+    memcpy(new_matrix, kb->host_matrix, KEYBOARD_BITMAP_SIZE);
+    if (!decode_matrix_packet(matrix_packet, new_matrix)) {
+        s_results.bad_packets++;
+        return;
+    }
+
+    for (key_num = 0; key_num < KEYS_PER_KEYBOARD; ++key_num) {
+        const bool was_down = (bool)bitmap_get_bit(kb->host_matrix, key_num);
+        const bool is_down = (bool)bitmap_get_bit(new_matrix, key_num);
+
+        if (was_down == is_down) {
+            continue;
+        }
+
+        if (is_down) {
+            s_results.host_presses++;
+            add_latency(&s_results.press_latency, g_sim_time_us - kb->press_time[key_num]);
+        } else {
+            add_latency(&s_results.release_latency, g_sim_time_us - kb->release_time[key_num]);
+        }
+    }
+
+    memcpy(kb->host_matrix, new_matrix, KEYBOARD_BITMAP_SIZE);
+}
+
+/*********************************************************************
+ *                        the virtual keyboards                      *
+ *********************************************************************/
+
+static void setup_keyboard(virtual_keyboard_t *kb, uint8_t device_id) {
+    const uint8_t pipe_num = device_id_to_pipe_num(device_id);
+
+    memset(kb, 0, sizeof(virtual_keyboard_t));
+    kb->device_id = device_id;
+
+    // same addresses as `nrf_registers_init_sender()`
+    if (pipe_num == 0) {
+        memcpy(kb->addr, g_rf_settings.pipe_addr_0, RF_ADDR_WIDTH);
+    } else {
+        memcpy(kb->addr, g_rf_settings.pipe_addr_1, RF_ADDR_WIDTH);
+        if (pipe_num >= 2) {
+            kb->addr[0] = (&g_rf_settings.pipe_addr_2)[pipe_num-2];
+        }
+    }
+    kb->ard_us = (pipe_num + 2) * 250;
+    rf_hop_init(&kb->hop, g_rf_settings.ekey, RF_CHANNEL);
+    power_manager_init(&kb->power, timer_read16_ms());
+
+    kb->uid = random_u32() << 16;
+    kb->battery_level = random_range(20, 100);
+    kb->next_battery_drain = random_range(BATTERY_DRAIN_US / 2, BATTERY_DRAIN_US * 3 / 2);
+    kb->next_tick = random_range(0, KEYBOARD_TICK_US - 1);
+    kb->next_keystroke = random_range(0, s_keystroke_interval_us);
+}
+
+static uint8_t count_keys_down(const uint8_t *matrix) {
+    uint8_t count = 0;
+    uint8_t key_num;
+    for (key_num = 0; key_num < KEYS_PER_KEYBOARD; ++key_num) {
+        count += (bool)bitmap_get_bit(matrix, key_num);
+    }
+    return count;
+}
+
+static void type_keys(virtual_keyboard_t *kb, bool is_typing) {
+    uint8_t key_num;
+
+    for (key_num = 0; key_num < KEYS_PER_KEYBOARD; ++key_num) {
+        if (kb->release_at[key_num] && g_sim_time_us >= kb->release_at[key_num]) {
+            bitmap_clear_bit(kb->matrix, key_num);
+            kb->release_time[key_num] = g_sim_time_us;
+            kb->release_at[key_num] = 0;
+            kb->matrix_changed = true;
+        }
+    }
+
+    if (is_typing && g_sim_time_us >= kb->next_battery_drain && kb->battery_level) {
+        kb->battery_level--;
+        kb->battery_report_countdown = 0;
+        kb->next_battery_drain = g_sim_time_us + random_range(
+            BATTERY_DRAIN_US / 2,
+            BATTERY_DRAIN_US * 3 / 2
+        );
+    }
+
+    if (!is_typing || g_sim_time_us < kb->next_keystroke) {
+        return;
+    }
+
+    kb->next_keystroke = g_sim_time_us + random_range(
+        s_keystroke_interval_us / 2,
+        s_keystroke_interval_us * 3 / 2
+    );
+
+    key_num = random_range(0, KEYS_PER_KEYBOARD - 1);
+    if (bitmap_get_bit(kb->matrix, key_num)) {
+        return;
+    }
+
+    bitmap_set_bit(kb->matrix, key_num);
+    kb->press_time[key_num] = g_sim_time_us;
+    kb->release_at[key_num] = g_sim_time_us + random_range(MIN_HOLD_TIME_US, MAX_HOLD_TIME_US);
+    kb->matrix_changed = true;
+    s_results.keystrokes++;
+}
+
+/// Encode the keys that are down the same way `get_matrix_data()` does when
+/// deltas aren't used
+///
+/// @return the size of the matrix packet
+static uint8_t encode_matrix(const virtual_keyboard_t *kb, uint8_t *dest) {
+    const uint8_t num_keys_down = count_keys_down(kb->matrix);
+
+    if (num_keys_down < KEYBOARD_BITMAP_SIZE) {
+        uint8_t key_num;
+        uint8_t pos = 1;
+        dest[0] = (PACKET_MATRIX_KEY_LIST << PACKET_MATRIX_TYPE_BIT_POS) | num_keys_down;
+        for (key_num = 0; key_num < KEYS_PER_KEYBOARD; ++key_num) {
+            if (bitmap_get_bit(kb->matrix, key_num)) {
+                dest[pos++] = key_num;
+            }
+        }
+        return num_keys_down + 1;
+    } else {
+        dest[0] = (PACKET_MATRIX_RAW << PACKET_MATRIX_TYPE_BIT_POS) | KEYBOARD_BITMAP_SIZE;
+        memcpy(dest+1, kb->matrix, KEYBOARD_BITMAP_SIZE);
+        return KEYBOARD_BITMAP_SIZE + 1;
+    }
+}
+
+/// Writing to a full TX FIFO is ignored by the nRF24
+static void write_tx_payload(virtual_keyboard_t *kb, const uint8_t *packet) {
+    if (kb->tx_len == SIM_NRF24_FIFO_SIZE) {
+        s_results.tx_fifo_full++;
+        print_event(kb, "TX FIFO full, packet dropped");
+        return;
+    }
+    memcpy(kb->tx_fifo[kb->tx_len++], packet, PACKET_SIZE);
+}
+
+/// The same as `rf_send_matrix_packet()`
+static void send_matrix_packet(virtual_keyboard_t *kb) {
+    packet_t packet;
+    uint8_t matrix_data[PACKET_PAYLOAD_LENGTH];
+    uint8_t *records = packet.matrix.matrix_data + 1;
+    const uint8_t matrix_size = encode_matrix(kb, matrix_data);
+    uint8_t records_end = matrix_size + 1;
+
+    memset(&packet, 0, sizeof(packet));
+    if (kb->hop.hop_request != RF_HOP_NO_REQUEST &&
+            records_end + 2 <= PACKET_RECORDS_MAX_LENGTH) {
+        records[records_end] = (PACKET_RECORD_HOP_REQUEST << PACKET_RECORD_TYPE_BIT_POS) | 1;
+        records[records_end+1] = rf_hop_take_request(&kb->hop);
+        records_end += 2;
+        s_results.hop_requests++;
+        print_event(kb, "asking the receiver to hop");
+    }
+    if (kb->battery_report_countdown == 0 &&
+            records_end + 2 <= PACKET_RECORDS_MAX_LENGTH) {
+        records[records_end] = (PACKET_RECORD_BATTERY << PACKET_RECORD_TYPE_BIT_POS) | 1;
+        records[records_end+1] = kb->battery_level;
+        records_end += 2;
+        kb->battery_report_countdown = BATTERY_REPORT_INTERVAL;
+    } else if (kb->battery_report_countdown) {
+        kb->battery_report_countdown--;
+    }
+
+    if (records_end != matrix_size + 1) {
+        records[0] = (PACKET_RECORD_MATRIX << PACKET_RECORD_TYPE_BIT_POS) | matrix_size;
+        memcpy(records+1, matrix_data, matrix_size);
+        packet.matrix.matrix_data[0] = PACKET_TYPE_MULTI_RECORD | records_end;
+        s_results.multi_record_packets++;
+    } else {
+        memcpy(packet.matrix.matrix_data, matrix_data, matrix_size);
+    }
+    packet.matrix.device_id = kb->device_id;
+    packet.matrix.packet_id = kb->uid++;
+
+    aes_encrypt(packet.raw);
+    write_tx_payload(kb, packet.raw);
+}
+
+static bool is_salt_zeroed(const packet_t *packet) {
+    uint8_t i;
+    for (i = 0; i < PACKET_SYNC_SALT_LENGTH; ++i) {
+        if (packet->sync.salt[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// The same as `rf_handle_ack_payloads()`
+static void handle_ack_payloads(virtual_keyboard_t *kb) {
+    uint8_t i;
+
+    for (i = 0; i < kb->rx_len; ++i) {
+        packet_t *packet = (packet_t*)kb->rx_fifo[i];
+
+        if (kb->rx_width[i] != PACKET_SIZE) {
+            continue;
+        }
+
+        aes_decrypt(packet->raw);
+        if (get_packet_type(packet) == PACKET_TYPE_SESSION_UPDATE &&
+                is_salt_zeroed(packet)) {
+            print_event(kb, "answering sync challenge");
+            packet->sync.device_id = kb->device_id;
+            packet->sync.packet_id = kb->uid++;
+            aes_encrypt(packet->raw);
+            write_tx_payload(kb, packet->raw);
+
+            send_matrix_packet(kb);
+        }
+    }
+
+    kb->rx_len = 0;
+}
+
+static void start_sending(virtual_keyboard_t *kb) {
+    kb->is_sending = true;
+    kb->retransmits = 0;
+    kb->next_attempt = g_sim_time_us;
+}
+
+static void remove_tx_payload(virtual_keyboard_t *kb) {
+    kb->tx_len--;
+    memmove(kb->tx_fifo[0], kb->tx_fifo[1], kb->tx_len * PACKET_SIZE);
+    kb->pid = (kb->pid + 1) & 0x03;
+}
+
+/// The keyboard's main loop, following `battery_mode_main_loop()`
+static void keyboard_tick(virtual_keyboard_t *kb) {
+    if (kb->is_max_rt) {
+        kb->is_max_rt = false;
+        rf_hop_tx_failed(&kb->hop, kb->retransmits - 1);
+        kb->err_count++;
+        if (kb->err_count > MAX_RETRY_COUNT) {
+            s_results.tx_dropped += kb->tx_len;
+            print_event(kb, "too many failed retries, TX FIFO flushed");
+            while (kb->tx_len) {
+                remove_tx_payload(kb);
+            }
+            kb->err_count = 0;
+            power_manager_tx_done(&kb->power);
+        } else {
+            power_manager_tx_failed(&kb->power, timer_read16_ms(), kb->err_count);
+        }
+    }
+
+    if (kb->matrix_changed) {
+        kb->matrix_changed = false;
+        send_matrix_packet(kb);
+    }
+
+    if (kb->rx_len) {
+        handle_ack_payloads(kb);
+    }
+
+    if (kb->tx_len == 0) {
+        kb->err_count = 0;
+        power_manager_tx_done(&kb->power);
+    } else if (
+        !kb->is_sending &&
+        power_manager_tx_ready(&kb->power, timer_read16_ms())
+    ) {
+        start_sending(kb);
+    }
+}
+
+static bool overlaps(const air_time_t *a, const air_time_t *b) {
+    return a->channel == b->channel && a->start < b->end && a->end > b->start;
+}
+
+/// Check if another keyboard was on the air on the same channel at the same
+/// time as `kb`
+static bool has_collided(const virtual_keyboard_t *kb) {
+    const air_time_t *air = &kb->air[0];
+    uint8_t i;
+
+    for (i = 0; i < s_num_keyboards; ++i) {
+        const virtual_keyboard_t *other = &s_keyboards[i];
+        if (other == kb) {
+            continue;
+        }
+        if (overlaps(&other->air[0], air) || overlaps(&other->air[1], air)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void start_attempt(virtual_keyboard_t *kb) {
+    const uint32_t start = g_sim_time_us + TX_SETTLE_US;
+
+    if (!kb->has_transmitted) {
+        kb->has_transmitted = true;
+        kb->first_tx_time = g_sim_time_us;
+    }
+
+    kb->air[1] = kb->air[0];
+    kb->air[0].channel = rf_hop_channel(&kb->hop);
+    kb->air[0].start = start;
+    // Reserve the air for an ACK with a payload until the real one is known
+    kb->air[0].end = start + ESB_AIR_TIME_US(PACKET_SIZE) + TX_SETTLE_US +
+        ESB_AIR_TIME_US(PACKET_SIZE);
+    kb->attempt_state = ATTEMPT_SENDING;
+    kb->attempt_done = start + ESB_AIR_TIME_US(PACKET_SIZE);
+    s_results.attempts++;
+}
+
+/// The packet has finished going over the air
+static void deliver_packet(virtual_keyboard_t *kb) {
+    const uint32_t packet_end = g_sim_time_us;
+    const uint8_t channel = kb->air[0].channel;
+
+    kb->ack.is_acked = false;
+    kb->ack.width = 0;
+
+    if (has_collided(kb)) {
+        s_results.collisions++;
+    } else if (is_interfered(channel)) {
+        s_results.interference++;
+    } else if (random_chance(s_loss_percent)) {
+        s_results.lost++;
+    } else {
+        const uint32_t received = g_sim_nrf24_stats.received;
+
+        sim_nrf24_receive(channel, kb->addr, kb->pid, kb->tx_fifo[0], PACKET_SIZE, &kb->ack);
+
+        if (g_sim_nrf24_stats.received != received) {
+            if (kb->has_late_packet) {
+                sim_nrf24_ack_t late_ack;
+                // The old packet has a different ESB packet id, so the radio
+                // doesn't treat it as a retransmission
+                sim_nrf24_receive(
+                    channel, kb->addr, (kb->pid + 2) & 0x03,
+                    kb->late_packet, PACKET_SIZE, &late_ack
+                );
+                kb->has_late_packet = false;
+                s_results.late_packets++;
+            }
+
+            if (random_chance(s_late_percent)) {
+                kb->has_late_packet = true;
+                memcpy(kb->late_packet, kb->tx_fifo[0], PACKET_SIZE);
+            }
+        }
+    }
+
+    kb->air[0].end = packet_end + TX_SETTLE_US + ESB_AIR_TIME_US(kb->ack.width);
+    kb->attempt_state = ATTEMPT_WAITING_FOR_ACK;
+    kb->attempt_done = kb->air[0].end;
+}
+
+/// The time for the ACK has passed
+static void finish_attempt(virtual_keyboard_t *kb) {
+    const uint32_t packet_end = kb->air[0].start + ESB_AIR_TIME_US(PACKET_SIZE);
+    bool is_acked = kb->ack.is_acked;
+
+    kb->attempt_state = ATTEMPT_IDLE;
+
+    if (is_acked && is_interfered(kb->air[0].channel)) {
+        s_results.interference++;
+        is_acked = false;
+    } else if (is_acked && random_chance(s_ack_loss_percent)) {
+        s_results.acks_lost++;
+        is_acked = false;
+    }
+
+    if (is_acked) {
+        const uint8_t index = kb->hop.index;
+
+        rf_hop_tx_delivered(&kb->hop, kb->retransmits);
+        if (index != kb->hop.index) {
+            print_event(kb, "following the receiver to the next channel");
+        }
+        remove_tx_payload(kb);
+        kb->is_sending = false;
+        if (kb->ack.width && kb->rx_len < SIM_NRF24_FIFO_SIZE) {
+            memcpy(kb->rx_fifo[kb->rx_len], kb->ack.payload, kb->ack.width);
+            kb->rx_width[kb->rx_len] = kb->ack.width;
+            kb->rx_len++;
+        }
+        return;
+    }
+
+    kb->retransmits++;
+    if (kb->retransmits > (kb->hop.is_searching ? RF_HOP_SEARCH_ARC : s_arc)) {
+        s_results.max_rt++;
+        print_event(kb, "maximum retransmits reached");
+        kb->is_sending = false;
+        kb->is_max_rt = true;
+    } else {
+        kb->next_attempt = packet_end + kb->ard_us;
+    }
+}
+
+static void keyboard_step(virtual_keyboard_t *kb, bool is_typing) {
+    type_keys(kb, is_typing);
+
+    if (kb->attempt_state != ATTEMPT_IDLE && g_sim_time_us >= kb->attempt_done) {
+        if (kb->attempt_state == ATTEMPT_SENDING) {
+            deliver_packet(kb);
+        } else {
+            finish_attempt(kb);
+        }
+    }
+
+    if (g_sim_time_us >= kb->next_tick) {
+        kb->next_tick += KEYBOARD_TICK_US;
+        keyboard_tick(kb);
+    }
+
+    if (kb->is_sending && kb->attempt_state == ATTEMPT_IDLE &&
+            g_sim_time_us >= kb->next_attempt) {
+        start_attempt(kb);
+    }
+}
+
+/*********************************************************************
+ *                            simulation                             *
+ *********************************************************************/
+
+static bool simulate(void) {
+    const uint32_t end_time = s_typing_time_us + SETTLE_TIME_US;
+    const double seconds = end_time / 1000000.0;
+    uint32_t next_task = 0;
+    uint8_t i;
+
+    memset(&s_results, 0, sizeof(s_results));
+    memset(g_rf_rx_drop_count, 0, sizeof(g_rf_rx_drop_count));
+
+    g_sim_time_us = 0;
+    setup_receiver();
+    if (!sim_nrf24_is_listening()) {
+        fprintf(stderr, "error: the receiver didn't start listening\n");
+        return false;
+    }
+
+    for (i = 0; i < s_num_keyboards; ++i) {
+        setup_keyboard(&s_keyboards[i], i);
+    }
+
+    for (g_sim_time_us = 0; g_sim_time_us < end_time; g_sim_time_us += SIM_STEP_US) {
+        const bool is_typing = (g_sim_time_us < s_typing_time_us);
+
+        for (i = 0; i < s_num_keyboards; ++i) {
+            keyboard_step(&s_keyboards[i], is_typing);
+        }
+
+        if (g_sim_time_us >= next_task) {
+            next_task += s_task_period_us;
+            rf_task();
+        }
+    }
+
+    for (i = 0; i < s_num_keyboards; ++i) {
+        virtual_keyboard_t *kb = &s_keyboards[i];
+        uint8_t key_num;
+
+        if (kb->has_transmitted && !kb->is_synced) {
+            s_results.never_synced++;
+        }
+
+        if (kb->is_synced && g_rf_battery_level[i] != kb->battery_level) {
+            s_results.wrong_battery_levels++;
+        }
+
+        if (rf_hop_channel(&kb->hop) != rf_hop_channel(&g_rf_hop)) {
+            s_results.off_channel++;
+        }
+
+        for (key_num = 0; key_num < KEYS_PER_KEYBOARD; ++key_num) {
+            if (bitmap_get_bit(kb->host_matrix, key_num)) {
+                s_results.stuck_keys++;
+                if (s_verbose) {
+                    printf("  keyboard %u: key %u stuck down\n", i, key_num);
+                }
+            }
+        }
+    }
+
+    printf("  keystrokes: %u typed, %u missed, %u stuck keys\n",
+        s_results.keystrokes,
+        s_results.keystrokes - s_results.host_presses,
+        s_results.stuck_keys
+    );
+    print_latency("press latency", &s_results.press_latency);
+    print_latency("release latency", &s_results.release_latency);
+    print_latency("time to sync", &s_results.sync_time);
+    if (s_results.never_synced) {
+        printf("  %u keyboards never synced\n", s_results.never_synced);
+    }
+    printf("  air: %u attempts (%.1f/s), %u collisions, %u lost, %u ACKs lost, %u late packets\n",
+        s_results.attempts,
+        s_results.attempts / seconds,
+        s_results.collisions,
+        s_results.lost,
+        s_results.acks_lost,
+        s_results.late_packets
+    );
+    printf("  interference: %u packets and ACKs lost\n", s_results.interference);
+    printf("  keyboards: %u max retransmits, %u packets dropped, %u TX FIFO full\n",
+        s_results.max_rt,
+        s_results.tx_dropped,
+        s_results.tx_fifo_full
+    );
+    printf("  receiver: %u packets (%.1f/s), %u duplicates, %u RX FIFO full, %u flushed\n",
+        g_sim_nrf24_stats.received,
+        g_sim_nrf24_stats.received / seconds,
+        g_sim_nrf24_stats.duplicates,
+        g_sim_nrf24_stats.rx_fifo_full,
+        g_sim_nrf24_stats.flushed
+    );
+    {
+        rf_device_stats_t total;
+
+        memset(&total, 0, sizeof(total));
+        for (i = 0; i < s_num_keyboards; ++i) {
+            total.received += g_rf_device_stats[i].received;
+            total.rejected += g_rf_device_stats[i].rejected;
+            total.replayed += g_rf_device_stats[i].replayed;
+            total.late += g_rf_device_stats[i].late;
+            total.resyncs += g_rf_device_stats[i].resyncs;
+        }
+        printf("  device stats: %u received, %u rejected, %u replayed, %u late, %u resyncs\n",
+            total.received,
+            total.rejected,
+            total.replayed,
+            total.late,
+            total.resyncs
+        );
+    }
+    printf("  buffer drops per pipe:");
+    for (i = 0; i < NUM_RF_PIPES; ++i) {
+        printf(" %u", g_rf_rx_drop_count[i]);
+    }
+    printf("\n");
+    printf("  battery: %u multi record packets, level out of date for %u keyboards\n",
+        s_results.multi_record_packets,
+        s_results.wrong_battery_levels
+    );
+    printf("  hopping: %u hop requests, receiver ended on channel %u, "
+            "%u keyboards on another channel\n",
+        s_results.hop_requests,
+        rf_hop_channel(&g_rf_hop),
+        s_results.off_channel
+    );
+    for (i = 0; i < RF_HOP_CHANNEL_COUNT; ++i) {
+        rf_channel_stats_t tx;
+        uint8_t j;
+
+        memset(&tx, 0, sizeof(tx));
+        for (j = 0; j < s_num_keyboards; ++j) {
+            const rf_channel_stats_t *stats = &s_keyboards[j].hop.stats[i];
+            tx.packets += stats->packets;
+            tx.retransmits += stats->retransmits;
+            tx.max_rt += stats->max_rt;
+        }
+        printf("    channel %2u: %u received, %u hops away, "
+                "%u delivered with %u retransmits, %u max retransmits\n",
+            g_rf_hop.channels[i],
+            g_rf_hop.stats[i].packets,
+            g_rf_hop.stats[i].hops,
+            tx.packets,
+            tx.retransmits,
+            tx.max_rt
+        );
+    }
+    printf("  accepted: %u matrix packets (%.1f/s), %u rejected, %u bad\n",
+        s_results.accepted,
+        s_results.accepted / seconds,
+        g_sim_nrf24_stats.read - s_results.accepted,
+        s_results.bad_packets
+    );
+
+    return s_results.stuck_keys == 0 &&
+        s_results.never_synced == 0 &&
+        s_results.bad_packets == 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:k:l:a:o:j:t:c:s:vh")) != -1) {
+        switch (opt) {
+            case 'n': s_num_keyboards = strtoul(optarg, NULL, 0); break;
+            case 'd': s_typing_time_us = strtod(optarg, NULL) * 1000000; break;
+            case 'k': s_keystroke_interval_us = strtod(optarg, NULL) * 1000; break;
+            case 'l': s_loss_percent = strtod(optarg, NULL); break;
+            case 'a': s_ack_loss_percent = strtod(optarg, NULL); break;
+            case 'o': s_late_percent = strtod(optarg, NULL); break;
+            case 'j': s_busy_percent = strtod(optarg, NULL); break;
+            case 't': s_task_period_us = strtoul(optarg, NULL, 0); break;
+            case 'c': s_arc = strtoul(optarg, NULL, 0); break;
+            case 's': s_rand_state = strtoul(optarg, NULL, 0); break;
+            case 'v': s_verbose = true; break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc ||
+            s_num_keyboards == 0 || s_num_keyboards > MAX_KEYBOARDS ||
+            s_keystroke_interval_us < 2 ||
+            s_task_period_us == 0 ||
+            s_arc > 15 ||
+            s_rand_state == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("keyboards: %u, keystroke every %.0f ms, loss: %.1f%%, ACK loss: %.1f%%, "
+            "out of order: %.1f%%, busy channel: %.1f%%, rf_task period: %u us, "
+            "arc: %u, seed: %u\n\n",
+        s_num_keyboards,
+        s_keystroke_interval_us / 1000.0,
+        s_loss_percent,
+        s_ack_loss_percent,
+        s_late_percent,
+        s_busy_percent,
+        s_task_period_us,
+        s_arc,
+        s_rand_state
+    );
+
+    return simulate() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
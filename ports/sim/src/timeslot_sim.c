@@ -0,0 +1,599 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file timeslot_sim.c
+///
+/// A model of the radio timeslots an nRF52 receiver runs ESB in while it is
+/// connected over BLE, for tuning `core/timeslot_sched.c`.
+///
+/// The SoftDevice holds the radio for a connection event at the start of
+/// every connection interval. Timeslots are granted between those events,
+/// the way `esb_timeslot.c` requests them: as soon as possible or at a
+/// distance from the last slot, with extensions, and a blocked event when
+/// the SoftDevice can't fit a request. ESB listens for the keyboards from
+/// the start of a slot until the slot is about to end.
+///
+/// A number of keyboards type random keys and send a packet for each
+/// change, retransmitting it until it is acknowledged. A packet is only
+/// received if it is on the air while the receiver listens, and no other
+/// keyboard is on the air at the same time.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timeslot_sched.h"
+
+/// Resolution of the simulation
+#define TICK_US 10
+
+#define MAX_NUM_KEYBOARDS 16
+
+// The same margins as `esb_timeslot.c`
+/// The slot is ended this long before it runs out
+#define TS_SAFETY_MARGIN_US 500
+/// An extension is requested this long before the slot runs out
+#define TS_EXTEND_MARGIN_US 1000
+/// Time from the start of a slot until ESB is set up and listening
+#define SLOT_SETUP_US 200
+/// Time the SoftDevice takes to answer a timeslot request
+#define REQUEST_LATENCY_US 100
+
+// ESB timing at 2Mbps
+#define TX_SETTLE_US 130
+#define US_PER_BYTE 4
+#define ESB_OVERHEAD_BYTES (1 + 5 + 2 + 2)
+#define ESB_AIR_TIME_US(width) (((width) + ESB_OVERHEAD_BYTES) * US_PER_BYTE)
+#define PACKET_WIDTH 32
+#define ACK_WIDTH 0
+/// How long a keyboard listens for an ACK before it gives up on an attempt
+#define ACK_TIMEOUT_US 250
+
+/// The same as `MAX_RETRY_COUNT` in the xmega battery mode loop
+#define MAX_RETRY_COUNT 10
+/// Packets a keyboard can queue while it is still sending
+#define TX_FIFO_SIZE 3
+
+/// Shortest and longest time a key is held down
+#define MIN_HOLD_TIME_US 40000
+#define MAX_HOLD_TIME_US 160000
+
+typedef struct latency_t {
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+} latency_t;
+
+typedef struct results_t {
+    latency_t latency;
+    uint32_t packets;
+    uint32_t attempts;
+    uint32_t collisions;
+    uint32_t max_rt;
+    uint32_t dropped;
+    uint32_t tx_fifo_full;
+    /// Time the radio spent in timeslots, and listening for ESB packets
+    uint32_t slot_time;
+    uint32_t listen_time;
+} results_t;
+
+typedef struct keyboard_t {
+    /// Automatic retransmit delay, from the keyboard's pipe like on the nRF52
+    uint32_t ard_us;
+
+    /// Time each queued packet was made
+    uint32_t queue[TX_FIFO_SIZE];
+    uint8_t queue_len;
+
+    bool is_sending;
+    /// Start of the next attempt
+    uint32_t next_attempt;
+    /// The last attempt on the air
+    uint32_t air_start;
+    uint32_t air_end;
+    /// Slot the receiver got the last attempt in
+    uint32_t air_slot;
+    bool is_on_air;
+    /// The ACK of the last attempt, if the receiver got it
+    bool is_ack_pending;
+    uint32_t ack_end;
+    /// Attempts made for the current packet
+    uint8_t attempts;
+    /// MAX_RT in a row for the current packet
+    uint8_t err_count;
+    /// The receiver already has the current packet, retransmits of it are
+    /// duplicates
+    bool is_received;
+
+    uint32_t next_keystroke;
+    uint32_t release_at;
+} keyboard_t;
+
+typedef enum slot_state_t {
+    /// The request was blocked, the event reaches the port at `event_time`
+    SLOT_BLOCKED,
+    /// A slot starts at `start`
+    SLOT_GRANTED,
+    SLOT_ACTIVE,
+} slot_state_t;
+
+typedef struct slot_t {
+    uint8_t state;
+    uint32_t event_time;
+    /// The current or next slot
+    uint32_t start;
+    uint32_t end;
+    /// Time the next extension is considered
+    uint32_t check_time;
+    /// ESB is listening, since `listen_start`
+    bool is_listening;
+    uint32_t listen_start;
+    /// Counts the slots, so a packet can tell if it stayed in one
+    uint32_t id;
+} slot_t;
+
+static results_t s_results;
+static keyboard_t s_keyboards[MAX_NUM_KEYBOARDS];
+static slot_t s_slot;
+
+timeslot_sched_t g_timeslot_sched;
+
+static uint32_t s_sim_time_us = 60000000;
+static uint8_t s_num_keyboards = 2;
+static uint32_t s_keystroke_interval_us = 150000;
+static double s_pause_percent = 5;
+static uint32_t s_max_pause_us = 5000000;
+/// BLE connection interval and the length of its connection events, an
+/// interval of 0 for no connection
+static uint32_t s_ble_interval_us = 7500;
+static uint32_t s_ble_event_us = 1250;
+static uint8_t s_arc = 15;
+static uint32_t s_rand_state = 1;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\n"
+        "  -d S     how long to type for in seconds (default: 60)\n"
+        "  -n NUM   number of keyboards, up to %d (default: 2)\n"
+        "  -k MS    average time between keystrokes (default: 150)\n"
+        "  -p PCT   chance of a pause after a keystroke (default: 5)\n"
+        "  -P S     longest pause in seconds (default: 5)\n"
+        "  -c MS    BLE connection interval, 0 for no connection (default: 7.5)\n"
+        "  -e US    length of a BLE connection event (default: 1250)\n"
+        "  -a NUM   ESB retransmit count of the keyboards (default: 15)\n"
+        "  -l US    shortest slot (default: %lu)\n"
+        "  -m US    longest slot (default: %lu)\n"
+        "  -g US    longest gap between idle slots (default: %lu)\n"
+        "  -x US    longest time a slot is extended by (default: %lu)\n"
+        "  -s SEED  random seed (default: 1)\n",
+        name,
+        MAX_NUM_KEYBOARDS,
+        TIMESLOT_DEFAULT_MIN_LEN_US,
+        TIMESLOT_DEFAULT_MAX_LEN_US,
+        TIMESLOT_DEFAULT_MAX_GAP_US,
+        TIMESLOT_DEFAULT_MAX_EXTEND_US
+    );
+}
+
+/*********************************************************************
+ *                          random numbers                           *
+ *********************************************************************/
+
+/// xorshift32, so that runs are the same on every machine
+static uint32_t random_u32(void) {
+    uint32_t x = s_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rand_state = x;
+    return x;
+}
+
+/// A random number in [`low`, `high`]
+static uint32_t random_range(uint32_t low, uint32_t high) {
+    return low + random_u32() % (high - low + 1);
+}
+
+static bool random_chance(double percent) {
+    return percent > 0 && (random_u32() % 1000000) < percent * 10000;
+}
+
+static void add_latency(latency_t *latency, uint32_t delay) {
+    latency->count++;
+    latency->total += delay;
+    if (delay > latency->max) {
+        latency->max = delay;
+    }
+}
+
+/*********************************************************************
+ *                            SoftDevice                             *
+ *********************************************************************/
+
+/// Check if a BLE connection event overlaps [`start`, `end`)
+static bool ble_overlaps(uint32_t start, uint32_t end) {
+    uint32_t event_start;
+
+    if (s_ble_interval_us == 0) {
+        return false;
+    }
+    event_start = start - start % s_ble_interval_us;
+    if (start < event_start + s_ble_event_us) {
+        return true;
+    }
+    return event_start + s_ble_interval_us < end;
+}
+
+/// The earliest start from `time` on for a slot of `len` that doesn't overlap
+/// a connection event.
+///
+/// @return false if the slot doesn't fit between two connection events
+static bool ble_earliest_fit(uint32_t time, uint32_t len, uint32_t *start) {
+    uint32_t event_start;
+
+    if (s_ble_interval_us == 0) {
+        *start = time;
+        return true;
+    }
+    if (len > s_ble_interval_us - s_ble_event_us) {
+        return false;
+    }
+
+    event_start = time - time % s_ble_interval_us;
+    if (time < event_start + s_ble_event_us) {
+        time = event_start + s_ble_event_us;
+    }
+    if (time + len > event_start + s_ble_interval_us) {
+        time = event_start + s_ble_interval_us + s_ble_event_us;
+    }
+    *start = time;
+    return true;
+}
+
+/// The same as `next_timeslot_request()` and `sd_radio_request()`
+static void request_slot(uint32_t now) {
+    const uint32_t len = g_timeslot_sched.len_us;
+    bool is_granted;
+    uint32_t start;
+
+    if (g_timeslot_sched.distance_us == 0) {
+        is_granted = ble_earliest_fit(now + REQUEST_LATENCY_US, len, &start);
+    } else {
+        start = s_slot.start + g_timeslot_sched.distance_us;
+        is_granted = (
+            start >= now + REQUEST_LATENCY_US &&
+            !ble_overlaps(start, start + len)
+        );
+    }
+
+    s_slot.event_time = now + REQUEST_LATENCY_US;
+    if (is_granted) {
+        s_slot.state = SLOT_GRANTED;
+        s_slot.start = start;
+    } else {
+        s_slot.state = SLOT_BLOCKED;
+    }
+}
+
+static void stop_listening(uint32_t now) {
+    if (s_slot.is_listening) {
+        s_results.listen_time += now - s_slot.listen_start;
+        s_slot.is_listening = false;
+    }
+}
+
+/// The radio callback and timeslot IRQs of `esb_timeslot.c`
+static void slot_task(uint32_t now) {
+    switch (s_slot.state) {
+        case SLOT_BLOCKED: {
+            if (now >= s_slot.event_time) {
+                timeslot_sched_blocked(&g_timeslot_sched);
+                request_slot(now);
+            }
+        } break;
+
+        case SLOT_GRANTED: {
+            if (now >= s_slot.start) {
+                timeslot_sched_start(&g_timeslot_sched);
+                s_slot.state = SLOT_ACTIVE;
+                s_slot.end = now + g_timeslot_sched.slot_len_us;
+                s_slot.check_time = s_slot.end - TS_EXTEND_MARGIN_US;
+                s_slot.id++;
+            }
+        } break;
+
+        case SLOT_ACTIVE: {
+            if (!s_slot.is_listening && s_slot.check_time != 0 &&
+                    now >= s_slot.start + SLOT_SETUP_US) {
+                s_slot.is_listening = true;
+                s_slot.listen_start = now;
+            }
+
+            if (s_slot.check_time != 0 && now >= s_slot.check_time) {
+                if (!timeslot_sched_should_extend(&g_timeslot_sched)) {
+                    stop_listening(now);
+                    s_slot.check_time = 0;
+                } else if (ble_overlaps(s_slot.end, s_slot.end + TIMESLOT_EXTENSION_US)) {
+                    timeslot_sched_extend_failed(&g_timeslot_sched);
+                    stop_listening(now);
+                    s_slot.check_time = 0;
+                } else {
+                    timeslot_sched_extended(&g_timeslot_sched);
+                    s_slot.end += TIMESLOT_EXTENSION_US;
+                    s_slot.check_time += TIMESLOT_EXTENSION_US;
+                }
+            }
+
+            if (now >= s_slot.end - TS_SAFETY_MARGIN_US) {
+                stop_listening(now);
+                s_results.slot_time += now - s_slot.start;
+                timeslot_sched_end(&g_timeslot_sched);
+                request_slot(now);
+            }
+        } break;
+    }
+}
+
+/*********************************************************************
+ *                             keyboards                             *
+ *********************************************************************/
+
+static void setup_keyboards(void) {
+    uint8_t i;
+
+    for (i = 0; i < s_num_keyboards; ++i) {
+        keyboard_t *kb = &s_keyboards[i];
+        // `nrf52_esb_config_init_common()`: `(pipe + 2) * 250` us
+        kb->ard_us = (i % 6 + 2) * 250;
+        kb->next_keystroke = random_range(0, s_keystroke_interval_us);
+    }
+}
+
+static void queue_packet(keyboard_t *kb, uint32_t now) {
+    if (kb->queue_len == TX_FIFO_SIZE) {
+        s_results.tx_fifo_full++;
+        return;
+    }
+    kb->queue[kb->queue_len++] = now;
+    s_results.packets++;
+}
+
+static void type_keys(keyboard_t *kb, uint32_t now) {
+    if (kb->release_at != 0 && now >= kb->release_at) {
+        kb->release_at = 0;
+        queue_packet(kb, now);
+    }
+
+    if (now >= kb->next_keystroke && now < s_sim_time_us) {
+        uint32_t delay = random_range(
+            s_keystroke_interval_us / 2,
+            s_keystroke_interval_us + s_keystroke_interval_us / 2
+        );
+        if (random_chance(s_pause_percent)) {
+            delay += random_range(0, s_max_pause_us);
+        }
+        kb->next_keystroke = now + delay;
+
+        if (kb->release_at == 0) {
+            kb->release_at = now + random_range(MIN_HOLD_TIME_US, MAX_HOLD_TIME_US);
+            queue_packet(kb, now);
+        }
+    }
+}
+
+static void next_packet(keyboard_t *kb) {
+    kb->queue_len--;
+    memmove(kb->queue, kb->queue + 1, kb->queue_len * sizeof(kb->queue[0]));
+    kb->is_sending = false;
+    kb->is_received = false;
+    kb->err_count = 0;
+}
+
+static bool is_collision(keyboard_t *kb) {
+    uint8_t i;
+
+    for (i = 0; i < s_num_keyboards; ++i) {
+        keyboard_t *other = &s_keyboards[i];
+        if (other != kb && other->air_end != 0 &&
+                other->air_start < kb->air_end && kb->air_start < other->air_end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void keyboard_task(keyboard_t *kb, uint32_t now) {
+    type_keys(kb, now);
+
+    if (kb->is_ack_pending && now >= kb->ack_end) {
+        kb->is_ack_pending = false;
+        // The ACK is only sent if the receiver is still listening
+        if (s_slot.is_listening && s_slot.id == kb->air_slot) {
+            add_latency(&s_results.latency, now - kb->queue[0]);
+            next_packet(kb);
+            return;
+        }
+    }
+
+    if (kb->is_on_air && now >= kb->air_end) {
+        kb->is_on_air = false;
+        if (is_collision(kb)) {
+            s_results.collisions++;
+        } else if (s_slot.is_listening && s_slot.listen_start <= kb->air_start) {
+            // The receiver was listening for the whole packet
+            kb->air_slot = s_slot.id;
+            if (!kb->is_received) {
+                kb->is_received = true;
+                timeslot_sched_rx(&g_timeslot_sched);
+            }
+            kb->is_ack_pending = true;
+            kb->ack_end = now + TX_SETTLE_US + ESB_AIR_TIME_US(ACK_WIDTH);
+            return;
+        }
+
+        if (kb->attempts > s_arc) {
+            s_results.max_rt++;
+            kb->attempts = 0;
+            kb->err_count++;
+            if (kb->err_count >= MAX_RETRY_COUNT) {
+                s_results.dropped++;
+                next_packet(kb);
+                return;
+            }
+        }
+        kb->next_attempt = now + ACK_TIMEOUT_US + kb->ard_us;
+    }
+
+    if (!kb->is_sending && kb->queue_len != 0) {
+        kb->is_sending = true;
+        kb->attempts = 0;
+        kb->next_attempt = now;
+    }
+
+    if (kb->is_sending && !kb->is_on_air && !kb->is_ack_pending &&
+            now >= kb->next_attempt) {
+        s_results.attempts++;
+        kb->attempts++;
+        kb->is_on_air = true;
+        kb->air_start = now + TX_SETTLE_US;
+        kb->air_end = kb->air_start + ESB_AIR_TIME_US(PACKET_WIDTH);
+    }
+}
+
+/*********************************************************************
+ *                               main                                *
+ *********************************************************************/
+
+static void simulate(void) {
+    // Let the keyboards send the packets they have left
+    const uint32_t end_time = s_sim_time_us + MAX_HOLD_TIME_US + 1000000;
+    uint32_t now;
+    uint8_t i;
+
+    setup_keyboards();
+    request_slot(0);
+
+    for (now = 0; now < end_time; now += TICK_US) {
+        slot_task(now);
+        for (i = 0; i < s_num_keyboards; ++i) {
+            keyboard_task(&s_keyboards[i], now);
+        }
+    }
+}
+
+static void print_results(void) {
+    const timeslot_stats_t *stats = &g_timeslot_sched.stats;
+    const uint32_t end_time = s_sim_time_us + MAX_HOLD_TIME_US + 1000000;
+    const double ble_share = (s_ble_interval_us == 0) ? 0 :
+        100.0 * s_ble_event_us / s_ble_interval_us;
+    const double slot_share = 100.0 * s_results.slot_time / end_time;
+
+    printf("  packets: %u sent, %u delivered, %u dropped, %u TX FIFO full\n",
+        s_results.packets,
+        s_results.latency.count,
+        s_results.dropped,
+        s_results.tx_fifo_full
+    );
+    if (s_results.latency.count) {
+        printf("  latency: avg %.2f ms, max %.2f ms\n",
+            s_results.latency.total / 1000.0 / s_results.latency.count,
+            s_results.latency.max / 1000.0
+        );
+    }
+    printf("  air: %u attempts, %u collisions, %u max retransmits\n",
+        s_results.attempts,
+        s_results.collisions,
+        s_results.max_rt
+    );
+    printf("  radio: %.1f%% BLE, %.1f%% timeslots, %.1f%% listening for ESB, "
+            "%.1f%% free\n",
+        ble_share,
+        slot_share,
+        100.0 * s_results.listen_time / end_time,
+        100.0 - ble_share - slot_share
+    );
+    printf("  timeslots: %u granted, %u blocked, %u extended, %u extend failed, "
+            "%u ESB packets\n",
+        stats->granted,
+        stats->blocked,
+        stats->extensions,
+        stats->extend_failed,
+        stats->rx
+    );
+    printf("  slots by ESB packets received: 0: %u, 1: %u, 2-3: %u, 4-7: %u, 8+: %u\n",
+        stats->slot_packets[0],
+        stats->slot_packets[1],
+        stats->slot_packets[2],
+        stats->slot_packets[3],
+        stats->slot_packets[4]
+    );
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    timeslot_sched_init(&g_timeslot_sched);
+
+    while ((opt = getopt(argc, argv, "d:n:k:p:P:c:e:a:l:m:g:x:s:h")) != -1) {
+        switch (opt) {
+            case 'd': s_sim_time_us = strtod(optarg, NULL) * 1000000; break;
+            case 'n': s_num_keyboards = strtoul(optarg, NULL, 0); break;
+            case 'k': s_keystroke_interval_us = strtod(optarg, NULL) * 1000; break;
+            case 'p': s_pause_percent = strtod(optarg, NULL); break;
+            case 'P': s_max_pause_us = strtod(optarg, NULL) * 1000000; break;
+            case 'c': s_ble_interval_us = strtod(optarg, NULL) * 1000; break;
+            case 'e': s_ble_event_us = strtoul(optarg, NULL, 0); break;
+            case 'a': s_arc = strtoul(optarg, NULL, 0); break;
+            case 'l': g_timeslot_sched.min_len_us = strtoul(optarg, NULL, 0); break;
+            case 'm': g_timeslot_sched.max_len_us = strtoul(optarg, NULL, 0); break;
+            case 'g': g_timeslot_sched.max_gap_us = strtoul(optarg, NULL, 0); break;
+            case 'x': g_timeslot_sched.max_extend_us = strtoul(optarg, NULL, 0); break;
+            case 's': s_rand_state = strtoul(optarg, NULL, 0); break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // The simulated time is 32 bits of us, so keep the run under an hour.
+    // A slot has to be long enough to set up ESB and end it again.
+    if (optind != argc ||
+            s_sim_time_us == 0 || s_sim_time_us > 3600000000 ||
+            s_num_keyboards == 0 || s_num_keyboards > MAX_NUM_KEYBOARDS ||
+            s_keystroke_interval_us < 2 ||
+            s_max_pause_us > 60000000 ||
+            (s_ble_interval_us != 0 && s_ble_event_us >= s_ble_interval_us) ||
+            s_arc > 15 ||
+            g_timeslot_sched.min_len_us < TS_EXTEND_MARGIN_US + SLOT_SETUP_US ||
+            g_timeslot_sched.max_len_us < g_timeslot_sched.min_len_us ||
+            s_rand_state == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    g_timeslot_sched.len_us = g_timeslot_sched.max_len_us;
+
+    printf("keyboards: %u, keystroke every %.0f ms, pauses: %.1f%% up to %.0f s, "
+            "BLE: %.2f ms interval with %u us events, arc: %u, seed: %u\n",
+        s_num_keyboards,
+        s_keystroke_interval_us / 1000.0,
+        s_pause_percent,
+        s_max_pause_us / 1000000.0,
+        s_ble_interval_us / 1000.0,
+        s_ble_event_us,
+        s_arc,
+        s_rand_state
+    );
+    printf("slots: %lu-%lu us, gaps up to %lu us, extended by up to %lu us\n\n",
+        (unsigned long)g_timeslot_sched.min_len_us,
+        (unsigned long)g_timeslot_sched.max_len_us,
+        (unsigned long)g_timeslot_sched.max_gap_us,
+        (unsigned long)g_timeslot_sched.max_extend_us
+    );
+
+    simulate();
+    print_results();
+
+    return EXIT_SUCCESS;
+}
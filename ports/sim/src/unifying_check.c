@@ -0,0 +1,184 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+
+/// @file unifying_check.c
+///
+/// Checks the unifying mouse queue in `core/unifying_mouse_queue.c`. Each
+/// case adds a list of reports the way the radio interrupt does, then takes
+/// the entries out the way `unifying_mouse_task()` does and compares them to
+/// the expected ones. Motion with the same buttons must be merged, and each
+/// button change must come out in the order it was received.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/unifying_mouse_queue.h"
+
+#define MAX_CASE_REPORTS 8
+
+/// Add the next report after `unifying_mouse_queue_skip_next()`
+#define SKIP 0xff
+
+typedef struct queue_case_t {
+    const char *name;
+    /// Reports added to the queue, ending at a 0 length report. `buttons_2`
+    /// set to `SKIP` calls `unifying_mouse_queue_skip_next()` instead.
+    unifying_mouse_state_t added[MAX_CASE_REPORTS];
+    /// Expected entries taken out of the queue, ending like `added`
+    unifying_mouse_state_t expected[MAX_CASE_REPORTS];
+    /// Number of reports `unifying_mouse_queue_add()` should reject
+    uint8_t lost;
+} queue_case_t;
+
+#define END { 0, 0, 0, 0, 0, 0 }
+
+static const queue_case_t s_cases[] = {
+    {
+        "motion is merged",
+        {
+            { 0x00, 0, 1, -1, 0, 1 },
+            { 0x00, 0, 2, -2, 0, 0 },
+            { 0x00, 0, 3, -3, 1, -1 },
+            END,
+        },
+        {
+            { 0x00, 0, 6, -6, 1, 0 },
+            END,
+        },
+        0,
+    },
+    {
+        "button changes stay in order",
+        {
+            { 0x00, 0, 1, 0, 0, 0 },
+            { 0x01, 0, 2, 0, 0, 0 },
+            { 0x01, 0, 3, 0, 0, 0 },
+            { 0x00, 0, 4, 0, 0, 0 },
+            { 0x00, 0x01, 5, 0, 0, 0 },
+            END,
+        },
+        {
+            { 0x00, 0, 1, 0, 0, 0 },
+            { 0x01, 0, 5, 0, 0, 0 },
+            { 0x00, 0, 4, 0, 0, 0 },
+            { 0x00, 0x01, 5, 0, 0, 0 },
+            END,
+        },
+        0,
+    },
+    {
+        "full queue",
+        {
+            { 0x01, 0, 1, 0, 0, 0 },
+            { 0x02, 0, 1, 0, 0, 0 },
+            { 0x03, 0, 1, 0, 0, 0 },
+            { 0x04, 0, 1, 0, 0, 0 },
+            { 0x05, 0, 1, 0, 0, 0 },
+            END,
+        },
+        {
+            { 0x01, 0, 1, 0, 0, 0 },
+            { 0x02, 0, 1, 0, 0, 0 },
+            { 0x03, 0, 1, 0, 0, 0 },
+            { 0x05, 0, 2, 0, 0, 0 },
+            END,
+        },
+        1,
+    },
+    {
+        "motion saturates",
+        {
+            { 0x00, 0, INT16_MAX, INT16_MIN, INT8_MAX, INT8_MIN },
+            { 0x00, 0, 100, -100, 100, -100 },
+            END,
+        },
+        {
+            { 0x00, 0, INT16_MAX, INT16_MIN, INT8_MAX, INT8_MIN },
+            END,
+        },
+        0,
+    },
+    {
+        "skip the report after a click",
+        {
+            { 0x00, 0, 1, 0, 0, 0 },
+            { 0x00, SKIP, 0, 0, 0, 0 },
+            { 0x04, 0, 100, 0, 0, 0 },
+            { 0x00, 0, 2, 0, 0, 0 },
+            END,
+        },
+        {
+            { 0x00, 0, 3, 0, 0, 0 },
+            END,
+        },
+        0,
+    },
+};
+
+#define NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+static bool is_end(const unifying_mouse_state_t *report) {
+    static const unifying_mouse_state_t end = END;
+    return memcmp(report, &end, sizeof(end)) == 0;
+}
+
+static void print_report(const char *prefix, const unifying_mouse_state_t *report) {
+    printf("  %s buttons %02x %02x, x %d, y %d, wheel %d %d\n",
+        prefix,
+        report->buttons_1,
+        report->buttons_2,
+        report->x,
+        report->y,
+        report->wheel_x,
+        report->wheel_y
+    );
+}
+
+static bool check_case(const queue_case_t *queue_case) {
+    unifying_mouse_state_t report;
+    uint8_t lost = 0;
+    uint8_t i;
+    bool is_ok = true;
+
+    for (i = 0; !is_end(&queue_case->added[i]); ++i) {
+        if (queue_case->added[i].buttons_2 == SKIP) {
+            unifying_mouse_queue_skip_next();
+        } else if (!unifying_mouse_queue_add(&queue_case->added[i])) {
+            lost++;
+        }
+    }
+
+    for (i = 0; unifying_mouse_queue_pop(&report); ++i) {
+        if (i >= MAX_CASE_REPORTS || is_end(&queue_case->expected[i])) {
+            print_report("extra entry:", &report);
+            is_ok = false;
+        } else if (memcmp(&report, &queue_case->expected[i], sizeof(report)) != 0) {
+            print_report("entry:", &report);
+            print_report("expected:", &queue_case->expected[i]);
+            is_ok = false;
+        }
+    }
+    if (i < MAX_CASE_REPORTS && !is_end(&queue_case->expected[i])) {
+        print_report("missing entry:", &queue_case->expected[i]);
+        is_ok = false;
+    }
+    if (lost != queue_case->lost) {
+        printf("  %u reports lost, expected %u\n", lost, queue_case->lost);
+        is_ok = false;
+    }
+
+    printf("%-30s %s\n", queue_case->name, is_ok ? "ok" : "FAIL");
+    return is_ok;
+}
+
+int main(void) {
+    bool is_ok = true;
+    uint8_t i;
+
+    for (i = 0; i < NUM_CASES; ++i) {
+        is_ok &= check_case(&s_cases[i]);
+    }
+
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
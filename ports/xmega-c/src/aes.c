@@ -17,3 +17,10 @@ void aes_encrypt(uint8_t *block) {
 void aes_decrypt(uint8_t *block) {
     aes128_dec(block, &aes_ctx);
 }
+
+void aes_decrypt_blocks(uint8_t *XRAM *blocks, uint8_t count) {
+    uint8_t i;
+    for (i = 0; i < count; ++i) {
+        aes128_dec(blocks[i], &aes_ctx);
+    }
+}
@@ -24,11 +24,6 @@
 #define BOOTLOADER_PID 0xBB01
 #endif
 
-// TODO: move to settings
-// TODO: an option to enter deep sleep when there has been no change in the matrix
-// state for a long time
-#define DEEP_SLEEP_TIME 3000
-
 #define SCANNER_MATRIX_DELTA 1
 
 #define INTERNAL_SCAN_METHOD (MATRIX_SCANNER_INTERNAL_FAST_ROW_COL)
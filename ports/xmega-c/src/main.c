@@ -19,16 +19,14 @@
 #include "core/matrix_scanner.h"
 #include "core/nrf24.h"
 #include "core/packet.h"
+#include "core/power_manager.h"
 #include "core/rf.h"
 #include "core/settings.h"
 #include "core/timer.h"
 #include "core/usb_commands.h"
 #include "core/mouse.h"
 
-#include "hid_reports/keyboard_report.h"
-#include "hid_reports/media_report.h"
-#include "hid_reports/mouse_report.h"
-#include "hid_reports/vendor_report.h"
+#include "hid_reports/hid_reports.h"
 
 #include "key_handlers/key_hold.h"
 #include "key_handlers/key_mouse.h"
@@ -95,7 +93,7 @@ void battery_mode_setup(void) {
 #define ADAPTIVE_SCAN 1
 
 void battery_mode_main_loop(void) {
-    uint16_t idle_time_start = 0;
+    XRAM power_manager_t power;
     uint8_t err_count = 0;
 
     bool matrix_needs_scanning = true;
@@ -111,10 +109,23 @@ void battery_mode_main_loop(void) {
         }
     }
 
+    power_manager_init(&power, timer_read16_ms());
+
     while (1) {
+        uint16_t now = timer_read16_ms();
+
 #if ADAPTIVE_SCAN
         scan_changed = false;
-        if (matrix_needs_scanning) {
+        // In the idle power state, only scan every `idle_scan_interval` ms
+        // unless a key is debouncing. The changes seen between two scans
+        // are sent together in one packet.
+        if (
+            matrix_needs_scanning &&
+            (
+                get_matrix_num_keys_debouncing() != 0 ||
+                power_manager_should_scan(&power, now)
+            )
+        ) {
 #else
         {
 #endif
@@ -138,20 +149,36 @@ void battery_mode_main_loop(void) {
             //
             // Then if we have lots of failed attempts, we should clear
             // messages from the queue.
+#if USE_RF_HOPPING
+            rf_handle_max_rt();
+#endif
             err_count++;
 
             if (err_count > MAX_RETRY_COUNT) {
                 nrf24_flush_tx();
                 err_count = 0;
+                power_manager_tx_done(&power);
             } else {
-                nrf24_send_one();
+                // The packet stays in the TX FIFO, and is sent again below
+                // once the backoff time has passed.
+                power_manager_tx_failed(&power, now, err_count);
             }
             nrf24_write_reg(NRF_STATUS, STATUS_MAX_RT_bm);
         }
 
+#if USE_RF_HOPPING
+        if (nrf_status & (STATUS_TX_DS_bm)) {
+            rf_handle_tx_ds();
+            nrf24_write_reg(NRF_STATUS, STATUS_TX_DS_bm);
+        }
+#endif
+
         if (scan_changed) {
             rf_send_matrix_packet();
-            idle_time_start = timer_read16_ms();
+            power_manager_activity(&power, now);
+            // This packet can carry the resync ACK payload, so there's no
+            // need to send another one
+            deep_sleep_resync_packet = false;
         }
 
         if (NRF24_STATUS_RX_PIPE(nrf_status) != STATUS_RX_FIFO_EMPTY ) {
@@ -165,19 +192,24 @@ void battery_mode_main_loop(void) {
         if (fifo_status & FIFO_TX_EMPTY_bm) {
             // empty
             err_count = 0;
-        } else {
+            power_manager_tx_done(&power);
+        } else if (power_manager_tx_ready(&power, now)) {
             // not empty
             nrf24_send_one();
         }
 
-        if (get_matrix_num_keys_down() == 0 &&
-            (uint16_t)(timer_read16_ms() - idle_time_start) > DEEP_SLEEP_TIME &&
-            get_matrix_num_keys_debouncing() == 0 &&
-            !scan_changed &&
-            (fifo_status & FIFO_TX_EMPTY_bm)
-            ) {
+        if (
+            power_manager_update(
+                &power,
+                now,
+                get_matrix_num_keys_down() == 0 &&
+                get_matrix_num_keys_debouncing() == 0 &&
+                !scan_changed &&
+                (fifo_status & FIFO_TX_EMPTY_bm)
+            ) == POWER_STATE_SLEEP
+        ) {
             deep_sleep();
-            idle_time_start = timer_read16_ms();
+            power_manager_activity(&power, timer_read16_ms());
             matrix_needs_scanning = true;
             deep_sleep_resync_packet = true;
         } else {
@@ -195,6 +227,8 @@ void battery_mode_main_loop(void) {
                 if (matrix_has_active_row()) {
                     matrix_needs_scanning = true;
                     matrix_scan_irq_disable();
+                    // scan the new key at once, even in the idle state
+                    power_manager_activity(&power, timer_read16_ms());
                 } else {
                     matrix_needs_scanning = false;
                 }
@@ -215,6 +249,9 @@ void battery_mode_main_loop(void) {
             // payload after wakeup from deep sleep.
             // If this is not done, an unsynced device might not be able to
             // register a key press until a second key is pressed.
+            //
+            // It is skipped when the key that woke us up has already been
+            // sent.
             if (deep_sleep_resync_packet) {
                 rf_send_matrix_packet();
                 deep_sleep_resync_packet = false;
@@ -305,7 +342,13 @@ void usb_mode_main_loop(void) {
     while (1) {
         bool scan_changed = false;
 
-        scan_changed |= matrix_scan();
+#if USB_LOW_LATENCY
+        // Refill the endpoints the host polled during the last pass before
+        // doing anything else
+        send_hid_reports();
+#endif
+
+        scan_changed |= matrix_scan_task();
 
         // TODO: need to clean this up
         if (scan_changed) {
@@ -358,6 +401,11 @@ void usb_mode_main_loop(void) {
 
         interpret_all_keyboard_matrices();
 
+#if USB_LOW_LATENCY
+        // Don't make key changes wait for the RF and mouse tasks
+        send_hid_reports();
+#endif
+
 #if USE_NRF24
         if (g_rf_enabled) {
             // TODO: might want to implement a scheduling system for tasks
@@ -367,15 +415,15 @@ void usb_mode_main_loop(void) {
                 rf_task();
             }
             handle_mouse_events();
+#if USE_MOUSE_GESTURE
+            gesture_task();
+#endif
         }
 #endif
         macro_task();
         mouse_key_task();
 
-        send_keyboard_report();
-        send_media_report();
-        send_mouse_report();
-        send_vendor_report();
+        send_hid_reports();
 
         // usb out reports
         handle_vendor_out_reports();
@@ -389,6 +437,9 @@ void usb_mode_main_loop(void) {
         // Don't have RF IRQ, so don't sleep to reduce chance that packets are
         // dropped
         // debug_toggle(0);
+#elif USB_LOW_LATENCY
+        // Don't sleep so the next pass can start as soon as an endpoint is
+        // free again
 #else
         // okay to sleep if we have RF IRQ
         // debug_set(0, 1);
@@ -402,7 +453,7 @@ void usb_mode_main_loop(void) {
 
 NO_RETURN_ATTR void recovery_mode_main_loop(void) {
     while (1) {
-        send_vendor_report();
+        send_hid_reports();
         handle_vendor_out_reports();
 
         enter_sleep_mode(SLEEP_MODE_IDLE);
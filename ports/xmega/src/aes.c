@@ -22,3 +22,10 @@ void aes_encrypt(uint8_t *block) {
 void aes_decrypt(uint8_t *block) {
     xmega_aes_crypt(block, block, aes_dkey, XMEGA_AES_DECRYPT);
 }
+
+void aes_decrypt_blocks(uint8_t *XRAM *blocks, uint8_t count) {
+    uint8_t i;
+    for (i = 0; i < count; ++i) {
+        xmega_aes_crypt(blocks[i], blocks[i], aes_dkey, XMEGA_AES_DECRYPT);
+    }
+}
@@ -272,8 +272,16 @@ void usb_cb_control_setup(void) {
         /* uint8_t interface = 1; */
 
         if (bRequest == USB_REQ_HID_SET_REPORT) {
-            /* TODO: */
-            usb_ep0_stall();
+            if (
+                interface == INTERFACE_MOUSE &&
+                MSB_U16(usb_setup.wValue) == HID_REPORT_TYPE_FEATURE
+            ) {
+                // Resolution multiplier, handled once the data stage arrives
+                usb_ep0_out();
+            } else {
+                /* TODO: */
+                usb_ep0_stall();
+            }
         } else if (bRequest == USB_REQ_HID_GET_REPORT) {
             /* uint8_t report_id = usbRequest.wValueLSB; */
             // this requests the HID report we defined with the HID report descriptor.
@@ -288,8 +296,12 @@ void usb_cb_control_setup(void) {
                     usb_ep0_out();
                     break;
                 case INTERFACE_MOUSE:
-                    memcpy(ep0_buf_in, (uint8_t*)&g_mouse_report, sizeof(hid_report_mouse_t));
-                    usb_ep0_in(sizeof(hid_report_mouse_t));
+                    if (MSB_U16(usb_setup.wValue) == HID_REPORT_TYPE_FEATURE) {
+                        usb_ep0_in(mouse_report_get_feature(ep0_buf_in));
+                    } else {
+                        memcpy(ep0_buf_in, (uint8_t*)&g_mouse_report, sizeof(hid_report_mouse_t));
+                        usb_ep0_in(sizeof(hid_report_mouse_t));
+                    }
                     usb_ep0_out();
                     break;
                 case INTERFACE_MEDIA:
@@ -346,6 +358,14 @@ void usb_cb_control_in_completion(void) {
 }
 
 void usb_cb_control_out_completion(void) {
+    if (
+        usb_setup.bRequest == USB_REQ_HID_SET_REPORT &&
+        usb_setup.wIndex == INTERFACE_MOUSE
+    ) {
+        mouse_report_set_feature(ep0_buf_out, usb_ep_out_length(0));
+        // status stage
+        usb_ep0_in(0);
+    }
 }
 
 bool usb_cb_set_interface(uint16_t interface, uint16_t altsetting) {
@@ -38,3 +38,10 @@ void aes_encrypt(uint8_t *block);
 
 /// Decrypt a block (in-place)
 void aes_decrypt(uint8_t *block);
+
+/// Decrypt `count` blocks (in-place).
+///
+/// Used by the receiver to decrypt every queued packet in one go. Ports with
+/// an AES peripheral only set it up once for the whole batch instead of once
+/// per block. Only needed by ports that receive RF packets.
+void aes_decrypt_blocks(uint8_t *XRAM *blocks, uint8_t count);
@@ -105,12 +105,47 @@ endif
 ifeq ($(USE_SCANNER), 0)
     CDEFS += -DUSE_SCANNER=0
     CDEFS += -DMAX_NUM_ROWS=0
+    CDEFS += -DUSE_DEBOUNCE_STATS=0
+    CDEFS += -DUSE_COUNTER_DEBOUNCE=0
+    CDEFS += -DUSE_IDLE_SCAN=0
+    CDEFS += -DUSE_ANTI_GHOSTING=0
 else
     C_SRC += \
         $(CORE_PATH)/io_map.c \
         $(CORE_PATH)/matrix_scanner.c
     CDEFS += -DUSE_SCANNER=1
     CDEFS += -DMAX_NUM_ROWS=$(MAX_NUM_ROWS)
+
+    # Per key bounce statistics and adaptive debounce times, defaults to 1
+    ifeq ($(USE_DEBOUNCE_STATS), 0)
+        CDEFS += -DUSE_DEBOUNCE_STATS=0
+    else
+        CDEFS += -DUSE_DEBOUNCE_STATS=1
+    endif
+
+    # Bit-parallel integrator and eager debouncers, defaults to 1. Their
+    # counters use 5 bytes of RAM for each byte of a matrix row. Without
+    # them, layouts that pick these debounce modes use the timer debouncer.
+    ifeq ($(USE_COUNTER_DEBOUNCE), 0)
+        CDEFS += -DUSE_COUNTER_DEBOUNCE=0
+    else
+        CDEFS += -DUSE_COUNTER_DEBOUNCE=1
+    endif
+
+    # Stop scanning an idle matrix until a pin changes, defaults to 1. Needs
+    # the port to implement the `matrix_scan_irq_*()` functions.
+    ifeq ($(USE_IDLE_SCAN), 0)
+        CDEFS += -DUSE_IDLE_SCAN=0
+    else
+        CDEFS += -DUSE_IDLE_SCAN=1
+    endif
+
+    # Ghost key filter for matrices without diodes, defaults to 1
+    ifeq ($(USE_ANTI_GHOSTING), 0)
+        CDEFS += -DUSE_ANTI_GHOSTING=0
+    else
+        CDEFS += -DUSE_ANTI_GHOSTING=1
+    endif
 endif
 
 # Hardware specific scan, defaults to 0
@@ -131,6 +166,14 @@ else
     USE_HID = 1
 endif
 
+# Low latency USB profile, defaults to 0. Polls every HID endpoint each 1ms
+# frame and services USB first in the main loop.
+ifeq ($(USB_LOW_LATENCY), 1)
+    CDEFS += -DUSB_LOW_LATENCY=1
+else
+    CDEFS += -DUSB_LOW_LATENCY=0
+endif
+
 # Bluetooth module, defaults to 0
 ifeq ($(USE_BLUETOOTH), 1)
     CDEFS += -DUSE_BLUETOOTH=1
@@ -164,6 +207,27 @@ ifeq ($(USE_NRF24), 1)
     CDEFS += -DUSE_NRF24=1
     CDEFS += -DNONCE_ADDR=$(NONCE_ADDR)
 
+    # Per device link statistics and battery levels on the receiver, defaults
+    # to 1. Uses 11 bytes of RAM for each of the `MAX_NUM_DEVICES` (64)
+    # devices, so the nrf24lu1 turns it off.
+    ifeq ($(USE_RF_STATS), 0)
+        CDEFS += -DUSE_RF_STATS=0
+    else
+        CDEFS += -DUSE_RF_STATS=1
+    endif
+
+    # Adaptive channel hopping, defaults to 0. The unifying mouse stays on
+    # one channel, so the two can't be used together.
+    ifeq ($(USE_RF_HOPPING), 1)
+        ifneq ($(USE_UNIFYING), 0)
+            $(error "Channel hopping needs USE_UNIFYING = 0")
+        endif
+        C_SRC += $(CORE_PATH)/rf_hop.c
+        CDEFS += -DUSE_RF_HOPPING=1
+    else
+        CDEFS += -DUSE_RF_HOPPING=0
+    endif
+
     ifeq ($(USE_UNIFYING), 0)
         CDEFS += -DUSE_UNIFYING=0
     else
@@ -171,18 +235,30 @@ ifeq ($(USE_NRF24), 1)
             $(error "Need USB/BT for unifying support")
         endif
         C_SRC += $(CORE_PATH)/unifying.c
+        C_SRC += $(CORE_PATH)/unifying_mouse_queue.c
         CDEFS += -DUSE_UNIFYING=1
         USE_MOUSE = 1
     endif
 else
     CDEFS += -DUSE_NRF24=0
     CDEFS += -DUSE_UNIFYING=0
+    CDEFS += -DUSE_RF_HOPPING=0
+    CDEFS += -DUSE_RF_STATS=0
 endif
 
 ifeq ($(USE_NRF52_ESB), 1)
     CDEFS += -DUSE_NRF52_ESB=1
+
+    # With bluetooth, ESB shares the radio with the SoftDevice in timeslots
+    ifeq ($(USE_BLUETOOTH), 1)
+        C_SRC += $(CORE_PATH)/timeslot_sched.c
+        CDEFS += -DUSE_ESB_TIMESLOT=1
+    else
+        CDEFS += -DUSE_ESB_TIMESLOT=0
+    endif
 else
     CDEFS += -DUSE_NRF52_ESB=0
+    CDEFS += -DUSE_ESB_TIMESLOT=0
 endif
 
 ifeq ($(USE_MOUSE), 1)
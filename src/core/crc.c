@@ -6,6 +6,20 @@
 
 // WARNING: this crc doesn't output 0 when appended with itself
 #define CRC16_POLY 0x1021
+
+// crc16_nibble_table[n] is the crc of the 4 bit value `n` with a zero crc.
+// A full 256 entry table is faster again, but costs 512 bytes of flash.
+static ROM const uint16_t crc16_nibble_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+uint16_t crc16_byte(uint16_t crc, uint8_t data) {
+    crc = (crc << 4) ^ crc16_nibble_table[(uint8_t)(crc >> 12) ^ (data >> 4)];
+    crc = (crc << 4) ^ crc16_nibble_table[(uint8_t)(crc >> 12) ^ (data & 0x0f)];
+    return crc;
+}
+
 uint16_t crc16_step(uint16_t crc, uint8_t data, uint8_t num_bits) {
     while (num_bits != 0) {
         bit_t bitn = data & 0x80;
@@ -23,8 +37,7 @@ uint16_t crc16_step(uint16_t crc, uint8_t data, uint8_t num_bits) {
 uint16_t crc16_buffer(const uint8_t *buf_ptr, uint8_t length) {
     uint16_t crc = 0xffff;
     while (length-- > 0) {
-        crc = crc16_step(crc, *buf_ptr++, 8);
-        length--;
+        crc = crc16_byte(crc, *buf_ptr++);
     }
     return crc;
 }
@@ -33,7 +46,7 @@ uint16_t crc16_flash_buffer(flash_addr_t flash_ptr, uint8_t length) {
     uint16_t crc = 0xffff;
     while (length-- > 0) {
         const uint8_t flash_byte = flash_read_byte(flash_ptr++);
-        crc = crc16_step(crc, flash_byte , 8);
+        crc = crc16_byte(crc, flash_byte);
     }
     return crc;
 }
@@ -55,12 +68,12 @@ bit_t crc_check_nrf24_raw_packet(XRAM const uint8_t *addr, XRAM uint8_t *raw_pac
 
     // the crc is computed over the address as well as the data
     for (i = RF_ADDR_WIDTH-1; i >= 0; --i) {
-        crc = crc16_step(crc, addr[i], 8);
+        crc = crc16_byte(crc, addr[i]);
     }
 
     // combine (x+3) bytes to the checksum
     for (i = 0; i < payload_len+3; ++i) {
-        crc = crc16_step(crc, raw_packet[i], 8);
+        crc = crc16_byte(crc, raw_packet[i]);
     }
 
     // get the one left over bit and apply it to the checksum
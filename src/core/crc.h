@@ -3,12 +3,23 @@
 /// @file core/crc.h
 ///
 /// CRC functions used for RF packets and verifying the settings section.
+///
+/// The CRC is CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xffff, no
+/// reflection and no final xor. It matches `keyplus/utility/crc16.py`. Test
+/// vectors for `crc16_buffer()`, checked by `ports/sim/src/crc_check.c`:
+///
+///   ""                -> 0xffff
+///   "123456789"       -> 0x29b1
+///   bytes 0x00..0x1f  -> 0x23b3
 
 #pragma once
 
 #include "core/util.h"
 
+/// Add the top `num_bits` bits of `data` to the crc, one bit at a time
 uint16_t crc16_step(uint16_t crc, uint8_t data, uint8_t num_bits);
+/// Add a whole byte to the crc using a lookup table
+uint16_t crc16_byte(uint16_t crc, uint8_t data);
 bit_t crc_check_nrf24_raw_packet(XRAM const uint8_t *addr, XRAM uint8_t *raw_packet, uint8_t payload_len);
 uint16_t crc16_buffer(const uint8_t *buf_ptr, uint8_t length);
 uint16_t crc16_flash_buffer(flash_addr_t flash_ptr, uint8_t length);
@@ -33,6 +33,7 @@ typedef enum error_code_type {
     ERROR_VENDOR_IN_REPORT_CANT_KEEP_UP = 6,
     ERROR_INVALID_KB_ID_USED = 7,
     ERROR_MACRO_CMD_ERROR = 8,
+    ERROR_KEY_TRANSITION_QUEUE_FULL = 9,
 
     // critical errors
     CRITICAL_ERROR_START = 64,
@@ -352,6 +352,9 @@ typedef enum special_keycode_t {
     // mouse gestures
     KC_MOUSE_GESTURE           = KC_SPECIAL_START | 0x1004,
 
+    // mouse movement key with an acceleration profile
+    KC_MOUSE_KEY               = KC_SPECIAL_START | 0x1005,
+
     // // sends raw hid codes
     // KC_HID_KEYBOARD            = KC_SPECIAL_START | 0x1010,
     // KC_HID_CONSUMER            = KC_SPECIAL_START | 0x1011,
@@ -168,9 +168,13 @@ static uint8_t macro_step(void) REENT {
         if (err) return 0;
         g_report_pending_mouse = true;
     } else if (keycode == MACRO_CMD_MOUSE_WHEEL) {
-        err  = macro_get_data((uint8_t*)&g_mouse_report.wheel_x, sizeof(int8_t));
-        err  = macro_get_data((uint8_t*)&g_mouse_report.wheel_y, sizeof(int8_t));
+        macro_cmd_mouse_wheel_t wheel;
+        err = macro_get_data((uint8_t*)&wheel, sizeof(macro_cmd_mouse_wheel_t));
         if (err) return 0;
+        mouse_report_add_wheel(
+            wheel.y * MOUSE_WHEEL_HI_RES_DETENT,
+            wheel.x * MOUSE_WHEEL_HI_RES_DETENT
+        );
         g_report_pending_mouse = true;
     } else if (keycode == MACRO_CMD_FINISH) {
         macro_abort();
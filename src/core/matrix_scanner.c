@@ -18,6 +18,13 @@
 
 #define MAX_UPDATE_LIST 16
 #define MAX_DOWN_LIST 16
+/// After this many delta list packets in a row, `get_matrix_data()` sends
+/// the whole matrix state so a receiver that lost a packet catches up.
+#define MATRIX_DELTA_REFRESH_COUNT 8
+
+// Debounce windows a key must go through without a late bounce before the
+// extra debounce time it was given is reduced by 1ms
+#define DEBOUNCE_ADAPT_DECAY_WINDOWS 32
 
 // can probably make this static
 XRAM uint8_t g_matrix[MAX_NUM_ROWS][IO_PORT_COUNT*sizeof(port_mask_t)];
@@ -31,13 +38,67 @@ XRAM uint8_t s_has_updated;
 // XRAM uint8_t g_col_masks[IO_PORT_COUNT];
 // #endif
 
-static XRAM uint8_t s_is_debouncing[MAX_NUM_ROWS][IO_PORT_COUNT];
-static XRAM uint8_t s_debounce_time[MAX_NUM_KEYS];
+#define MATRIX_ROW_SIZE (IO_PORT_COUNT*sizeof(port_mask_t))
+
+static XRAM uint8_t s_is_debouncing[MAX_NUM_ROWS][MATRIX_ROW_SIZE];
 static XRAM uint8_t s_invalid_key_debounce_time;
-static XRAM uint8_t s_debounce_type[KEY_NUMBER_BITMAP_SIZE];
+
+/// Only one debouncer runs at a time, so they share their state.
+static XRAM union {
+    /// State for `MATRIX_DEBOUNCE_MODE_TIMER`
+    struct {
+        uint8_t time[MAX_NUM_KEYS];
+        uint8_t type[KEY_NUMBER_BITMAP_SIZE];
+    } timer;
+#if USE_COUNTER_DEBOUNCE
+    /// State for the bit-parallel debouncers. Bit `n` of the counter for a
+    /// pin is stored in `count[n]`, so a whole row byte of counters can be
+    /// updated at once.
+    struct {
+        uint8_t count[DEBOUNCE_COUNTER_BITS][MAX_NUM_ROWS][MATRIX_ROW_SIZE];
+        /// Pins in their hold off time (`MATRIX_DEBOUNCE_MODE_EAGER`)
+        uint8_t hold[MAX_NUM_ROWS][MATRIX_ROW_SIZE];
+    } counter;
+#endif
+} s_debounce;
+
+#if USE_COUNTER_DEBOUNCE
+/// Time of the last counter update for each row
+static XRAM uint8_t s_counter_tick[MAX_NUM_ROWS];
+/// Bit masks of the counter thresholds
+static XRAM uint8_t s_press_time_mask[DEBOUNCE_COUNTER_BITS];
+static XRAM uint8_t s_release_time_mask[DEBOUNCE_COUNTER_BITS];
+static XRAM uint8_t s_release_trigger_mask[DEBOUNCE_COUNTER_BITS];
+#endif
+
+#if USE_DEBOUNCE_STATS
+XRAM debounce_key_stats_t g_debounce_stats[MAX_NUM_KEYS];
+/// The raw pin values from the last call to `scanner_debounce_row()`
+static XRAM uint8_t s_last_raw_row[MAX_NUM_ROWS][MATRIX_ROW_SIZE];
+/// Time each key last started debouncing
+static XRAM uint8_t s_bounce_start_time[MAX_NUM_KEYS];
+/// Debounce windows each key started since its last late bounce
+static XRAM uint8_t s_adapt_windows[MAX_NUM_KEYS];
+#endif
 static XRAM uint8_t s_matrix_number_keys_down;
 static XRAM uint8_t s_matrix_number_keys_debouncing;
 
+#if USE_ANTI_GHOSTING
+/// Set when `g_scan_plan.anti_ghosting` is on and the matrix has rows
+static XRAM uint8_t s_is_anti_ghosting;
+/// Keys in `g_matrix` that have been passed on by the anti-ghosting filter
+static XRAM uint8_t s_reported_matrix[MAX_NUM_ROWS][MATRIX_ROW_SIZE];
+/// Keys of the current row that sit on a rectangle of down keys
+static XRAM uint8_t s_ghost_mask[MATRIX_ROW_SIZE];
+#endif
+
+#if USE_IDLE_SCAN
+/// Set while the matrix is waiting for a pin change instead of being scanned
+static XRAM uint8_t s_is_scan_idle;
+/// Time of the last scan that saw a key down or debouncing
+static XRAM uint16_t s_last_active_time;
+#endif
+
 XRAM uint8_t g_key_num_bitmap[KEY_NUMBER_BITMAP_SIZE];
 
 XRAM matrix_scan_plan_t g_scan_plan;
@@ -48,11 +109,21 @@ XRAM uint8_t g_delta_list_len;
 XRAM uint8_t g_down_list[MAX_DOWN_LIST];
 XRAM uint8_t g_down_list_len;
 
+/// Set when a key change didn't fit in `g_delta_list`, so the next packet
+/// has to carry the whole matrix state.
+static XRAM uint8_t s_is_delta_list_overflowed;
+/// Set when a pressed key didn't fit in `g_down_list`. The list is rebuilt
+/// from `g_key_num_bitmap` once few enough keys are down.
+static XRAM uint8_t s_is_down_list_overflowed;
+/// Number of keys set in `g_key_num_bitmap`
+static XRAM uint8_t s_num_reported_keys;
+/// Delta list packets sent since the last packet with the whole matrix state
+static XRAM uint8_t s_delta_packet_count;
+
 static void scanner_init_debouncer(void);
 
-// TODO: probably change this
 uint8_t get_matrix_compressed_size(void) {
-    return INT_DIV_ROUND_UP(g_scan_plan.max_key_num, 8);
+    return g_scan_plan.max_key_num / 8 + 1;
 }
 
 static inline uint8_t get_key_number(uint8_t row, uint8_t col) {
@@ -71,7 +142,7 @@ static inline uint8_t get_debounce_time(uint8_t key_num) {
     if (key_num == INVALID_KEY_NUMBER) {
         return s_invalid_key_debounce_time;
     } else {
-        return s_debounce_time[key_num];
+        return s_debounce.timer.time[key_num];
     }
 }
 
@@ -79,8 +150,25 @@ static inline void set_debounce_time(uint8_t key_num, uint8_t time) {
     if (key_num == INVALID_KEY_NUMBER) {
         s_invalid_key_debounce_time = time;
     } else {
-        s_debounce_time[key_num] = time;
+        s_debounce.timer.time[key_num] = time;
+    }
+}
+
+static inline uint8_t get_debounce_extra_time(uint8_t key_num) {
+#if USE_DEBOUNCE_STATS
+    if (key_num != INVALID_KEY_NUMBER) {
+        return g_debounce_stats[key_num].extra_time;
     }
+#endif
+    return 0;
+}
+
+static uint8_t get_debounce_time_press(uint8_t key_num) {
+    return g_scan_plan.debounce_time_press + get_debounce_extra_time(key_num);
+}
+
+static uint8_t get_debounce_time_release(uint8_t key_num) {
+    return g_scan_plan.debounce_time_release + get_debounce_extra_time(key_num);
 }
 
 int init_matrix_scanner_utils(void) {
@@ -99,10 +187,19 @@ int init_matrix_scanner_utils(void) {
 
     g_delta_list_len = 0;
     g_down_list_len = 0;
+    s_is_delta_list_overflowed = false;
+    s_is_down_list_overflowed = false;
+    s_num_reported_keys = 0;
+    s_delta_packet_count = 0;
     // TODO: load scan key map
     memset(g_key_num_bitmap, 0, KEY_NUMBER_BITMAP_SIZE);
     s_has_raw_matrix_updated = 0;
 
+#if USE_IDLE_SCAN
+    s_is_scan_idle = false;
+    s_last_active_time = timer_read16_ms();
+#endif
+
     scanner_init_debouncer();
 
     return 0;
@@ -120,15 +217,20 @@ void scanner_add_matrix_key(uint8_t key_num) {
     if (g_delta_list_len < MAX_UPDATE_LIST) {
         g_delta_list[g_delta_list_len] = MATRIX_DELTA_TYPE_PRESSED | key_num;
         g_delta_list_len++;
+    } else {
+        s_is_delta_list_overflowed = true;
     }
 
     if (g_down_list_len < MAX_DOWN_LIST) {
         g_down_list[g_down_list_len] = key_num;
         g_down_list_len++;
+    } else {
+        s_is_down_list_overflowed = true;
     }
 
     { // add key code to the key number bitmap
         g_key_num_bitmap[key_num / 8] |= (1 << (key_num % 8));
+        s_num_reported_keys++;
     }
 }
 
@@ -143,6 +245,8 @@ void scanner_del_matrix_key(uint8_t key_num) {
     if (g_delta_list_len < MAX_UPDATE_LIST) {
         g_delta_list[g_delta_list_len] = MATRIX_DELTA_TYPE_RELEASED | key_num;
         g_delta_list_len++;
+    } else {
+        s_is_delta_list_overflowed = true;
     }
 
     // delete key from the down key list
@@ -160,19 +264,71 @@ void scanner_del_matrix_key(uint8_t key_num) {
 
     { // delete key code from the key number bitmap
         g_key_num_bitmap[key_num / 8] &= ~(1 << (key_num % 8));
+        s_num_reported_keys--;
     }
 }
 
+/// Rebuild `g_down_list` from `g_key_num_bitmap` after it overflowed
+static void rebuild_down_list(void) {
+    const uint8_t matrix_size = get_matrix_compressed_size();
+    uint8_t i;
+
+    g_down_list_len = 0;
+    for (i = 0; i < matrix_size; ++i) {
+        const uint8_t keys = g_key_num_bitmap[i];
+        uint8_t bit;
+
+        if (!keys) {
+            continue;
+        }
+
+        for (bit = 0; bit < 8; ++bit) {
+            if (keys & (1 << bit)) {
+                g_down_list[g_down_list_len] = i*8 + bit;
+                g_down_list_len++;
+            }
+        }
+    }
+
+    s_is_down_list_overflowed = false;
+}
+
 uint8_t get_matrix_data(uint8_t *dest, bool use_deltas) {
     const uint8_t matrix_size = get_matrix_compressed_size();
-    const uint8_t num_keys_down = get_matrix_num_keys_down();
+    const uint8_t num_keys_down = s_num_reported_keys;
+    bool use_key_list;
 
 #if SCANNER_MATRIX_DELTA != 0
     const uint8_t num_keys_changed = g_delta_list_len;
+#endif
     g_delta_list_len = 0; // clear update list even if we don't use it
 
-    if (use_deltas || (matrix_size > (PACKET_PAYLOAD_LENGTH-1) && num_keys_down > PACKET_PAYLOAD_LENGTH-1)) {
-        if ( (num_keys_changed < num_keys_down) && (num_keys_changed < matrix_size) ) {
+    if (s_is_down_list_overflowed && num_keys_down <= MAX_DOWN_LIST) {
+        rebuild_down_list();
+    }
+
+    // The whole matrix state is sent either as a list of the keys that are
+    // down or as a bitmap, whichever is smaller.
+    use_key_list = !s_is_down_list_overflowed && (num_keys_down < matrix_size);
+
+#if SCANNER_MATRIX_DELTA != 0
+    {
+        const uint8_t full_size = (use_key_list ? num_keys_down : matrix_size) + 1;
+        // If the whole state doesn't fit in a packet, deltas are the only
+        // option left.
+        const bool is_full_too_big = (full_size > PACKET_PAYLOAD_LENGTH);
+
+        if (
+            !s_is_delta_list_overflowed &&
+            (use_deltas || is_full_too_big) &&
+            (
+                is_full_too_big || (
+                    num_keys_changed + 1 < full_size &&
+                    s_delta_packet_count < MATRIX_DELTA_REFRESH_COUNT
+                )
+            )
+        ) {
+            s_delta_packet_count++;
             *dest = (PACKET_MATRIX_DELTA_LIST << PACKET_MATRIX_TYPE_BIT_POS) | (num_keys_changed & PACKET_MATRIX_SIZE_MASK);
             dest++;
             memcpy(dest, g_delta_list, num_keys_changed);
@@ -181,11 +337,16 @@ uint8_t get_matrix_data(uint8_t *dest, bool use_deltas) {
     }
 #endif
 
+    // The whole matrix state is in this packet, so any lost deltas no
+    // longer matter.
+    s_is_delta_list_overflowed = false;
+    s_delta_packet_count = 0;
+
     // A few keys down, send a list of keys instead of the whole matrix.
-    if (num_keys_down < matrix_size) {
+    if (use_key_list) {
         *dest = (PACKET_MATRIX_KEY_LIST << PACKET_MATRIX_TYPE_BIT_POS) | (num_keys_down & PACKET_MATRIX_SIZE_MASK);
         dest++;
-        memcpy(dest, g_down_list, g_down_list_len);
+        memcpy(dest, g_down_list, num_keys_down);
         return num_keys_down+1;
     }
 
@@ -198,13 +359,298 @@ uint8_t get_matrix_data(uint8_t *dest, bool use_deltas) {
     }
 }
 
+#if USE_COUNTER_DEBOUNCE
+static uint8_t clamp_counter_time(uint8_t time) {
+    if (time > DEBOUNCE_COUNTER_MAX_TIME) {
+        return DEBOUNCE_COUNTER_MAX_TIME;
+    }
+    return time;
+}
+#endif
+
 static void scanner_init_debouncer(void) {
     memset(s_is_debouncing, 0, sizeof(s_is_debouncing));
+    memset(&s_debounce, 0, sizeof(s_debounce));
     s_matrix_number_keys_down = 0;
     s_matrix_number_keys_debouncing = 0;
+
+#if USE_DEBOUNCE_STATS
+    memset(g_debounce_stats, 0, sizeof(g_debounce_stats));
+    memset(s_last_raw_row, 0, sizeof(s_last_raw_row));
+    memset(s_adapt_windows, 0, sizeof(s_adapt_windows));
+#endif
+
+#if USE_ANTI_GHOSTING
+    memset(s_reported_matrix, 0, sizeof(s_reported_matrix));
+    s_is_anti_ghosting = g_scan_plan.anti_ghosting && (
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_COL_ROW ||
+        g_scan_plan.mode == MATRIX_SCANNER_MODE_ROW_COL
+    );
+#endif
+
+#if USE_COUNTER_DEBOUNCE
+    if (g_scan_plan.debounce_mode != MATRIX_DEBOUNCE_MODE_TIMER) {
+        const uint8_t press_time = clamp_counter_time(g_scan_plan.debounce_time_press);
+        const uint8_t release_time = clamp_counter_time(g_scan_plan.debounce_time_release);
+        const uint8_t release_trigger = clamp_counter_time(g_scan_plan.trigger_time_release);
+        uint8_t bit;
+
+        // Expand each threshold bit to a whole byte so it can be compared
+        // against a row of vertical counters in one go.
+        for (bit = 0; bit < DEBOUNCE_COUNTER_BITS; ++bit) {
+            s_press_time_mask[bit] = ((press_time >> bit) & 1) ? 0xff : 0x00;
+            s_release_time_mask[bit] = ((release_time >> bit) & 1) ? 0xff : 0x00;
+            s_release_trigger_mask[bit] = ((release_trigger >> bit) & 1) ? 0xff : 0x00;
+        }
+        memset(s_counter_tick, timer_read8_ms(), sizeof(s_counter_tick));
+    }
+#else
+    // The bit-parallel debouncers aren't built in
+    g_scan_plan.debounce_mode = MATRIX_DEBOUNCE_MODE_TIMER;
+#endif
 }
 
-bool scanner_debounce_row(
+#if USE_COUNTER_DEBOUNCE || USE_ANTI_GHOSTING
+
+static uint8_t count_set_bits(uint8_t value) {
+    uint8_t result = 0;
+    while (value) {
+        value &= value - 1;
+        result++;
+    }
+    return result;
+}
+#endif
+
+#if USE_COUNTER_DEBOUNCE
+/// Clear the counters of pins not in `keep`, then add one to the counters of
+/// the pins in `inc`.
+static void advance_counters(uint8_t row, uint8_t i, uint8_t keep, uint8_t inc) {
+    uint8_t carry = inc;
+    uint8_t bit;
+    for (bit = 0; bit < DEBOUNCE_COUNTER_BITS; ++bit) {
+        const uint8_t count = s_debounce.counter.count[bit][row][i] & keep;
+        s_debounce.counter.count[bit][row][i] = count ^ carry;
+        carry &= count;
+    }
+}
+
+/// Update the debouncing key count after a row byte changed from
+/// `old_debouncing` to `new_debouncing`.
+static void update_debouncing_count(uint8_t old_debouncing, uint8_t new_debouncing) {
+    s_matrix_number_keys_debouncing +=
+        count_set_bits(new_debouncing) - count_set_bits(old_debouncing);
+}
+#endif
+
+#if USE_COUNTER_DEBOUNCE || USE_ANTI_GHOSTING
+
+/// Pass the pins that were pressed/released in byte `i` of a row on to the
+/// matrix scanner module.
+static void report_changed_pins(
+    uint8_t row,
+    uint8_t i,
+    uint8_t pressed,
+    uint8_t released
+) {
+    uint8_t pin_mask = 0x01;
+    uint8_t col = i*8;
+
+    for ( ; pin_mask != 0; col++, pin_mask <<= 1) {
+        if (pressed & pin_mask) {
+            scanner_add_matrix_key(get_key_number(row, col));
+        } else if (released & pin_mask) {
+            scanner_del_matrix_key(get_key_number(row, col));
+        }
+    }
+}
+#endif
+
+#if USE_COUNTER_DEBOUNCE
+/// Register the pins that the debouncer accepted as pressed/released in byte
+/// `i` of a row. `g_matrix` must already be updated. With the anti-ghosting
+/// filter on, the keys are passed on later by `scanner_filter_ghosts()`.
+static void register_changed_pins(
+    uint8_t row,
+    uint8_t i,
+    uint8_t pressed,
+    uint8_t released
+) {
+    s_matrix_number_keys_down += count_set_bits(pressed) - count_set_bits(released);
+#if USE_ANTI_GHOSTING
+    if (s_is_anti_ghosting) {
+        return;
+    }
+#endif
+    report_changed_pins(row, i, pressed, released);
+}
+#endif
+
+/// Register a single key press accepted by the debouncer. `g_matrix` must
+/// already be updated.
+static void register_key_press(uint8_t key_num) {
+    s_matrix_number_keys_down++;
+#if USE_ANTI_GHOSTING
+    if (s_is_anti_ghosting) {
+        return;
+    }
+#endif
+    scanner_add_matrix_key(key_num);
+}
+
+/// Register a single key release accepted by the debouncer. `g_matrix` must
+/// already be updated.
+static void register_key_release(uint8_t key_num) {
+    s_matrix_number_keys_down--;
+#if USE_ANTI_GHOSTING
+    if (s_is_anti_ghosting) {
+        return;
+    }
+#endif
+    scanner_del_matrix_key(key_num);
+}
+
+#if USE_COUNTER_DEBOUNCE
+/// Bit-parallel debouncer. Each pin has a counter of how many ms it has read
+/// a different value from its state in `g_matrix`. When a counter reaches the
+/// threshold for that pin, the new state is accepted. The counters are stored
+/// as vertical counters, so a byte of pins takes the same number of
+/// operations as a single pin, and key numbers only need to be looked up for
+/// the pins that actually change state.
+static bool scanner_debounce_row_integrator(
+    uint8_t row,
+    const uint8_t *new_row,
+    uint8_t bytes_per_row
+) REENT {
+    const uint8_t cur_time = timer_read8_ms();
+    const bool is_new_tick = (cur_time != s_counter_tick[row]);
+    uint8_t i;
+
+    s_has_updated = false;
+    s_counter_tick[row] = cur_time;
+
+    for (i = 0; i < bytes_per_row; ++i) {
+        const uint8_t state = g_matrix[row][i];
+        const uint8_t was_debouncing = s_is_debouncing[row][i];
+        // pins whose new reading doesn't match their debounced state
+        const uint8_t active = state ^ new_row[i];
+        uint8_t mismatch;
+        uint8_t done;
+        uint8_t bit;
+
+        if (!active && !was_debouncing) {
+            continue;
+        }
+
+        // Reset counters for pins that bounced back, and find pins that
+        // have reached their threshold. Released pins count towards a press
+        // and pressed pins count towards a release.
+        mismatch = 0;
+        for (bit = 0; bit < DEBOUNCE_COUNTER_BITS; ++bit) {
+            const uint8_t threshold =
+                (state & s_release_time_mask[bit]) |
+                (~state & s_press_time_mask[bit]);
+            s_debounce.counter.count[bit][row][i] &= active;
+            mismatch |= s_debounce.counter.count[bit][row][i] ^ threshold;
+        }
+        done = active & ~mismatch;
+
+        // Advance the counters of the pins that are still debouncing, and
+        // clear the counters of the pins that have finished.
+        advance_counters(row, i, active & ~done, is_new_tick ? (active & ~done) : 0);
+
+        s_is_debouncing[row][i] = active & ~done;
+        update_debouncing_count(was_debouncing, active & ~done);
+
+        if (done) {
+            g_matrix[row][i] = state ^ done;
+            register_changed_pins(row, i, done & new_row[i], done & ~new_row[i]);
+        }
+    }
+
+    return s_has_updated;
+}
+
+/// Eager press, deferred release debouncer. Uses the same vertical counters
+/// as the integrator. Each pin is in one of these states:
+///
+/// * idle: the pin is read every scan. A press is registered straight away,
+///   and an up reading on a pressed key starts a release wait.
+/// * release wait (busy, not hold): the key is down but reads up. The
+///   release is registered once it has read up for `trigger_time_release`
+///   ms. Reading down again cancels the wait without any events.
+/// * hold (busy and hold): after a press or release is registered, the pin
+///   is ignored for `debounce_time_press`/`debounce_time_release` ms.
+///
+/// A press can only follow a release after the release hold off, and a
+/// release can only follow a press after the press hold off plus a steady
+/// up reading, so a bouncing or noisy pin can't make extra events.
+static bool scanner_debounce_row_eager(
+    uint8_t row,
+    const uint8_t *new_row,
+    uint8_t bytes_per_row
+) REENT {
+    const uint8_t cur_time = timer_read8_ms();
+    const bool is_new_tick = (cur_time != s_counter_tick[row]);
+    uint8_t i;
+
+    s_has_updated = false;
+    s_counter_tick[row] = cur_time;
+
+    for (i = 0; i < bytes_per_row; ++i) {
+        const uint8_t state = g_matrix[row][i];
+        const uint8_t raw = new_row[i];
+        const uint8_t busy = s_is_debouncing[row][i];
+        const uint8_t hold = s_debounce.counter.hold[row][i];
+        uint8_t mismatch;
+        uint8_t expired;
+        uint8_t continuing;
+        uint8_t pressed;
+        uint8_t released;
+        uint8_t idle;
+        uint8_t bit;
+
+        if (!busy && state == raw) {
+            continue;
+        }
+
+        // Find the pins whose hold off or release wait has run out
+        mismatch = 0;
+        for (bit = 0; bit < DEBOUNCE_COUNTER_BITS; ++bit) {
+            const uint8_t threshold =
+                (hold & (
+                    (state & s_press_time_mask[bit]) |
+                    (~state & s_release_time_mask[bit])
+                )) |
+                (~hold & s_release_trigger_mask[bit]);
+            mismatch |= s_debounce.counter.count[bit][row][i] ^ threshold;
+        }
+        expired = busy & ~mismatch;
+
+        released = busy & ~hold & ~raw & expired;
+        continuing = busy & ~(hold & expired) & ~(~hold & raw) & ~released;
+
+        // Pins that aren't waiting on anything react to the raw value now
+        idle = ~(continuing | released);
+        pressed = idle & ~state & raw;
+
+        advance_counters(row, i, continuing, is_new_tick ? continuing : 0);
+        s_debounce.counter.hold[row][i] = (hold & continuing) | pressed | released;
+        s_is_debouncing[row][i] = continuing | pressed | released |
+            (idle & state & ~raw);
+        update_debouncing_count(busy, s_is_debouncing[row][i]);
+
+        if (pressed | released) {
+            g_matrix[row][i] = state ^ (pressed | released);
+            register_changed_pins(row, i, pressed, released);
+        }
+    }
+
+    return s_has_updated;
+}
+#endif
+
+static bool scanner_debounce_row_timer(
     uint8_t row,
     const uint8_t *new_row,
     uint8_t bytes_per_row
@@ -236,7 +682,7 @@ bool scanner_debounce_row(
 
                 // key debouncing:
                 // check if the key has finished debouncing
-                if (bitmap_get_bit(s_debounce_type, key_num)) {
+                if (bitmap_get_bit(s_debounce.timer.type, key_num)) {
                     // debouncing key press
                     const uint8_t bounce_duration = (uint8_t)(
                         cur_time - get_debounce_time(key_num)
@@ -248,8 +694,7 @@ bool scanner_debounce_row(
                                 // if still down after DEBOUNCE_PRESS_TRIGGER_TIME
                                 // register the key press
                                 g_matrix[row][i] |= pin_mask;
-                                s_matrix_number_keys_down++;
-                                scanner_add_matrix_key(key_num);
+                                register_key_press(key_num);
                             } else {
                                 // reject key press and reset debouncing state
                                 s_is_debouncing[row][i] &= ~pin_mask;
@@ -259,7 +704,7 @@ bool scanner_debounce_row(
                     } else {
                         // key press has already been registered, wait until the
                         // debounce time is over
-                        if ( bounce_duration >= g_scan_plan.debounce_time_press) {
+                        if (bounce_duration >= get_debounce_time_press(key_num)) {
                             // debounce time is now over
                             s_is_debouncing[row][i] &= ~pin_mask;
                             s_matrix_number_keys_debouncing--;
@@ -281,9 +726,8 @@ bool scanner_debounce_row(
                             // key has been in the up state for DEBOUNCE_RELEASE_TRIGGER_TIME,
                             // accept that the key has actual been release now
                             g_matrix[row][i] &= ~pin_mask;
-                            s_matrix_number_keys_down--;
-                            scanner_del_matrix_key(key_num);
-                        } else if (bounce_duration >= g_scan_plan.debounce_time_release ) {
+                            register_key_release(key_num);
+                        } else if (bounce_duration >= get_debounce_time_release(key_num)) {
                             // debounce over
                             s_is_debouncing[row][i] &= ~pin_mask;
                             s_matrix_number_keys_debouncing--;
@@ -313,24 +757,22 @@ bool scanner_debounce_row(
                     // changes in key state.
                     // state.
                     g_matrix[row][i] |= pin_mask;
-                    s_matrix_number_keys_down++;
-                    scanner_add_matrix_key(key_num);
+                    register_key_press(key_num);
                 } else if (g_scan_plan.trigger_time_release == 0 && !is_key_down) {
                     // debounce release trigger time is 0, so register the key press
                     // immediately. The debouncing algorithm then waits until
                     // DEBOUNCE_RELEASE_TIME has elapsed before accepting any
                     // more changes in key state.
                     g_matrix[row][i] &= ~pin_mask;
-                    s_matrix_number_keys_down--;
-                    scanner_del_matrix_key(key_num);
+                    register_key_release(key_num);
                 }
 
                 // this pin has changed, so we start it's debounce timer
                 if (is_key_down) {
-                    bitmap_set_bit(s_debounce_type, key_num); // indicates key press debounce
+                    bitmap_set_bit(s_debounce.timer.type, key_num); // indicates key press debounce
 
                 } else {
-                    bitmap_clear_bit(s_debounce_type, key_num); // indicates key release debounce
+                    bitmap_clear_bit(s_debounce.timer.type, key_num); // indicates key release debounce
                 }
 
                 s_is_debouncing[row][i] |= pin_mask;
@@ -343,6 +785,227 @@ bool scanner_debounce_row(
     return s_has_updated;
 }
 
+#if USE_DEBOUNCE_STATS
+static void record_bounce(uint8_t key_num, uint8_t cur_time) {
+    XRAM debounce_key_stats_t *stats = &g_debounce_stats[key_num];
+    const uint8_t bounce_time = cur_time - s_bounce_start_time[key_num];
+    uint8_t window_time;
+    uint8_t window;
+
+    if (stats->bounce_count != UINT8_MAX) {
+        stats->bounce_count++;
+    }
+    if (bounce_time > stats->max_bounce_time) {
+        stats->max_bounce_time = bounce_time;
+    }
+
+    // Only the timer debouncer has per key debounce times
+    if (g_scan_plan.debounce_mode != MATRIX_DEBOUNCE_MODE_TIMER) {
+        return;
+    }
+
+    // The timer debouncer restarts the release window each time the key
+    // bounces back down, so measure from its window and not from the first
+    // edge. This runs before the debouncer sees the bounce, so the window
+    // hasn't been restarted for it yet.
+    window_time = cur_time - get_debounce_time(key_num);
+    window = bitmap_get_bit(s_debounce.timer.type, key_num) ?
+        get_debounce_time_press(key_num) :
+        get_debounce_time_release(key_num);
+
+    // A bounce in the last ms of the debounce window means the switch is
+    // close to outlasting it, so give this key a longer window.
+    if (
+        window_time + 1 >= window &&
+        stats->extra_time < g_scan_plan.debounce_adapt_limit
+    ) {
+        stats->extra_time++;
+    }
+
+    // A bounce that would have been late with 1ms less extra time stops the
+    // extra time from decaying
+    if (window_time + 2 >= window) {
+        s_adapt_windows[key_num] = 0;
+    }
+}
+
+/// A key started a new debounce window. Once a key has gone through
+/// `DEBOUNCE_ADAPT_DECAY_WINDOWS` windows without a late bounce, 1ms of its
+/// extra debounce time is taken away again, so a switch that stopped
+/// bouncing late goes back to the fastest debounce time that is safe for it.
+static void record_window_start(uint8_t key_num) {
+    XRAM debounce_key_stats_t *stats = &g_debounce_stats[key_num];
+
+    if (stats->extra_time == 0) {
+        return;
+    }
+
+    s_adapt_windows[key_num]++;
+    if (s_adapt_windows[key_num] >= DEBOUNCE_ADAPT_DECAY_WINDOWS) {
+        s_adapt_windows[key_num] = 0;
+        stats->extra_time--;
+    }
+}
+
+/// Record the start of each debounce window and the bounces that happen
+/// inside it. Only pins whose raw value changed need their key number
+/// looked up.
+static void update_bounce_stats(
+    uint8_t row,
+    const uint8_t *new_row,
+    uint8_t bytes_per_row
+) {
+    const uint8_t cur_time = timer_read8_ms();
+    uint8_t i;
+
+    for (i = 0; i < bytes_per_row; ++i) {
+        const uint8_t raw_changed = s_last_raw_row[row][i] ^ new_row[i];
+        const uint8_t debouncing = s_is_debouncing[row][i];
+        const uint8_t started = ~debouncing & (
+            raw_changed | (g_matrix[row][i] ^ new_row[i])
+        );
+        const uint8_t bounced = debouncing & raw_changed;
+        uint8_t pin_mask = 0x01;
+        uint8_t col = i*8;
+
+        s_last_raw_row[row][i] = new_row[i];
+
+        if (!(started | bounced)) {
+            continue;
+        }
+
+        for ( ; pin_mask != 0; col++, pin_mask <<= 1) {
+            uint8_t key_num;
+
+            if (!((started | bounced) & pin_mask)) {
+                continue;
+            }
+
+            key_num = get_key_number(row, col);
+            if (key_num == INVALID_KEY_NUMBER) {
+                continue;
+            }
+
+            if (started & pin_mask) {
+                s_bounce_start_time[key_num] = cur_time;
+                record_window_start(key_num);
+            } else {
+                record_bounce(key_num, cur_time);
+            }
+        }
+    }
+}
+#endif
+
+#if USE_ANTI_GHOSTING
+/// Find the down keys of `row` that share two or more columns with the down
+/// keys of another row, and store them in `s_ghost_mask`.
+///
+/// Without diodes, three down keys on the corners of a rectangle pull the
+/// fourth corner down too, so once two rows share two columns there is no
+/// way to tell which of the shared keys are real.
+static void find_ghost_keys(uint8_t row, uint8_t bytes_per_row) {
+    uint8_t other;
+    uint8_t i;
+
+    memset(s_ghost_mask, 0, sizeof(s_ghost_mask));
+
+    for (other = 0; other < g_scan_plan.rows; ++other) {
+        uint8_t shared_cols = 0;
+
+        if (other == row) {
+            continue;
+        }
+
+        for (i = 0; i < bytes_per_row; ++i) {
+            const uint8_t shared = g_matrix[row][i] & g_matrix[other][i];
+            if (shared) {
+                shared_cols += count_set_bits(shared);
+            }
+        }
+
+        if (shared_cols < 2) {
+            continue;
+        }
+
+        for (i = 0; i < bytes_per_row; ++i) {
+            s_ghost_mask[i] |= g_matrix[row][i] & g_matrix[other][i];
+        }
+    }
+}
+
+/// Anti-ghosting filter, run once the last row of the matrix has been
+/// debounced. Releases are always passed on, but a press is held back while
+/// its key sits on a rectangle of down keys. Keys that were already passed
+/// on stay down, so only the key that completed the rectangle and the ghost
+/// it caused are suppressed. A held back key is passed on as soon as it
+/// stops being ambiguous.
+static void scanner_filter_ghosts(uint8_t bytes_per_row) {
+    uint8_t row;
+    uint8_t i;
+
+    for (row = 0; row < g_scan_plan.rows; ++row) {
+        uint8_t pending = 0;
+
+        for (i = 0; i < bytes_per_row; ++i) {
+            pending |= g_matrix[row][i] ^ s_reported_matrix[row][i];
+        }
+
+        if (!pending) {
+            continue;
+        }
+
+        find_ghost_keys(row, bytes_per_row);
+
+        for (i = 0; i < bytes_per_row; ++i) {
+            const uint8_t state = g_matrix[row][i];
+            const uint8_t reported = s_reported_matrix[row][i];
+            const uint8_t pressed = state & ~reported & ~s_ghost_mask[i];
+            const uint8_t released = reported & ~state;
+
+            if (pressed | released) {
+                s_reported_matrix[row][i] = reported ^ (pressed | released);
+                report_changed_pins(row, i, pressed, released);
+            }
+        }
+    }
+}
+#endif
+
+bool scanner_debounce_row(
+    uint8_t row,
+    const uint8_t *new_row,
+    uint8_t bytes_per_row
+) REENT {
+    bool has_updated;
+
+#if USE_DEBOUNCE_STATS
+    update_bounce_stats(row, new_row, bytes_per_row);
+#endif
+
+#if USE_COUNTER_DEBOUNCE
+    if (g_scan_plan.debounce_mode == MATRIX_DEBOUNCE_MODE_INTEGRATOR) {
+        has_updated = scanner_debounce_row_integrator(row, new_row, bytes_per_row);
+    } else if (g_scan_plan.debounce_mode == MATRIX_DEBOUNCE_MODE_EAGER) {
+        has_updated = scanner_debounce_row_eager(row, new_row, bytes_per_row);
+    } else
+#endif
+    {
+        has_updated = scanner_debounce_row_timer(row, new_row, bytes_per_row);
+    }
+
+#if USE_ANTI_GHOSTING
+    // A ghost can show up in an earlier row than the key that caused it, so
+    // wait until every row has been debounced before looking for them.
+    if (s_is_anti_ghosting && row == g_scan_plan.rows - 1) {
+        scanner_filter_ghosts(bytes_per_row);
+        has_updated = s_has_updated;
+    }
+#endif
+
+    return has_updated;
+}
+
 uint8_t get_matrix_num_keys_down(void) {
     return s_matrix_number_keys_down;
 }
@@ -351,6 +1014,50 @@ uint8_t get_matrix_num_keys_debouncing(void) {
     return s_matrix_number_keys_debouncing;
 }
 
+#if USE_IDLE_SCAN
+bool matrix_scan_task(void) {
+    bool scan_changed;
+
+    if (s_is_scan_idle) {
+        if (!matrix_scan_irq_has_triggered()) {
+            return false;
+        }
+
+        // A pin changed, so go back to scanning
+        matrix_scan_irq_disable();
+        s_is_scan_idle = false;
+        s_last_active_time = timer_read16_ms();
+    }
+
+    scan_changed = matrix_scan();
+
+    if (
+        scan_changed ||
+        get_matrix_num_keys_down() ||
+        get_matrix_num_keys_debouncing() ||
+        g_scan_plan.scan_idle_time == 0
+    ) {
+        s_last_active_time = timer_read16_ms();
+    } else if (
+        (uint16_t)(timer_read16_ms() - s_last_active_time) >=
+        g_scan_plan.scan_idle_time
+    ) {
+        matrix_scan_irq_enable();
+
+        if (matrix_has_active_row()) {
+            // A key went down after the last scan. Its pin is already low
+            // so it won't trigger the interrupt, keep scanning instead.
+            matrix_scan_irq_disable();
+            s_last_active_time = timer_read16_ms();
+        } else {
+            s_is_scan_idle = true;
+        }
+    }
+
+    return scan_changed;
+}
+#endif
+
 #define PASSTHROUGH_BITMAP_SIZE (MAX_NUM_KEYS/8)
 
 void passthrough_keycodes_task(void) REENT {
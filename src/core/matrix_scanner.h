@@ -76,6 +76,33 @@ typedef enum matrix_internal_scan_method_t {
     MATRIX_SCANNER_INTERNAL_CUSTOM = 0xff,
 } matrix_internal_scan_method_t;
 
+/// Debouncing algorithms that can be selected by the scan plan
+typedef enum matrix_debounce_mode_t {
+    /// Per key timestamps. Uses the trigger times to decide when to register
+    /// a change and the debounce times to ignore bounces after it.
+    MATRIX_DEBOUNCE_MODE_TIMER = 0x00,
+    /// Bit-parallel integrator built from vertical counters. Each row is
+    /// updated a byte at a time, and a change is registered once a pin has
+    /// read its new state for `debounce_time_press`/`debounce_time_release`
+    /// ms in a row. The trigger times are not used by this mode.
+    MATRIX_DEBOUNCE_MODE_INTEGRATOR = 0x01,
+    /// Eager press, deferred release. A press is registered on the first
+    /// scan that sees it, then the key ignores its pin for
+    /// `debounce_time_press` ms. A release is only registered after the key
+    /// has read up for `trigger_time_release` ms in a row, then the key
+    /// ignores its pin for `debounce_time_release` ms. Uses vertical
+    /// counters like the integrator.
+    ///
+    /// Builds with `USE_COUNTER_DEBOUNCE = 0` use the timer mode in place of
+    /// the integrator and eager modes.
+    MATRIX_DEBOUNCE_MODE_EAGER = 0x02,
+} matrix_debounce_mode_t;
+
+/// Number of bits in the vertical counters used by the bit-parallel debouncers
+#define DEBOUNCE_COUNTER_BITS 4
+/// Largest time (in ms) the bit-parallel debouncers can count up to
+#define DEBOUNCE_COUNTER_MAX_TIME ((1 << DEBOUNCE_COUNTER_BITS) - 1)
+
 typedef struct matrix_scan_plan_t {
     uint8_t mode; ///< matrix scanning mode
     uint8_t rows; ///< number of rows in the scan matrix
@@ -93,8 +120,26 @@ typedef struct matrix_scan_plan_t {
     uint8_t parasitic_discharge_delay_debouncing;
     uint8_t max_col_pin_num; ///< The largest column pin number used.
     uint8_t max_key_num; ///< The largest key number used.
+    uint8_t debounce_mode; ///< One of `matrix_debounce_mode_t`
+    /// The most time (ms) that can be added to a key's debounce times when
+    /// it is seen bouncing late in its debounce window. The added time
+    /// decays again once the key stops bouncing late. 0 turns this off.
+    uint8_t debounce_adapt_limit;
+    /// How long (ms) the matrix must be quiet before `matrix_scan_task()`
+    /// stops scanning and waits for a pin change. 0 always scans.
+    uint8_t scan_idle_time;
+    /// When non zero, key presses that could be ghosts in a matrix without
+    /// diodes are held back until they are no longer ambiguous.
+    uint8_t anti_ghosting;
 } ATTR_PACKED matrix_scan_plan_t;
 
+/// Bounce statistics for a single key
+typedef struct debounce_key_stats_t {
+    uint8_t bounce_count; ///< Number of bounces seen (saturates at 255)
+    uint8_t max_bounce_time; ///< Longest time from the first edge to a bounce (ms)
+    uint8_t extra_time; ///< Time (ms) added to this key's debounce times
+} ATTR_PACKED debounce_key_stats_t;
+
 
 /*********************************************************************
  *                         global variables                          *
@@ -110,6 +155,10 @@ extern XRAM uint8_t g_key_num_bitmap[KEY_NUMBER_BITMAP_SIZE];
 extern const ROM uint8_t *g_scan_key_map;
 extern XRAM matrix_scan_plan_t g_scan_plan;
 
+#if USE_DEBOUNCE_STATS
+extern XRAM debounce_key_stats_t g_debounce_stats[MAX_NUM_KEYS];
+#endif
+
 /*********************************************************************
  *                    port implemented functions                     *
  *********************************************************************/
@@ -152,6 +201,20 @@ uint8_t get_matrix_num_keys_down(void);
 /// Returns the number of keys currently being debounced in the matrix
 uint8_t get_matrix_num_keys_debouncing(void);
 
+#if USE_IDLE_SCAN
+/// Scan the matrix, but only while it might be changing.
+///
+/// Once no keys have been down or debouncing for `g_scan_plan.scan_idle_time`
+/// ms, this selects all the rows with `matrix_scan_irq_enable()` and stops
+/// scanning. Scanning starts again on the first call after
+/// `matrix_scan_irq_has_triggered()` reports a pin change.
+///
+/// @return true if the matrix state has changed
+bool matrix_scan_task(void);
+#else
+#define matrix_scan_task() matrix_scan()
+#endif
+
 /// setup for common scanning and debouncing code
 ///
 /// @return returns non zero on error
@@ -172,6 +235,11 @@ int init_matrix_scanner_utils(void);
 /// that is a packet which lists only the keys that changed and not the entire
 /// matrix state. However, the function may choose to ignore the `use_deltas`
 /// flag if it is more efficient to transmit the entire matrix state.
+///
+/// The smallest of the three encodings is used. The entire matrix state is
+/// always sent after more key changes happened than fit in the delta list,
+/// and after every `MATRIX_DELTA_REFRESH_COUNT` delta packets, so a receiver
+/// that missed a packet doesn't keep a stuck key.
 uint8_t get_matrix_data(uint8_t *dest, bool use_deltas);
 
 /// Add a pressed key to the matrix scanner, putting it in the pressed state.
@@ -192,7 +260,7 @@ void scanner_del_matrix_key(uint8_t key_num);
 /// `scanner_del_matrix_key()` and `scanner_add_matrix_key()` to add the key
 /// press/release event to the matrix scanner module.
 ///
-/// s
+/// The algorithm used is picked by `g_scan_plan.debounce_mode`.
 bool scanner_debounce_row(
     uint8_t row,
     const uint8_t *new_row,
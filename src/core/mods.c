@@ -101,10 +101,8 @@ uint8_t get_mods(void) {
 
 void apply_mods(void) {
     if (mods_dirty) {
-        touch_keyboard_report();
         mod_state = get_mods();
-        g_boot_keyboard_report.modifiers = mod_state;
-        g_nkro_keyboard_report.modifiers = mod_state;
+        set_keyboard_report_modifiers(mod_state);
         mods_dirty = 0;
     }
 }
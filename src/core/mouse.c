@@ -7,15 +7,22 @@
 
 #include "core/layout.h"
 #include "core/matrix_interpret.h"
+#include "core/timer.h"
 #include "key_handlers/key_hold.h"
 
 #include <stdio.h>
 
 // TODO: should move this to an init function
-XRAM hid_report_mouse_t g_mouse_state = {0};
+XRAM mouse_state_t g_mouse_state = {0};
 XRAM uint8_t g_mouse_activity = 0;
 
 #if USE_MOUSE_GESTURE
+// Time in ms before a tapped gesture keycode is released
+#define GESTURE_TAP_RELEASE_TIME 3
+
+// Matches any second stroke in `find_gesture_sequence()`
+#define GESTURE_ANY 0xfe
+
 XRAM gesture_state_t s_gesture = {0};
 
 void gesture_init(void) {
@@ -28,20 +35,191 @@ void gesture_press(uint16_t ekc_addr, uint8_t kb_id) {
         s_gesture.state = GESTURE_STATE_SCANNING;
         s_gesture.ekc_addr = ekc_addr;
         s_gesture.kb_id = kb_id;
+        s_gesture.start_time = timer_read16_ms();
         get_ekc_data(&s_gesture.threshold, s_gesture.ekc_addr, sizeof(uint16_t)*3);
+        get_ekc_data(
+            &s_gesture.timeout,
+            s_gesture.ekc_addr + EKC_GESTURE_TIMEOUT_ADDR,
+            sizeof(uint16_t)*2 + sizeof(uint8_t)
+        );
+    }
+}
+
+/// @brief Get the direction of a stroke, treating flicks as normal strokes.
+static uint8_t get_base_stroke(uint8_t stroke) {
+    if (stroke >= GESTURE_FLICK_LEFT && stroke <= GESTURE_FLICK_DOWN) {
+        return stroke - GESTURE_FLICK_LEFT + GESTURE_LEFT;
+    }
+    return stroke;
+}
+
+/// @brief Search the flick and two-stroke gestures of the gesture key.
+///
+/// @return The keycode for the sequence, or KC_NONE if there is no match
+static keycode_t find_gesture_sequence(uint8_t first, uint8_t second) {
+    gesture_sequence_t seq;
+    uint8_t i;
+
+    for (i = 0; i < s_gesture.num_sequences; ++i) {
+        get_ekc_data(
+            &seq,
+            s_gesture.ekc_addr + EKC_GESTURE_SEQUENCES_ADDR + i*sizeof(gesture_sequence_t),
+            sizeof(gesture_sequence_t)
+        );
+        if (seq.first != first) {
+            continue;
+        }
+        if (
+            seq.second == second ||
+            (second == GESTURE_ANY && seq.second != GESTURE_NONE)
+        ) {
+            return seq.keycode;
+        }
+    }
+    return KC_NONE;
+}
+
+/// @brief Get the keycode for a single stroke or tap.
+static keycode_t get_stroke_keycode(uint8_t stroke) {
+    keycode_t gesture_kc;
+
+    if (stroke >= GESTURE_FLICK_LEFT) {
+        gesture_kc = find_gesture_sequence(stroke, GESTURE_NONE);
+        if (gesture_kc != KC_NONE) {
+            return gesture_kc;
+        }
+        // Flicks without their own keycode act like normal strokes
+        stroke = get_base_stroke(stroke);
+    }
+
+    get_ekc_data(
+        &gesture_kc,
+        s_gesture.ekc_addr + EKC_GESTURE_LEFT_ADDR + stroke*2,
+        sizeof(keycode_t)
+    );
+    return gesture_kc;
+}
+
+/// @brief Press a gesture keycode until the gesture key is released.
+static void trigger_gesture(keycode_t gesture_kc) {
+    queue_keycode_event(gesture_kc, EVENT_PRESSED, s_gesture.kb_id);
+
+    s_gesture.state = GESTURE_STATE_ACTIVATED;
+    s_gesture.triggered_kc = gesture_kc;
+}
+
+/// @brief Press a gesture keycode and release it from `gesture_task()`.
+static void tap_gesture(keycode_t gesture_kc) {
+    queue_keycode_event(gesture_kc, EVENT_PRESSED, s_gesture.kb_id);
+
+    s_gesture.state = GESTURE_STATE_TAPPED;
+    s_gesture.triggered_kc = gesture_kc;
+    s_gesture.start_time = timer_read16_ms();
+}
+
+static void finish_stroke(uint8_t stroke) {
+    const uint8_t base_stroke = get_base_stroke(stroke);
+
+    if (s_gesture.state == GESTURE_STATE_SECOND_STROKE) {
+        keycode_t gesture_kc = find_gesture_sequence(
+            get_base_stroke(s_gesture.first_stroke),
+            base_stroke
+        );
+        if (gesture_kc == KC_NONE) {
+            // Not a known two-stroke gesture, use the first stroke by itself
+            gesture_kc = get_stroke_keycode(s_gesture.first_stroke);
+        }
+        trigger_gesture(gesture_kc);
+    } else if (find_gesture_sequence(base_stroke, GESTURE_ANY) != KC_NONE) {
+        // This stroke can start a two-stroke gesture, so wait for the second
+        s_gesture.state = GESTURE_STATE_SECOND_STROKE;
+        s_gesture.first_stroke = stroke;
+        s_gesture.start_time = timer_read16_ms();
+        s_gesture.x = 0;
+        s_gesture.y = 0;
+    } else {
+        trigger_gesture(get_stroke_keycode(stroke));
+    }
+}
+
+/// @brief Feed a batch of mouse movement to the gesture recognizer.
+static void gesture_update(int16_t x, int16_t y) {
+    const uint16_t current_time = timer_read16_ms();
+    uint8_t has_pos_x, has_neg_x, has_pos_y, has_neg_y;
+    uint8_t stroke;
+
+    if (
+        (s_gesture.state != GESTURE_STATE_SCANNING &&
+         s_gesture.state != GESTURE_STATE_SECOND_STROKE) ||
+        (x == 0 && y == 0)
+    ) {
+        return;
+    }
+
+    if (s_gesture.x == 0 && s_gesture.y == 0) {
+        s_gesture.stroke_time = current_time;
+    }
+
+    s_gesture.x += x;
+    s_gesture.y += y;
+
+    // trigger threshold for diagonal motions, a threshold of 0 disables them
+    has_pos_x = s_gesture.threshold_diag && s_gesture.x >  s_gesture.threshold_diag;
+    has_neg_x = s_gesture.threshold_diag && s_gesture.x < -s_gesture.threshold_diag;
+    has_pos_y = s_gesture.threshold_diag && s_gesture.y >  s_gesture.threshold_diag;
+    has_neg_y = s_gesture.threshold_diag && s_gesture.y < -s_gesture.threshold_diag;
+
+    if (has_neg_x && has_neg_y) {
+        stroke = GESTURE_UP_LEFT;
+    } else if (has_pos_x && has_neg_y) {
+        stroke = GESTURE_UP_RIGHT;
+    } else if (has_neg_x && has_pos_y) {
+        stroke = GESTURE_DOWN_LEFT;
+    } else if (has_pos_x && has_pos_y) {
+        stroke = GESTURE_DOWN_RIGHT;
+    } else if (s_gesture.threshold == 0) {
+        return;
+    } else if (s_gesture.x < -s_gesture.threshold) {
+        stroke = GESTURE_LEFT;
+    } else if (s_gesture.x > s_gesture.threshold) {
+        stroke = GESTURE_RIGHT;
+    } else if (s_gesture.y < -s_gesture.threshold) {
+        stroke = GESTURE_UP;
+    } else if (s_gesture.y >  s_gesture.threshold) {
+        stroke = GESTURE_DOWN;
+    } else {
+        return;
     }
+
+    // A stroke that reaches its threshold quickly enough is a flick
+    if (
+        stroke <= GESTURE_DOWN &&
+        s_gesture.flick_time &&
+        (uint16_t)(current_time - s_gesture.stroke_time) <= s_gesture.flick_time
+    ) {
+        stroke += GESTURE_FLICK_LEFT - GESTURE_LEFT;
+    }
+
+    finish_stroke(stroke);
 }
 
 void gesture_release(uint16_t ekc_addr, uint8_t kb_id) {
     switch (s_gesture.state) {
         case GESTURE_STATE_SCANNING: {
+            const uint16_t held_time = timer_read16_ms() - s_gesture.start_time;
             if (
                 (abs(s_gesture.x) < s_gesture.threshold_tap) &&
-                (abs(s_gesture.y) < s_gesture.threshold_tap)
+                (abs(s_gesture.y) < s_gesture.threshold_tap) &&
+                (s_gesture.timeout == 0 || held_time < s_gesture.timeout)
             ) {
-                // TAP
+                tap_gesture(get_stroke_keycode(GESTURE_TAP));
+            } else {
+                s_gesture.state = GESTURE_STATE_INACTIVE;
             }
-            s_gesture.state = GESTURE_STATE_INACTIVE;
+        } break;
+        case GESTURE_STATE_SECOND_STROKE: {
+            // Released before a second stroke, so use the first by itself
+            tap_gesture(get_stroke_keycode(s_gesture.first_stroke));
         } break;
         case GESTURE_STATE_ACTIVATED: {
             queue_keycode_event(s_gesture.triggered_kc, EVENT_RELEASED, s_gesture.kb_id);
@@ -50,34 +228,31 @@ void gesture_release(uint16_t ekc_addr, uint8_t kb_id) {
     }
 }
 
-void trigger_gesture(uint8_t gesture_type) {
-    // Gesture EKC data layout:
-    //
-    // typedef struct ekc_gesture_t {
-    // 00:  uint16_t threshold;
-    // 02:  uint16_t threshold_diag;
-    // 04:  uint16_t threshold_tap;
-    // 06:  keycode_t left;
-    // 08:  keycode_t right;
-    // 0A:  keycode_t up;
-    // 0C:  keycode_t down;
-    // 1E:  keycode_t up_left;
-    // 10:  keycode_t up_right;
-    // 12:  keycode_t down_left;
-    // 14:  keycode_t down_right;
-    // 16:  keycode_t tap;
-    // } ekc_gesture_t;
-    keycode_t gesture_kc;
-    get_ekc_data(
-        &gesture_kc,
-        s_gesture.ekc_addr + EKC_GESTURE_LEFT_ADDR + gesture_type*2,
-        sizeof(keycode_t)
-    );
-
-    queue_keycode_event(gesture_kc, EVENT_PRESSED, s_gesture.kb_id);
+/// @brief Handle gesture timeouts and release tapped gesture keycodes.
+///
+/// @return true if the gesture is waiting for a timer to expire
+bool gesture_task(void) {
+    const uint16_t elapsed = timer_read16_ms() - s_gesture.start_time;
 
-    s_gesture.state = GESTURE_STATE_ACTIVATED;
-    s_gesture.triggered_kc = gesture_kc;
+    switch (s_gesture.state) {
+        case GESTURE_STATE_SECOND_STROKE: {
+            if (s_gesture.timeout == 0) {
+                return false;
+            }
+            if (elapsed >= s_gesture.timeout) {
+                trigger_gesture(get_stroke_keycode(s_gesture.first_stroke));
+            }
+            return true;
+        } break;
+        case GESTURE_STATE_TAPPED: {
+            if (elapsed >= GESTURE_TAP_RELEASE_TIME) {
+                queue_keycode_event(s_gesture.triggered_kc, EVENT_RELEASED, s_gesture.kb_id);
+                s_gesture.state = GESTURE_STATE_INACTIVE;
+            }
+            return true;
+        } break;
+    }
+    return false;
 }
 #endif
 
@@ -94,7 +269,7 @@ void mouse_unclick(uint8_t buttons) {
     g_mouse_activity = UNIFYING_MOUSE_ACTIVE;
 }
 
-void mouse_move(int16_t x, int16_t y, int8_t wheel_y, int8_t wheel_x) {
+void mouse_move(int16_t x, int16_t y, int16_t wheel_y, int16_t wheel_x) {
     g_mouse_state.x += x;
     g_mouse_state.y += y;
     g_mouse_state.wheel_y += wheel_y;
@@ -102,6 +277,23 @@ void mouse_move(int16_t x, int16_t y, int8_t wheel_y, int8_t wheel_x) {
 
     g_mouse_activity = UNIFYING_MOUSE_ACTIVE;
 }
+
+/// @brief Check if relative mouse motion can skip `handle_mouse_events()`.
+///
+/// Motion only needs to go through the mouse state when the active layout has
+/// mouse layers or a gesture key is tracking it. Otherwise the port can send
+/// it straight to the host.
+bool mouse_can_pass_through(void) {
+    if (has_active_slot() && has_mouse_layers(get_active_keyboard_id())) {
+        return false;
+    }
+#if USE_MOUSE_GESTURE
+    if (s_gesture.state != GESTURE_STATE_INACTIVE) {
+        return false;
+    }
+#endif
+    return true;
+}
 #endif
 
 static void zero_mouse_movement(void) {
@@ -135,10 +327,8 @@ void handle_mouse_events(void) REENT {
     }
 
     if (g_mouse_activity == UNIFYING_MOUSE_ACTIVE) {
-        g_mouse_report.x = g_mouse_state.x;
-        g_mouse_report.y = g_mouse_state.y;
-        g_mouse_report.wheel_x = KP_SIGN(g_mouse_state.wheel_x);
-        g_mouse_report.wheel_y = KP_SIGN(g_mouse_state.wheel_y);
+        mouse_report_add_motion(g_mouse_state.x, g_mouse_state.y);
+        mouse_report_add_wheel(g_mouse_state.wheel_y, g_mouse_state.wheel_x);
         g_report_pending_mouse = true;
     } else if (g_mouse_activity == UNIFYING_MOUSE_EXTRA_BUTTON) {
         // If a special button was pressed don't want to update the cursor position.
@@ -148,40 +338,7 @@ void handle_mouse_events(void) REENT {
     }
 
 #if USE_MOUSE_GESTURE
-    // Gesture handling
-    // if (g_mouse_state.buttons_1 & 0x80) {
-    switch (s_gesture.state) {
-        case GESTURE_STATE_SCANNING: {
-            uint8_t has_pos_x, has_neg_x, has_pos_y, has_neg_y;
-
-            s_gesture.x += g_mouse_state.x;
-            s_gesture.y += g_mouse_state.y;
-
-            // trigger threshold for diagonal motions
-            has_pos_x = s_gesture.x >  s_gesture.threshold_diag;
-            has_neg_x = s_gesture.x < -s_gesture.threshold_diag;
-            has_pos_y = s_gesture.y >  s_gesture.threshold_diag;
-            has_neg_y = s_gesture.y < -s_gesture.threshold_diag;
-
-            if (has_neg_x && has_neg_y) {
-                trigger_gesture(GESTURE_UP_LEFT);
-            } else if (has_pos_x && has_neg_y) {
-                trigger_gesture(GESTURE_UP_RIGHT);
-            } else if (has_neg_x && has_pos_y) {
-                trigger_gesture(GESTURE_DOWN_LEFT);
-            } else if (has_pos_x && has_pos_y) {
-                trigger_gesture(GESTURE_DOWN_RIGHT);
-            } else if (s_gesture.x < -s_gesture.threshold) {
-                trigger_gesture(GESTURE_LEFT);
-            } else if (s_gesture.x > s_gesture.threshold) {
-                trigger_gesture(GESTURE_RIGHT);
-            } else if (s_gesture.y < -s_gesture.threshold) {
-                trigger_gesture(GESTURE_UP);
-            } else if (s_gesture.y >  s_gesture.threshold) {
-                trigger_gesture(GESTURE_DOWN);
-            }
-        } break;
-    }
+    gesture_update(g_mouse_state.x, g_mouse_state.y);
 #endif
 
     zero_mouse_movement();
@@ -15,8 +15,14 @@ typedef enum {
 
 enum {
     GESTURE_STATE_INACTIVE = 0,
+    /// Waiting for the first stroke
     GESTURE_STATE_SCANNING = 1,
+    /// A gesture keycode is pressed until the gesture key is released
     GESTURE_STATE_ACTIVATED = 2,
+    /// The first stroke matched a two-stroke gesture, waiting for the second
+    GESTURE_STATE_SECOND_STROKE = 3,
+    /// A gesture keycode was tapped and is released after a short delay
+    GESTURE_STATE_TAPPED = 4,
 };
 
 enum {
@@ -29,9 +35,47 @@ enum {
     GESTURE_DOWN_LEFT = 6,
     GESTURE_DOWN_RIGHT = 7,
     GESTURE_TAP = 8,
+    // A horizontal or vertical stroke finished within `flick_time`
+    GESTURE_FLICK_LEFT = 9,
+    GESTURE_FLICK_RIGHT = 10,
+    GESTURE_FLICK_UP = 11,
+    GESTURE_FLICK_DOWN = 12,
+    GESTURE_NONE = 0xff,
 };
 
+// Gesture EKC data layout:
+//
+// typedef struct ekc_gesture_t {
+// 00:  uint16_t threshold;
+// 02:  uint16_t threshold_diag;
+// 04:  uint16_t threshold_tap;
+// 06:  keycode_t left;
+// 08:  keycode_t right;
+// 0A:  keycode_t up;
+// 0C:  keycode_t down;
+// 0E:  keycode_t up_left;
+// 10:  keycode_t up_right;
+// 12:  keycode_t down_left;
+// 14:  keycode_t down_right;
+// 16:  keycode_t tap;
+// 18:  uint16_t timeout;
+// 1A:  uint16_t flick_time;
+// 1C:  uint8_t num_sequences;
+// 1D:  uint8_t reserved;
+// 1E:  gesture_sequence_t sequences[num_sequences];
+// } ekc_gesture_t;
 #define EKC_GESTURE_LEFT_ADDR 0x06
+#define EKC_GESTURE_TIMEOUT_ADDR 0x18
+#define EKC_GESTURE_NUM_SEQUENCES_ADDR 0x1C
+#define EKC_GESTURE_SEQUENCES_ADDR 0x1E
+
+/// A flick or a two-stroke gesture. Single flicks use `second = GESTURE_NONE`.
+typedef struct ATTR_PACKED gesture_sequence_t {
+    uint8_t first;
+    uint8_t second;
+    keycode_t keycode;
+} gesture_sequence_t;
+
 typedef struct gesture_state_t {
     uint8_t state;
     int16_t x;
@@ -42,20 +86,43 @@ typedef struct gesture_state_t {
     int16_t threshold;
     int16_t threshold_diag;
     int16_t threshold_tap;
+    uint16_t timeout;
+    uint16_t flick_time;
+    uint8_t num_sequences;
+    /// The first stroke while in `GESTURE_STATE_SECOND_STROKE`
+    uint8_t first_stroke;
+    /// When the gesture key was pressed, or when the first stroke finished
+    uint16_t start_time;
+    /// When the current stroke started moving
+    uint16_t stroke_time;
 } gesture_state_t;
 
-extern XRAM hid_report_mouse_t g_mouse_state;
+/// Motion received from a physical mouse since the last call to
+/// `handle_mouse_events()`
+typedef struct mouse_state_t {
+    uint8_t buttons_1;
+    uint8_t buttons_2;
+    int16_t x;
+    int16_t y;
+    /// Wheel motion in units of 1/MOUSE_WHEEL_HI_RES_DETENT detents
+    int16_t wheel_y;
+    int16_t wheel_x;
+} mouse_state_t;
+
+extern XRAM mouse_state_t g_mouse_state;
 extern XRAM uint8_t g_mouse_state_changed;
 extern XRAM uint8_t g_mouse_activity;
 
 #if USE_VIRTUAL_MODE
 void mouse_click(uint8_t buttons);
 void mouse_unclick(uint8_t buttons);
-void mouse_move(int16_t x, int16_t y, int8_t wheel_y, int8_t wheel_x);
+void mouse_move(int16_t x, int16_t y, int16_t wheel_y, int16_t wheel_x);
+bool mouse_can_pass_through(void);
 #endif
 
 void gesture_init(void);
 void gesture_press(uint16_t ekc_addr, uint8_t kd_id);
 void gesture_release(uint16_t ekc_addr, uint8_t kd_id);
+bool gesture_task(void);
 
 void handle_mouse_events(void) REENT;
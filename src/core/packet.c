@@ -18,6 +18,10 @@ bool is_matrix_packet(packet_t *packet) {
     return type <= PACKET_MATRIX_DELTA_LIST;
 }
 
+bool is_multi_record_packet(packet_t *packet) {
+    return (packet->gen.type & PACKET_MATRIX_TYPE_MASK) == PACKET_TYPE_MULTI_RECORD;
+}
+
 /* void set_packet_uid(void) { */
 /*  packet->gen.device_id = g_settings.device_id; */
 /*  packet->gen.is_master = 0; /1* TODO: load based on *1/ */
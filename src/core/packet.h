@@ -44,6 +44,28 @@
 
 #define MATRIX_DELTA_KEY_MASK 0x7f
 
+// A multi record packet carries several records in one transmission. Its
+// first byte is `PACKET_TYPE_MULTI_RECORD` ORed with the total length of the
+// records that follow. Each record starts with a header byte holding the
+// record type in the top 3 bits and the length of its data in the bottom 5
+// bits, the same layout as the header of a matrix packet.
+//
+// Receivers skip record types they don't know.
+#define PACKET_TYPE_MULTI_RECORD (PACKET_MATRIX_RESERVED << PACKET_MATRIX_TYPE_BIT_POS)
+#define PACKET_RECORDS_MAX_LENGTH (PACKET_PAYLOAD_LENGTH-1)
+#define PACKET_RECORD_TYPE_BIT_POS 5
+#define PACKET_RECORD_LENGTH_MASK 0x1f
+
+typedef enum {
+    // data is a matrix packet
+    PACKET_RECORD_MATRIX = 0x00,
+    // data is the battery level in percent
+    PACKET_RECORD_BATTERY = 0x01,
+    // data is the index in the hop schedule of the channel the device wants
+    // the receiver to leave, see `core/rf_hop.h`
+    PACKET_RECORD_HOP_REQUEST = 0x03,
+} packet_record_type_t;
+
 typedef enum {
     PACKET_MATRIX_RAW = 0x00,
     PACKET_MATRIX_KEY_LIST = 0x01,
@@ -90,3 +112,4 @@ typedef union packet_t {
 uint8_t get_packet_type(const packet_t *packet);
 void set_packet_type(packet_t *packet, uint8_t type);
 bool is_matrix_packet(packet_t *packet);
+bool is_multi_record_packet(packet_t *packet);
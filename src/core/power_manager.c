@@ -0,0 +1,136 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/power_manager.c
+///
+/// @brief Power states for battery powered wireless keyboards.
+
+#include "core/power_manager.h"
+
+#include <string.h>
+
+#include "core/settings.h"
+
+#if USE_RF_HOPPING
+#  include "core/rf_hop.h"
+#endif
+
+static uint8_t setting_or_default(uint8_t value, uint8_t default_value) {
+    return (value == 0) ? default_value : value;
+}
+
+void power_manager_init(XRAM power_manager_t *pm, uint16_t now) {
+    memset(pm, 0, sizeof(power_manager_t));
+
+    pm->idle_time = 10 * (uint16_t)setting_or_default(
+        g_rf_settings.power_idle_time, POWER_DEFAULT_IDLE_TIME
+    );
+    pm->sleep_time = setting_or_default(
+        g_rf_settings.power_sleep_time, POWER_DEFAULT_SLEEP_TIME
+    );
+    pm->idle_scan_interval = setting_or_default(
+        g_rf_settings.power_idle_scan_interval, POWER_DEFAULT_IDLE_SCAN_INTERVAL
+    );
+    pm->max_backoff = setting_or_default(
+        g_rf_settings.power_max_backoff, POWER_DEFAULT_MAX_BACKOFF
+    );
+#if USE_RF_HOPPING
+    // The first failures search the hop schedule for the receiver with a
+    // short retransmit count, so they are sent again at once
+    pm->free_retries = RF_HOP_CHANNEL_COUNT;
+#endif
+
+    power_manager_activity(pm, now);
+}
+
+/// The matrix changed, or the keyboard woke up from sleep
+void power_manager_activity(XRAM power_manager_t *pm, uint16_t now) {
+    pm->state = POWER_STATE_ACTIVE;
+    pm->last_activity = now;
+}
+
+/// Check if the matrix should be scanned on this timer tick. Keys that are
+/// debouncing need a scan on every tick, whatever the state.
+bit_t power_manager_should_scan(XRAM power_manager_t *pm, uint16_t now) {
+    if (
+        pm->state == POWER_STATE_IDLE &&
+        (uint16_t)(now - pm->last_scan) < pm->idle_scan_interval
+    ) {
+        return false;
+    }
+    pm->last_scan = now;
+    return true;
+}
+
+/// Move between the power states.
+///
+/// @param can_sleep true if no keys are down or debouncing, and there is
+/// nothing left to send
+///
+/// @return the new state. On `POWER_STATE_SLEEP`, the port sleeps until a
+/// pin change, then calls `power_manager_activity()`.
+uint8_t power_manager_update(XRAM power_manager_t *pm, uint16_t now, bit_t can_sleep) {
+    if (pm->state == POWER_STATE_ACTIVE) {
+        if ((uint16_t)(now - pm->last_activity) >= pm->idle_time) {
+            // The sleep time counts from the last matrix change, not from
+            // the start of the idle state
+            pm->state = POWER_STATE_IDLE;
+            pm->idle_seconds = 0;
+            pm->last_second = pm->last_activity;
+        }
+    }
+
+    if (pm->state == POWER_STATE_IDLE) {
+        // Count whole seconds so that the sleep time isn't limited by the
+        // 16 bit timer. The idle time can be longer than a second, so catch
+        // up on the seconds that passed before the idle state.
+        while ((uint16_t)(now - pm->last_second) >= 1000) {
+            pm->last_second += 1000;
+            if (pm->idle_seconds != 0xff) {
+                pm->idle_seconds++;
+            }
+        }
+        if (can_sleep && pm->idle_seconds >= pm->sleep_time) {
+            pm->state = POWER_STATE_SLEEP;
+        }
+    }
+
+    return pm->state;
+}
+
+/// A transmit reached the maximum retransmit count for the `err_count`th time
+/// in a row. After the first `free_retries` failures, wait 1, 2, 4, ... ms up
+/// to `max_backoff` before the next try.
+void power_manager_tx_failed(XRAM power_manager_t *pm, uint16_t now, uint8_t err_count) {
+    uint8_t backoff = 1;
+
+    if (err_count <= pm->free_retries) {
+        pm->backoff_time = 0;
+        return;
+    }
+    err_count -= pm->free_retries;
+
+    while (err_count > 1 && backoff < pm->max_backoff) {
+        backoff = (backoff > pm->max_backoff / 2) ? pm->max_backoff : backoff * 2;
+        err_count--;
+    }
+
+    pm->backoff_start = now;
+    pm->backoff_time = backoff;
+}
+
+/// The TX FIFO is empty, so the next transmit doesn't need to wait
+void power_manager_tx_done(XRAM power_manager_t *pm) {
+    pm->backoff_time = 0;
+}
+
+/// Check if a transmit can be started
+bit_t power_manager_tx_ready(XRAM power_manager_t *pm, uint16_t now) {
+    if (pm->backoff_time == 0) {
+        return true;
+    }
+    if ((uint16_t)(now - pm->backoff_start) >= pm->backoff_time) {
+        pm->backoff_time = 0;
+        return true;
+    }
+    return false;
+}
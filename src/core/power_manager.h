@@ -0,0 +1,74 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/power_manager.h
+///
+/// @brief Power states for battery powered wireless keyboards.
+///
+/// A keyboard moves between three states:
+///
+/// * active: the matrix is scanned on every timer tick, and each change is
+///   sent at once.
+/// * idle: nothing has changed for `idle_time`. Keys may still be held down,
+///   but the matrix is only scanned every `idle_scan_interval` ms, so the
+///   changes seen between two scans go out in a single packet. Any change
+///   returns to the active state.
+/// * sleep: nothing has changed for `sleep_time`, and the keyboard is idle
+///   with no keys down and nothing left to send. The port powers down the radio and waits for a pin
+///   change interrupt from the matrix.
+///
+/// The thresholds come from the RF settings, where 0 picks the default.
+///
+/// Failed transmits are retried with an exponential backoff, so a keyboard
+/// that can't reach the receiver doesn't keep its radio on all the time.
+///
+/// The functions here take the time as an argument and don't touch the
+/// hardware, the port's main loop applies the decisions.
+
+#pragma once
+
+#include "core/util.h"
+
+// Defaults for RF settings that are 0
+#define POWER_DEFAULT_IDLE_TIME 50 // units of 10ms
+#define POWER_DEFAULT_SLEEP_TIME 3 // seconds
+#define POWER_DEFAULT_IDLE_SCAN_INTERVAL 10 // ms
+#define POWER_DEFAULT_MAX_BACKOFF 32 // ms
+
+typedef enum power_state_t {
+    POWER_STATE_ACTIVE = 0,
+    POWER_STATE_IDLE = 1,
+    POWER_STATE_SLEEP = 2,
+} power_state_t;
+
+typedef struct power_manager_t {
+    /// One of `power_state_t`
+    uint8_t state;
+    /// Time of the last matrix change
+    uint16_t last_activity;
+    /// Time of the last matrix scan
+    uint16_t last_scan;
+    /// Whole seconds since `last_activity`, counted up to `last_second`
+    uint8_t idle_seconds;
+    uint16_t last_second;
+    /// Time of the last failed transmit, and how long to wait after it
+    /// before trying again. `backoff_time` is 0 when not backing off.
+    uint16_t backoff_start;
+    uint8_t backoff_time;
+    /// Failures in a row that are sent again without a backoff
+    uint8_t free_retries;
+
+    // The thresholds from the RF settings
+    uint16_t idle_time; // ms
+    uint8_t sleep_time; // seconds
+    uint8_t idle_scan_interval; // ms
+    uint8_t max_backoff; // ms
+} power_manager_t;
+
+void power_manager_init(XRAM power_manager_t *pm, uint16_t now);
+void power_manager_activity(XRAM power_manager_t *pm, uint16_t now);
+bit_t power_manager_should_scan(XRAM power_manager_t *pm, uint16_t now);
+uint8_t power_manager_update(XRAM power_manager_t *pm, uint16_t now, bit_t can_sleep);
+
+void power_manager_tx_failed(XRAM power_manager_t *pm, uint16_t now, uint8_t err_count);
+void power_manager_tx_done(XRAM power_manager_t *pm);
+bit_t power_manager_tx_ready(XRAM power_manager_t *pm, uint16_t now);
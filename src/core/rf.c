@@ -20,7 +20,6 @@
 #include "nrf_log.h"
 #endif
 #include "core/packet.h"
-#include "core/ring_buf.h"
 #include "core/settings.h"
 #include "core/util.h"
 
@@ -30,6 +29,10 @@
 
 XRAM uint8_t g_rf_enabled;
 
+#if USE_RF_HOPPING
+XRAM rf_hop_t g_rf_hop;
+#endif
+
 // #define NRF24_IRQ_MASKS (MASK_TX_DS_bm | MASK_MAX_RT_bm)
 // #define NRF24_IRQ_MASKS (0x70)
 #define NRF24_RX_IRQ_MASK (MASK_MAX_RT_bm | MASK_TX_DS_bm)
@@ -117,6 +120,10 @@ void rf_init_send(void) {
 
     g_rf_settings.hw_type = RF_HW_NRF24L01;
 
+#if USE_RF_HOPPING
+    rf_hop_init(&g_rf_hop, g_rf_settings.ekey, g_rf_settings.channel);
+#endif
+
     nrf24_init();
 
     if (has_critical_error()) {
@@ -132,13 +139,66 @@ void rf_init_send(void) {
     nrf24_ce(0);
 }
 
+// The battery level is resent after this many packets, in case the packet
+// that carried it was lost
+#define RF_BATTERY_REPORT_INTERVAL 16
+
+static XRAM uint8_t s_battery_level = RF_STATUS_UNKNOWN;
+static XRAM uint8_t s_battery_report_countdown;
+
+// Set the battery level in percent that is sent to the receiver along with
+// the matrix packets
+void rf_set_battery_level(uint8_t level) {
+    if (level != s_battery_level) {
+        s_battery_level = level;
+        s_battery_report_countdown = 0;
+    }
+}
+
 void rf_send_matrix_packet(void) {
     XRAM packet_matrix_t packet;
+    XRAM uint8_t matrix_data[PACKET_PAYLOAD_LENGTH];
+    uint8_t *records = packet.matrix_data + 1;
+
+    const uint8_t matrix_size = get_matrix_data(matrix_data, false);
+    // the matrix is the first record, any others are added after it
+    uint8_t records_end = matrix_size + 1;
+
+    memset(packet.matrix_data, 0, PACKET_PAYLOAD_LENGTH);
+
+    // When a hop request or the battery level are due to be sent and there's
+    // room for them, send them in the same packet as the matrix as a multi
+    // record packet. A hop request goes first, since the link depends on it.
+#if USE_RF_HOPPING
+    if (
+        g_rf_hop.hop_request != RF_HOP_NO_REQUEST &&
+        records_end + 2 <= PACKET_RECORDS_MAX_LENGTH
+    ) {
+        records[records_end] = (PACKET_RECORD_HOP_REQUEST << PACKET_RECORD_TYPE_BIT_POS) | 1;
+        records[records_end+1] = rf_hop_take_request(&g_rf_hop);
+        records_end += 2;
+    }
+#endif
 
-    const uint8_t matrix_size = get_matrix_data(packet.matrix_data, false);
+    if (
+        s_battery_level != RF_STATUS_UNKNOWN &&
+        s_battery_report_countdown == 0 &&
+        records_end + 2 <= PACKET_RECORDS_MAX_LENGTH
+    ) {
+        records[records_end] = (PACKET_RECORD_BATTERY << PACKET_RECORD_TYPE_BIT_POS) | 1;
+        records[records_end+1] = s_battery_level;
+        records_end += 2;
+        s_battery_report_countdown = RF_BATTERY_REPORT_INTERVAL;
+    } else if (s_battery_report_countdown != 0) {
+        s_battery_report_countdown--;
+    }
 
-    if (matrix_size < PACKET_PAYLOAD_LENGTH) {
-        memset(packet.matrix_data+matrix_size, 0, PACKET_PAYLOAD_LENGTH-matrix_size);
+    if (records_end != matrix_size + 1) {
+        records[0] = (PACKET_RECORD_MATRIX << PACKET_RECORD_TYPE_BIT_POS) | matrix_size;
+        memcpy(records+1, matrix_data, matrix_size);
+        packet.matrix_data[0] = PACKET_TYPE_MULTI_RECORD | records_end;
+    } else {
+        memcpy(packet.matrix_data, matrix_data, matrix_size);
     }
 
     // TODO: make a function that does this for us
@@ -180,51 +240,191 @@ void rf_handle_ack_payloads(void) {
         }
     }
 }
+
+#if USE_RF_HOPPING
+// Move the radio to the channel of the hop schedule in use. While searching
+// for the receiver, each channel is only tried a few times.
+static void rf_hop_update_radio(void) {
+    const uint8_t arc = g_rf_hop.is_searching ? RF_HOP_SEARCH_ARC : g_rf_settings.arc;
+    const uint8_t setup_retr = nrf24_read_reg(SETUP_RETR) & ~(0xf << ARC);
+
+    nrf24_write_reg(RF_CH, rf_hop_channel(&g_rf_hop));
+    nrf24_write_reg(SETUP_RETR, setup_retr | ((arc & 0xf) << ARC));
+}
+
+// Call when the radio sets the TX_DS flag, a packet was acknowledged. Only
+// the last packet's retransmits are known, so when several packets were sent
+// since the last call, the link quality is judged from the last one.
+void rf_handle_tx_ds(void) {
+    const uint8_t index = g_rf_hop.index;
+    const uint8_t is_searching = g_rf_hop.is_searching;
+    const uint8_t retransmits = (nrf24_read_reg(OBSERVE_TX) >> ARC_CNT) & 0xf;
+
+    rf_hop_tx_delivered(&g_rf_hop, retransmits);
+
+    if (index != g_rf_hop.index || is_searching != g_rf_hop.is_searching) {
+        rf_hop_update_radio();
+    }
+}
+
+// Call when the radio sets the MAX_RT flag, before the packet is resent
+void rf_handle_max_rt(void) {
+    const uint8_t retransmits = (nrf24_read_reg(OBSERVE_TX) >> ARC_CNT) & 0xf;
+
+    rf_hop_tx_failed(&g_rf_hop, retransmits);
+    rf_hop_update_radio();
+}
+#endif
 #endif
 
 #ifndef NO_RF_RECEIVE
 
-#define PACKET_BUFFER_MAX_LEN 22
-
-static XRAM ring_buf128_type s_rx_buffer;
+typedef struct rx_slot_t {
+    uint8_t pipe_num;
+    uint8_t width;
+    uint8_t payload[PACKET_BUFFER_MAX_LEN];
+} rx_slot_t;
+
+static XRAM rx_slot_t s_rx_slots[RF_RX_SLOT_COUNT];
+// slot indices of the buffered packets, oldest first
+static XRAM uint8_t s_rx_order[RF_RX_SLOT_COUNT];
+static XRAM uint8_t s_rx_len;
+// bit `n` is set while slot `n` holds a packet, so `RF_RX_SLOT_COUNT` <= 8
+static XRAM uint8_t s_rx_used_slots;
+// slots taken out of the arrival order by `packet_buffer_claim()`, which
+// stay in use until `packet_buffer_release()`
+static XRAM uint8_t s_rx_claimed_slots;
+// number of slots held by each pipe
+static XRAM uint8_t s_rx_pipe_len[NUM_RF_PIPES];
+
+XRAM uint16_t g_rf_rx_drop_count[NUM_RF_PIPES];
 
 void packet_buffer_clear(void) {
-    ring_buf128_clear(&s_rx_buffer);
+    s_rx_len = 0;
+    s_rx_used_slots = s_rx_claimed_slots;
+    memset(s_rx_pipe_len, 0, sizeof(s_rx_pipe_len));
 }
 
-uint8_t packet_buffer_free_space(void) {
-    return ring_buf128_free_space(&s_rx_buffer);
+bit_t packet_buffer_has_data(void) {
+    return s_rx_len != 0;
 }
 
-uint8_t packet_buffer_len(void) {
-    return ring_buf128_len(&s_rx_buffer);
+// take the packet at position `pos` out of the arrival order, and return its
+// slot
+static uint8_t packet_buffer_unlink(uint8_t pos) {
+    const uint8_t slot = s_rx_order[pos];
+
+    s_rx_pipe_len[s_rx_slots[slot].pipe_num]--;
+    s_rx_len--;
+    for (; pos < s_rx_len; ++pos) {
+        s_rx_order[pos] = s_rx_order[pos+1];
+    }
+    return slot;
 }
 
-bit_t packet_buffer_has_data(void) {
-    return ring_buf128_has_data(&s_rx_buffer);
+// remove the packet at position `pos` in the arrival order
+static void packet_buffer_remove(uint8_t pos) {
+    s_rx_used_slots &= ~(1 << packet_buffer_unlink(pos));
+}
+
+// drop the oldest packet buffered for `pipe_num`
+static void packet_buffer_drop_oldest(uint8_t pipe_num) {
+    uint8_t pos;
+    for (pos = 0; pos < s_rx_len; ++pos) {
+        if (s_rx_slots[s_rx_order[pos]].pipe_num == pipe_num) {
+            packet_buffer_remove(pos);
+            g_rf_rx_drop_count[pipe_num]++;
+            return;
+        }
+    }
+}
+
+// Reserve a slot for a packet of `width` bytes received on `pipe_num` and
+// return the buffer its payload should be written to.
+//
+// If the pipe already holds its quota of slots, its oldest packet is dropped.
+// If the pool is full, the oldest packet of the pipe holding the most slots is
+// dropped instead, so only the stream that is overrunning the buffer loses
+// packets. Returns NULL if the packet can't be buffered at all.
+XRAM uint8_t *packet_buffer_alloc(uint8_t pipe_num, uint8_t width) {
+    uint8_t slot;
+    uint8_t busiest;
+
+    if (pipe_num >= NUM_RF_PIPES) {
+        return NULL;
+    }
+
+    if (width > PACKET_BUFFER_MAX_LEN) {
+        g_rf_rx_drop_count[pipe_num]++;
+        return NULL;
+    }
+
+    if (s_rx_pipe_len[pipe_num] >= RF_RX_PIPE_QUOTA) {
+        packet_buffer_drop_oldest(pipe_num);
+    } else if (s_rx_used_slots == RF_RX_ALL_SLOTS) {
+        busiest = pipe_num;
+        for (slot = 0; slot < NUM_RF_PIPES; ++slot) {
+            if (s_rx_pipe_len[slot] > s_rx_pipe_len[busiest]) {
+                busiest = slot;
+            }
+        }
+        packet_buffer_drop_oldest(busiest);
+    }
+
+    // Every slot is claimed by packets that are being handled
+    if (s_rx_used_slots == RF_RX_ALL_SLOTS) {
+        g_rf_rx_drop_count[pipe_num]++;
+        return NULL;
+    }
+
+    for (slot = 0; s_rx_used_slots & (1 << slot); ++slot) {
+    }
+    s_rx_used_slots |= (1 << slot);
+    s_rx_order[s_rx_len++] = slot;
+    s_rx_pipe_len[pipe_num]++;
+
+    s_rx_slots[slot].pipe_num = pipe_num;
+    s_rx_slots[slot].width = width;
+    return s_rx_slots[slot].payload;
 }
 
-uint8_t packet_buffer_get(void) {
-    return ring_buf128_get(&s_rx_buffer);
+// Copy the oldest buffered packet into `dest` and free its slot. Returns the
+// width of the packet. Must only be called if `packet_buffer_has_data()`.
+uint8_t packet_buffer_take(XRAM uint8_t *dest, uint8_t *pipe_num) {
+    XRAM rx_slot_t *rx_slot = &s_rx_slots[s_rx_order[0]];
+    const uint8_t width = rx_slot->width;
+
+    *pipe_num = rx_slot->pipe_num;
+    memcpy(dest, rx_slot->payload, width);
+    packet_buffer_remove(0);
+    return width;
 }
 
-void packet_buffer_add_byte(uint8_t byte) {
-    ring_buf128_put(&s_rx_buffer, byte);
+// Take the oldest buffered packet out of the arrival order without copying
+// it. Its slot stays in use until it is passed to `packet_buffer_release()`,
+// so the packet can be handled in place while new packets are received.
+// Returns the slot. Must only be called if `packet_buffer_has_data()`.
+static uint8_t packet_buffer_claim(void) {
+    const uint8_t slot = packet_buffer_unlink(0);
+    s_rx_claimed_slots |= (1 << slot);
+    return slot;
 }
 
-void packet_buffer_take(XRAM uint8_t *dest, uint8_t width) {
-    ring_buf128_take(&s_rx_buffer, dest, width);
+// Free the slots in the bit mask `slots` taken by `packet_buffer_claim()`
+static void packet_buffer_release(uint8_t slots) {
+    s_rx_claimed_slots &= ~slots;
+    s_rx_used_slots &= ~slots;
 }
 
 #if NRF24_INBUILT_SPI_HANDLING
 
-static void packet_buffer_load(uint8_t len) {
+static void packet_buffer_load(XRAM uint8_t *dest, uint8_t len) {
     uint8_t i;
     const nrf24_spi_command_t cmd = R_RX_PAYLOAD;
     nrf24_csn(0);
     nrf24_spi_send_byte(cmd);
     for (i = 0; i < len; ++i) {
-        packet_buffer_add_byte(nrf24_spi_send_byte(NRF_NOP));
+        dest[i] = nrf24_spi_send_byte(NRF_NOP);
     }
     nrf24_csn(1);
 }
@@ -233,15 +433,8 @@ static void packet_buffer_load(uint8_t len) {
 // If the device doesn't use the inbuilt spi handling in `core/nrf24.c`, then
 // it doesn't provide `nrf24_spi_send_byte()`, so we use `nrf24_read_buf()`
 // here instead
-static void packet_buffer_load(uint8_t len) {
-    uint8_t i;
-    uint8_t s_rx_buf[MAX_PAYLOAD_LENGTH+1];
-
-    nrf24_read_buf(R_RX_PAYLOAD, s_rx_buf, len);
-
-    for (i = 0; i < len; ++i) {
-        packet_buffer_add_byte(s_rx_buf[i]);
-    }
+static void packet_buffer_load(XRAM uint8_t *dest, uint8_t len) {
+    nrf24_read_rx_payload(dest, len);
 }
 #endif
 
@@ -255,15 +448,28 @@ enum {
     DEV_STATE_SYNCED_0     = 0x80, //
 } dev_sync_state_t;
 
-typedef struct packet_id_t {
-    uint8_t sync_state;
-    uint32_t check_id;
-} packet_id_t;
+typedef enum {
+    PACKET_ID_NEW = 0,      // newer than any packet id seen from the device
+    PACKET_ID_LATE = 1,     // older, but inside the replay window and not seen yet
+    PACKET_ID_REPLAYED = 2, // already received from the device
+    PACKET_ID_INVALID = 3,  // too old, too far ahead, or on the wrong pipe
+} packet_id_check_t;
 
 // TODO: put this in an `init` function
 XRAM packet_id_t device_uid_list[MAX_NUM_DEVICES];
 
+#if USE_RF_STATS
+XRAM rf_device_stats_t g_rf_device_stats[MAX_NUM_DEVICES];
+XRAM uint8_t g_rf_battery_level[MAX_NUM_DEVICES];
+#define RF_STATS_COUNT(device_id, counter) (g_rf_device_stats[device_id].counter++)
+#else
+#define RF_STATS_COUNT(device_id, counter)
+#endif
+
+#if 0
+// only used by the disabled passive listening code in `handle_packet()`
 static XRAM uint16_t last_crc[NRF24_NUMBER_PIPES];
+#endif
 
 static void nrf_registers_init_receiver(void) {
     uint8_t i;
@@ -295,6 +501,10 @@ static void nrf_registers_init_receiver(void) {
 
 static void init_uid_buffer_list(void) {
     memset(device_uid_list, 0, sizeof(device_uid_list));
+#if USE_RF_STATS
+    memset(g_rf_device_stats, 0, sizeof(g_rf_device_stats));
+    memset(g_rf_battery_level, RF_STATUS_UNKNOWN, sizeof(g_rf_battery_level));
+#endif
 }
 
 void rf_init_receive(void) {
@@ -318,6 +528,10 @@ void rf_init_receive(void) {
 
     g_rf_settings.hw_type = RF_HW_NRF24L01;
 
+#if USE_RF_HOPPING
+    rf_hop_init(&g_rf_hop, g_rf_settings.ekey, g_rf_settings.channel);
+#endif
+
     nrf24_init();
 
     if (has_critical_error()) {
@@ -416,55 +630,204 @@ void rf_nrf24_load_sync_ack_payload(uint8_t device_id) {
 
 // For a packet to be valid:
 // * its pipe must be correctly associated with the device_id in the packet
-// * the packet ID can't be older then the most recently received packet for
-//      the device
-// * the packet ID must be within a relatively small interval from the last
-//      received packet.
+// * the packet ID must be within a relatively small interval after the newest
+//      packet received from the device, or
+// * the packet ID can be up to `RF_REPLAY_WINDOW_SIZE` older than the newest
+//      packet if it hasn't been received before. Packets reordered by
+//      retransmits are then not mistaken for an attack, like the anti-replay
+//      window used by IPsec.
 //
-// If we receive too many invalid packets, the device will be disconnected
-// from the receive and will have to pass the challenge-response authentication
-// again.
-bit_t is_valid_packet(const packet_t *packet, uint8_t pipe_num) {
+// Replayed packets are rejected. If we receive too many invalid packets, the
+// device will be disconnected from the receive and will have to pass the
+// challenge-response authentication again.
+static uint8_t check_packet_id(const packet_t *packet, uint8_t pipe_num) {
     const uint8_t device_id = packet->gen.device_id;
     const uint32_t pid = packet->gen.packet_id;
     const uint32_t last_pid = device_uid_list[device_id].check_id;
+    uint32_t age;
+
     // packet needs to be received on the correct pipe for its device id
     if (device_id_to_pipe_num(device_id) != pipe_num) {
-        return false;
-    }
-    // only except small jumps in pid
-    if (pid < last_pid || pid > (last_pid+PACKET_ID_MAX_INCREMENT)) {
-        return false;
+        return PACKET_ID_INVALID;
     }
 
     if (device_id > GET_SETTING(layout.number_devices)) {
-        return false;
+        return PACKET_ID_INVALID;
     }
 
-    return true;
+    if (pid > last_pid) {
+        // only except small jumps in pid
+        if (pid - last_pid > PACKET_ID_MAX_INCREMENT) {
+            return PACKET_ID_INVALID;
+        }
+        return PACKET_ID_NEW;
+    }
+
+    age = last_pid - pid;
+    if (age >= RF_REPLAY_WINDOW_SIZE) {
+        return PACKET_ID_INVALID;
+    } else if (device_uid_list[device_id].seen_ids & ((replay_window_t)1 << age)) {
+        return PACKET_ID_REPLAYED;
+    } else {
+        return PACKET_ID_LATE;
+    }
 }
 
-// Returns false if not a valid packet
-bit_t read_packet(void) REENT {
-    static XRAM uint8_t packet_payload[PACKET_BUFFER_MAX_LEN];
+// Mark a packet id accepted by `check_packet_id()` as seen, sliding the
+// window forward if it is the newest id received from the device.
+static void mark_packet_id_seen(uint8_t device_id, uint32_t pid) {
+    XRAM packet_id_t *dev = &device_uid_list[device_id];
 
-    // get the packet pipe and size from the buffer
-    uint8_t pipe_num;
-    uint8_t width;
+    if (pid > dev->check_id) {
+        const uint32_t shift = pid - dev->check_id;
+        if (shift < RF_REPLAY_WINDOW_SIZE) {
+            dev->seen_ids = (dev->seen_ids << (uint8_t)shift) | 1;
+        } else {
+            dev->seen_ids = 1;
+        }
+        if (shift > UINT8_MAX - dev->full_state_age) {
+            dev->full_state_age = UINT8_MAX;
+        } else {
+            dev->full_state_age += (uint8_t)shift;
+        }
+        dev->check_id = pid;
+    } else {
+        dev->seen_ids |= (replay_window_t)1 << (uint8_t)(dev->check_id - pid);
+    }
+}
 
+// slots claimed by `read_packet_batch()`, oldest first
+static XRAM uint8_t s_rx_batch[RF_RX_SLOT_COUNT];
+static XRAM uint8_t *XRAM s_rx_batch_blocks[RF_RX_SLOT_COUNT];
+
+// Claim every buffered packet, and decrypt all the keyboard packets in place
+// with a single `aes_decrypt_blocks()` call.
+//
+// Returns the number of slots in `s_rx_batch`.
+static uint8_t read_packet_batch(void) {
+    uint8_t count = 0;
+    uint8_t num_blocks = 0;
+    uint8_t i;
 
     disable_interrupts();
-    pipe_num = packet_buffer_get();
-    width = packet_buffer_get();
-    if (width > PACKET_BUFFER_MAX_LEN || width > packet_buffer_len())  {
-        packet_buffer_clear();
+    while (packet_buffer_has_data()) {
+        s_rx_batch[count++] = packet_buffer_claim();
+    }
+    enable_interrupts();
+
+    for (i = 0; i < count; ++i) {
+        XRAM rx_slot_t *rx_packet = &s_rx_slots[s_rx_batch[i]];
+
+        // All packets except unifying mouse packets are encrypted, other
+        // packet sizes are unsupported
+        if (rx_packet->pipe_num < NUM_KEYBOARD_PIPES &&
+                rx_packet->width == AES_BUF_SIZE) {
+#if DEBUG_LEVEL >= 8
+            // Print the packet before decryption
+            usb_print(rx_packet->payload, AES_BUF_SIZE);
+#endif
+            s_rx_batch_blocks[num_blocks++] = rx_packet->payload;
+        }
+    }
+
+    aes_decrypt_blocks(s_rx_batch_blocks, num_blocks);
+
+    return count;
+}
+
+// Handle the records of a multi record packet from a device that has passed
+// all the packet checks. Records that don't fit in the packet, and battery
+// records on receivers built without `USE_RF_STATS`, are ignored.
+//
+// Returns true if the packet updated the matrix of the device.
+static bit_t handle_packet_records(uint8_t device_id, XRAM uint8_t *payload) REENT {
+    const uint8_t end = 1 + (payload[0] & PACKET_RECORD_LENGTH_MASK);
+    uint8_t pos = 1;
+    bit_t has_matrix = false;
+
+    if (end > PACKET_PAYLOAD_LENGTH) {
         return false;
     }
 
+    while (pos < end) {
+        const uint8_t record_type = payload[pos] >> PACKET_RECORD_TYPE_BIT_POS;
+        const uint8_t len = payload[pos] & PACKET_RECORD_LENGTH_MASK;
+        XRAM uint8_t *data = &payload[pos+1];
 
-    // read out the packet payload into the buffer
-    packet_buffer_take(packet_payload, width);
-    enable_interrupts();
+        pos += 1 + len;
+        if (pos > end) {
+            break;
+        }
+
+        if (record_type == PACKET_RECORD_MATRIX) {
+            // the matrix packet has to fit inside the record
+            if (len != 0 && (data[0] & PACKET_MATRIX_SIZE_MASK) < len) {
+                keyboard_update_device_matrix(device_id, data);
+                has_matrix = true;
+            }
+#if USE_RF_STATS
+        } else if (record_type == PACKET_RECORD_BATTERY && len != 0) {
+            g_rf_battery_level[device_id] = data[0];
+#endif
+#if USE_RF_HOPPING
+        } else if (
+            record_type == PACKET_RECORD_HOP_REQUEST && len != 0 &&
+            g_rf_settings.hw_type == RF_HW_NRF24L01 &&
+            rf_hop_rx_request(&g_rf_hop, data[0])
+        ) {
+            // The ACK for the request has already been sent, so the device
+            // knows to follow us to the next channel.
+            nrf24_ce(0);
+            nrf24_write_reg(RF_CH, rf_hop_channel(&g_rf_hop));
+            nrf24_ce(1);
+#endif
+        }
+    }
+
+    return has_matrix;
+}
+
+// Returns true if a matrix packet lists every key that is down, rather than
+// the keys that changed.
+static bit_t is_full_matrix_state(const XRAM uint8_t *matrix_packet) {
+    return (matrix_packet[0] >> PACKET_MATRIX_TYPE_BIT_POS) != PACKET_MATRIX_DELTA_LIST;
+}
+
+// Returns true if the packet carries the whole matrix state of the device,
+// either as its matrix packet or in the matrix record of a multi record
+// packet.
+static bit_t has_full_matrix_state(packet_t *packet, const XRAM uint8_t *payload) {
+    if (is_matrix_packet(packet)) {
+        return is_full_matrix_state(payload);
+    } else if (is_multi_record_packet(packet)) {
+        const uint8_t end = 1 + (payload[0] & PACKET_RECORD_LENGTH_MASK);
+        uint8_t pos = 1;
+
+        if (end > PACKET_PAYLOAD_LENGTH) {
+            return false;
+        }
+
+        while (pos < end) {
+            const uint8_t record_type = payload[pos] >> PACKET_RECORD_TYPE_BIT_POS;
+            const uint8_t len = payload[pos] & PACKET_RECORD_LENGTH_MASK;
+
+            if (pos + 1 + len > end) {
+                break;
+            }
+            if (record_type == PACKET_RECORD_MATRIX && len != 0) {
+                return is_full_matrix_state(&payload[pos+1]);
+            }
+            pos += 1 + len;
+        }
+    }
+    return false;
+}
+
+// Returns false if not a valid packet
+static bit_t handle_packet(XRAM rx_slot_t *rx_packet) REENT {
+    XRAM uint8_t *packet_payload = rx_packet->payload;
+    const uint8_t pipe_num = rx_packet->pipe_num;
+    const uint8_t width = rx_packet->width;
 
 #if USE_UNIFYING
     // NOTE: currently mouse pipes are disabled in passive listening mode
@@ -473,15 +836,11 @@ bit_t read_packet(void) REENT {
             return false;
         }
 
-        if (unifying_calc_checksum(packet_payload, width) != 0) {
-            return false;
-        }
-
 #if DEBUG_LEVEL >= 6
         usb_print(packet_payload, width);
 #endif
 
-        // checksum passed, so assume we got a valid unifying packet
+        // the checksum was checked by `unifying_rx_packet()`
         unifying_read_packet(packet_payload, width);
         return true;
     }
@@ -553,20 +912,12 @@ bit_t read_packet(void) REENT {
     }
 #endif
 
-    // other packet sizes are unsupported
+    // other packet sizes are unsupported, and were not decrypted by
+    // `read_packet_batch()`
     if (width != AES_BUF_SIZE) {
         return false;
     }
 
-#if DEBUG_LEVEL >= 8
-    // Print the packet before encryption
-    usb_print(packet_payload, width);
-#endif
-
-
-    // All packets except unifying mouse packets are encrypted.
-    aes_decrypt(packet_payload);
-
 #if DEBUG_LEVEL >= 6
     // Print the packet after encrpytion
     usb_print(packet_payload, width);
@@ -576,10 +927,17 @@ bit_t read_packet(void) REENT {
     {
         packet_t *packet = (packet_t*)packet_payload;
         // NOTE: This is the id read from the packet, we can't guarantee that
-        // this is actually form this device until we call is_valid_packet later.
+        // this is actually form this device until we call check_packet_id later.
         const uint8_t device_id = packet->gen.device_id;
         const uint8_t packet_type = get_packet_type(packet);
-        uint8_t state = device_uid_list[device_id].sync_state;
+        uint8_t state;
+        uint8_t id_check;
+
+        if (device_id >= MAX_NUM_DEVICES) {
+            return false;
+        }
+
+        state = device_uid_list[device_id].sync_state;
 
         // We received a packet from a disconnected device.  We generate a uid
         // which we will send to the slave in a packet.
@@ -589,9 +947,10 @@ bit_t read_packet(void) REENT {
         // it passes this challenge, we then update the check_id in the
         // device_uid_list with the packet_id received from the slave.
         //
-        // The check_id is then used and updated in is_valid_packet() to
-        // validate further packets received from the slave.
+        // The check_id is then used with check_packet_id() to validate
+        // further packets received from the slave.
         if (state == DEV_STATE_DISCONNECTED) {
+            RF_STATS_COUNT(device_id, resyncs);
             device_uid_list[device_id].sync_state = DEV_STATE_SYNCING_0;
             // set the check_id for the challenge-response authentication
             device_uid_list[device_id].check_id = uid_generate();
@@ -625,6 +984,9 @@ bit_t read_packet(void) REENT {
                 // valid response to the challenge
                 device_uid_list[device_id].sync_state = DEV_STATE_SYNCED_0;
                 device_uid_list[device_id].check_id = packet->sync.packet_id;
+                device_uid_list[device_id].seen_ids = 1;
+                // The device follows the sync with its whole matrix state
+                device_uid_list[device_id].full_state_age = 0;
 
                 // Got a valid sync packet! Can now accept future packets
                 // but don't have any data to process in the current sync packet
@@ -632,6 +994,7 @@ bit_t read_packet(void) REENT {
                 return false;
             } else {
                 // incorrect response to the challenge
+                RF_STATS_COUNT(device_id, rejected);
                 device_uid_list[device_id].sync_state++; // keep track of failed attempts
                 // TODO: should probably reduce retry attempts to 1?
                 if (state >= DEV_STATE_SYNCING_0 + SYNCING_RETRY_LIMIT) {
@@ -645,8 +1008,15 @@ bit_t read_packet(void) REENT {
         } // else assume that the claimed device_id is synced
 
         // expecting a normal data packet from the slave.
-        if (!is_valid_packet(packet, pipe_num)) {
+        id_check = check_packet_id(packet, pipe_num);
+        if (id_check == PACKET_ID_REPLAYED) {
+            // already handled this packet, so ignore it without counting it
+            // as a failure
+            RF_STATS_COUNT(device_id, replayed);
+            return false;
+        } else if (id_check == PACKET_ID_INVALID) {
             // keep track of the number of failed packets received
+            RF_STATS_COUNT(device_id, rejected);
             device_uid_list[device_id].sync_state++;
 
             // If we exceed the PACKET_FAIL_LIMIT, the device returns to
@@ -660,12 +1030,43 @@ bit_t read_packet(void) REENT {
 
         // the packet we got is valid, so reset the sync state count
         device_uid_list[device_id].sync_state = DEV_STATE_SYNCED_0;
-        device_uid_list[device_id].check_id = packet->gen.packet_id;
+        mark_packet_id_seen(device_id, packet->gen.packet_id);
+        RF_STATS_COUNT(device_id, received);
+#if USE_RF_HOPPING
+        rf_hop_rx_packet(&g_rf_hop);
+#endif
+
+        // A late packet is genuine, but a newer packet from the device has
+        // already updated its matrix, so applying it would undo newer changes.
+        //
+        // Devices send their whole matrix state every few packets, or when
+        // their list of changes overflowed. If a late packet carried the
+        // whole state and no newer packet did, the changes applied since
+        // then were applied to a state that may be missing some. That state
+        // can't be fixed from here, so make the device sync again: it sends
+        // its whole matrix state straight after the sync.
+        if (id_check == PACKET_ID_LATE) {
+            RF_STATS_COUNT(device_id, late);
+            if (
+                has_full_matrix_state(packet, packet_payload) &&
+                device_uid_list[device_id].full_state_age >
+                    (uint8_t)(device_uid_list[device_id].check_id - packet->gen.packet_id)
+            ) {
+                device_uid_list[device_id].sync_state = DEV_STATE_DISCONNECTED;
+            }
+            return false;
+        }
+
+        if (has_full_matrix_state(packet, packet_payload)) {
+            device_uid_list[device_id].full_state_age = 0;
+        }
 
         // finally have a valid data packet ready to be processed
         if (is_matrix_packet(packet)) {
             keyboard_update_device_matrix(device_id, packet_payload);
             return true;
+        } else if (is_multi_record_packet(packet)) {
+            return handle_packet_records(device_id, packet_payload);
         } else {
             /* TODO: handle other packet types here */
             return false;
@@ -673,9 +1074,15 @@ bit_t read_packet(void) REENT {
     }
 }
 
+#if USE_UNIFYING
+// unifying packets are read here before `unifying_rx_packet()` sorts them
+static XRAM uint8_t s_unifying_rx_buf[UNIFYING_MAX_PACKET_SIZE];
+#endif
+
 void rf_packet_buffer_add(void) {
     uint8_t pipe_num;
     uint8_t width;
+    XRAM uint8_t *dest;
 
     pipe_num = nrf24_get_rx_pipe_num();
 
@@ -686,21 +1093,28 @@ void rf_packet_buffer_add(void) {
 
     width = nrf24_read_rx_payload_width();
 
-    if (packet_buffer_free_space() < width+2) {
-        // no space left in buffer
-        nrf24_flush_rx(); // TODO: could probably handle this better
+#if USE_UNIFYING
+    if (pipe_num == UNIFYING_RF_PIPE_MOUSE || pipe_num == UNIFYING_RF_PIPE_DONGLE) {
+        if (width > UNIFYING_MAX_PACKET_SIZE) {
+            nrf24_read_rx_payload(NULL, 0);
+            g_rf_rx_drop_count[pipe_num]++;
+            return;
+        }
+        packet_buffer_load(s_unifying_rx_buf, width);
+        unifying_rx_packet(pipe_num, s_unifying_rx_buf, width);
         return;
     }
+#endif
 
-    if (width > PACKET_BUFFER_MAX_LEN) {
+    dest = packet_buffer_alloc(pipe_num, width);
+
+    if (dest == NULL) {
         // drop packets that are too large
         nrf24_read_rx_payload(NULL, 0);
         return;
     }
 
-    packet_buffer_add_byte(pipe_num);
-    packet_buffer_add_byte(width);
-    packet_buffer_load(width);
+    packet_buffer_load(dest, width);
 }
 
 // NOTE: if other code needs to communicate with the nRF24L01+, it should
@@ -717,6 +1131,28 @@ void rf_isr(void) {
     nrf24_write_reg(NRF_STATUS, STATUS_ALL_IRQ_FLAGS_bm);
 }
 
+static bit_t handle_packets(void) {
+    bit_t has_data = false;
+    uint8_t count;
+    uint8_t i;
+
+    while (packet_buffer_has_data()) {
+        uint8_t slots = 0;
+
+        count = read_packet_batch();
+        for (i = 0; i < count; ++i) {
+            has_data |= handle_packet(&s_rx_slots[s_rx_batch[i]]);
+            slots |= (1 << s_rx_batch[i]);
+        }
+
+        disable_interrupts();
+        packet_buffer_release(slots);
+        enable_interrupts();
+    }
+
+    return has_data;
+}
+
 // check for radio messages and handle them
 bit_t rf_task(void) {
     // TODO: should probably add an option to make this interrupt based when we
@@ -729,24 +1165,22 @@ bit_t rf_task(void) {
         #endif
 
         rf_disable_receive_irq();
-        while (packet_buffer_has_data()) {
-            has_data |= read_packet();
-        }
+        has_data = handle_packets();
         rf_enable_receive_irq();
 #if USE_NRF52_ESB
     } else if (g_rf_settings.hw_type == RF_HW_NRF52_ESB) {
         NVIC_DisableIRQ(ESB_EVT_IRQ);
-        while (packet_buffer_has_data()) {
-            has_data |= read_packet();
-        }
+        has_data = handle_packets();
         NVIC_EnableIRQ(ESB_EVT_IRQ);
     } else if (g_rf_settings.hw_type == RF_HW_BLE_AND_ESB) {
-        while (packet_buffer_has_data()) {
-            has_data |= read_packet();
-        }
+        has_data = handle_packets();
 #endif
     }
 
+#if USE_UNIFYING
+    has_data |= unifying_mouse_task();
+#endif
+
     return has_data;
 }
 
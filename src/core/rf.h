@@ -8,6 +8,10 @@
 #include "core/matrix_interpret.h"
 #include "core/unifying.h"
 #include "core/nonce.h"
+#include "core/settings.h"
+#if USE_RF_HOPPING
+#include "core/rf_hop.h"
+#endif
 
 // number of consecutive invalid packets required before a session is terminated
 #define PACKET_FAIL_LIMIT 6
@@ -20,6 +24,38 @@
 #define NUM_KEYBOARD_PIPES 4
 #define UNIFYING_RF_PIPE_MOUSE 4
 #define UNIFYING_RF_PIPE_DONGLE 5
+#define NUM_RF_PIPES 6
+
+// Received packets are held in a pool of fixed size slots until `rf_task()`
+// handles them. A single pipe may only hold `RF_RX_PIPE_QUOTA` of the slots,
+// so a busy device can't starve the others.
+#define RF_RX_SLOT_COUNT 8
+#define RF_RX_ALL_SLOTS ((1 << RF_RX_SLOT_COUNT) - 1)
+#define RF_RX_PIPE_QUOTA 4
+#define PACKET_BUFFER_MAX_LEN 22
+
+// Packet ids up to this far below the newest id received from a device are
+// still accepted once if they arrive late. The window is kept for each of the
+// `MAX_NUM_DEVICES` devices, so it is only as wide as the few packets that
+// retransmits can reorder.
+#define RF_REPLAY_WINDOW_SIZE 16
+typedef uint16_t replay_window_t;
+
+typedef struct packet_id_t {
+    uint8_t sync_state;
+    // While syncing, the challenge sent to the device. Once synced, the
+    // newest packet id received from the device.
+    uint32_t check_id;
+    // Sliding window of packet ids that have been received, bit `n` is set
+    // if the packet id `check_id - n` has been seen.
+    replay_window_t seen_ids;
+    // How far `check_id` is past the last packet that carried the whole
+    // matrix state of the device, up to 255
+    uint8_t full_state_age;
+} packet_id_t;
+
+// Value of a battery level that hasn't been reported yet
+#define RF_STATUS_UNKNOWN 0xff
 
 typedef enum {
     RF_HW_NRF24L01 = 0,
@@ -28,6 +64,7 @@ typedef enum {
 } rf_hw_type_t;
 
 extern XRAM uint8_t g_rf_enabled;
+extern XRAM packet_id_t device_uid_list[MAX_NUM_DEVICES];
 
 void rf_init_send(void);
 void rf_init_receive(void);
@@ -38,19 +75,51 @@ bit_t is_auto_ack_enabled(void);
 #endif
 
 uint8_t device_id_to_pipe_num(const uint8_t device_id);
-uint8_t packet_buffer_free_space(void);
-void packet_buffer_add_byte(uint8_t byte);
-uint8_t packet_buffer_get(void);
-uint8_t packet_buffer_len(void);
 void packet_buffer_clear(void);
 bit_t packet_buffer_has_data(void);
-void packet_buffer_take(XRAM uint8_t *dest, uint8_t width);
+XRAM uint8_t *packet_buffer_alloc(uint8_t pipe_num, uint8_t width);
+uint8_t packet_buffer_take(XRAM uint8_t *dest, uint8_t *pipe_num);
+
+// Number of received packets dropped on each pipe because its slots were
+// full or the packet was too large.
+extern XRAM uint16_t g_rf_rx_drop_count[NUM_RF_PIPES];
+
+#if USE_RF_STATS
+// Link statistics the receiver keeps for each device, read with the
+// `INFO_RF_STATS` info page. The counters wrap around.
+typedef struct rf_device_stats_t {
+    // packets that passed all the checks, including late ones
+    uint16_t received;
+    // packets that failed the packet id check or the sync challenge
+    uint16_t rejected;
+    // copies of packets that were already handled
+    uint16_t replayed;
+    // packets that arrived after a newer packet from the device
+    uint16_t late;
+    // number of sync challenges sent to the device
+    uint16_t resyncs;
+} rf_device_stats_t;
+
+extern XRAM rf_device_stats_t g_rf_device_stats[MAX_NUM_DEVICES];
+// The battery level in percent that each device last reported in a multi
+// record packet, or `RF_STATUS_UNKNOWN`
+extern XRAM uint8_t g_rf_battery_level[MAX_NUM_DEVICES];
+#endif
 
 bit_t rf_task(void);
 
+void rf_set_battery_level(uint8_t level);
 void rf_send_matrix_packet(void);
 void rf_handle_ack_payloads(void);
 
+#if USE_RF_HOPPING
+// The hop schedule and per channel link statistics
+extern XRAM rf_hop_t g_rf_hop;
+
+void rf_handle_tx_ds(void);
+void rf_handle_max_rt(void);
+#endif
+
 void rf_receive_buffer_add(void);
 
 void rf_init_receive_irq(void);
@@ -0,0 +1,186 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/rf_hop.c
+///
+/// @brief Adaptive channel hopping for the nRF24 wireless protocol.
+
+#include "core/rf_hop.h"
+
+#include <string.h>
+
+#include "core/flash.h"
+#include "core/crc.h"
+#include "core/settings.h"
+
+/// xorshift16, the receiver and its devices need to generate the same
+/// sequence on every platform
+static uint16_t hop_random(uint16_t x) {
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    return x;
+}
+
+static bit_t is_channel_used(XRAM rf_hop_t *hop, uint8_t count, uint8_t channel) {
+    uint8_t i;
+    for (i = 0; i < count; ++i) {
+        const uint8_t other = hop->channels[i];
+        if (
+            (channel >= other && channel - other < RF_HOP_MIN_SPACING) ||
+            (channel < other && other - channel < RF_HOP_MIN_SPACING)
+        ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void window_reset(XRAM rf_hop_t *hop) {
+    hop->window_packets = 0;
+    hop->window_retransmits = 0;
+}
+
+/// Build the hop schedule shared by the receiver and its devices.
+///
+/// @param key the pairing key, `AES_KEY_LEN` bytes
+/// @param first_channel the channel from the RF settings, which is where the
+/// link starts
+void rf_hop_init(XRAM rf_hop_t *hop, const uint8_t *key, uint8_t first_channel) {
+    uint16_t seed = crc16_buffer(key, AES_KEY_LEN);
+    uint8_t channel;
+    uint8_t i;
+
+    memset(hop, 0, sizeof(rf_hop_t));
+    hop->hop_request = RF_HOP_NO_REQUEST;
+    hop->channels[0] = first_channel;
+
+    if (seed == 0) {
+        seed = 1;
+    }
+
+    // The spacing only rules out a few channels around each one picked, so
+    // a free channel is always left in the range.
+    for (i = 1; i < RF_HOP_CHANNEL_COUNT; ++i) {
+        do {
+            seed = hop_random(seed);
+            channel = RF_HOP_MIN_CHANNEL +
+                seed % (RF_HOP_MAX_CHANNEL - RF_HOP_MIN_CHANNEL + 1);
+        } while (is_channel_used(hop, i, channel));
+        hop->channels[i] = channel;
+    }
+}
+
+uint8_t rf_hop_channel(XRAM rf_hop_t *hop) {
+    return hop->channels[hop->index];
+}
+
+/// A packet was acknowledged after `retransmits` retransmits
+void rf_hop_tx_delivered(XRAM rf_hop_t *hop, uint8_t retransmits) {
+    XRAM rf_channel_stats_t *stats = &hop->stats[hop->index];
+
+    stats->packets++;
+    stats->retransmits += retransmits;
+
+    if (hop->is_searching) {
+        // found the receiver
+        hop->is_searching = false;
+        window_reset(hop);
+    }
+
+    if (hop->hop_requested) {
+        // The receiver has the hop request, and will normally move to the
+        // next channel of the schedule. If it went elsewhere, the search
+        // finds it.
+        hop->hop_requested = false;
+        stats->hops++;
+        hop->index = (hop->index + 1) % RF_HOP_CHANNEL_COUNT;
+        hop->is_searching = true;
+        window_reset(hop);
+        return;
+    }
+
+    hop->window_packets++;
+    if (hop->window_retransmits > 0xff - retransmits) {
+        hop->window_retransmits = 0xff;
+    } else {
+        hop->window_retransmits += retransmits;
+    }
+
+    if (hop->window_packets >= RF_HOP_WINDOW_PACKETS) {
+        if (hop->window_retransmits > RF_HOP_RETRANSMIT_LIMIT) {
+            hop->hop_request = hop->index;
+        }
+        window_reset(hop);
+    }
+}
+
+/// A packet reached the maximum retransmit count, so look for the receiver
+/// on the next channel of the schedule
+void rf_hop_tx_failed(XRAM rf_hop_t *hop, uint8_t retransmits) {
+    XRAM rf_channel_stats_t *stats = &hop->stats[hop->index];
+
+    stats->max_rt++;
+    stats->retransmits += retransmits;
+    if (!hop->is_searching) {
+        stats->hops++;
+    }
+
+    hop->index = (hop->index + 1) % RF_HOP_CHANNEL_COUNT;
+    hop->is_searching = true;
+    hop->hop_request = RF_HOP_NO_REQUEST;
+    hop->hop_requested = false;
+    window_reset(hop);
+}
+
+/// Get the index of the channel the receiver should leave, or
+/// `RF_HOP_NO_REQUEST`. Once the packet with the request is delivered, the
+/// device follows the receiver to its next channel.
+uint8_t rf_hop_take_request(XRAM rf_hop_t *hop) {
+    const uint8_t request = hop->hop_request;
+
+    if (request != RF_HOP_NO_REQUEST) {
+        hop->hop_request = RF_HOP_NO_REQUEST;
+        hop->hop_requested = true;
+    }
+
+    return request;
+}
+
+/// The receiver got a valid packet on the current channel
+void rf_hop_rx_packet(XRAM rf_hop_t *hop) {
+    hop->stats[hop->index].packets++;
+}
+
+/// The receiver got a hop request from a device.
+///
+/// Requests for a channel other than the current one are late copies of a
+/// request that has already been handled, and are ignored.
+///
+/// @return true if the receiver needs to change channel
+bit_t rf_hop_rx_request(XRAM rf_hop_t *hop, uint8_t leave_index) {
+    uint8_t next = hop->index;
+    uint8_t i;
+
+    if (leave_index != hop->index) {
+        return false;
+    }
+
+    hop->stats[hop->index].hops++;
+    hop->blacklist |= (1 << hop->index);
+
+    for (i = 0; i < RF_HOP_CHANNEL_COUNT; ++i) {
+        next = (next + 1) % RF_HOP_CHANNEL_COUNT;
+        if (!(hop->blacklist & (1 << next))) {
+            break;
+        }
+    }
+
+    if (hop->blacklist & (1 << next)) {
+        // Every channel is blacklisted, so give the others another chance.
+        hop->blacklist = (1 << hop->index);
+        next = (hop->index + 1) % RF_HOP_CHANNEL_COUNT;
+    }
+
+    hop->index = next;
+    return true;
+}
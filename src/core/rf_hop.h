@@ -0,0 +1,87 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/rf_hop.h
+///
+/// @brief Adaptive channel hopping for the nRF24 wireless protocol.
+///
+/// The receiver and its devices share a schedule of `RF_HOP_CHANNEL_COUNT`
+/// channels. The first one is the channel from the RF settings, the others are
+/// derived from the pairing key, so every device paired with a receiver knows
+/// the same schedule without it being sent over the air.
+///
+/// The receiver decides which channel of the schedule is in use. A device
+/// measures the link quality from the retransmits its packets need, and when
+/// the current channel is bad it asks the receiver to leave it with a
+/// `PACKET_RECORD_HOP_REQUEST` record. The receiver blacklists that channel
+/// and moves to the next good one in the schedule.
+///
+/// Devices that lose the receiver, because it hopped or because the channel
+/// went bad, resync by trying the channels of the schedule in order with a
+/// short retransmit count until a packet is acknowledged.
+///
+/// The functions here only update the hopping state, `core/rf.c` applies
+/// the changes to the radio.
+
+#pragma once
+
+#include "core/util.h"
+
+#define RF_HOP_CHANNEL_COUNT 8
+
+// The channels are picked from this range, at least `RF_HOP_MIN_SPACING` MHz
+// apart since the 2Mbps data rate uses 2MHz of bandwidth.
+#define RF_HOP_MIN_CHANNEL 2
+#define RF_HOP_MAX_CHANNEL 80
+#define RF_HOP_MIN_SPACING 3
+
+// The link quality is judged over windows of this many delivered packets. If
+// the packets of a window needed more than `RF_HOP_RETRANSMIT_LIMIT`
+// retransmits, the device asks the receiver to leave the channel.
+#define RF_HOP_WINDOW_PACKETS 16
+#define RF_HOP_RETRANSMIT_LIMIT 24
+
+// Automatic retransmit count used while searching for the receiver
+#define RF_HOP_SEARCH_ARC 3
+
+// Value of `hop_request` when no hop request needs to be sent
+#define RF_HOP_NO_REQUEST 0xff
+
+typedef struct rf_channel_stats_t {
+    // packets delivered by a device, or received by the receiver
+    uint16_t packets;
+    // retransmits needed by the delivered packets, device only
+    uint16_t retransmits;
+    // packets that reached the maximum retransmit count, device only
+    uint16_t max_rt;
+    // number of times the link left the channel because it was bad
+    uint16_t hops;
+} rf_channel_stats_t;
+
+typedef struct rf_hop_t {
+    uint8_t channels[RF_HOP_CHANNEL_COUNT];
+    rf_channel_stats_t stats[RF_HOP_CHANNEL_COUNT];
+    // index in `channels` of the channel in use
+    uint8_t index;
+    // receiver only, bit `n` is set if `channels[n]` is blacklisted
+    uint8_t blacklist;
+    // device only, non zero while searching for the receiver
+    uint8_t is_searching;
+    // device only, the index of the channel to ask the receiver to leave
+    uint8_t hop_request;
+    // device only, non zero once a hop request has been sent
+    uint8_t hop_requested;
+    uint8_t window_packets;
+    uint8_t window_retransmits;
+} rf_hop_t;
+
+void rf_hop_init(XRAM rf_hop_t *hop, const uint8_t *key, uint8_t first_channel);
+uint8_t rf_hop_channel(XRAM rf_hop_t *hop);
+
+// device side
+void rf_hop_tx_delivered(XRAM rf_hop_t *hop, uint8_t retransmits);
+void rf_hop_tx_failed(XRAM rf_hop_t *hop, uint8_t retransmits);
+uint8_t rf_hop_take_request(XRAM rf_hop_t *hop);
+
+// receiver side
+void rf_hop_rx_packet(XRAM rf_hop_t *hop);
+bit_t rf_hop_rx_request(XRAM rf_hop_t *hop, uint8_t leave_index);
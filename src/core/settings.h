@@ -108,8 +108,20 @@ typedef struct ATTR_PACKED rf_settings_t { // 64 bytes
     uint8_t power;
     /// The type of ESB transmit e.g. nRF24L01+, nrf52_esb
     uint8_t hw_type;
+    /// Time without matrix changes before a wireless keyboard goes from the
+    /// active to the idle power state, in units of 10ms. 0 for the default.
+    uint8_t power_idle_time;
+    /// Time without matrix changes before a wireless keyboard with no keys
+    /// down goes to sleep, in seconds. 0 for the default.
+    uint8_t power_sleep_time;
+    /// Time between matrix scans in the idle power state, in ms. 0 for the
+    /// default.
+    uint8_t power_idle_scan_interval;
+    /// Longest wait in ms before a failed transmit is tried again. 0 for the
+    /// default.
+    uint8_t power_max_backoff;
     /// These bytes are reserved for future use.
-    uint8_t _reserved[13]; // padding
+    uint8_t _reserved[9]; // padding
     /// The AES-128 encryption key used for nRF24/nrf_esb packets.
     uint8_t ekey[AES_KEY_LEN];
     /// The AES-128 decryption key used for nRF24/nrf_esb packets.
@@ -174,9 +186,9 @@ typedef struct ATTR_PACKED settings_t { // 512 bytes
     uint8_t default_report_mode;
     /// The matrix scanning settings for this device.
     /// TODO/NOTE: maybe this should be moved to the start of the layout section?
-    matrix_scan_plan_t scan_plan; // 11 bytes
+    matrix_scan_plan_t scan_plan; // 15 bytes
     /// These bytes are reserved for future use.
-    uint8_t _reserved0[8];
+    uint8_t _reserved0[4];
     /// Used to enable/disable hardware features like nRF24 wireless/split I2C
     uint8_t feature_ctrl;
     /// These bytes are reserved for future use.
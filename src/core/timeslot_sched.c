@@ -0,0 +1,125 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/timeslot_sched.c
+///
+/// @brief Length and spacing of the radio timeslots used by ESB + BLE.
+
+#include "core/timeslot_sched.h"
+
+#include <string.h>
+
+void timeslot_sched_init(timeslot_sched_t *sched) {
+    memset(sched, 0, sizeof(timeslot_sched_t));
+
+    sched->min_len_us = TIMESLOT_DEFAULT_MIN_LEN_US;
+    sched->max_len_us = TIMESLOT_DEFAULT_MAX_LEN_US;
+    sched->max_gap_us = TIMESLOT_DEFAULT_MAX_GAP_US;
+    sched->max_extend_us = TIMESLOT_DEFAULT_MAX_EXTEND_US;
+
+    // Start busy, so the first packets from the keyboards aren't delayed
+    sched->len_us = sched->max_len_us;
+}
+
+/// A slot of `len_us` was granted
+void timeslot_sched_start(timeslot_sched_t *sched) {
+    sched->stats.granted++;
+    sched->slot_len_us = sched->len_us;
+    sched->extended_us = 0;
+    sched->slot_rx = 0;
+    sched->window_rx = 0;
+}
+
+/// An ESB packet was received
+void timeslot_sched_rx(timeslot_sched_t *sched) {
+    sched->stats.rx++;
+    sched->slot_rx++;
+    sched->window_rx++;
+}
+
+/// An ACK payload was sent
+void timeslot_sched_tx(timeslot_sched_t *sched) {
+    sched->stats.tx++;
+}
+
+/// The slot is about to end. Extend it if packets arrived since the last
+/// time this was checked.
+bit_t timeslot_sched_should_extend(timeslot_sched_t *sched) {
+    const bit_t is_busy = (sched->window_rx != 0);
+
+    sched->window_rx = 0;
+    return is_busy &&
+        sched->extended_us + TIMESLOT_EXTENSION_US <= sched->max_extend_us;
+}
+
+/// The SoftDevice granted an extension of `TIMESLOT_EXTENSION_US`
+void timeslot_sched_extended(timeslot_sched_t *sched) {
+    sched->stats.extensions++;
+    sched->extended_us += TIMESLOT_EXTENSION_US;
+    sched->slot_len_us += TIMESLOT_EXTENSION_US;
+}
+
+void timeslot_sched_extend_failed(timeslot_sched_t *sched) {
+    sched->stats.extend_failed++;
+}
+
+/// The slot ended. Pick the length of the next slot and when it starts.
+///
+/// @return the distance from the start of the slot that ended to the start
+/// of the next one, or 0 to request the next slot as soon as possible.
+uint32_t timeslot_sched_end(timeslot_sched_t *sched) {
+    uint8_t bucket = 0;
+    uint16_t count = sched->slot_rx;
+
+    while (count != 0 && bucket < TIMESLOT_PACKET_BUCKETS-1) {
+        count >>= 1;
+        bucket++;
+    }
+    sched->stats.slot_packets[bucket]++;
+    sched->stats.end++;
+
+    if (sched->slot_rx != 0) {
+        sched->len_us *= 2;
+        if (sched->len_us > sched->max_len_us) {
+            sched->len_us = sched->max_len_us;
+        }
+        sched->gap_us = 0;
+    } else {
+        sched->len_us -= sched->len_us / 4;
+        if (sched->len_us < sched->min_len_us) {
+            sched->len_us = sched->min_len_us;
+        }
+        sched->gap_us += TIMESLOT_GAP_STEP_US;
+        if (sched->gap_us > sched->max_gap_us) {
+            sched->gap_us = sched->max_gap_us;
+        }
+    }
+
+    if (sched->gap_us == 0) {
+        sched->distance_us = 0;
+    } else {
+        sched->distance_us = sched->slot_len_us + sched->gap_us;
+    }
+    return sched->distance_us;
+}
+
+/// The SoftDevice couldn't fit the requested slot in its schedule. The next
+/// request is made as soon as possible. If this one already was, the slot is
+/// too long to fit between the SoftDevice's radio events, so it is shortened.
+void timeslot_sched_blocked(timeslot_sched_t *sched) {
+    sched->stats.blocked++;
+    if (sched->distance_us != 0) {
+        sched->distance_us = 0;
+        return;
+    }
+    sched->len_us /= 2;
+    if (sched->len_us < sched->min_len_us) {
+        sched->len_us = sched->min_len_us;
+    }
+}
+
+/// The SoftDevice cancelled the requested slot for a higher priority event.
+/// The next request is made as soon as possible.
+void timeslot_sched_canceled(timeslot_sched_t *sched) {
+    sched->stats.canceled++;
+    sched->distance_us = 0;
+}
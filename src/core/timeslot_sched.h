@@ -0,0 +1,104 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/timeslot_sched.h
+///
+/// @brief Length and spacing of the radio timeslots ESB runs in when it
+/// shares the nRF52 radio with the BLE SoftDevice.
+///
+/// The receiver only hears its keyboards during a timeslot, and a keyboard
+/// whose packet falls outside of one retransmits it until the next slot.
+/// The schedule follows the ESB traffic:
+///
+/// * While packets arrive, the slots grow up to `max_len_us`, the next slot
+///   is requested as soon as possible, and a slot is extended for as long as
+///   packets keep arriving in it, up to `max_extend_us` in total.
+/// * While no packets arrive, the slots shrink down to `min_len_us`, they
+///   aren't extended, and a growing gap of up to `max_gap_us` is left
+///   between them, so the SoftDevice gets the radio for its other work.
+///
+/// A slot requested as soon as possible is only blocked when the SoftDevice
+/// can't fit its length between its own radio events, so those requests
+/// shrink the slot length. A slot requested after a gap is blocked when its
+/// start time is taken, and it is requested again as soon as possible.
+///
+/// The functions here only track the schedule and its statistics, the port
+/// makes the timeslot requests.
+
+#pragma once
+
+#include "core/util.h"
+
+#define TIMESLOT_DEFAULT_MIN_LEN_US 3000UL
+#define TIMESLOT_DEFAULT_MAX_LEN_US 6000UL
+#define TIMESLOT_DEFAULT_MAX_GAP_US 4000UL
+#define TIMESLOT_DEFAULT_MAX_EXTEND_US 10000UL
+
+/// Length of each timeslot extension
+#define TIMESLOT_EXTENSION_US 1000UL
+/// How much the gap between idle slots grows after each idle slot
+#define TIMESLOT_GAP_STEP_US 1000UL
+
+/// Buckets of `slot_packets`: slots with 0, 1, 2-3, 4-7 and 8 or more ESB
+/// packets received
+#define TIMESLOT_PACKET_BUCKETS 5
+
+typedef struct timeslot_stats_t {
+    /// Slots granted by the SoftDevice
+    uint32_t granted;
+    /// Slots that ended
+    uint32_t end;
+    /// Requests the SoftDevice couldn't fit in its schedule
+    uint32_t blocked;
+    /// Requests the SoftDevice cancelled for a higher priority event
+    uint32_t canceled;
+    uint32_t extensions;
+    uint32_t extend_failed;
+    /// ESB packets received, and ACK payloads sent
+    uint32_t rx;
+    uint32_t tx;
+    /// Histogram of the ESB packets received in each slot
+    uint32_t slot_packets[TIMESLOT_PACKET_BUCKETS];
+} timeslot_stats_t;
+
+typedef struct timeslot_sched_t {
+    timeslot_stats_t stats;
+
+    /// Length to request for the next slot
+    uint32_t len_us;
+    /// Gap to leave between the end of the current slot and the start of the
+    /// next one
+    uint32_t gap_us;
+    /// Distance from the start of the last slot to the start of the
+    /// requested one, 0 if it was requested as soon as possible
+    uint32_t distance_us;
+    /// Length of the current slot, with its extensions
+    uint32_t slot_len_us;
+    /// Time the current slot has been extended by
+    uint32_t extended_us;
+    /// ESB packets received in the current slot, and since the last time an
+    /// extension was considered
+    uint16_t slot_rx;
+    uint16_t window_rx;
+
+    // Limits of the schedule
+    uint32_t min_len_us;
+    uint32_t max_len_us;
+    uint32_t max_gap_us;
+    uint32_t max_extend_us;
+} timeslot_sched_t;
+
+void timeslot_sched_init(timeslot_sched_t *sched);
+
+void timeslot_sched_start(timeslot_sched_t *sched);
+void timeslot_sched_rx(timeslot_sched_t *sched);
+void timeslot_sched_tx(timeslot_sched_t *sched);
+bit_t timeslot_sched_should_extend(timeslot_sched_t *sched);
+void timeslot_sched_extended(timeslot_sched_t *sched);
+void timeslot_sched_extend_failed(timeslot_sched_t *sched);
+uint32_t timeslot_sched_end(timeslot_sched_t *sched);
+
+void timeslot_sched_blocked(timeslot_sched_t *sched);
+void timeslot_sched_canceled(timeslot_sched_t *sched);
+
+/// The timeslot schedule of the ESB + BLE mode, defined by the port
+extern timeslot_sched_t g_timeslot_sched;
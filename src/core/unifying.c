@@ -13,6 +13,7 @@
 #include "core/rf.h"
 #include "core/settings.h"
 #include "core/timer.h"
+#include "core/unifying_mouse_queue.h"
 #include "core/usb_commands.h"
 #include "core/mouse.h"
 
@@ -49,18 +50,13 @@ static XRAM uint16_t packet_timeout;
 // TODO: move to init function
 static XRAM uint8_t s_extra_button_last_state = 0;
 
-// Seems to be a bug in the mouse firmware. It seems to send an extra report
-// after some requests (that seems to correspond to a left click, might
-// be specific to m560???).
-static XRAM uint8_t s_ignore_buggy_report = 0;
-
 // HID++ communication state
 static XRAM uint8_t s_index = 0;
 
 void unifying_set_pairing_address(const XRAM uint8_t *target_addr, uint8_t addr_lsb);
 
 /// Two's complement checksum used by unifying packets
-uint8_t unifying_calc_checksum(const XRAM uint8_t *data, const uint8_t len) {
+uint8_t unifying_calc_checksum(const XRAM uint8_t *data, const uint8_t len) REENT {
     uint8_t i;
     uint8_t result = 0;
 
@@ -120,109 +116,188 @@ void unifying_send_packet(const XRAM uint8_t *data, uint8_t size) {
     write_ack_payload(data, size, UNIFYING_RF_PIPE_MOUSE);
 }
 
-void unifying_read_packet(const XRAM uint8_t *nrf_packet, uint8_t width) {
-    const uint8_t nrf_packet_type = nrf_packet[1];
+static XRAM unifying_mouse_state_t s_rx_mouse_report;
+static XRAM unifying_mouse_state_t s_mouse_report;
 
-#if 0
-    // For debugging print unifying packets
-    if (nrf_packet_type == 0x40 || nrf_packet_type == 0x4F) {
-    // } else if (nrf_packet_type == 0xC2) {
-    } else {
-        usb_print(nrf_packet, width);
+// Called from the radio interrupt
+static void queue_mouse_report(uint8_t pipe_num, const XRAM uint8_t *nrf_packet) {
+    const uint16_t x = ((nrf_packet[5] & 0x0f) << 8) | nrf_packet[4];
+    const uint16_t y = (uint16_t)((nrf_packet[6]) << 4) | (uint16_t)((nrf_packet[5] & 0xf0) >> 4);
+
+    s_rx_mouse_report.buttons_1 = nrf_packet[2];
+    s_rx_mouse_report.buttons_2 = nrf_packet[3];
+    s_rx_mouse_report.x = sign_extend_12(x);
+    s_rx_mouse_report.y = sign_extend_12(y);
+    s_rx_mouse_report.wheel_y = (int8_t)nrf_packet[7];
+    s_rx_mouse_report.wheel_x = (int8_t)nrf_packet[8];
+
+    if (!unifying_mouse_queue_add(&s_rx_mouse_report)) {
+        g_rf_rx_drop_count[pipe_num]++;
     }
-#endif
+}
 
-    switch (nrf_packet_type) {
-        case UNIFYING_FRAME_MOUSE: {
-            uint16_t x = ((nrf_packet[5] & 0x0f) << 8) | nrf_packet[4];
-            uint16_t y = (uint16_t)((nrf_packet[6]) << 4) | (uint16_t)((nrf_packet[5] & 0xf0) >> 4);
+/// Handle a packet received on one of the unifying pipes. Called from the
+/// radio interrupt or the ESB event handler.
+///
+/// Mouse motion reports can arrive at up to 1000Hz, so they skip the receive
+/// buffer the keyboards use and are merged in `core/unifying_mouse_queue.c`
+/// instead. The main loop then handles one report per pass with
+/// `unifying_mouse_task()`, whatever the keyboards are sending. The other
+/// frames are rare, and are buffered for `unifying_read_packet()`.
+void unifying_rx_packet(uint8_t pipe_num, const XRAM uint8_t *data, uint8_t width) {
+    XRAM uint8_t *dest;
+    uint8_t i;
 
-            if (s_ignore_buggy_report) {
-                s_ignore_buggy_report = 0;
-                break;
-            }
+    if (g_runtime_settings.feature.ctrl.rf_mouse_disabled) {
+        return;
+    }
+
+    if (width < 2 || unifying_calc_checksum(data, width) != 0) {
+        return;
+    }
+
+    if (data[1] == UNIFYING_FRAME_MOUSE && width >= sizeof(unifying_mouse_packet_t)) {
+        queue_mouse_report(pipe_num, data);
+        return;
+    }
+
+    if (
+        data[1] == UNIFYING_FRAME_EXTRA_BUTTON &&
+        width > 6 &&
+        data[6] == UNIFYING_EXTRA_MIDDLE
+    ) {
+        // Seems to be a bug in the mouse firmware. It seems to send an extra
+        // report after some requests (that seems to correspond to a left
+        // click, might be specific to m560???). Skip the report that follows
+        // the button, the reports queued before it are still good.
+        unifying_mouse_queue_skip_next();
+    }
+
+    dest = packet_buffer_alloc(pipe_num, width);
+    if (dest == NULL) {
+        return;
+    }
+    for (i = 0; i < width; ++i) {
+        dest[i] = data[i];
+    }
+}
 
+static void update_mouse_state(const XRAM unifying_mouse_state_t *mouse_report) {
 #if USE_MOUSE_GESTURE
-            // On left mouse click, send a HID++ packet.
-            if ((g_mouse_state.buttons_1 & 0x01) == 0 && (nrf_packet[2] & 0x01)) {
-                // TODO: integrate this functionality so it happens automatically
-                // on device power on and receiving packets from the mouse
-                unifying_hidpp20_long_t XRAM* report = (unifying_hidpp20_long_t*)tmp_buffer;
-                uint8_t size = sizeof(unifying_hidpp20_long_t);
-                memset(report, 0, size);
-                report->id = 0x00;
-                report->frame_type = UNIFYING_FRAME_HIDPP_LONG;
-                report->device_index = 0x01;
+    // On left mouse click, send a HID++ packet.
+    if ((g_mouse_state.buttons_1 & 0x01) == 0 && (mouse_report->buttons_1 & 0x01)) {
+        // TODO: integrate this functionality so it happens automatically
+        // on device power on and receiving packets from the mouse
+        unifying_hidpp20_long_t XRAM* report = (unifying_hidpp20_long_t*)tmp_buffer;
+        uint8_t size = sizeof(unifying_hidpp20_long_t);
+        memset(report, 0, size);
+        report->id = 0x00;
+        report->frame_type = UNIFYING_FRAME_HIDPP_LONG;
+        report->device_index = 0x01;
 
 #if 0
-                // Discover a feature index using IRoot_GetFeature()
-                {
-                    uint16_t feature = HIDPP20_REPROG_CONTROLS_V4;
-
-                    report->feature_index = HIDPP20_ROOT_INDEX;
-                    report->function_id = HIDPP20_IRoot_GetFeature;
-                    report->software_id = 1;
-                    report->parameters[0] = (feature >> 8) & 0xff; // big endian
-                    report->parameters[1] = (feature >> 0) & 0xff;
-                }
+        // Discover a feature index using IRoot_GetFeature()
+        {
+            uint16_t feature = HIDPP20_REPROG_CONTROLS_V4;
+
+            report->feature_index = HIDPP20_ROOT_INDEX;
+            report->function_id = HIDPP20_IRoot_GetFeature;
+            report->software_id = 1;
+            report->parameters[0] = (feature >> 8) & 0xff; // big endian
+            report->parameters[1] = (feature >> 0) & 0xff;
+        }
 #endif
 
 #if 1
-                // HIDPP20 HIDPP20_REPROG_CONTROLS_V4
-                {
-                    uint8_t cid_tab[3] = {
-                        HIDPP20_CID_SCROLL_LEFT,
-                        HIDPP20_CID_SCROLL_RIGHT,
-                        HIDPP20_CID_GESTURE,
-                    };
-                    uint8_t cid = cid_tab[s_index%3];
-
-                    uint8_t flags = (
-                        ((1<<0) * 1) | // divert
-                        ((1<<1) * 1) | // dvalid
-                        ((1<<2) * 1) | // persist
-                        ((1<<3) * 1) | // pvalid
-                        ((1<<4) * 0) | // rawXY
-                        ((1<<5) * 0)   // rvalid
-                    );
-                    uint8_t remap = 0; // 0-> don't change
-
-                    report->feature_index = 0x0b;
-
-                    // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCount;
-                    // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCidInfo;
-                    // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCidReporting;
-                    report->function_id = HIDPP20_SpecialKeysMSEButtons_SetCidReporting;
-                    report->software_id = KEYPLUS_HIDPP_SOFTWARE_ID;
-
-                    report->parameters[0] = (cid>>8) & 0xff;
-                    report->parameters[1] = (cid>>0) & 0xff;
-
-                    report->parameters[2] = flags;
-
-                    report->parameters[3] = (remap>>8) & 0xff;
-                    report->parameters[4] = (remap>>0) & 0xff;
-                }
+        // HIDPP20 HIDPP20_REPROG_CONTROLS_V4
+        {
+            uint8_t cid_tab[3] = {
+                HIDPP20_CID_SCROLL_LEFT,
+                HIDPP20_CID_SCROLL_RIGHT,
+                HIDPP20_CID_GESTURE,
+            };
+            uint8_t cid = cid_tab[s_index%3];
+
+            uint8_t flags = (
+                ((1<<0) * 1) | // divert
+                ((1<<1) * 1) | // dvalid
+                ((1<<2) * 1) | // persist
+                ((1<<3) * 1) | // pvalid
+                ((1<<4) * 0) | // rawXY
+                ((1<<5) * 0)   // rvalid
+            );
+            uint8_t remap = 0; // 0-> don't change
+
+            report->feature_index = 0x0b;
+
+            // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCount;
+            // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCidInfo;
+            // report->function_id = HIDPP20_SpecialKeysMSEButtons_GetCidReporting;
+            report->function_id = HIDPP20_SpecialKeysMSEButtons_SetCidReporting;
+            report->software_id = KEYPLUS_HIDPP_SOFTWARE_ID;
+
+            report->parameters[0] = (cid>>8) & 0xff;
+            report->parameters[1] = (cid>>0) & 0xff;
+
+            report->parameters[2] = flags;
+
+            report->parameters[3] = (remap>>8) & 0xff;
+            report->parameters[4] = (remap>>0) & 0xff;
+        }
 #endif
 
-                report->checksum = unifying_calc_checksum((uint8_t *XRAM)report, size-1);
+        report->checksum = unifying_calc_checksum((uint8_t *XRAM)report, size-1);
 
-                s_index++;
+        s_index++;
 
-                unifying_send_packet((uint8_t *XRAM)report, size);
-            }
+        unifying_send_packet((uint8_t *XRAM)report, size);
+    }
 #endif
 
+    // Add the motion, in case `handle_mouse_events()` hasn't used the last
+    // report yet
+    g_mouse_state.buttons_1 = mouse_report->buttons_1 | s_extra_button_last_state;
+    g_mouse_state.buttons_2 = mouse_report->buttons_2;
+    g_mouse_state.x += mouse_report->x;
+    g_mouse_state.y += mouse_report->y;
+    g_mouse_state.wheel_y += mouse_report->wheel_y * MOUSE_WHEEL_HI_RES_DETENT;
+    g_mouse_state.wheel_x += mouse_report->wheel_x * MOUSE_WHEEL_HI_RES_DETENT;
 
-            g_mouse_state.buttons_1 = nrf_packet[2] | s_extra_button_last_state;
-            g_mouse_state.buttons_2 = nrf_packet[3];
-            g_mouse_state.x = sign_extend_12(x);
-            g_mouse_state.y = sign_extend_12(y);
-            g_mouse_state.wheel_y = nrf_packet[7];
-            g_mouse_state.wheel_x = nrf_packet[8];
+    g_mouse_activity = UNIFYING_MOUSE_ACTIVE;
+}
 
-            g_mouse_activity = UNIFYING_MOUSE_ACTIVE;
-        } break;
+/// Apply the oldest motion report received by `unifying_rx_packet()` to
+/// `g_mouse_state`.
+///
+/// Returns true if there was a report.
+bit_t unifying_mouse_task(void) {
+    bit_t has_report = false;
+
+    disable_interrupts();
+    has_report = unifying_mouse_queue_pop(&s_mouse_report);
+    enable_interrupts();
+
+    if (has_report) {
+        update_mouse_state(&s_mouse_report);
+    }
+    return has_report;
+}
+
+void unifying_read_packet(const XRAM uint8_t *nrf_packet, uint8_t width) {
+    const uint8_t nrf_packet_type = nrf_packet[1];
+
+#if 0
+    // For debugging print unifying packets
+    if (nrf_packet_type == 0x40 || nrf_packet_type == 0x4F) {
+    // } else if (nrf_packet_type == 0xC2) {
+    } else {
+        usb_print(nrf_packet, width);
+    }
+#endif
+
+    switch (nrf_packet_type) {
+        // Motion reports are taken out of the receive path by
+        // `unifying_rx_packet()`, see `unifying_mouse_task()`
 
         case UNIFYING_FRAME_EXTRA_BUTTON: { // 0xD1
 
@@ -242,7 +317,6 @@ void unifying_read_packet(const XRAM uint8_t *nrf_packet, uint8_t width) {
             switch (nrf_packet[6]) {
                 case UNIFYING_EXTRA_MIDDLE: {    // AF: middle mouse button
                     s_extra_button_last_state |= UNIFYING_MSB_MIDDLE;
-                    s_ignore_buggy_report = 1;
                 } break;
                 case UNIFYING_EXTRA_SIDE_UP: {   // B0: side button 1
                     s_extra_button_last_state |= UNIFYING_MSB_EXTRA_1;
@@ -424,15 +498,8 @@ bit_t handle_pairing(uint8_t pipe_num) {
     uint8_t width;
 #if USE_NRF52_ESB
     if (g_rf_settings.hw_type == RF_HW_NRF52_ESB) {
-        pipe_num = packet_buffer_get();
-        width = packet_buffer_get();
-        if (width > UNIFYING_MAX_PACKET_SIZE || width > packet_buffer_len())  {
-            packet_buffer_clear();
-            return false;
-        }
-
         // read out the packet payload into the buffer
-        packet_buffer_take(tmp_buffer, width);
+        width = packet_buffer_take(tmp_buffer, &pipe_num);
     } else
 #endif
     {
@@ -13,6 +13,9 @@
 
 #define UNIFYING_MAX_PACKET_SIZE 22
 
+// Mouse reports with different buttons that can wait for the main loop
+#define UNIFYING_MOUSE_QUEUE_SIZE 4
+
 // If pairing is not complete in this time, fail
 #define UNIFYING_PAIRING_TIMEOUT 20000
 #define UNIFYING_PAIRING_PACKET_TIMEOUT 2000
@@ -291,8 +294,10 @@ typedef struct unifying_hidpp20_diverted_buttons_t {
     uint8_t checksum;
 } ATTR_PACKED unifying_hidpp20_diverted_buttons_t;
 
-uint8_t unifying_calc_checksum(const XRAM uint8_t *data, const uint8_t len);
+uint8_t unifying_calc_checksum(const XRAM uint8_t *data, const uint8_t len) REENT;
 void unifying_send_packet(const XRAM uint8_t *data, uint8_t size);
+void unifying_rx_packet(uint8_t pipe_num, const XRAM uint8_t *data, uint8_t width);
+bit_t unifying_mouse_task(void);
 void unifying_read_packet(const uint8_t XRAM *nrf_packet, uint8_t width);
 void unifying_begin_pairing(void);
 void unifying_pairing_poll(void);
@@ -0,0 +1,98 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/unifying_mouse_queue.c
+///
+/// @brief Unifying mouse reports waiting for the main loop.
+
+#include "core/unifying_mouse_queue.h"
+
+#include <string.h>
+
+static XRAM unifying_mouse_state_t s_mouse_queue[UNIFYING_MOUSE_QUEUE_SIZE];
+static XRAM uint8_t s_mouse_queue_head;
+static XRAM uint8_t s_mouse_queue_len;
+static XRAM uint8_t s_skip_next;
+
+static int16_t add_motion(int16_t total, int16_t delta) {
+    const int32_t sum = (int32_t)total + delta;
+    if (sum > INT16_MAX) {
+        return INT16_MAX;
+    } else if (sum < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return sum;
+}
+
+static int8_t add_wheel(int8_t total, int8_t delta) {
+    const int16_t sum = (int16_t)total + delta;
+    if (sum > INT8_MAX) {
+        return INT8_MAX;
+    } else if (sum < INT8_MIN) {
+        return INT8_MIN;
+    }
+    return sum;
+}
+
+/// Add a report to the queue.
+///
+/// Returns false if the queue was full and the buttons of the newest entry
+/// were lost.
+bit_t unifying_mouse_queue_add(const XRAM unifying_mouse_state_t *report) {
+    XRAM unifying_mouse_state_t *entry = NULL;
+    bit_t is_ok = true;
+
+    if (s_skip_next) {
+        s_skip_next = 0;
+        return true;
+    }
+
+    if (s_mouse_queue_len != 0) {
+        entry = &s_mouse_queue[
+            (s_mouse_queue_head + s_mouse_queue_len - 1) % UNIFYING_MOUSE_QUEUE_SIZE
+        ];
+        if (entry->buttons_1 != report->buttons_1 || entry->buttons_2 != report->buttons_2) {
+            if (s_mouse_queue_len < UNIFYING_MOUSE_QUEUE_SIZE) {
+                entry = NULL;
+            } else {
+                is_ok = false;
+            }
+        }
+    }
+
+    if (entry == NULL) {
+        entry = &s_mouse_queue[
+            (s_mouse_queue_head + s_mouse_queue_len) % UNIFYING_MOUSE_QUEUE_SIZE
+        ];
+        s_mouse_queue_len++;
+        entry->x = 0;
+        entry->y = 0;
+        entry->wheel_x = 0;
+        entry->wheel_y = 0;
+    }
+
+    entry->buttons_1 = report->buttons_1;
+    entry->buttons_2 = report->buttons_2;
+    entry->x = add_motion(entry->x, report->x);
+    entry->y = add_motion(entry->y, report->y);
+    entry->wheel_x = add_wheel(entry->wheel_x, report->wheel_x);
+    entry->wheel_y = add_wheel(entry->wheel_y, report->wheel_y);
+    return is_ok;
+}
+
+/// Drop the next report passed to `unifying_mouse_queue_add()`
+void unifying_mouse_queue_skip_next(void) {
+    s_skip_next = 1;
+}
+
+/// Take the oldest entry out of the queue.
+///
+/// Returns false if the queue is empty.
+bit_t unifying_mouse_queue_pop(XRAM unifying_mouse_state_t *report) {
+    if (s_mouse_queue_len == 0) {
+        return false;
+    }
+    memcpy(report, &s_mouse_queue[s_mouse_queue_head], sizeof(unifying_mouse_state_t));
+    s_mouse_queue_head = (s_mouse_queue_head + 1) % UNIFYING_MOUSE_QUEUE_SIZE;
+    s_mouse_queue_len--;
+    return true;
+}
@@ -0,0 +1,24 @@
+// Copyright 2019 jem@seethis.link
+// Licensed under the MIT license (http://opensource.org/licenses/MIT)
+/// @file core/unifying_mouse_queue.h
+///
+/// @brief Unifying mouse reports waiting for the main loop.
+///
+/// Mouse motion reports can arrive at up to 1000Hz. The radio interrupt
+/// adds them here, and the main loop takes them out oldest first. A report
+/// is merged into the newest entry when its buttons are the same, so no
+/// motion is lost while the main loop is busy, and a new entry is only used
+/// when the buttons change. When the queue is full, the newest entry takes
+/// the new buttons and the buttons it had are lost.
+///
+/// `unifying_mouse_queue_add()` is called from the radio interrupt, and
+/// `unifying_mouse_queue_pop()` from the main loop with interrupts disabled.
+
+#pragma once
+
+#include "core/util.h"
+#include "core/unifying.h"
+
+bit_t unifying_mouse_queue_add(const XRAM unifying_mouse_state_t *report);
+void unifying_mouse_queue_skip_next(void);
+bit_t unifying_mouse_queue_pop(XRAM unifying_mouse_state_t *report);
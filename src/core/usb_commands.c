@@ -14,6 +14,12 @@
 #include "core/led.h"
 #include "core/matrix_interpret.h"
 #include "core/matrix_scanner.h"
+#if USE_RF_STATS
+#include "core/rf.h"
+#endif
+#if USE_ESB_TIMESLOT
+#include "core/timeslot_sched.h"
+#endif
 #include "core/timer.h"
 
 #if USE_UNIFYING
@@ -32,6 +38,15 @@ XRAM static uint8_t s_vendor_state = STATE_WAIT_CMD;
 
 XRAM static uint8_t s_usb_commands_in_progress;
 
+/// Size of the payload of a CMD_REPORT_RATE_TEST packet
+#define REPORT_RATE_TEST_PAYLOAD_SIZE 4
+
+/// Number of CMD_REPORT_RATE_TEST packets left to send
+static XRAM uint16_t s_rate_test_count;
+/// Sequence number of the next CMD_REPORT_RATE_TEST packet
+static XRAM uint16_t s_rate_test_seq;
+static XRAM uint8_t s_rate_test_payload[REPORT_RATE_TEST_PAYLOAD_SIZE];
+
 static XRAM struct {
     // TODO: clean up most of the code related to this
     // TODO: must change to 16bit, need to check flashing software first
@@ -102,6 +117,8 @@ void reset_usb_reports(void) {
 
     reset_hid_reports();
 
+    s_rate_test_count = 0;
+
     unlock_usb_commands();
 }
 
@@ -231,6 +248,47 @@ static void cmd_read_layout(void) {
     }
 }
 
+#if USE_RF_STATS
+// The `INFO_RF_STATS` page starts with the first device id, the number of
+// devices, the current channel and the buffer drops for each pipe. Then for
+// each device, its `rf_device_stats_t`, sync state and battery level.
+#define RF_STATS_INFO_HEADER_SIZE (3 + sizeof(g_rf_rx_drop_count))
+#define RF_STATS_INFO_DEVICE_SIZE (sizeof(rf_device_stats_t) + 2)
+
+static void get_rf_stats_info(void) {
+    // data[2] is the first device id to return stats for
+    const uint8_t first_device = g_vendor_report_out.data[2];
+    const uint8_t max_count = (EP_SIZE_VENDOR-2-RF_STATS_INFO_HEADER_SIZE) / RF_STATS_INFO_DEVICE_SIZE;
+    XRAM uint8_t *dest = g_vendor_report_in.data+2+RF_STATS_INFO_HEADER_SIZE;
+    uint8_t count = 0;
+    uint8_t i;
+
+    if (first_device < MAX_NUM_DEVICES) {
+        count = MAX_NUM_DEVICES - first_device;
+        if (count > max_count) {
+            count = max_count;
+        }
+    }
+
+    g_vendor_report_in.data[2] = first_device;
+    g_vendor_report_in.data[3] = count;
+#if USE_RF_HOPPING
+    g_vendor_report_in.data[4] = rf_hop_channel(&g_rf_hop);
+#else
+    g_vendor_report_in.data[4] = g_rf_settings.channel;
+#endif
+    memcpy(g_vendor_report_in.data+5, g_rf_rx_drop_count, sizeof(g_rf_rx_drop_count));
+
+    for (i = 0; i < count; ++i) {
+        const uint8_t device_id = first_device + i;
+        memcpy(dest, &g_rf_device_stats[device_id], sizeof(rf_device_stats_t));
+        dest[sizeof(rf_device_stats_t)] = device_uid_list[device_id].sync_state;
+        dest[sizeof(rf_device_stats_t)+1] = g_rf_battery_level[device_id];
+        dest += RF_STATS_INFO_DEVICE_SIZE;
+    }
+}
+#endif
+
 // TODO: clean this up
 static void cmd_get_info(void) {
     uint8_t info_type = g_vendor_report_out.data[1];
@@ -275,6 +333,53 @@ static void cmd_get_info(void) {
             g_error_code_table,
             SIZE_ERROR_CODE_TABLE
         );
+    } else if (info_type == INFO_HID_STATS) {
+        memcpy(
+            g_vendor_report_in.data+2,
+            &g_hid_report_stats,
+            sizeof(hid_report_stats_t)
+        );
+#if USE_DEBOUNCE_STATS
+    } else if (info_type == INFO_DEBOUNCE_STATS) {
+        // data[2] is the first key number to return stats for
+        const uint8_t first_key = g_vendor_report_out.data[2];
+        const uint8_t max_count = (EP_SIZE_VENDOR-4) / sizeof(debounce_key_stats_t);
+        uint8_t count = 0;
+        if (first_key <= g_scan_plan.max_key_num && first_key < MAX_NUM_KEYS) {
+            count = g_scan_plan.max_key_num - first_key + 1;
+            if (count > MAX_NUM_KEYS - first_key) {
+                count = MAX_NUM_KEYS - first_key;
+            }
+            if (count > max_count) {
+                count = max_count;
+            }
+            memcpy(
+                g_vendor_report_in.data+4,
+                &g_debounce_stats[first_key],
+                count * sizeof(debounce_key_stats_t)
+            );
+        }
+        g_vendor_report_in.data[2] = first_key;
+        g_vendor_report_in.data[3] = count;
+#endif
+#if USE_RF_STATS
+    } else if (info_type == INFO_RF_STATS) {
+        get_rf_stats_info();
+#endif
+#if USE_ESB_TIMESLOT
+    } else if (info_type == INFO_TIMESLOT_STATS) {
+        // The length of the next slot and the gap before it in us, then
+        // the `timeslot_stats_t`
+        const uint16_t len_us = g_timeslot_sched.len_us;
+        const uint16_t gap_us = g_timeslot_sched.gap_us;
+        memcpy(g_vendor_report_in.data+2, &len_us, sizeof(uint16_t));
+        memcpy(g_vendor_report_in.data+4, &gap_us, sizeof(uint16_t));
+        memcpy(
+            g_vendor_report_in.data+6,
+            &g_timeslot_sched.stats,
+            sizeof(timeslot_stats_t)
+        );
+#endif
     } else if (INFO_LAYOUT_DATA_0 <= info_type && info_type <= INFO_LAYOUT_DATA_5) {
         const uint16_t offset = 62 * (info_type - INFO_LAYOUT_DATA_0);
         uint8_t size = 62;
@@ -330,6 +435,14 @@ static void parse_cmd(void) REENT {
             cmd_send_layer(data1);
         } break;
 
+        /// CMD_REPORT_RATE_TEST format:
+        /// byte0:   this command name
+        /// byte1-2: number of packets to send, 0 stops a running test
+        case CMD_REPORT_RATE_TEST: {
+            s_rate_test_count = read_u16le(g_vendor_report_out.data+1);
+            s_rate_test_seq = 0;
+        } break;
+
 #if USE_SECONDARY_BOOTLOADER
         case CMD_LOGITECH_BOOTLOADER: {
             cmd_logitech_bootloader();
@@ -535,7 +648,58 @@ static void parse_cmd(void) REENT {
     }
 }
 
+/// @brief Send the next CMD_REPORT_RATE_TEST packet.
+///
+/// A packet is only queued once the previous one has been loaded into the
+/// endpoint, so the rate the host receives them at is the rate the main loop
+/// can keep an IN endpoint full. Each packet holds a sequence number and the
+/// time it was queued in ms.
+static void report_rate_test_task(void) {
+    uint16_t now;
+
+    if (s_rate_test_count == 0) {
+        return;
+    }
+
+#if USB_BUFFERED
+    if (vendor_in_buf_has_packet() || g_vendor_report_in.len != 0) {
+        return;
+    }
+#else
+    if (g_vendor_report_in.len != 0) {
+        return;
+    }
+#endif
+
+    write_u16le(s_rate_test_payload+0, s_rate_test_seq);
+    now = timer_read16_ms();
+    write_u16le(s_rate_test_payload+2, now);
+
+#if USB_BUFFERED
+    queue_vendor_in_packet(
+        CMD_REPORT_RATE_TEST,
+        s_rate_test_payload,
+        REPORT_RATE_TEST_PAYLOAD_SIZE,
+        STATIC_LENGTH_CMD
+    );
+#else
+    g_vendor_report_in.data[0] = CMD_REPORT_RATE_TEST;
+    memcpy(
+        g_vendor_report_in.data+1,
+        s_rate_test_payload,
+        REPORT_RATE_TEST_PAYLOAD_SIZE
+    );
+    g_vendor_report_in.len = 1 + REPORT_RATE_TEST_PAYLOAD_SIZE;
+#endif
+    send_vendor_report();
+
+    s_rate_test_seq++;
+    s_rate_test_count--;
+}
+
 void handle_vendor_out_reports(void) {
+    report_rate_test_task();
+
     if (!is_ready_vendor_out_report()) {
         return;
     }
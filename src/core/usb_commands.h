@@ -25,6 +25,7 @@ enum usb_vendor_cmd_t {
     CMD_UPDATE_LAYOUT = 0x0B, // flash keyboard layout
     CMD_READ_LAYOUT = 0x0C, // read keyboard layout
     CMD_WRITE_FLASH = 0x0D, // write data to flash
+    CMD_REPORT_RATE_TEST = 0x0E, // send a stream of timestamped packets
 
     CMD_UNIFYING_PAIR = 0x10, // enter pairing mode
     CMD_UNIFYING_SEND = 0x11, //< send data as a unifying packet
@@ -75,6 +76,10 @@ enum {
     INFO_LAYOUT_DATA_3 = 9, // 248
     INFO_LAYOUT_DATA_4 = 10, // 310
     INFO_LAYOUT_DATA_5 = 11, // 372
+    INFO_HID_STATS = 12,
+    INFO_DEBOUNCE_STATS = 13,
+    INFO_RF_STATS = 14,
+    INFO_TIMESLOT_STATS = 15,
     INFO_UNSUPPORTED = 0xff,
 };
 
@@ -7,7 +7,10 @@
 #include <stdint.h>
 #include "kp_ble/hid.h"
 
-void kp_ble_hids_input_report_send(
+/// Queue an input report for sending.
+///
+/// @return false if the port is busy and the report should be retried later
+bool kp_ble_hids_input_report_send(
     uint8_t report_index,
     uint8_t report_size,
     uint8_t* data
@@ -3,10 +3,38 @@
 
 #include "hid_reports/hid_reports.h"
 
+#include "core/settings.h"
+#include "core/timer.h"
+
 #if USE_VIRTUAL_MODE
 #include "hid_reports/virtual_reports.h"
 #endif
 
+#if defined(USE_USB) && USE_USB
+#include "usb/descriptors.h"
+#endif
+
+/// All BLE input reports are sent through the notification queue of the
+/// connection, so they behave like a single shared endpoint.
+#define BLE_REPORT_QUEUE 0x01
+
+#define EP_MASK(ep_num) (1 << (ep_num))
+
+#if USE_USB
+#define HID_REPORT_POLL_INTERVAL REPORT_INTERVAL_BOOT_KEYBOARD
+#else
+#define HID_REPORT_POLL_INTERVAL 1
+#endif
+
+XRAM hid_report_stats_t g_hid_report_stats;
+
+/// Reports that are waiting for their endpoint as a bit mask
+static XRAM uint8_t s_waiting_reports;
+/// Time when each waiting report was first blocked by its endpoint
+static XRAM uint16_t s_wait_start_time[HID_REPORT_COUNT];
+/// Time of the last pass that found the endpoint of a waiting report busy
+static XRAM uint16_t s_busy_check_time[HID_REPORT_COUNT];
+
 void reset_hid_reports(void) {
     reset_keyboard_reports();
     reset_mouse_report();
@@ -20,15 +48,204 @@ void reset_hid_reports(void) {
 #if USE_VIRTUAL_MODE
     kp_virtual_hid_reports_reset();
 #endif
+
+    g_hid_report_stats.poll_interval = HID_REPORT_POLL_INTERVAL;
+    g_hid_report_stats.missed_poll_slots = 0;
+    g_hid_report_stats.max_wait = 0;
+    s_waiting_reports = 0;
+}
+
+/// @brief Check if the reports are sent on endpoints the host polls in fixed
+/// slots. Only the USB endpoints are, so only they record statistics.
+static bit_t has_poll_slots(void) {
+#if USE_BLUETOOTH
+    if (g_runtime_settings.mode == TRANS_MODE_BLE) {
+        return false;
+    }
+#endif
+    return USE_USB;
+}
+
+/// @brief Check if the endpoint of a report is free to be filled.
+static bit_t is_report_endpoint_ready(uint8_t report) {
+#if USE_USB
+    switch (report) {
+        case HID_REPORT_KEYBOARD: {
+            return is_ready_keyboard_report();
+        } break;
+        case HID_REPORT_MEDIA: {
+            return is_ready_media_report();
+        } break;
+        case HID_REPORT_MOUSE: {
+            return is_ready_mouse_report();
+        } break;
+        case HID_REPORT_VENDOR: {
+            return is_ready_vendor_in_report();
+        } break;
+    }
+#endif
+
+    (void)report;
+    return true;
 }
 
-void send_hid_reports(void) {
-    send_keyboard_report();
-    send_mouse_report();
-    send_media_report();
+/// @brief Record how long a report waited to be sent.
+///
+/// A report that waits for its endpoint is expected, since the endpoint
+/// holds the previous report until the host polls it. A poll is only missed
+/// when the endpoint was free but the report wasn't loaded into it. The
+/// endpoint is checked on every pass, so it can only have been free since
+/// the last pass that found it busy. Every interval past the first in that
+/// gap counts as a missed poll.
+///
+/// @param was_ready true if the endpoint was free before the report was sent
+/// @param is_waiting true if the report is still pending
+static void update_report_stats(uint8_t report, bit_t was_ready, bit_t is_waiting) {
+    const uint8_t mask = (1 << report);
+    const uint16_t now = timer_read16_ms();
+    uint16_t wait;
+    uint16_t missed;
+
+    if (s_waiting_reports & mask) {
+        if (!was_ready) {
+            s_busy_check_time[report] = now;
+            if (is_waiting) {
+                return;
+            }
+        } else {
+            // The report was loaded into the endpoint on this pass
+            wait = now - s_wait_start_time[report];
+            if (wait > g_hid_report_stats.max_wait) {
+                g_hid_report_stats.max_wait = wait;
+            }
+
+            wait = now - s_busy_check_time[report];
+            if (wait > HID_REPORT_POLL_INTERVAL) {
+                missed = wait / HID_REPORT_POLL_INTERVAL - 1;
+                if (missed > UINT16_MAX - g_hid_report_stats.missed_poll_slots) {
+                    g_hid_report_stats.missed_poll_slots = UINT16_MAX;
+                } else {
+                    g_hid_report_stats.missed_poll_slots += missed;
+                }
+            }
+        }
+        s_waiting_reports &= ~mask;
+    }
+
+    // Still pending after the report was loaded, or its endpoint is busy
+    if (is_waiting) {
+        s_waiting_reports |= mask;
+        s_wait_start_time[report] = now;
+        s_busy_check_time[report] = now;
+    }
+}
+
+/// @brief The endpoint of a report is busy with a higher priority report,
+/// so the report can't be loaded into it on this pass.
+static void update_report_blocked(uint8_t report) {
+    if (s_waiting_reports & (1 << report)) {
+        s_busy_check_time[report] = timer_read16_ms();
+    }
+}
+
+/// @brief Get the endpoints a report is sent on as a bit mask.
+///
+/// Reports whose masks overlap compete for the same endpoint.
+static uint8_t get_report_queue(uint8_t report) {
+#if USE_BLUETOOTH
+    if (g_runtime_settings.mode == TRANS_MODE_BLE) {
+        return BLE_REPORT_QUEUE;
+    }
+#endif
+
+#if USE_USB
+    switch (report) {
+        case HID_REPORT_KEYBOARD: {
+            return EP_MASK(EP_NUM_BOOT_KEYBOARD) | EP_MASK(EP_NUM_NKRO_KEYBOARD);
+        } break;
+        case HID_REPORT_MEDIA: {
+            return EP_MASK(EP_NUM_MEDIA);
+        } break;
+        case HID_REPORT_MOUSE: {
+            return EP_MASK(EP_NUM_MOUSE);
+        } break;
+        case HID_REPORT_VENDOR: {
+            return EP_MASK(EP_NUM_VENDOR_IN);
+        } break;
+    }
+#endif
+
+    (void)report;
+    return 0;
+}
+
+/// @brief Send a report if it is pending.
+///
+/// @return true if the report is pending but its endpoint is busy
+static bit_t send_report(uint8_t report) {
+    switch (report) {
+        case HID_REPORT_KEYBOARD: {
+            return send_keyboard_report();
+        } break;
+        case HID_REPORT_MEDIA: {
+            return send_media_report();
+        } break;
+        case HID_REPORT_MOUSE: {
+            return send_mouse_report();
+        } break;
+        case HID_REPORT_VENDOR: {
 #if USE_VIRTUAL_MODE
-    // don't support vendor report
+            // don't support vendor report
+            return false;
 #else
-    send_vendor_report();
+            return send_vendor_report();
 #endif
+        } break;
+    }
+    return false;
+}
+
+/// @brief Send the pending HID reports in priority order.
+///
+/// Each report holds the latest state of its device, so changes made while
+/// a report waits are coalesced into the next report sent. Mouse motion is
+/// accumulated while the mouse endpoint is busy.
+///
+/// Keyboard changes come first, then media, mouse and vendor reports. When a
+/// report is blocked by a busy endpoint, lower priority reports that share
+/// that endpoint wait, so they can't take the endpoint from it once it
+/// becomes free.
+///
+/// @return true if a report is still waiting for a busy endpoint
+bit_t send_hid_reports(void) {
+    uint8_t blocked_queues = 0;
+    const bit_t is_recording = has_poll_slots();
+    bit_t is_waiting = false;
+    uint8_t report;
+
+    for (report = 0; report < HID_REPORT_COUNT; ++report) {
+        const uint8_t queue = get_report_queue(report);
+        bit_t was_ready;
+        bit_t is_report_waiting;
+
+        if (blocked_queues & queue) {
+            if (is_recording) {
+                update_report_blocked(report);
+            }
+            continue;
+        }
+
+        was_ready = is_recording && is_report_endpoint_ready(report);
+        is_report_waiting = send_report(report);
+        if (is_recording) {
+            update_report_stats(report, was_ready, is_report_waiting);
+        }
+
+        if (is_report_waiting) {
+            blocked_queues |= queue;
+            is_waiting = true;
+        }
+    }
+
+    return is_waiting;
 }
@@ -1,11 +1,36 @@
 // Copyright 2019 jem@seethis.link
 // Licensed under the MIT license (http://opensource.org/licenses/MIT)
 
+#pragma once
+
 #include "hid_reports/keyboard_report.h"
 #include "hid_reports/media_report.h"
 #include "hid_reports/mouse_report.h"
 #include "hid_reports/vendor_report.h"
 
+/// The input reports in the order send_hid_reports() services them.
+enum {
+    HID_REPORT_KEYBOARD = 0,
+    HID_REPORT_MEDIA = 1,
+    HID_REPORT_MOUSE = 2,
+    HID_REPORT_VENDOR = 3,
+    HID_REPORT_COUNT = 4,
+};
+
+/// Timing statistics of the HID reports, read by the host with the
+/// `INFO_HID_STATS` info page.
+typedef struct ATTR_PACKED hid_report_stats_t {
+    /// The polling interval of the HID endpoints in ms
+    uint8_t poll_interval;
+    /// Number of polls where an endpoint was free but the report waiting
+    /// for it hadn't been loaded yet. Only USB endpoints are measured.
+    uint16_t missed_poll_slots;
+    /// Longest time in ms that a report waited to be sent
+    uint16_t max_wait;
+} hid_report_stats_t;
+
+extern XRAM hid_report_stats_t g_hid_report_stats;
+
 // Functions
 void reset_hid_reports(void);
-void send_hid_reports(void);
+bit_t send_hid_reports(void);
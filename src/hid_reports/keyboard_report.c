@@ -16,34 +16,81 @@
 #include "hid_reports/ble_reports.h"
 #include "hid_reports/virtual_reports.h"
 
-#define KEY_AGE_LIST_LEN BOOT_REPORT_KEY_COUNT
+#define BOOT_REPORT_ALL_SLOTS ((1 << BOOT_REPORT_KEY_COUNT) - 1)
 
 /// The 6KRO boot keyboard report
 XRAM hid_report_boot_keyboard_t g_boot_keyboard_report;
 /// The NKRO keyboard report
 XRAM hid_report_nkro_keyboard_t g_nkro_keyboard_report;
+/// The parts of the keyboard reports that need to be sent
+XRAM keyboard_report_dirty_t g_keyboard_report_dirty;
+
+/// The occupied slots of the 6KRO report in the order they were pressed,
+/// oldest first. The oldest key is the one replaced when the report is full.
+static XRAM uint8_t s_key_order[BOOT_REPORT_KEY_COUNT];
+/// The number of keys in the 6KRO report
+static XRAM uint8_t s_boot_key_count;
 
-static XRAM uint8_t s_key_age[KEY_AGE_LIST_LEN];
 static XRAM uint8_t s_keyboard_report_mode;
 static XRAM uint8_t s_keyboard_report_dirty;
 static bit_t boot_protocol = false;
 
-/// Maximum number of retrigger keys that can be queued
-#define MAX_NUMBER_RETRIGGER_KEYS 6
-
-/// The keys in the retrigger list
-static XRAM uint8_t retrigger_list[MAX_NUMBER_RETRIGGER_KEYS];
+/// Maximum number of key transitions that can wait for earlier reports
+#define KEY_TRANSITION_QUEUE_LEN 16
+
+/// Number of keycodes that can be tracked in the NKRO report
+#define NKRO_REPORT_KEY_COUNT (NKRO_REPORT_BYTES*8)
+
+enum {
+    KEY_TRANSITION_PRESS = 0,
+    KEY_TRANSITION_RELEASE = 1,
+    KEY_TRANSITION_MODIFIERS = 2,
+};
+
+typedef struct key_transition_t {
+    /// One of `KEY_TRANSITION_PRESS`, `KEY_TRANSITION_RELEASE` or
+    /// `KEY_TRANSITION_MODIFIERS`
+    uint8_t action;
+    /// The keycode, or the new modifiers for `KEY_TRANSITION_MODIFIERS`
+    uint8_t value;
+} key_transition_t;
+
+/// Transitions that would undo a change that hasn't been sent to the host
+/// yet. They are applied in order as the reports before them are sent.
+static XRAM key_transition_t s_transition_queue[KEY_TRANSITION_QUEUE_LEN];
+static XRAM uint8_t s_transition_queue_head;
+static XRAM uint8_t s_transition_queue_len;
+
+/// Keys that have been pressed or released since the report was last sent
+static XRAM uint8_t s_unsent_keys[NKRO_REPORT_BYTES];
+/// Modifiers that have changed since the report was last sent
+static XRAM uint8_t s_unsent_mods;
+/// Set when a key is added to or removed from one of the reports
+static bit_t s_key_changed;
+
+/// Forget the transitions waiting to be sent
+static void clear_key_transitions(void) {
+    s_transition_queue_head = 0;
+    s_transition_queue_len = 0;
+    memset(s_unsent_keys, 0, sizeof(s_unsent_keys));
+    s_unsent_mods = 0;
+}
 
-/// The length of the retrigger list
-static XRAM uint8_t retrigger_list_len;
+/// Mark every part of the keyboard reports as changed
+static void touch_all_keyboard_report(void) {
+    s_keyboard_report_dirty = 1;
+    g_keyboard_report_dirty.boot_slots = BOOT_REPORT_ALL_SLOTS;
+    g_keyboard_report_dirty.nkro_start = 0;
+    g_keyboard_report_dirty.nkro_end = NKRO_REPORT_BYTES;
+}
 
 /// @brief reset the keyboard reports to their start-up state.
 void reset_keyboard_reports(void) {
-    memset(s_key_age, 0, KEY_AGE_LIST_LEN);
     memset(&g_boot_keyboard_report, 0, sizeof(hid_report_boot_keyboard_t));
     memset(&g_nkro_keyboard_report, 0, sizeof(hid_report_nkro_keyboard_t));
-    retrigger_list_len = 0;
-    touch_keyboard_report();
+    s_boot_key_count = 0;
+    clear_key_transitions();
+    touch_all_keyboard_report();
 #if SHARED_HID_DESCRIPTOR
     g_nkro_keyboard_report.report_id = REPORT_ID_NKRO;
 #endif
@@ -60,6 +107,10 @@ void reset_keyboard_reports(void) {
 /// If you modify the keyboard reports directly, then you need to mark them as
 /// being update, so that send_keyboard_report() report knows that they have
 /// changed.
+///
+/// NOTE: keys and modifiers need to go through add_keycode(), del_keycode()
+/// and set_keyboard_report_modifiers(), so that their changes are tracked
+/// and never merged away before they are sent.
 void touch_keyboard_report(void) {
     s_keyboard_report_dirty = 1;
 }
@@ -93,29 +144,70 @@ uint8_t get_keyboard_protocol(void) {
     return (uint8_t)boot_protocol;
 }
 
+/// Mark a byte of the NKRO bitmask as changed
+static void nkro_mark_dirty(uint8_t byte_offset) {
+    s_keyboard_report_dirty = 1;
+    if (g_keyboard_report_dirty.nkro_start == g_keyboard_report_dirty.nkro_end) {
+        g_keyboard_report_dirty.nkro_start = byte_offset;
+        g_keyboard_report_dirty.nkro_end = byte_offset + 1;
+    } else if (byte_offset < g_keyboard_report_dirty.nkro_start) {
+        g_keyboard_report_dirty.nkro_start = byte_offset;
+    } else if (byte_offset >= g_keyboard_report_dirty.nkro_end) {
+        g_keyboard_report_dirty.nkro_end = byte_offset + 1;
+    }
+}
+
 /// Add a key to the NKRO report
 void nkro_add_keycode(uint8_t kc) {
     const uint8_t byte_offset = kc / 8;
-    const uint8_t bit_offset = kc % 8;
-    g_nkro_keyboard_report.bitmask[byte_offset] |= (1 << bit_offset);
+    const uint8_t bit_mask = 1 << (kc % 8);
+    if (!(g_nkro_keyboard_report.bitmask[byte_offset] & bit_mask)) {
+        g_nkro_keyboard_report.bitmask[byte_offset] |= bit_mask;
+        nkro_mark_dirty(byte_offset);
+        s_key_changed = true;
+    }
 }
 
 /// Delete a key from the NKRO report
 void nkro_del_keycode(uint8_t kc) {
     const uint8_t byte_offset = kc / 8;
-    const uint8_t bit_offset = kc % 8;
-    g_nkro_keyboard_report.bitmask[byte_offset] &= ~(1 << bit_offset);
+    const uint8_t bit_mask = 1 << (kc % 8);
+    if (g_nkro_keyboard_report.bitmask[byte_offset] & bit_mask) {
+        g_nkro_keyboard_report.bitmask[byte_offset] &= ~bit_mask;
+        nkro_mark_dirty(byte_offset);
+        s_key_changed = true;
+    }
 }
 
 /// Checks if the 6KRO report is empty
 uint8_t is_boot_report_empty(void) {
+    return s_boot_key_count == 0 && g_boot_keyboard_report.modifiers == 0;
+}
+
+/// Remove a slot from the 6KRO press order list
+static void key_order_remove(uint8_t slot) {
     uint8_t i;
-    for (i = 0; i < sizeof(hid_report_boot_keyboard_t); ++i) {
-        if (((uint8_t*)&g_boot_keyboard_report)[i] != 0 ) {
-            return false;
+    bool found = false;
+    for (i = 0; i < s_boot_key_count; ++i) {
+        if (found) {
+            s_key_order[i-1] = s_key_order[i];
+        } else if (s_key_order[i] == slot) {
+            found = true;
         }
     }
-    return true;
+    if (found) {
+        s_boot_key_count--;
+    }
+}
+
+/// Put a key in a 6KRO report slot and make it the newest key
+static void boot_set_slot(uint8_t slot, uint8_t kc) {
+    g_boot_keyboard_report.keys[slot] = kc;
+    s_key_order[s_boot_key_count] = slot;
+    s_boot_key_count++;
+    g_keyboard_report_dirty.boot_slots |= (1 << slot);
+    s_keyboard_report_dirty = 1;
+    s_key_changed = true;
 }
 
 // @brief Add's a keycode to the boot keyboard report.
@@ -124,42 +216,35 @@ uint8_t is_boot_report_empty(void) {
 // pressed is forgotten.
 void boot_add_keycode(uint8_t kc) {
     uint8_t i;
-    bool is_full;
+    uint8_t free_slot = BOOT_REPORT_KEY_COUNT;
 
-    // looks for an empty slot in the report. Set kc=0 if it finds one.
-    // adds +1 to the age of any other key in the report.
     for (i = 0; i < BOOT_REPORT_KEY_COUNT; ++i) {
         const uint8_t key_i = g_boot_keyboard_report.keys[i];
-        if (key_i == 0 || (key_i == kc && kc != 0)) {
-            g_boot_keyboard_report.keys[i] = kc;
-            s_key_age[i] = 0;
-            kc = 0; // make sure we don't set anything else
-        } else {
-            // all keycodes != 0 increase age
-            s_key_age[i]++;
+        if (key_i == kc) {
+            // Already pressed, so it becomes the newest key
+            key_order_remove(i);
+            s_key_order[s_boot_key_count] = i;
+            s_boot_key_count++;
+            return;
+        } else if (key_i == 0 && free_slot == BOOT_REPORT_KEY_COUNT) {
+            free_slot = i;
         }
     }
 
-    is_full = (kc != 0);
-
-    // Upgrade to nkro mode if using KEYBOARD_REPORT_MODE_AUTO.
-    if (is_full && s_keyboard_report_mode == KEYBOARD_REPORT_MODE_AUTO) {
-        s_keyboard_report_mode = KEYBOARD_REPORT_MODE_UPGRADE;
+    if (free_slot != BOOT_REPORT_KEY_COUNT) {
+        boot_set_slot(free_slot, kc);
         return;
     }
 
-    // if kc != 0, then report is full. Find oldest key, and replace it.
-    if (is_full && s_keyboard_report_mode == KEYBOARD_REPORT_MODE_6KRO) {
-        uint8_t oldest_val = 0;
-        uint8_t oldest_i = 0;
-        for (i = 0; i < BOOT_REPORT_KEY_COUNT; ++i) {
-            if (s_key_age[i] > oldest_val) {
-                oldest_val = s_key_age[i];
-                oldest_i = i;
-            }
-        }
-        g_boot_keyboard_report.keys[oldest_i] = kc;
-        s_key_age[oldest_i] = 0;
+    // The report is full
+    if (s_keyboard_report_mode == KEYBOARD_REPORT_MODE_AUTO) {
+        // Upgrade to nkro mode if using KEYBOARD_REPORT_MODE_AUTO.
+        s_keyboard_report_mode = KEYBOARD_REPORT_MODE_UPGRADE;
+    } else if (s_keyboard_report_mode == KEYBOARD_REPORT_MODE_6KRO) {
+        // Replace the oldest key
+        const uint8_t oldest_slot = s_key_order[0];
+        key_order_remove(oldest_slot);
+        boot_set_slot(oldest_slot, kc);
     }
 }
 
@@ -167,20 +252,50 @@ void boot_add_keycode(uint8_t kc) {
 void boot_del_keycode(uint8_t kc) {
     uint8_t i;
     for (i = 0; i < BOOT_REPORT_KEY_COUNT; ++i) {
-        const uint8_t key_i = g_boot_keyboard_report.keys[i];
-        if (key_i == kc) {
+        if (g_boot_keyboard_report.keys[i] == kc) {
             g_boot_keyboard_report.keys[i] = 0;
+            key_order_remove(i);
+            g_keyboard_report_dirty.boot_slots |= (1 << i);
+            s_keyboard_report_dirty = 1;
+            s_key_changed = true;
         }
-        s_key_age[i]--;
     }
 }
 
-/// @brief Add a key to the keyboard report.
-void add_keycode(uint8_t kc) {
-    if (kc == 0) {
+/// Check if a key has been pressed or released since the last report
+static bool is_unsent_key(uint8_t kc) {
+    if (kc >= NKRO_REPORT_KEY_COUNT) {
+        return false;
+    }
+    return s_unsent_keys[kc / 8] & (1 << (kc % 8));
+}
+
+/// Record that a key was pressed or released since the last report
+static void mark_unsent_key(uint8_t kc) {
+    if (kc >= NKRO_REPORT_KEY_COUNT) {
         return;
     }
-    s_keyboard_report_dirty = 1;
+    s_unsent_keys[kc / 8] |= (1 << (kc % 8));
+}
+
+/// Check if a transition would undo a change that hasn't been sent yet
+static bool is_transition_blocked(uint8_t action, uint8_t value) {
+    switch (action) {
+        case KEY_TRANSITION_PRESS: {
+            return is_unsent_key(value) && !has_keycode(value);
+        } break;
+        case KEY_TRANSITION_RELEASE: {
+            return is_unsent_key(value) && has_keycode(value);
+        } break;
+        case KEY_TRANSITION_MODIFIERS: {
+            return (g_boot_keyboard_report.modifiers ^ value) & s_unsent_mods;
+        } break;
+    }
+    return false;
+}
+
+static void apply_add_keycode(uint8_t kc) {
+    s_key_changed = false;
 
     if (s_keyboard_report_mode == KEYBOARD_REPORT_MODE_6KRO ||
             s_keyboard_report_mode == KEYBOARD_REPORT_MODE_AUTO) {
@@ -193,18 +308,142 @@ void add_keycode(uint8_t kc) {
     } else {
         nkro_add_keycode(kc);
     }
+
+    if (s_key_changed) {
+        mark_unsent_key(kc);
+    }
+}
+
+static void apply_del_keycode(uint8_t kc) {
+    s_key_changed = false;
+
+    if (s_keyboard_report_mode != KEYBOARD_REPORT_MODE_NKRO) {
+        boot_del_keycode(kc);
+    }
+    nkro_del_keycode(kc);
+
+    if (s_key_changed) {
+        mark_unsent_key(kc);
+    }
+}
+
+static void apply_modifiers(uint8_t mods) {
+    s_unsent_mods |= g_boot_keyboard_report.modifiers ^ mods;
+    g_boot_keyboard_report.modifiers = mods;
+    g_nkro_keyboard_report.modifiers = mods;
+    touch_keyboard_report();
+}
+
+static void apply_transition(uint8_t action, uint8_t value) {
+    switch (action) {
+        case KEY_TRANSITION_PRESS: {
+            apply_add_keycode(value);
+        } break;
+        case KEY_TRANSITION_RELEASE: {
+            apply_del_keycode(value);
+        } break;
+        case KEY_TRANSITION_MODIFIERS: {
+            apply_modifiers(value);
+        } break;
+    }
+}
+
+/// @brief Apply queued transitions in order.
+///
+/// @param force If false, stop at the first transition that would undo a
+///     change that hasn't been sent yet. If true, apply every transition.
+static void apply_queued_transitions(bool force) {
+    while (s_transition_queue_len) {
+        const XRAM key_transition_t *transition =
+            &s_transition_queue[s_transition_queue_head];
+
+        if (!force && is_transition_blocked(transition->action, transition->value)) {
+            break;
+        }
+
+        apply_transition(transition->action, transition->value);
+        s_transition_queue_head++;
+        if (s_transition_queue_head == KEY_TRANSITION_QUEUE_LEN) {
+            s_transition_queue_head = 0;
+        }
+        s_transition_queue_len--;
+    }
+}
+
+/// @brief Apply a transition, or queue it behind the reports it has to wait
+/// for.
+///
+/// A transition has to wait if it would undo a change that hasn't been sent
+/// yet, e.g. releasing a key whose press is still unsent. Otherwise the host
+/// would never see the press. Once one transition is queued, the ones after
+/// it are queued too so that they reach the host in order.
+static void add_transition(uint8_t action, uint8_t value) {
+    XRAM key_transition_t *transition;
+    uint8_t pos;
+
+    if (s_transition_queue_len) {
+        // Drop repeats of the last queued transition
+        pos = s_transition_queue_head + s_transition_queue_len - 1;
+        if (pos >= KEY_TRANSITION_QUEUE_LEN) {
+            pos -= KEY_TRANSITION_QUEUE_LEN;
+        }
+        transition = &s_transition_queue[pos];
+        if (transition->action == action && transition->value == value) {
+            return;
+        }
+
+        if (s_transition_queue_len == KEY_TRANSITION_QUEUE_LEN) {
+            // Fall back to merging the queued transitions into the current
+            // report. Some of them may not reach the host, but the final
+            // state of the report is still correct.
+            register_error(ERROR_KEY_TRANSITION_QUEUE_FULL);
+            apply_queued_transitions(true);
+        }
+    }
+
+    if (s_transition_queue_len == 0 && !is_transition_blocked(action, value)) {
+        apply_transition(action, value);
+        return;
+    }
+
+    pos = s_transition_queue_head + s_transition_queue_len;
+    if (pos >= KEY_TRANSITION_QUEUE_LEN) {
+        pos -= KEY_TRANSITION_QUEUE_LEN;
+    }
+    transition = &s_transition_queue[pos];
+    transition->action = action;
+    transition->value = value;
+    s_transition_queue_len++;
+}
+
+/// @brief Add a key to the keyboard report.
+///
+/// If the key's release hasn't been sent yet, the press is queued until it
+/// has been.
+void add_keycode(uint8_t kc) {
+    if (kc == 0) {
+        return;
+    }
+    add_transition(KEY_TRANSITION_PRESS, kc);
 }
 
 /// @brief Delete a from the keyboard report.
+///
+/// If the key's press hasn't been sent yet, the release is queued until it
+/// has been.
 void del_keycode(uint8_t kc) {
     if (kc == 0) {
         return;
     }
-    s_keyboard_report_dirty = 1;
-    if (s_keyboard_report_mode != KEYBOARD_REPORT_MODE_NKRO) {
-        boot_del_keycode(kc);
-    }
-    nkro_del_keycode(kc);
+    add_transition(KEY_TRANSITION_RELEASE, kc);
+}
+
+/// @brief Set the modifiers in the keyboard reports.
+///
+/// If the change would undo a modifier change that hasn't been sent yet, it
+/// is queued until it has been.
+void set_keyboard_report_modifiers(uint8_t mods) {
+    add_transition(KEY_TRANSITION_MODIFIERS, mods);
 }
 
 /// Resend a key that is already pressed.
@@ -213,10 +452,7 @@ void del_keycode(uint8_t kc) {
 /// then add it again so that the host will see a new key press be generated.
 void retrigger_keycode(uint8_t kc) {
     del_keycode(kc);
-    if (retrigger_list_len < MAX_NUMBER_RETRIGGER_KEYS) {
-        retrigger_list[retrigger_list_len] = kc;
-        retrigger_list_len++;
-    }
+    add_keycode(kc);
 }
 
 /// Checks if a key is pressed in the USB report.
@@ -224,24 +460,32 @@ void retrigger_keycode(uint8_t kc) {
 /// @retval true The key is pressed in the active keyboard report.
 /// @retval false The key is released in the active keyboard report.
 bool has_keycode(uint8_t kc) {
-    if (s_keyboard_report_mode == KEYBOARD_REPORT_MODE_NKRO) {
+    if (s_keyboard_report_mode == KEYBOARD_REPORT_MODE_NKRO ||
+            s_keyboard_report_mode == KEYBOARD_REPORT_MODE_UPGRADE) {
         const uint8_t byte_offset = kc / 8;
         const uint8_t bit_offset = kc % 8;
-        return g_nkro_keyboard_report.bitmask[byte_offset] & (1 << bit_offset);
-    } else { // slight
+        if (kc < NKRO_REPORT_KEY_COUNT &&
+                (g_nkro_keyboard_report.bitmask[byte_offset] & (1 << bit_offset))) {
+            return true;
+        }
+    }
+
+    if (s_keyboard_report_mode != KEYBOARD_REPORT_MODE_NKRO) {
         uint8_t i;
         for (i = 0; i < BOOT_REPORT_KEY_COUNT; ++i) {
             if (g_boot_keyboard_report.keys[i] == kc) {
                 return true;
             }
         }
-        return false;
     }
+
+    return false;
 }
 
 /// Remove all keys from the 6KRO keyboard report.
 static void clear_boot_keyboard_report(void) {
     memset(&g_boot_keyboard_report, 0, sizeof(hid_report_boot_keyboard_t));
+    s_boot_key_count = 0;
 }
 
 /// Remove all keys from the NKRO keyboard report.
@@ -260,7 +504,8 @@ static void clear_nkro_keyboard_report(void) {
 
 /// Remove all keys from the keyboard reports.
 void clear_keyboard_report(void) {
-    s_keyboard_report_dirty = 1;
+    clear_key_transitions();
+    touch_all_keyboard_report();
     clear_boot_keyboard_report();
     clear_nkro_keyboard_report();
 }
@@ -272,7 +517,10 @@ void clear_keyboard_report(void) {
 ///
 /// If the report has not changed, no data will be sent.
 ///
-/// @retval true A keyboard report is ready but could not be sent and was left pending.
+/// Key transitions that had to wait for this report are applied once it is
+/// sent, so another report may be left pending straight away.
+///
+/// @retval true A keyboard report is left pending.
 /// @retval false There is no keyboard report left pending.
 bit_t send_keyboard_report(void) {
     uint8_t result = 0;
@@ -287,12 +535,23 @@ bit_t send_keyboard_report(void) {
         case KEYBOARD_REPORT_MODE_AUTO:
         case KEYBOARD_REPORT_MODE_6KRO: {
             result = send_boot_keyboard_report();
+            if (!result) {
+                g_keyboard_report_dirty.boot_slots = 0;
+            }
         } break;
 
         case KEYBOARD_REPORT_MODE_UPGRADE: {
             // transitioning from boot report to nkro report
-            result |= send_nkro_keyboard_report();
-            result |= send_boot_keyboard_report();
+            if (!send_nkro_keyboard_report()) {
+                g_keyboard_report_dirty.nkro_start = g_keyboard_report_dirty.nkro_end;
+            } else {
+                result = 1;
+            }
+            if (!send_boot_keyboard_report()) {
+                g_keyboard_report_dirty.boot_slots = 0;
+            } else {
+                result = 1;
+            }
             if (is_boot_report_empty()) {
                 s_keyboard_report_mode = KEYBOARD_REPORT_MODE_NKRO;
             }
@@ -300,18 +559,19 @@ bit_t send_keyboard_report(void) {
 
         case KEYBOARD_REPORT_MODE_NKRO: {
             result = send_nkro_keyboard_report();
+            if (!result) {
+                g_keyboard_report_dirty.nkro_start = g_keyboard_report_dirty.nkro_end;
+            }
         } break;
     }
 
     if (result == 0) {
         s_keyboard_report_dirty = 0;
-        if (retrigger_list_len) {
-            uint8_t i;
-            for (i = 0; i < retrigger_list_len; ++i) {
-                add_keycode(retrigger_list[i]);
-            }
-            retrigger_list_len = 0;
-        }
+        memset(s_unsent_keys, 0, sizeof(s_unsent_keys));
+        s_unsent_mods = 0;
+        // The transitions that were waiting for this report can go in the next
+        apply_queued_transitions(false);
+        result = s_keyboard_report_dirty;
     }
 
     return result;
@@ -343,11 +603,13 @@ bit_t send_boot_keyboard_report(void) {
 
 #if USE_BLUETOOTH
     if (g_runtime_settings.mode == TRANS_MODE_BLE) {
-        kp_ble_hids_input_report_send(
-            BLE_INPUT_REPORT_INDEX_BOOT_KB,
-            sizeof(hid_report_boot_keyboard_t),
-            (uint8_t*)&g_boot_keyboard_report
-        );
+        if (!kp_ble_hids_input_report_send(
+                BLE_INPUT_REPORT_INDEX_BOOT_KB,
+                sizeof(hid_report_boot_keyboard_t),
+                (uint8_t*)&g_boot_keyboard_report
+        )) {
+            return true;
+        }
         return false;
     }
 #endif
@@ -378,11 +640,13 @@ bit_t send_nkro_keyboard_report(void) {
 
 #if USE_BLUETOOTH
     if (g_runtime_settings.mode == TRANS_MODE_BLE) {
-        kp_ble_hids_input_report_send(
-            BLE_INPUT_REPORT_INDEX_NKRO,
-            sizeof(hid_report_nkro_keyboard_t),
-            (uint8_t*)&g_nkro_keyboard_report
-        );
+        if (!kp_ble_hids_input_report_send(
+                BLE_INPUT_REPORT_INDEX_NKRO,
+                sizeof(hid_report_nkro_keyboard_t),
+                (uint8_t*)&g_nkro_keyboard_report
+        )) {
+            return true;
+        }
         return false;
     }
 #endif
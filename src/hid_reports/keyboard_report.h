@@ -63,8 +63,20 @@ typedef struct {
     uint8_t keys[BOOT_REPORT_KEY_COUNT];
 } ATTR_PACKED hid_report_boot_keyboard_t;
 
+/// Parts of the keyboard reports changed since they were last sent
+typedef struct keyboard_report_dirty_t {
+    /// Bitmask of the `keys[]` slots changed in the 6KRO report
+    uint8_t boot_slots;
+    /// First changed byte of the NKRO bitmask
+    uint8_t nkro_start;
+    /// One past the last changed byte of the NKRO bitmask. When equal to
+    /// `nkro_start`, no bytes have changed.
+    uint8_t nkro_end;
+} keyboard_report_dirty_t;
+
 extern XRAM hid_report_boot_keyboard_t g_boot_keyboard_report;
 extern XRAM hid_report_nkro_keyboard_t g_nkro_keyboard_report;
+extern XRAM keyboard_report_dirty_t g_keyboard_report_dirty;
 
 void boot_add_keycode(uint8_t kc);
 void boot_del_keycode(uint8_t kc);
@@ -73,6 +85,7 @@ void nkro_del_keycode(uint8_t kc);
 
 void add_keycode(uint8_t kc);
 void del_keycode(uint8_t kc);
+void set_keyboard_report_modifiers(uint8_t mods);
 
 void set_keyboard_protocol(uint8_t proto);
 uint8_t get_keyboard_protocol(void);
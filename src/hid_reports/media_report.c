@@ -68,11 +68,13 @@ bit_t send_media_report(void) {
             case REPORT_ID_SYSTEM:   { report_index = BLE_INPUT_REPORT_INDEX_SYSTEM; } break;
             default: { return true; } break;
         }
-        kp_ble_hids_input_report_send(
-            report_index,
-            sizeof(uint16_t),
-            (uint8_t*)&g_media_report.code
-        );
+        if (!kp_ble_hids_input_report_send(
+                report_index,
+                sizeof(uint16_t),
+                (uint8_t*)&g_media_report.code
+        )) {
+            return true;
+        }
         reset_media_report();
         return false;
     }
@@ -26,4 +26,5 @@ extern bit_t g_report_pending_media;
 void reset_media_report(void);
 void touch_media_report(void);
 
+bit_t is_ready_media_report(void);
 bit_t send_media_report(void);
@@ -21,6 +21,18 @@ XRAM hid_report_mouse_t g_mouse_report;
 /// Set to true if a mouse report is pending.
 bit_t g_report_pending_mouse = false;
 
+/// The Resolution Multiplier feature value set by the host. While a bit is
+/// clear, that wheel is reported in whole detents.
+XRAM uint8_t g_mouse_resolution_multiplier = 0;
+
+enum {
+    MOUSE_WHEEL_AXIS_Y = 0,
+    MOUSE_WHEEL_AXIS_X = 1,
+};
+
+/// Wheel motion in high resolution units that is too small to be sent yet
+static XRAM int16_t s_wheel_remainder[2];
+
 /// @brief Convert a 16 bit signed value into a 16 bit signed value.
 ///
 /// @return A 16 bit signed value
@@ -38,6 +50,8 @@ int16_t sign_extend_8(uint8_t x) {
 /// @brief Reset the mouse to its start-up state
 void reset_mouse_report(void) {
     memset(&g_mouse_report, 0, sizeof(hid_report_mouse_t));
+    s_wheel_remainder[MOUSE_WHEEL_AXIS_Y] = 0;
+    s_wheel_remainder[MOUSE_WHEEL_AXIS_X] = 0;
     // g_report_pending_mouse = true; // Set to true so that
 #if SHARED_HID_DESCRIPTOR
     g_mouse_report.report_id = REPORT_ID_MOUSE;
@@ -49,6 +63,112 @@ void touch_mouse_report(void) {
     g_report_pending_mouse = true;
 }
 
+static int16_t add_motion_axis(int16_t value, int16_t delta) {
+    const int32_t total = (int32_t)value + delta;
+
+    if (total > INT16_MAX) {
+        return INT16_MAX;
+    } else if (total < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)total;
+}
+
+/// @brief Add cursor motion to the mouse report.
+///
+/// If the previous report hasn't been sent yet because the endpoint is busy,
+/// the motion is merged into it instead of replacing it.
+void mouse_report_add_motion(int16_t x, int16_t y) {
+    g_mouse_report.x = add_motion_axis(g_mouse_report.x, x);
+    g_mouse_report.y = add_motion_axis(g_mouse_report.y, y);
+}
+
+/// @brief Get the number of high resolution wheel units in one report count.
+static uint8_t get_wheel_divisor(uint8_t multiplier_bit) {
+#if USE_VIRTUAL_MODE
+    return 1;
+#else
+    if (g_mouse_resolution_multiplier & multiplier_bit) {
+        return MOUSE_WHEEL_HI_RES_DETENT / MOUSE_WHEEL_RESOLUTION_MULTIPLIER;
+    } else {
+        return MOUSE_WHEEL_HI_RES_DETENT;
+    }
+#endif
+}
+
+static mouse_wheel_t add_wheel_axis(
+    mouse_wheel_t value,
+    int16_t delta,
+    uint8_t axis,
+    uint8_t multiplier_bit
+) {
+    const uint8_t divisor = get_wheel_divisor(multiplier_bit);
+    const int32_t total = (int32_t)s_wheel_remainder[axis] + delta;
+    int32_t counts = value + total / divisor;
+
+    s_wheel_remainder[axis] = total % divisor;
+
+    if (counts > MOUSE_WHEEL_MAX) {
+        counts = MOUSE_WHEEL_MAX;
+    } else if (counts < MOUSE_WHEEL_MIN) {
+        counts = MOUSE_WHEEL_MIN;
+    }
+    return (mouse_wheel_t)counts;
+}
+
+/// @brief Add wheel motion to the mouse report.
+///
+/// The motion is converted to the resolution the host has selected with the
+/// Resolution Multiplier feature. Any motion smaller than one report count
+/// is carried over to the next call.
+///
+/// @param wheel_y Vertical wheel motion in 1/MOUSE_WHEEL_HI_RES_DETENT detents
+/// @param wheel_x Horizontal wheel motion in 1/MOUSE_WHEEL_HI_RES_DETENT detents
+void mouse_report_add_wheel(int16_t wheel_y, int16_t wheel_x) {
+    if (wheel_y) {
+        g_mouse_report.wheel_y = add_wheel_axis(
+            g_mouse_report.wheel_y,
+            wheel_y,
+            MOUSE_WHEEL_AXIS_Y,
+            MOUSE_FEATURE_WHEEL_MULTIPLIER
+        );
+    }
+    if (wheel_x) {
+        g_mouse_report.wheel_x = add_wheel_axis(
+            g_mouse_report.wheel_x,
+            wheel_x,
+            MOUSE_WHEEL_AXIS_X,
+            MOUSE_FEATURE_PAN_MULTIPLIER
+        );
+    }
+}
+
+/// @brief Handle a SET_REPORT(Feature) request for the mouse.
+void mouse_report_set_feature(const uint8_t *data, uint8_t len) {
+    if (len < sizeof(hid_feature_mouse_t)) {
+        return;
+    }
+
+    g_mouse_resolution_multiplier = (
+        ((const hid_feature_mouse_t*)data)->multiplier &
+        (MOUSE_FEATURE_WHEEL_MULTIPLIER | MOUSE_FEATURE_PAN_MULTIPLIER)
+    );
+    s_wheel_remainder[MOUSE_WHEEL_AXIS_Y] = 0;
+    s_wheel_remainder[MOUSE_WHEEL_AXIS_X] = 0;
+}
+
+/// @brief Handle a GET_REPORT(Feature) request for the mouse.
+///
+/// @return The size of the feature report written to `data`
+uint8_t mouse_report_get_feature(uint8_t *data) {
+    hid_feature_mouse_t *feature = (hid_feature_mouse_t*)data;
+#if SHARED_HID_DESCRIPTOR
+    feature->report_id = REPORT_ID_MOUSE;
+#endif
+    feature->multiplier = g_mouse_resolution_multiplier;
+    return sizeof(hid_feature_mouse_t);
+}
+
 #if USE_USB
 /// @brief Check if the HID endpoint for MOUSE reports is ready
 bit_t is_ready_mouse_report(void) {
@@ -84,11 +204,13 @@ bit_t send_mouse_report(void) {
 
 #if USE_BLUETOOTH
     if (g_runtime_settings.mode == TRANS_MODE_BLE) {
-        kp_ble_hids_input_report_send(
-            BLE_INPUT_REPORT_INDEX_MOUSE,
-            sizeof(hid_report_mouse_t),
-            (uint8_t*)&g_mouse_report
-        );
+        if (!kp_ble_hids_input_report_send(
+                BLE_INPUT_REPORT_INDEX_MOUSE,
+                sizeof(hid_report_mouse_t),
+                (uint8_t*)&g_mouse_report
+        )) {
+            return true;
+        }
         zero_mouse();
         return false;
     }
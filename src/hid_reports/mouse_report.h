@@ -14,6 +14,30 @@
 #include "usb/descriptors.h"
 #endif
 
+/// Scroll wheel motion is tracked internally in units of 1/120 of a detent.
+/// This is the same resolution used by Linux (REL_WHEEL_HI_RES) and Windows.
+#define MOUSE_WHEEL_HI_RES_DETENT 120
+
+/// Wheel counts per detent sent to the host once it enables the Resolution
+/// Multiplier feature. Must divide `MOUSE_WHEEL_HI_RES_DETENT`.
+#define MOUSE_WHEEL_RESOLUTION_MULTIPLIER 8
+
+/// Bits of the Resolution Multiplier feature report
+#define MOUSE_FEATURE_WHEEL_MULTIPLIER 0x01
+#define MOUSE_FEATURE_PAN_MULTIPLIER   0x04
+
+#if USE_VIRTUAL_MODE
+// The virtual mouse isn't limited by an endpoint size, so pass the wheel
+// through in high resolution units.
+typedef int16_t mouse_wheel_t;
+#define MOUSE_WHEEL_MIN INT16_MIN
+#define MOUSE_WHEEL_MAX INT16_MAX
+#else
+typedef int8_t mouse_wheel_t;
+#define MOUSE_WHEEL_MIN INT8_MIN
+#define MOUSE_WHEEL_MAX INT8_MAX
+#endif
+
 // TODO: Should probably make this compatiable with a HID boot mouse
 
 // this is what the data that we send to the host is comprised of
@@ -25,15 +49,28 @@ typedef struct hid_report_mouse_t {
     uint8_t buttons_2;
     int16_t x;
     int16_t y;
-    int8_t wheel_y;
-    int8_t wheel_x;
+    mouse_wheel_t wheel_y;
+    mouse_wheel_t wheel_x;
 } ATTR_PACKED hid_report_mouse_t;
 
+// Resolution Multiplier feature report
+typedef struct hid_feature_mouse_t {
+#ifdef SHARED_HID_DESCRIPTOR
+    uint8_t report_id;
+#endif
+    uint8_t multiplier;
+} ATTR_PACKED hid_feature_mouse_t;
+
 extern XRAM hid_report_mouse_t g_mouse_report;
 extern bit_t g_report_pending_mouse;
+extern XRAM uint8_t g_mouse_resolution_multiplier;
 
 void reset_mouse_report(void);
 void touch_mouse_report(void);
+void mouse_report_add_motion(int16_t x, int16_t y);
+void mouse_report_add_wheel(int16_t wheel_y, int16_t wheel_x);
+void mouse_report_set_feature(const uint8_t *data, uint8_t len);
+uint8_t mouse_report_get_feature(uint8_t *data);
 
 int16_t sign_extend_12(uint16_t x);
 int16_t sign_extend_8(uint8_t x);
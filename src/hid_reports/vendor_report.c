@@ -173,11 +173,13 @@ bit_t send_vendor_report(void) {
 
 #if USE_BLUETOOTH
     if (g_runtime_settings.mode == TRANS_MODE_BLE) {
-        kp_ble_hids_input_report_send(
-            BLE_INPUT_REPORT_INDEX_VENDOR,
-            VENDOR_REPORT_LEN,
-            g_vendor_report_in.data
-        );
+        if (!kp_ble_hids_input_report_send(
+                BLE_INPUT_REPORT_INDEX_VENDOR,
+                VENDOR_REPORT_LEN,
+                g_vendor_report_in.data
+        )) {
+            return true;
+        }
         g_vendor_report_in.len = 0;
         return false;
     }
@@ -5,6 +5,7 @@
 
 #include <string.h>
 
+#include "core/keycode.h"
 #include "core/matrix_interpret.h"
 #include "core/timer.h"
 
@@ -17,17 +18,25 @@
 // /* TODO: mouse keycode */
 bit_t is_mouse_keycode(keycode_t keycode) {
 #if USE_MOUSE && USE_MOUSE_GESTURE
-    return ( IS_MOUSEKEY(keycode) || keycode == KC_MOUSE_GESTURE);
+    return (
+        IS_MOUSEKEY(keycode) ||
+        keycode == KC_MOUSE_KEY ||
+        keycode == KC_MOUSE_GESTURE
+    );
 #else
-    return IS_MOUSEKEY(keycode);
+    return IS_MOUSEKEY(keycode) || keycode == KC_MOUSE_KEY;
 #endif
 }
 
-// TODO: make these configurable
-#define MOUSE_SPEED 10
-#define MOUSE_WHEEL_SPEED 1
+// Default profiles used by the plain mouse keycodes (KC_MOUSE_UP etc.)
+#define MOUSE_SPEED (10 << MOUSE_KEY_SPEED_FRAC_BITS)
+#define MOUSE_WHEEL_SPEED (1 << MOUSE_KEY_SPEED_FRAC_BITS)
 #define MOUSE_REPORT_RATE 10
 
+// Limit used when tracking how long a mouse key has been held. Once this
+// much time has passed, acceleration is assumed to be complete.
+#define MOUSE_KEY_MAX_ELAPSED_TIME 0x4000
+
 #define MOUSE_KEY_LEFT  0x01
 #define MOUSE_KEY_RIGHT 0x02
 #define MOUSE_KEY_UP    0x04
@@ -38,10 +47,29 @@ bit_t is_mouse_keycode(keycode_t keycode) {
 #define MOUSE_KEY_WHEEL_UP    0x40
 #define MOUSE_KEY_WHEEL_DOWN  0x80
 
+#define MOUSE_KEY_MOVE_MASK  0x0f
+#define MOUSE_KEY_WHEEL_MASK 0xf0
+
+// Movement keys are split into two groups, each with their own profile.
+enum {
+    MOUSE_KEY_GROUP_MOVE = 0,
+    MOUSE_KEY_GROUP_WHEEL = 1,
+    MOUSE_KEY_GROUP_COUNT = 2,
+};
+
+// Axis index for the sub-pixel accumulators
+enum {
+    MOUSE_AXIS_X = 0,
+    MOUSE_AXIS_Y = 1,
+    MOUSE_AXIS_COUNT = 2,
+};
+
 /// The number of mouse keys currently in the pressed state
 static XRAM uint8_t s_num_mouse_keys_down;
-/// Keeps track of the number mouse keys that need
-static XRAM uint8_t s_report_time;
+/// The time at which the next mouse key report is due
+static XRAM uint16_t s_next_report_time;
+/// The time in ms between mouse key reports
+static XRAM uint8_t s_report_interval;
 
 static XRAM uint8_t s_mouse_keys;
 
@@ -50,23 +78,99 @@ static XRAM uint8_t s_relased_buttons;
 /// The number of mouse buttons to be released on the next mouse key report
 static XRAM uint8_t s_num_mouse_keys_to_release;
 
+/// The acceleration profile of the last key pressed in each group
+static XRAM mouse_key_profile_t s_profile[MOUSE_KEY_GROUP_COUNT];
+/// The time the first key in each group was pressed
+static XRAM uint16_t s_group_start_time[MOUSE_KEY_GROUP_COUNT];
+/// Fractional movement carried over between reports for each axis
+static XRAM uint8_t s_subpixel[MOUSE_AXIS_COUNT];
+
+static uint8_t get_mouse_key_mask(keycode_t kc) {
+    switch (kc) {
+        case KC_MOUSE_UP:    return MOUSE_KEY_UP;
+        case KC_MOUSE_DOWN:  return MOUSE_KEY_DOWN;
+        case KC_MOUSE_LEFT:  return MOUSE_KEY_LEFT;
+        case KC_MOUSE_RIGHT: return MOUSE_KEY_RIGHT;
+
+        case KC_MOUSE_WH_UP:    return MOUSE_KEY_WHEEL_UP;
+        case KC_MOUSE_WH_DOWN:  return MOUSE_KEY_WHEEL_DOWN;
+        case KC_MOUSE_WH_LEFT:  return MOUSE_KEY_WHEEL_LEFT;
+        case KC_MOUSE_WH_RIGHT: return MOUSE_KEY_WHEEL_RIGHT;
+    }
+    return 0;
+}
+
+static void load_default_profile(XRAM mouse_key_profile_t *profile, uint8_t group) {
+    profile->profile = MOUSE_KEY_PROFILE_CONSTANT;
+    profile->interval = MOUSE_REPORT_RATE;
+    profile->start_speed = (group == MOUSE_KEY_GROUP_MOVE) ? MOUSE_SPEED : MOUSE_WHEEL_SPEED;
+    profile->max_speed = profile->start_speed;
+    profile->delay = 0;
+    profile->ramp_time = 0;
+}
+
+static void press_movement_key(uint8_t key_mask, const mouse_key_profile_t *profile) {
+    const uint8_t group_mask = (key_mask & MOUSE_KEY_MOVE_MASK) ?
+        MOUSE_KEY_MOVE_MASK : MOUSE_KEY_WHEEL_MASK;
+    const uint8_t group = (key_mask & MOUSE_KEY_MOVE_MASK) ?
+        MOUSE_KEY_GROUP_MOVE : MOUSE_KEY_GROUP_WHEEL;
+
+    if (!(s_mouse_keys & group_mask)) {
+        // First key in this group, so start accelerating from the beginning
+        s_group_start_time[group] = timer_read16_ms();
+    }
+
+    if (profile) {
+        memcpy(&s_profile[group], profile, sizeof(mouse_key_profile_t));
+        if (s_profile[group].start_speed > MOUSE_KEY_MAX_SPEED) {
+            s_profile[group].start_speed = MOUSE_KEY_MAX_SPEED;
+        }
+        if (s_profile[group].max_speed > MOUSE_KEY_MAX_SPEED) {
+            s_profile[group].max_speed = MOUSE_KEY_MAX_SPEED;
+        }
+        if (s_profile[group].interval == 0) {
+            s_profile[group].interval = 1;
+        }
+    } else {
+        load_default_profile(&s_profile[group], group);
+    }
+
+    s_report_interval = s_profile[group].interval;
+    s_mouse_keys |= key_mask;
+}
+
 /* TODO: proper mouse handling */
 void handle_mouse_keycode(keycode_t ekc, key_event_t event) REENT {
     keycode_t kc = get_ekc_type(ekc);
+    mouse_key_profile_t ekc_profile;
+    const mouse_key_profile_t *profile = NULL;
 
     if (event == EVENT_RESET) {
         s_mouse_keys = 0;
         s_relased_buttons = 0;
         s_num_mouse_keys_down = 0;
         s_num_mouse_keys_to_release = 0;
+        s_report_interval = MOUSE_REPORT_RATE;
+        memset(s_subpixel, 0, sizeof(s_subpixel));
 #if USE_MOUSE && USE_MOUSE_GESTURE
         gesture_init();
 #endif
         return;
     }
 
+    if (kc == KC_MOUSE_KEY) {
+        // Mouse key with its own acceleration profile
+        get_ekc_data(&ekc_profile, EKC_DATA_ADDR(ekc), sizeof(mouse_key_profile_t));
+        kc = ekc_profile.direction;
+        profile = &ekc_profile;
+        if (!get_mouse_key_mask(kc)) {
+            return;
+        }
+    }
+
     if (s_num_mouse_keys_down == 0) {
-        s_report_time = timer_read8_ms();
+        // Send the first report on the next call to `mouse_key_task()`
+        s_next_report_time = timer_read16_ms();
     }
 
     if (IS_MOUSEKEY_BUTTON(kc)) {
@@ -83,31 +187,12 @@ void handle_mouse_keycode(keycode_t ekc, key_event_t event) REENT {
             g_report_pending_mouse = true;
         }
     } else if (kc >= KC_MOUSE_UP && kc <= KC_MOUSE_WH_RIGHT) {
+        const uint8_t key_mask = get_mouse_key_mask(kc);
         if (event == EVENT_PRESSED) {
-            switch (kc) {
-                case KC_MOUSE_UP:    { s_mouse_keys |= MOUSE_KEY_UP; } break;
-                case KC_MOUSE_DOWN:  { s_mouse_keys |= MOUSE_KEY_DOWN; } break;
-                case KC_MOUSE_LEFT:  { s_mouse_keys |= MOUSE_KEY_LEFT; } break;
-                case KC_MOUSE_RIGHT: { s_mouse_keys |= MOUSE_KEY_RIGHT; } break;
-
-                case KC_MOUSE_WH_UP:    { s_mouse_keys |= MOUSE_KEY_WHEEL_UP; } break;
-                case KC_MOUSE_WH_DOWN:  { s_mouse_keys |= MOUSE_KEY_WHEEL_DOWN; } break;
-                case KC_MOUSE_WH_LEFT:  { s_mouse_keys |= MOUSE_KEY_WHEEL_LEFT; } break;
-                case KC_MOUSE_WH_RIGHT: { s_mouse_keys |= MOUSE_KEY_WHEEL_RIGHT; } break;
-            }
+            press_movement_key(key_mask, profile);
             s_num_mouse_keys_down += 1;
         } else {
-            switch (kc) {
-                case KC_MOUSE_UP:    { s_mouse_keys &= ~MOUSE_KEY_UP; } break;
-                case KC_MOUSE_DOWN:  { s_mouse_keys &= ~MOUSE_KEY_DOWN; } break;
-                case KC_MOUSE_LEFT:  { s_mouse_keys &= ~MOUSE_KEY_LEFT; } break;
-                case KC_MOUSE_RIGHT: { s_mouse_keys &= ~MOUSE_KEY_RIGHT; } break;
-
-                case KC_MOUSE_WH_UP:    { s_mouse_keys &= ~MOUSE_KEY_WHEEL_UP; } break;
-                case KC_MOUSE_WH_DOWN:  { s_mouse_keys &= ~MOUSE_KEY_WHEEL_DOWN; } break;
-                case KC_MOUSE_WH_LEFT:  { s_mouse_keys &= ~MOUSE_KEY_WHEEL_LEFT; } break;
-                case KC_MOUSE_WH_RIGHT: { s_mouse_keys &= ~MOUSE_KEY_WHEEL_RIGHT; } break;
-            }
+            s_mouse_keys &= ~key_mask;
             s_num_mouse_keys_to_release += 1;
         }
 #if USE_MOUSE && USE_MOUSE_GESTURE
@@ -123,32 +208,149 @@ void handle_mouse_keycode(keycode_t ekc, key_event_t event) REENT {
     }
 }
 
-bool mouse_key_task(void) {
+/// @brief Calculate the speed of a mouse key group from its profile.
+///
+/// @param elapsed The time in ms since the first key in the group was pressed.
+///
+/// @return The speed in counts per report (8.8 fixed point)
+static uint16_t get_mouse_key_speed(uint8_t group, uint16_t elapsed) {
+    const XRAM mouse_key_profile_t *profile = &s_profile[group];
+    uint16_t ramp;
+    uint16_t speed_delta;
+
     if (
-        s_num_mouse_keys_down &&
-        ((uint8_t)(timer_read8_ms() - s_report_time) > MOUSE_REPORT_RATE)
+        profile->profile == MOUSE_KEY_PROFILE_CONSTANT ||
+        profile->max_speed <= profile->start_speed
     ) {
-        // Calulate mouse speed based of current mouse key button state
-        if (s_mouse_keys & MOUSE_KEY_LEFT)  { g_mouse_report.x += -MOUSE_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_RIGHT) { g_mouse_report.x += +MOUSE_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_UP)    { g_mouse_report.y += -MOUSE_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_DOWN)  { g_mouse_report.y += +MOUSE_SPEED; }
-
-        if (s_mouse_keys & MOUSE_KEY_WHEEL_LEFT)  { g_mouse_report.wheel_x += -MOUSE_WHEEL_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_WHEEL_RIGHT) { g_mouse_report.wheel_x += +MOUSE_WHEEL_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_WHEEL_UP)    { g_mouse_report.wheel_y += +MOUSE_WHEEL_SPEED; }
-        if (s_mouse_keys & MOUSE_KEY_WHEEL_DOWN)  { g_mouse_report.wheel_y += -MOUSE_WHEEL_SPEED; }
-
-        // Now that we have updated, we can remove the button release keys.
-        if (s_num_mouse_keys_to_release >= s_num_mouse_keys_down) {
-            s_num_mouse_keys_down = 0;
-        } else {
-            s_num_mouse_keys_down -= s_num_mouse_keys_to_release;
+        return profile->max_speed;
+    }
+
+    if (profile->profile == MOUSE_KEY_PROFILE_CONSTANT_THEN_RAMP) {
+        if (elapsed <= profile->delay) {
+            return profile->start_speed;
         }
-        s_num_mouse_keys_to_release = 0;
+        elapsed -= profile->delay;
+    }
+
+    if (elapsed >= profile->ramp_time) {
+        return profile->max_speed;
+    }
+
+    // Fraction of the ramp completed (0.8 fixed point)
+    ramp = ((uint32_t)elapsed << 8) / profile->ramp_time;
+    if (profile->profile == MOUSE_KEY_PROFILE_QUADRATIC) {
+        ramp = (ramp * ramp) >> 8;
+    }
+
+    speed_delta = profile->max_speed - profile->start_speed;
+    return profile->start_speed + (uint16_t)(((uint32_t)speed_delta * ramp) >> 8);
+}
+
+/// @brief Apply the speed to the sub-pixel accumulator of an axis.
+///
+/// @param dir The direction of the axis, -1, 0 or +1
+/// @return The whole number of counts to move on this axis for this report
+static int16_t get_mouse_key_step(uint8_t axis, int8_t dir, uint16_t speed) {
+    uint16_t total;
+
+    if (dir == 0) {
+        s_subpixel[axis] = 0;
+        return 0;
+    }
+
+    total = speed + s_subpixel[axis];
+    s_subpixel[axis] = total & ((1 << MOUSE_KEY_SPEED_FRAC_BITS) - 1);
+    total >>= MOUSE_KEY_SPEED_FRAC_BITS;
+
+    return (dir < 0) ? -(int16_t)total : (int16_t)total;
+}
+
+/// @brief Convert the speed of a wheel key into wheel motion for one report.
+///
+/// @return The wheel motion in units of 1/MOUSE_WHEEL_HI_RES_DETENT detents
+static int16_t get_mouse_key_wheel_step(int8_t dir, uint16_t speed) {
+    const int16_t step = (
+        ((uint32_t)speed * MOUSE_WHEEL_HI_RES_DETENT) >> MOUSE_KEY_SPEED_FRAC_BITS
+    );
+    return (dir < 0) ? -step : (dir > 0) ? step : 0;
+}
+
+static int8_t get_mouse_key_dir(uint8_t neg_mask, uint8_t pos_mask) {
+    return (
+        ((s_mouse_keys & pos_mask) ? 1 : 0) -
+        ((s_mouse_keys & neg_mask) ? 1 : 0)
+    );
+}
+
+bool mouse_key_task(void) {
+    uint16_t current_time;
+
+    if (!s_num_mouse_keys_down) {
+        return s_mouse_keys;
+    }
+
+    current_time = timer_read16_ms();
+
+    if ((int16_t)(current_time - s_next_report_time) < 0) {
+        // The deadline for the next report is still in the future. The
+        // signed difference stays correct when the 16 bit timer wraps.
+        return s_mouse_keys;
+    }
+
+    {
+        uint16_t speed[MOUSE_KEY_GROUP_COUNT];
+        uint8_t group;
+
+        for (group = 0; group < MOUSE_KEY_GROUP_COUNT; ++group) {
+            uint16_t elapsed = current_time - s_group_start_time[group];
+            if (elapsed > MOUSE_KEY_MAX_ELAPSED_TIME) {
+                // Stop the elapsed time from wrapping around while held
+                s_group_start_time[group] = current_time - MOUSE_KEY_MAX_ELAPSED_TIME;
+                elapsed = MOUSE_KEY_MAX_ELAPSED_TIME;
+            }
+            speed[group] = get_mouse_key_speed(group, elapsed);
+        }
+
+        // Calulate mouse movement based of current mouse key button state
+        mouse_report_add_motion(
+            get_mouse_key_step(
+                MOUSE_AXIS_X,
+                get_mouse_key_dir(MOUSE_KEY_LEFT, MOUSE_KEY_RIGHT),
+                speed[MOUSE_KEY_GROUP_MOVE]
+            ),
+            get_mouse_key_step(
+                MOUSE_AXIS_Y,
+                get_mouse_key_dir(MOUSE_KEY_UP, MOUSE_KEY_DOWN),
+                speed[MOUSE_KEY_GROUP_MOVE]
+            )
+        );
+        mouse_report_add_wheel(
+            get_mouse_key_wheel_step(
+                get_mouse_key_dir(MOUSE_KEY_WHEEL_DOWN, MOUSE_KEY_WHEEL_UP),
+                speed[MOUSE_KEY_GROUP_WHEEL]
+            ),
+            get_mouse_key_wheel_step(
+                get_mouse_key_dir(MOUSE_KEY_WHEEL_LEFT, MOUSE_KEY_WHEEL_RIGHT),
+                speed[MOUSE_KEY_GROUP_WHEEL]
+            )
+        );
+    }
+
+    // Now that we have updated, we can remove the button release keys.
+    if (s_num_mouse_keys_to_release >= s_num_mouse_keys_down) {
+        s_num_mouse_keys_down = 0;
+    } else {
+        s_num_mouse_keys_down -= s_num_mouse_keys_to_release;
+    }
+    s_num_mouse_keys_to_release = 0;
+
+    g_report_pending_mouse = true;
 
-        g_report_pending_mouse = true;
-        s_report_time = timer_read8_ms();
+    // Schedule from the previous deadline so the report rate doesn't drift
+    // with the main loop timing, unless we have fallen a whole interval behind.
+    s_next_report_time += s_report_interval;
+    if ((int16_t)(current_time - s_next_report_time) >= 0) {
+        s_next_report_time = current_time + s_report_interval;
     }
 
     return s_mouse_keys;
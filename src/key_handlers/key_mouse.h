@@ -6,6 +6,45 @@
 #include "key_handlers/key_handlers.h"
 #include "core/util.h"
 
+/// Number of fractional bits used for mouse key speeds. A speed of
+/// `1 << MOUSE_KEY_SPEED_FRAC_BITS` moves the cursor 1 count per report.
+#define MOUSE_KEY_SPEED_FRAC_BITS 8
+
+/// Largest speed accepted for mouse keys, just under 128 counts per report so
+/// that one wheel step still fits in 16 bits in high resolution wheel units.
+#define MOUSE_KEY_MAX_SPEED 0x7fff
+
+/// Acceleration curves used by mouse keys
+typedef enum mouse_key_profile_type_t {
+    /// Always move at `max_speed`
+    MOUSE_KEY_PROFILE_CONSTANT = 0,
+    /// Ramp from `start_speed` to `max_speed` linearly over `ramp_time`
+    MOUSE_KEY_PROFILE_LINEAR = 1,
+    /// Ramp from `start_speed` to `max_speed` quadratically over `ramp_time`
+    MOUSE_KEY_PROFILE_QUADRATIC = 2,
+    /// Move at `start_speed` for `delay` ms, then ramp linearly to `max_speed`
+    MOUSE_KEY_PROFILE_CONSTANT_THEN_RAMP = 3,
+} mouse_key_profile_type_t;
+
+/// External keycode data for `KC_MOUSE_KEY`. This data follows the keycode in
+/// the EKC table.
+typedef struct ATTR_PACKED mouse_key_profile_t {
+    /// The movement keycode this key acts as, `KC_MOUSE_UP`..`KC_MOUSE_WH_RIGHT`
+    keycode_t direction;
+    /// One of `mouse_key_profile_type_t`
+    uint8_t profile;
+    /// Time in ms between mouse key reports
+    uint8_t interval;
+    /// Speed when the key is first pressed, in counts per report (8.8 fixed point)
+    uint16_t start_speed;
+    /// Speed after acceleration finishes, in counts per report (8.8 fixed point)
+    uint16_t max_speed;
+    /// Time in ms to wait before starting to accelerate
+    uint16_t delay;
+    /// Time in ms to accelerate from `start_speed` to `max_speed`
+    uint16_t ramp_time;
+} mouse_key_profile_t;
+
 extern XRAM keycode_callbacks_t mouse_keycodes;
 
 bool mouse_key_task(void);
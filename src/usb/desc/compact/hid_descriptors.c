@@ -8,6 +8,8 @@
 #include "usb/util/hut_consumer.h"
 #include "usb/util/hut_led.h"
 
+#include "hid_reports/mouse_report.h"
+
 // the default keyboard descriptor - compatible with keyboard boot protocol
 // taken from the USB HID Descriptor Tool
 ROM const uint8_t hid_desc_boot_keyboard[] = {
@@ -170,20 +172,45 @@ ROM const uint8_t hid_desc_shared_hid[] = {
             HID_REPORT_SIZE(1)     , 16,
             HID_INPUT(1)           , IOF_DATA | IOF_VARIABLE | IOF_RELATIVE,
             // mouse wheel
-            HID_USAGE(1)           , HID_USAGE_WHEEL,
-            HID_LOGICAL_MINIMUM(1) , DB8(INT8_MIN),
-            HID_LOGICAL_MAXIMUM(1) , DB8(INT8_MAX),
-            HID_REPORT_COUNT(1)    , 1,
-            HID_REPORT_SIZE(1)     , 8,
-            HID_INPUT(1)           , IOF_DATA | IOF_VARIABLE | IOF_RELATIVE,
+            HID_COLLECTION(1)          , HID_COLLECTION_LOGICAL,
+                // resolution multiplier, 1 or MOUSE_WHEEL_RESOLUTION_MULTIPLIER
+                HID_USAGE(1)           , HID_USAGE_RESOLUTION_MULTIPLIER,
+                HID_LOGICAL_MINIMUM(1) , 0,
+                HID_LOGICAL_MAXIMUM(1) , 1,
+                HID_PHYSICAL_MINIMUM(1), 1,
+                HID_PHYSICAL_MAXIMUM(1), MOUSE_WHEEL_RESOLUTION_MULTIPLIER,
+                HID_REPORT_COUNT(1)    , 1,
+                HID_REPORT_SIZE(1)     , 2,
+                HID_FEATURE(1)         , IOF_DATA | IOF_VARIABLE | IOF_ABSOLUTE,
+                HID_USAGE(1)           , HID_USAGE_WHEEL,
+                HID_LOGICAL_MINIMUM(1) , DB8(INT8_MIN),
+                HID_LOGICAL_MAXIMUM(1) , DB8(INT8_MAX),
+                HID_PHYSICAL_MINIMUM(1), 0,
+                HID_PHYSICAL_MAXIMUM(1), 0,
+                HID_REPORT_SIZE(1)     , 8,
+                HID_INPUT(1)           , IOF_DATA | IOF_VARIABLE | IOF_RELATIVE,
+            HID_END_COLLECTION(0),
             // mouse pan wheel
-            HID_USAGE_PAGE(1)      , HID_USAGE_PAGE_CONSUMER,
-            HID_USAGE(2)           , DB16(HID_CONSUMER_AC_PAN),
-            // HID_LOGICAL_MINIMUM(1) , DB8(INT8_MIN), // Reuse global item
-            // HID_LOGICAL_MAXIMUM(1) , DB8(INT8_MAX), // Reuse global item
-            // HID_REPORT_COUNT(1)    , 1, // Reuse global item
-            // HID_REPORT_SIZE(1)     , 8, // Reuse global item
-            HID_INPUT(1), IOF_DATA | IOF_VARIABLE | IOF_RELATIVE,
+            HID_COLLECTION(1)          , HID_COLLECTION_LOGICAL,
+                HID_USAGE(1)           , HID_USAGE_RESOLUTION_MULTIPLIER,
+                HID_LOGICAL_MINIMUM(1) , 0,
+                HID_LOGICAL_MAXIMUM(1) , 1,
+                HID_PHYSICAL_MINIMUM(1), 1,
+                HID_PHYSICAL_MAXIMUM(1), MOUSE_WHEEL_RESOLUTION_MULTIPLIER,
+                HID_REPORT_SIZE(1)     , 2,
+                HID_FEATURE(1)         , IOF_DATA | IOF_VARIABLE | IOF_ABSOLUTE,
+                HID_USAGE_PAGE(1)      , HID_USAGE_PAGE_CONSUMER,
+                HID_USAGE(2)           , DB16(HID_CONSUMER_AC_PAN),
+                HID_LOGICAL_MINIMUM(1) , DB8(INT8_MIN),
+                HID_LOGICAL_MAXIMUM(1) , DB8(INT8_MAX),
+                HID_PHYSICAL_MINIMUM(1), 0,
+                HID_PHYSICAL_MAXIMUM(1), 0,
+                HID_REPORT_SIZE(1)     , 8,
+                HID_INPUT(1)           , IOF_DATA | IOF_VARIABLE | IOF_RELATIVE,
+            HID_END_COLLECTION(0),
+            // pad the resolution multiplier feature report to a byte
+            HID_REPORT_SIZE(1)         , 4,
+            HID_FEATURE(1)             , IOF_CONSTANT,
         HID_END_COLLECTION(0),
     HID_END_COLLECTION(0),
 };
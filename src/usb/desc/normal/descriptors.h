@@ -102,7 +102,11 @@ typedef struct usb_config_desc_keyboard_t {
 
 // report intervals for enpdoints (in ms)
 #define REPORT_INTERVAL_BOOT_KEYBOARD 1
+#if USB_LOW_LATENCY
+#define REPORT_INTERVAL_MEDIA 1
+#else
 #define REPORT_INTERVAL_MEDIA 10
+#endif
 #define REPORT_INTERVAL_MOUSE 1
 #define REPORT_INTERVAL_VENDOR_IN 1
 #define REPORT_INTERVAL_VENDOR_OUT 1
@@ -214,6 +214,11 @@ typedef enum {
 )
 
 
+// Report types used in the high byte of wValue for GET_REPORT/SET_REPORT
+#define HID_REPORT_TYPE_INPUT   0x01
+#define HID_REPORT_TYPE_OUTPUT  0x02
+#define HID_REPORT_TYPE_FEATURE 0x03
+
 // HID Item types
 typedef enum {
     HID_TYPE_MAIN   = 0,